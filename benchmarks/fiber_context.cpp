@@ -0,0 +1,67 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+// 测量各个 fiber 上下文切换实现每秒能完成的切换次数。
+// 用法：fiber_context_benchmark [往返次数]
+
+#include "../src/precompiled.hpp"
+#include "../src/fiber_context.hpp"
+#include <iostream>
+#include <time.h>
+
+namespace {
+	using namespace Poseidon;
+
+	double get_seconds(){
+		::timespec ts;
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+	}
+
+	template<typename ContextT>
+	struct PingPong {
+		ContextT outer;
+		ContextT inner;
+		unsigned long rounds;
+
+		static void proc(void *param){
+			PingPong *const self = static_cast<PingPong *>(param);
+			for(;;){
+				ContextT::swap(self->inner, self->outer);
+			}
+		}
+	};
+
+	template<typename ContextT>
+	void run(unsigned long rounds){
+		std::vector<char> stack(256 * 1024);
+		PingPong<ContextT> pp;
+		pp.rounds = rounds;
+		pp.inner.reset(&stack[0], stack.size(), &PingPong<ContextT>::proc, &pp);
+
+		const double begin = get_seconds();
+		for(unsigned long i = 0; i < rounds; ++i){
+			ContextT::swap(pp.outer, pp.inner);
+		}
+		const double elapsed = get_seconds() - begin;
+
+		// 每个往返包含两次切换。
+		const double switches = static_cast<double>(rounds) * 2;
+		std::cout <<std::setw(10) <<ContextT::get_backend_name()
+		          <<std::setw(16) <<std::fixed <<std::setprecision(0) <<(switches / elapsed) <<" switches/s"
+		          <<std::setw(12) <<std::setprecision(1) <<(elapsed * 1e9 / switches) <<" ns/switch" <<std::endl;
+	}
+}
+
+int main(int argc, char **argv){
+	unsigned long rounds = 10000000;
+	if(argc > 1){
+		rounds = std::strtoul(argv[1], NULLPTR, 0);
+	}
+
+	run<UcontextFiberContext>(rounds);
+#ifdef POSEIDON_FIBER_CONTEXT_HAS_ASM_
+	run<AsmFiberContext>(rounds);
+#endif
+	return 0;
+}
@@ -0,0 +1,444 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+// 检查 HPACK 和 HTTP/2 的流量控制。
+// RFC 7541 附录 C 的 C.2 到 C.6 先解码，再用一个新的编码器重新编码。重新编码的结果不能比示例长，并且必须解码出同样的报头，
+// C.4 必须与示例逐字节相同。
+// 之后不经过套接字，用一个遵守流量控制的客户端向 Http2Connection 上传请求实体，初始窗口分别小于、等于和大于 65535。
+// 客户端在读到我们的 SETTINGS 之前按照默认的窗口发送，之后按照差值调整；响应按照客户端通告的很小的窗口分段发送。
+// 用法：http2_check
+
+#include "../src/precompiled.hpp"
+#include "../src/http/http2_connection.hpp"
+#include "../src/http/hpack.hpp"
+#include "../src/stream_buffer.hpp"
+#include "../src/log.hpp"
+#include <iostream>
+#include <vector>
+
+namespace {
+	using namespace Poseidon;
+
+	// 名字和值交替，以空指针结尾。
+	struct HpackBlock {
+		const char *hex;
+		const char *const *headers;
+	};
+	struct HpackExample {
+		const char *title;
+		std::size_t table_size;
+		bool exact;
+		const HpackBlock *blocks;
+		std::size_t count;
+	};
+
+	const char *const C_2_1_HEADERS[] = { "custom-key", "custom-header", NULLPTR };
+	const char *const C_2_2_HEADERS[] = { ":path", "/sample/path", NULLPTR };
+	const char *const C_2_3_HEADERS[] = { "password", "secret", NULLPTR };
+	const char *const C_2_4_HEADERS[] = { ":method", "GET", NULLPTR };
+
+	const HpackBlock C_2_1[] = {
+		{ "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572", C_2_1_HEADERS },
+	};
+	const HpackBlock C_2_2[] = {
+		{ "040c 2f73 616d 706c 652f 7061 7468", C_2_2_HEADERS },
+	};
+	const HpackBlock C_2_3[] = {
+		{ "1008 7061 7373 776f 7264 0673 6563 7265 74", C_2_3_HEADERS },
+	};
+	const HpackBlock C_2_4[] = {
+		{ "82", C_2_4_HEADERS },
+	};
+
+	const char *const REQUEST_1_HEADERS[] = {
+		":method", "GET", ":scheme", "http", ":path", "/", ":authority", "www.example.com", NULLPTR };
+	const char *const REQUEST_2_HEADERS[] = {
+		":method", "GET", ":scheme", "http", ":path", "/", ":authority", "www.example.com", "cache-control", "no-cache", NULLPTR };
+	const char *const REQUEST_3_HEADERS[] = {
+		":method", "GET", ":scheme", "https", ":path", "/index.html", ":authority", "www.example.com", "custom-key", "custom-value", NULLPTR };
+
+	const HpackBlock C_3[] = {
+		{ "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d", REQUEST_1_HEADERS },
+		{ "8286 84be 5808 6e6f 2d63 6163 6865", REQUEST_2_HEADERS },
+		{ "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65", REQUEST_3_HEADERS },
+	};
+	const HpackBlock C_4[] = {
+		{ "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff", REQUEST_1_HEADERS },
+		{ "8286 84be 5886 a8eb 1064 9cbf", REQUEST_2_HEADERS },
+		{ "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf", REQUEST_3_HEADERS },
+	};
+
+	const char *const RESPONSE_1_HEADERS[] = {
+		":status", "302", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:21 GMT", "location", "https://www.example.com", NULLPTR };
+	const char *const RESPONSE_2_HEADERS[] = {
+		":status", "307", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:21 GMT", "location", "https://www.example.com", NULLPTR };
+	const char *const RESPONSE_3_HEADERS[] = {
+		":status", "200", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:22 GMT", "location", "https://www.example.com",
+		"content-encoding", "gzip", "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1", NULLPTR };
+
+	const HpackBlock C_5[] = {
+		{ "4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3120 474d 546e 1768"
+		  "7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d", RESPONSE_1_HEADERS },
+		{ "4803 3330 37c1 c0bf", RESPONSE_2_HEADERS },
+		{ "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d 54c0 5a04 677a 6970 7738 666f 6f3d 4153"
+		  "444a 4b48 514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49 553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e"
+		  "3d31", RESPONSE_3_HEADERS },
+	};
+	const HpackBlock C_6[] = {
+		{ "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6 2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8"
+		  "e9ae 82ae 43d3", RESPONSE_1_HEADERS },
+		{ "4883 640e ffc1 c0bf", RESPONSE_2_HEADERS },
+		{ "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab 77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b"
+		  "3960 d5af 2708 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed 4ee5 b106 3d50 07", RESPONSE_3_HEADERS },
+	};
+
+	const HpackExample HPACK_EXAMPLES[] = {
+		{ "C.2.1", 4096, false, C_2_1, COUNT_OF(C_2_1) },
+		{ "C.2.2", 4096, false, C_2_2, COUNT_OF(C_2_2) },
+		{ "C.2.3", 4096, false, C_2_3, COUNT_OF(C_2_3) },
+		{ "C.2.4", 4096, false, C_2_4, COUNT_OF(C_2_4) },
+		{ "C.3",   4096, false, C_3,   COUNT_OF(C_3)   },
+		{ "C.4",   4096, true,  C_4,   COUNT_OF(C_4)   },
+		{ "C.5",   256,  false, C_5,   COUNT_OF(C_5)   },
+		// C.6.2 中的 "307" 用 Huffman 编码并不更短，我们的编码器使用原文，因此不要求逐字节相同。
+		{ "C.6",   256,  false, C_6,   COUNT_OF(C_6)   },
+	};
+
+	StreamBuffer parse_hex(const char *hex){
+		StreamBuffer ret;
+		int high = -1;
+		for(const char *p = hex; *p; ++p){
+			int digit;
+			if(('0' <= *p) && (*p <= '9')){
+				digit = *p - '0';
+			} else if(('a' <= *p) && (*p <= 'f')){
+				digit = *p - 'a' + 10;
+			} else {
+				continue;
+			}
+			if(high < 0){
+				high = digit;
+			} else {
+				ret.put(static_cast<unsigned char>((high << 4) | digit));
+				high = -1;
+			}
+		}
+		return ret;
+	}
+	std::vector<Http::HpackHeader> make_headers(const char *const *headers){
+		std::vector<Http::HpackHeader> ret;
+		for(const char *const *p = headers; *p; p += 2){
+			ret.push_back(Http::HpackHeader(p[0], p[1]));
+		}
+		return ret;
+	}
+
+	bool check_headers(const char *what, const std::vector<Http::HpackHeader> &headers, const std::vector<Http::HpackHeader> &expected){
+		if(headers == expected){
+			return true;
+		}
+		std::cerr <<"  " <<what <<": got" <<std::endl;
+		for(std::size_t i = 0; i < headers.size(); ++i){
+			std::cerr <<"    " <<headers.at(i).first <<": " <<headers.at(i).second <<std::endl;
+		}
+		std::cerr <<"  Expecting" <<std::endl;
+		for(std::size_t i = 0; i < expected.size(); ++i){
+			std::cerr <<"    " <<expected.at(i).first <<": " <<expected.at(i).second <<std::endl;
+		}
+		return false;
+	}
+
+	bool check_hpack_example(const HpackExample &example){
+		std::cout <<"HPACK " <<example.title <<std::endl;
+		// 每个示例都从空的动态表开始，后面的报头块依赖前面的插入和淘汰。
+		Http::HpackDecoder decoder(example.table_size, 65536);
+		Http::HpackEncoder encoder(example.table_size);
+		Http::HpackDecoder redecoder(example.table_size, 65536);
+		for(std::size_t i = 0; i < example.count; ++i){
+			const AUTO_REF(block, example.blocks[i]);
+			const AUTO(expected, make_headers(block.headers));
+			std::vector<Http::HpackHeader> headers;
+			try {
+				decoder.decode(headers, parse_hex(block.hex));
+			} catch(std::exception &e){
+				std::cerr <<"  Block #" <<i <<": decoding failed: " <<e.what() <<std::endl;
+				return false;
+			}
+			if(!check_headers("Decoded", headers, expected)){
+				return false;
+			}
+
+			StreamBuffer encoded;
+			for(std::size_t j = 0; j < headers.size(); ++j){
+				encoder.encode(encoded, headers.at(j).first, headers.at(j).second);
+			}
+			// 我们的编码器总是在 Huffman 编码更短时使用它，索引的方式与示例相同。
+			const AUTO(example_block, parse_hex(block.hex).dump_string());
+			if(encoded.size() > example_block.size()){
+				std::cerr <<"  Block #" <<i <<": re-encoded block is longer than the example" <<std::endl;
+				return false;
+			}
+			if(example.exact && (encoded.dump_string() != example_block)){
+				std::cerr <<"  Block #" <<i <<": re-encoded block differs from the example" <<std::endl;
+				return false;
+			}
+			headers.clear();
+			try {
+				redecoder.decode(headers, encoded);
+			} catch(std::exception &e){
+				std::cerr <<"  Block #" <<i <<": decoding the re-encoded block failed: " <<e.what() <<std::endl;
+				return false;
+			}
+			if(!check_headers("Re-encoded", headers, expected)){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	enum {
+		REQUEST_ENTITY_SIZE     = 200000,
+		RESPONSE_ENTITY_SIZE    = 1000,
+		CLIENT_WINDOW_SIZE      = 100,
+	};
+
+	class TestServer : public Http::Http2Connection {
+	private:
+		StreamBuffer m_out;
+		std::string m_request_entity;
+		bool m_request_complete;
+
+	public:
+		explicit TestServer(boost::uint32_t initial_window_size)
+			: Http::Http2Connection(100, initial_window_size, 65536)
+			, m_request_complete(false)
+		{ }
+
+	public:
+		StreamBuffer &get_out(){
+			return m_out;
+		}
+		const std::string &get_request_entity() const {
+			return m_request_entity;
+		}
+		bool is_request_complete() const {
+			return m_request_complete;
+		}
+
+	protected:
+		boost::uint64_t get_max_request_length() const OVERRIDE {
+			return 1048576;
+		}
+		void on_http2_request(boost::uint32_t stream_id, Http::RequestHeaders /* request_headers */, StreamBuffer entity) OVERRIDE {
+			m_request_entity = entity.dump_string();
+			m_request_complete = true;
+
+			Http::ResponseHeaders response_headers;
+			response_headers.version = 10001;
+			response_headers.status_code = Http::ST_OK;
+			response_headers.reason = "OK";
+			put_response(stream_id, STD_MOVE(response_headers), StreamBuffer(std::string(RESPONSE_ENTITY_SIZE, 'y')));
+		}
+		void on_http2_stream_closed(boost::uint32_t /* stream_id */) OVERRIDE { }
+		long on_encoded_data_avail(StreamBuffer encoded) OVERRIDE {
+			m_out.splice(encoded);
+			return true;
+		}
+	};
+
+	boost::uint32_t load_be32(const unsigned char *ptr){
+		return (static_cast<boost::uint32_t>(ptr[0]) << 24) | (static_cast<boost::uint32_t>(ptr[1]) << 16)
+			| (static_cast<boost::uint32_t>(ptr[2]) << 8) | ptr[3];
+	}
+	void put_be32(StreamBuffer &data, boost::uint32_t val){
+		for(unsigned i = 4; i > 0; --i){
+			data.put(static_cast<unsigned char>(val >> (i * 8 - 8)));
+		}
+	}
+	void put_frame_header(StreamBuffer &data, std::size_t length, unsigned type, unsigned flags, boost::uint32_t stream_id){
+		const unsigned char header[9] = {
+			static_cast<unsigned char>(length >> 16), static_cast<unsigned char>(length >> 8), static_cast<unsigned char>(length),
+			static_cast<unsigned char>(type), static_cast<unsigned char>(flags),
+			static_cast<unsigned char>(stream_id >> 24), static_cast<unsigned char>(stream_id >> 16),
+			static_cast<unsigned char>(stream_id >> 8), static_cast<unsigned char>(stream_id) };
+		data.put(header, sizeof(header));
+	}
+	void put_window_update(StreamBuffer &data, boost::uint32_t stream_id, boost::uint32_t increment){
+		put_frame_header(data, 4, Http::FT_WINDOW_UPDATE, 0, stream_id);
+		put_be32(data, increment);
+	}
+
+	bool check_flow_control(boost::uint32_t initial_window_size){
+		std::cout <<"HTTP/2 flow control: initial_window_size = " <<initial_window_size <<std::endl;
+		TestServer server(initial_window_size);
+		Http::HpackEncoder encoder;
+		Http::HpackDecoder decoder(4096, 65536);
+
+		// 我们可以发送的窗口。对方的 SETTINGS 之前按照默认值。
+		boost::int64_t conn_send_window = Http::DEFAULT_WINDOW_SIZE;
+		boost::int64_t stream_send_window = Http::DEFAULT_WINDOW_SIZE;
+		boost::uint32_t peer_initial_window_size = Http::DEFAULT_WINDOW_SIZE;
+		// 对方可以发送的窗口，每个 DATA 帧都立即补充。
+		boost::int64_t stream_recv_window = CLIENT_WINDOW_SIZE;
+		bool settings_received = false;
+
+		std::size_t request_sent = 0;
+		std::string response_entity;
+		bool response_headers_received = false;
+		bool response_complete = false;
+
+		StreamBuffer out;
+		out.put(Http::CONNECTION_PREFACE, sizeof(Http::CONNECTION_PREFACE));
+		put_frame_header(out, 6, Http::FT_SETTINGS, 0, 0);
+		out.put(static_cast<unsigned char>(0));
+		out.put(static_cast<unsigned char>(Http::SET_INITIAL_WINDOW_SIZE));
+		put_be32(out, CLIENT_WINDOW_SIZE);
+		StreamBuffer block;
+		encoder.encode(block, ":method", "POST");
+		encoder.encode(block, ":scheme", "http");
+		encoder.encode(block, ":path", "/upload");
+		encoder.encode(block, ":authority", "localhost");
+		put_frame_header(out, block.size(), Http::FT_HEADERS, Http::FF_END_HEADERS, 1);
+		out.splice(block);
+
+		for(;;){
+			while(request_sent < REQUEST_ENTITY_SIZE){
+				if((conn_send_window <= 0) || (stream_send_window <= 0)){
+					break;
+				}
+				std::size_t size = std::min<std::size_t>(REQUEST_ENTITY_SIZE - request_sent, Http::DEFAULT_MAX_FRAME_SIZE);
+				size = std::min(size, static_cast<std::size_t>(std::min(conn_send_window, stream_send_window)));
+				request_sent += size;
+				put_frame_header(out, size, Http::FT_DATA, (request_sent == REQUEST_ENTITY_SIZE) ? Http::FF_END_STREAM : 0, 1);
+				out.put(static_cast<unsigned char>('x'), size);
+				conn_send_window -= static_cast<boost::int64_t>(size);
+				stream_send_window -= static_cast<boost::int64_t>(size);
+			}
+			if(out.empty()){
+				break;
+			}
+			if(!server.put_encoded_data(STD_MOVE(out))){
+				std::cerr <<"  HTTP/2 connection error" <<std::endl;
+				return false;
+			}
+			out.clear();
+
+			AUTO_REF(in, server.get_out());
+			for(;;){
+				unsigned char header[9];
+				if(in.peek(header, sizeof(header)) < sizeof(header)){
+					break;
+				}
+				const std::size_t length = (static_cast<std::size_t>(header[0]) << 16) | (static_cast<std::size_t>(header[1]) << 8) | header[2];
+				if(in.size() < sizeof(header) + length){
+					break;
+				}
+				in.discard(sizeof(header));
+				AUTO(payload, in.cut_off(length));
+				const unsigned type = header[3], flags = header[4];
+				const AUTO(stream_id, load_be32(header + 5) & 0x7FFFFFFFu);
+				unsigned char temp[6];
+				switch(type){
+				case Http::FT_SETTINGS:
+					if(flags & Http::FF_ACK){
+						break;
+					}
+					while(payload.get(temp, 6) == 6){
+						const unsigned id = (static_cast<unsigned>(temp[0]) << 8) | temp[1];
+						const AUTO(value, load_be32(temp + 2));
+						if(id == Http::SET_INITIAL_WINDOW_SIZE){
+							if(value != initial_window_size){
+								std::cerr <<"  SETTINGS_INITIAL_WINDOW_SIZE = " <<value <<", expecting " <<initial_window_size <<std::endl;
+								return false;
+							}
+							stream_send_window += static_cast<boost::int64_t>(value) - static_cast<boost::int64_t>(peer_initial_window_size);
+							peer_initial_window_size = value;
+						}
+					}
+					settings_received = true;
+					put_frame_header(out, 0, Http::FT_SETTINGS, Http::FF_ACK, 0);
+					break;
+				case Http::FT_WINDOW_UPDATE:
+					payload.get(temp, 4);
+					if(stream_id == 0){
+						conn_send_window += load_be32(temp) & 0x7FFFFFFFu;
+					} else {
+						stream_send_window += load_be32(temp) & 0x7FFFFFFFu;
+					}
+					break;
+				case Http::FT_HEADERS: {
+					std::vector<Http::HpackHeader> headers;
+					decoder.decode(headers, payload);
+					if(headers.empty() || (headers.front().first != ":status") || (headers.front().second != "200")){
+						std::cerr <<"  Unexpected response headers" <<std::endl;
+						return false;
+					}
+					response_headers_received = true;
+					response_complete = (flags & Http::FF_END_STREAM) != 0;
+					break; }
+				case Http::FT_DATA:
+					stream_recv_window -= static_cast<boost::int64_t>(length);
+					if(stream_recv_window < 0){
+						std::cerr <<"  DATA frame exceeds the stream window: length = " <<length <<std::endl;
+						return false;
+					}
+					response_entity += payload.dump_string();
+					response_complete = (flags & Http::FF_END_STREAM) != 0;
+					if(length != 0){
+						put_window_update(out, 0, static_cast<boost::uint32_t>(length));
+						if(!response_complete){
+							put_window_update(out, 1, static_cast<boost::uint32_t>(length));
+							stream_recv_window += static_cast<boost::int64_t>(length);
+						}
+					}
+					break;
+				case Http::FT_RST_STREAM:
+				case Http::FT_GOAWAY:
+					std::cerr <<"  Unexpected frame: type = " <<type <<std::endl;
+					return false;
+				default:
+					break;
+				}
+			}
+		}
+
+		// 双方都没有可以发送的数据时请求和响应都应当已经完成，否则说明窗口没有被补充。
+		if(!settings_received){
+			std::cerr <<"  No SETTINGS received" <<std::endl;
+			return false;
+		}
+		if(!server.is_request_complete()){
+			std::cerr <<"  Upload stalled: sent = " <<request_sent <<", conn_send_window = " <<conn_send_window
+			          <<", stream_send_window = " <<stream_send_window <<std::endl;
+			return false;
+		}
+		if(server.get_request_entity() != std::string(REQUEST_ENTITY_SIZE, 'x')){
+			std::cerr <<"  Request entity mismatch: size = " <<server.get_request_entity().size() <<std::endl;
+			return false;
+		}
+		if(!response_headers_received || !response_complete){
+			std::cerr <<"  Response stalled: received = " <<response_entity.size() <<std::endl;
+			return false;
+		}
+		if(response_entity != std::string(RESPONSE_ENTITY_SIZE, 'y')){
+			std::cerr <<"  Response entity mismatch: size = " <<response_entity.size() <<std::endl;
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(){
+	// 每个帧都有一条 TRACE 日志。
+	Logger::set_mask(Logger::LV_TRACE | Logger::LV_DEBUG, 0);
+
+	bool ok = true;
+	for(std::size_t i = 0; i < COUNT_OF(HPACK_EXAMPLES); ++i){
+		ok &= check_hpack_example(HPACK_EXAMPLES[i]);
+	}
+	ok &= check_flow_control(16384);
+	ok &= check_flow_control(Http::DEFAULT_WINDOW_SIZE);
+	ok &= check_flow_control(1048576);
+	std::cout <<(ok ? "PASSED" : "FAILED") <<std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,346 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+// 在本机回环上比较 HTTP/1.1 和 HTTP/2 的请求吞吐量。
+// HTTP/1.1 的客户端像浏览器一样不使用管线，每个连接同时只有一个请求，因此并发数就是连接数；
+// HTTP/2 的客户端在一个连接上保持同样多的流。服务端分别是 ServerReader/ServerWriter 和 Http2Connection，
+// 与 LowLevelSession 使用的一样，不经过 epoll 和任务线程，测量的是协议本身的开销。
+// 用法：http2_loopback_benchmark [含有 main.conf 的目录] [并发数] [请求总数]
+
+#include "../src/precompiled.hpp"
+#include "../src/singletons/main_config.hpp"
+#include "../src/http/server_reader.hpp"
+#include "../src/http/server_writer.hpp"
+#include "../src/http/http2_connection.hpp"
+#include "../src/http/hpack.hpp"
+#include "../src/stream_buffer.hpp"
+#include "../src/raii.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <time.h>
+
+namespace {
+	using namespace Poseidon;
+
+	double get_seconds(){
+		::timespec ts;
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+	}
+
+	Http::ResponseHeaders make_response_headers(){
+		Http::ResponseHeaders response_headers;
+		response_headers.version = 10001;
+		response_headers.status_code = Http::ST_OK;
+		response_headers.reason = "OK";
+		response_headers.headers.set(sslit("Content-Type"), "application/octet-stream");
+		response_headers.headers.set(sslit("Server"), "Poseidon");
+		return response_headers;
+	}
+	StreamBuffer make_response_entity(){
+		return StreamBuffer(std::string(256, 'x'));
+	}
+
+	class Http1Server : public Http::ServerReader, public Http::ServerWriter {
+	private:
+		StreamBuffer m_out;
+
+	public:
+		StreamBuffer &get_out(){
+			return m_out;
+		}
+
+	protected:
+		void on_request_headers(Http::RequestHeaders /* request_headers */, boost::uint64_t /* content_length */) OVERRIDE { }
+		void on_request_entity(boost::uint64_t /* entity_offset */, StreamBuffer /* entity */) OVERRIDE { }
+		bool on_request_end(boost::uint64_t /* content_length */, OptionalMap /* headers */) OVERRIDE {
+			put_response(make_response_headers(), make_response_entity(), true);
+			return true;
+		}
+		long on_encoded_data_avail(StreamBuffer encoded) OVERRIDE {
+			m_out.splice(encoded);
+			return true;
+		}
+	};
+
+	class Http2Server : public Http::Http2Connection {
+	private:
+		StreamBuffer m_out;
+
+	public:
+		Http2Server()
+			: Http::Http2Connection(1024, 65535, 65536)
+		{ }
+
+	public:
+		StreamBuffer &get_out(){
+			return m_out;
+		}
+
+	protected:
+		boost::uint64_t get_max_request_length() const OVERRIDE {
+			return 16384;
+		}
+		void on_http2_request(boost::uint32_t stream_id, Http::RequestHeaders /* request_headers */, StreamBuffer /* entity */) OVERRIDE {
+			put_response(stream_id, make_response_headers(), make_response_entity());
+		}
+		void on_http2_stream_closed(boost::uint32_t /* stream_id */) OVERRIDE { }
+		long on_encoded_data_avail(StreamBuffer encoded) OVERRIDE {
+			m_out.splice(encoded);
+			return true;
+		}
+	};
+
+	// 一对回环上的 TCP 连接，两端都是非阻塞的。
+	struct Connection {
+		UniqueFile client;
+		UniqueFile server;
+		StreamBuffer client_out;
+		StreamBuffer client_in;
+	};
+
+	void create_connection(Connection &conn, int listener, const ::sockaddr_in &addr){
+		if(!conn.client.reset(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0))){
+			std::abort();
+		}
+		if((::connect(conn.client.get(), reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) != 0) && (errno != EINPROGRESS)){
+			std::abort();
+		}
+		if(!conn.server.reset(::accept4(listener, NULLPTR, NULLPTR, SOCK_NONBLOCK))){
+			std::abort();
+		}
+		const int yes = 1;
+		::setsockopt(conn.client.get(), IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+		::setsockopt(conn.server.get(), IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	}
+
+	void pump_out(int fd, StreamBuffer &buffer){
+		char temp[16384];
+		while(!buffer.empty()){
+			const AUTO(size, buffer.peek(temp, sizeof(temp)));
+			const AUTO(result, ::send(fd, temp, size, MSG_NOSIGNAL | MSG_DONTWAIT));
+			if(result <= 0){
+				break;
+			}
+			buffer.discard(static_cast<std::size_t>(result));
+		}
+	}
+	void pump_in(int fd, StreamBuffer &buffer){
+		char temp[16384];
+		for(;;){
+			const AUTO(result, ::recv(fd, temp, sizeof(temp), MSG_DONTWAIT));
+			if(result <= 0){
+				break;
+			}
+			buffer.put(temp, static_cast<std::size_t>(result));
+		}
+	}
+	void wait_for_events(const std::vector<boost::shared_ptr<Connection> > &conns){
+		std::vector< ::pollfd> fds;
+		for(std::size_t i = 0; i < conns.size(); ++i){
+			::pollfd pfd = { conns[i]->client.get(), POLLIN, 0 };
+			if(!conns[i]->client_out.empty()){
+				pfd.events |= POLLOUT;
+			}
+			fds.push_back(pfd);
+			pfd.fd = conns[i]->server.get();
+			pfd.events = POLLIN | POLLOUT;
+			fds.push_back(pfd);
+		}
+		::poll(&fds[0], fds.size(), 1000);
+	}
+
+	// 返回处理的请求数。
+	unsigned long run_http1(int listener, const ::sockaddr_in &addr, unsigned concurrency, unsigned long total){
+		std::vector<boost::shared_ptr<Connection> > conns;
+		std::vector<boost::shared_ptr<Http1Server> > servers;
+		for(unsigned i = 0; i < concurrency; ++i){
+			conns.push_back(boost::make_shared<Connection>());
+			create_connection(*conns.back(), listener, addr);
+			servers.push_back(boost::make_shared<Http1Server>());
+		}
+		static const char REQUEST[] = "GET / HTTP/1.1\r\nHost: localhost\r\nUser-Agent: http2_loopback_benchmark\r\n\r\n";
+
+		unsigned long sent = 0, completed = 0;
+		for(unsigned i = 0; (i < concurrency) && (sent < total); ++i){
+			conns[i]->client_out.put(REQUEST);
+			++sent;
+		}
+		while(completed < total){
+			wait_for_events(conns);
+			for(unsigned i = 0; i < concurrency; ++i){
+				AUTO_REF(conn, *conns[i]);
+				pump_out(conn.client.get(), conn.client_out);
+
+				StreamBuffer data;
+				pump_in(conn.server.get(), data);
+				if(!data.empty()){
+					servers[i]->put_encoded_data(STD_MOVE(data));
+				}
+				pump_out(conn.server.get(), servers[i]->get_out());
+
+				pump_in(conn.client.get(), conn.client_in);
+				// 响应的长度是固定的，但是仍然按照 Content-Length 解析，与真实的客户端相当。
+				for(;;){
+					const AUTO(str, conn.client_in.dump_string());
+					const AUTO(header_end, str.find("\r\n\r\n"));
+					if(header_end == std::string::npos){
+						break;
+					}
+					const AUTO(pos, str.find("Content-Length: "));
+					const AUTO(content_length, std::strtoul(str.c_str() + pos + 16, NULLPTR, 10));
+					if(str.size() < header_end + 4 + content_length){
+						break;
+					}
+					conn.client_in.discard(header_end + 4 + content_length);
+					++completed;
+					if(sent < total){
+						conn.client_out.put(REQUEST);
+						++sent;
+					}
+				}
+			}
+		}
+		return completed;
+	}
+
+	void put_frame_header(StreamBuffer &data, std::size_t length, unsigned type, unsigned flags, boost::uint32_t stream_id){
+		const unsigned char header[9] = {
+			static_cast<unsigned char>(length >> 16), static_cast<unsigned char>(length >> 8), static_cast<unsigned char>(length),
+			static_cast<unsigned char>(type), static_cast<unsigned char>(flags),
+			static_cast<unsigned char>(stream_id >> 24), static_cast<unsigned char>(stream_id >> 16),
+			static_cast<unsigned char>(stream_id >> 8), static_cast<unsigned char>(stream_id) };
+		data.put(header, sizeof(header));
+	}
+	void put_request(StreamBuffer &data, Http::HpackEncoder &encoder, boost::uint32_t stream_id){
+		StreamBuffer block;
+		encoder.encode(block, ":method", "GET");
+		encoder.encode(block, ":scheme", "http");
+		encoder.encode(block, ":path", "/");
+		encoder.encode(block, ":authority", "localhost");
+		encoder.encode(block, "user-agent", "http2_loopback_benchmark");
+		put_frame_header(data, block.size(), Http::FT_HEADERS, Http::FF_END_HEADERS | Http::FF_END_STREAM, stream_id);
+		data.splice(block);
+	}
+
+	unsigned long run_http2(int listener, const ::sockaddr_in &addr, unsigned concurrency, unsigned long total){
+		std::vector<boost::shared_ptr<Connection> > conns;
+		conns.push_back(boost::make_shared<Connection>());
+		AUTO_REF(conn, *conns.front());
+		create_connection(conn, listener, addr);
+		Http2Server server;
+		Http::HpackEncoder encoder;
+
+		conn.client_out.put(Http::CONNECTION_PREFACE, sizeof(Http::CONNECTION_PREFACE));
+		put_frame_header(conn.client_out, 0, Http::FT_SETTINGS, 0, 0);
+
+		unsigned long sent = 0, completed = 0;
+		boost::uint32_t next_stream_id = 1;
+		boost::uint64_t unacknowledged = 0;
+		for(unsigned i = 0; (i < concurrency) && (sent < total); ++i){
+			put_request(conn.client_out, encoder, next_stream_id);
+			next_stream_id += 2;
+			++sent;
+		}
+		while(completed < total){
+			wait_for_events(conns);
+			pump_out(conn.client.get(), conn.client_out);
+
+			StreamBuffer data;
+			pump_in(conn.server.get(), data);
+			if(!data.empty() && !server.put_encoded_data(STD_MOVE(data))){
+				std::cerr <<"HTTP/2 connection error" <<std::endl;
+				std::abort();
+			}
+			pump_out(conn.server.get(), server.get_out());
+
+			pump_in(conn.client.get(), conn.client_in);
+			for(;;){
+				unsigned char header[9];
+				if(conn.client_in.peek(header, sizeof(header)) < sizeof(header)){
+					break;
+				}
+				const std::size_t length = (static_cast<std::size_t>(header[0]) << 16) | (static_cast<std::size_t>(header[1]) << 8) | header[2];
+				if(conn.client_in.size() < sizeof(header) + length){
+					break;
+				}
+				conn.client_in.discard(sizeof(header) + length);
+				const unsigned type = header[3], flags = header[4];
+				if((type == Http::FT_SETTINGS) && !(flags & Http::FF_ACK)){
+					put_frame_header(conn.client_out, 0, Http::FT_SETTINGS, Http::FF_ACK, 0);
+				}
+				if(type == Http::FT_DATA){
+					// 只补充连接的窗口，每个响应都小于流的初始窗口。
+					unacknowledged += length;
+					if(unacknowledged >= 32768){
+						put_frame_header(conn.client_out, 4, Http::FT_WINDOW_UPDATE, 0, 0);
+						for(unsigned i = 4; i > 0; --i){
+							conn.client_out.put(static_cast<unsigned char>(unacknowledged >> (i * 8 - 8)));
+						}
+						unacknowledged = 0;
+					}
+				}
+				if(((type == Http::FT_DATA) || (type == Http::FT_HEADERS)) && (flags & Http::FF_END_STREAM)){
+					++completed;
+					if(sent < total){
+						put_request(conn.client_out, encoder, next_stream_id);
+						next_stream_id += 2;
+						++sent;
+					}
+				}
+			}
+		}
+		return completed;
+	}
+}
+
+int main(int argc, char **argv){
+	const char *const run_path = (argc > 1) ? argv[1] : "etc/poseidon";
+	const unsigned concurrency = (argc > 2) ? static_cast<unsigned>(std::strtoul(argv[2], NULLPTR, 0)) : 32;
+	const unsigned long total = (argc > 3) ? std::strtoul(argv[3], NULLPTR, 0) : 200000;
+	if((concurrency == 0) || (concurrency > 1024)){
+		std::cerr <<"Concurrency must be between 1 and 1024." <<std::endl;
+		return 1;
+	}
+	MainConfig::set_run_path(run_path);
+	MainConfig::reload();
+
+	UniqueFile listener;
+	if(!listener.reset(::socket(AF_INET, SOCK_STREAM, 0))){
+		std::abort();
+	}
+	::sockaddr_in addr = { };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	::socklen_t addr_len = sizeof(addr);
+	if((::bind(listener.get(), reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) != 0) || (::listen(listener.get(), 1024) != 0)
+		|| (::getsockname(listener.get(), reinterpret_cast< ::sockaddr *>(&addr), &addr_len) != 0))
+	{
+		std::abort();
+	}
+
+	std::cout <<std::fixed <<std::setprecision(0);
+
+	double begin = get_seconds();
+	unsigned long completed = run_http1(listener.get(), addr, concurrency, total);
+	double elapsed = get_seconds() - begin;
+	std::cout <<"HTTP/1.1: " <<std::setw(4) <<concurrency <<" connection(s), " <<completed <<" requests, "
+	          <<std::setw(8) <<static_cast<double>(completed) / elapsed <<" req/s" <<std::endl;
+
+	begin = get_seconds();
+	completed = run_http2(listener.get(), addr, concurrency, total);
+	elapsed = get_seconds() - begin;
+	std::cout <<"HTTP/2  : " <<std::setw(4) <<1 <<" connection(s), " <<completed <<" requests, "
+	          <<std::setw(8) <<static_cast<double>(completed) / elapsed <<" req/s"
+	          <<" (" <<concurrency <<" concurrent streams)" <<std::endl;
+	return 0;
+}
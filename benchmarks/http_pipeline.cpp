@@ -0,0 +1,234 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+// 检查 LowLevelSession 的 HTTP/1.1 管线：分块响应排在普通响应前面时，普通响应必须等到前者的 trailer 之后才发送，
+// 以 RESPONSE_SEQ_FRONT 发送的块属于最早的未完成的请求，同时进行的两个压缩的分块响应各自使用自己的压缩器。
+// 不经过 epoll 和任务线程，按照 Http::Session 的方式依次调用，从回环连接的另一端读取并解析响应。
+// 用法：http_pipeline_check [含有 main.conf 的目录]
+
+#include "../src/precompiled.hpp"
+#include "../src/singletons/main_config.hpp"
+#include "../src/http/low_level_session.hpp"
+#include "../src/http/upgraded_session_base.hpp"
+#include "../src/stream_buffer.hpp"
+#include "../src/raii.hpp"
+#include "../src/zlib.hpp"
+#include <iostream>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+namespace {
+	using namespace Poseidon;
+
+	class TestSession : public Http::LowLevelSession {
+	public:
+		explicit TestSession(Move<UniqueFile> socket)
+			: Http::LowLevelSession(STD_MOVE(socket))
+		{ }
+
+	protected:
+		void on_low_level_request_headers(Http::RequestHeaders /* request_headers */, boost::uint64_t /* content_length */) OVERRIDE { }
+		void on_low_level_request_entity(boost::uint64_t /* entity_offset */, StreamBuffer /* entity */) OVERRIDE { }
+		boost::shared_ptr<Http::UpgradedSessionBase> on_low_level_request_end(boost::uint64_t /* content_length */, OptionalMap /* headers */) OVERRIDE {
+			return VAL_INIT;
+		}
+
+	public:
+		void feed(const char *str){
+			on_receive(StreamBuffer(str));
+		}
+		// 与 Session::SyncJobBase 一样，任务开始时设置序号，结束时恢复并标记响应完成。
+		void begin_job(boost::uint64_t seq){
+			set_response_seq(seq);
+		}
+		void end_job(boost::uint64_t seq){
+			set_response_seq(RESPONSE_SEQ_FRONT);
+			complete_response(seq);
+		}
+		void flush(){
+			Mutex::UniqueLock write_lock;
+			poll_write(write_lock, true);
+		}
+	};
+
+	OptionalMap make_text_headers(){
+		OptionalMap headers;
+		headers.set(sslit("Content-Type"), "text/plain");
+		return headers;
+	}
+	Http::ResponseHeaders make_chunked_headers(){
+		Http::ResponseHeaders response_headers;
+		response_headers.version = 10001;
+		response_headers.status_code = Http::ST_OK;
+		response_headers.reason = "OK";
+		response_headers.headers = make_text_headers();
+		return response_headers;
+	}
+
+	struct Response {
+		std::string content_encoding;
+		std::string entity;
+	};
+
+	std::string get_header(const std::string &header_block, const char *name){
+		const AUTO(key, std::string("\r\n") + name + ": ");
+		const AUTO(pos, header_block.find(key));
+		if(pos == std::string::npos){
+			return std::string();
+		}
+		const AUTO(begin, pos + key.size());
+		return header_block.substr(begin, header_block.find("\r\n", begin) - begin);
+	}
+
+	// 返回 false 表示数据不完整或者格式错误。
+	bool parse_responses(std::vector<Response> &responses, std::string str){
+		while(!str.empty()){
+			const AUTO(header_end, str.find("\r\n\r\n"));
+			if(header_end == std::string::npos){
+				return false;
+			}
+			const AUTO(header_block, str.substr(0, header_end + 2));
+			std::size_t pos = header_end + 4;
+			std::string entity;
+			if(get_header(header_block, "Transfer-Encoding") == "chunked"){
+				for(;;){
+					const AUTO(line_end, str.find("\r\n", pos));
+					if(line_end == std::string::npos){
+						return false;
+					}
+					const AUTO(size, std::strtoul(str.c_str() + pos, NULLPTR, 16));
+					pos = line_end + 2;
+					if(size == 0){
+						break;
+					}
+					if(str.size() < pos + size + 2){
+						return false;
+					}
+					entity.append(str, pos, size);
+					pos += size + 2;
+				}
+				// 没有 trailer 字段。
+				if(str.compare(pos, 2, "\r\n") != 0){
+					return false;
+				}
+				pos += 2;
+			} else {
+				const AUTO(size, std::strtoul(get_header(header_block, "Content-Length").c_str(), NULLPTR, 10));
+				if(str.size() < pos + size){
+					return false;
+				}
+				entity.append(str, pos, size);
+				pos += size;
+			}
+			Response response;
+			response.content_encoding = get_header(header_block, "Content-Encoding");
+			if(!response.content_encoding.empty()){
+				Inflator inflator(response.content_encoding == "gzip");
+				inflator.put(entity);
+				entity = inflator.finalize().dump_string();
+			}
+			response.entity.swap(entity);
+			responses.push_back(response);
+			str.erase(0, pos);
+		}
+		return true;
+	}
+
+	bool check(const std::vector<Response> &responses, std::size_t index, const char *expected, bool compressed){
+		if(index >= responses.size()){
+			std::cerr <<"Response #" <<index <<" is missing" <<std::endl;
+			return false;
+		}
+		const AUTO_REF(response, responses.at(index));
+		std::cout <<"Response #" <<index <<": " <<response.entity
+		          <<" (Content-Encoding: " <<(response.content_encoding.empty() ? "identity" : response.content_encoding) <<")" <<std::endl;
+		if(response.entity != expected){
+			std::cerr <<"  Expecting: " <<expected <<std::endl;
+			return false;
+		}
+		if(response.content_encoding.empty() == compressed){
+			std::cerr <<"  Unexpected Content-Encoding" <<std::endl;
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char **argv){
+	const char *const run_path = (argc > 1) ? argv[1] : "etc/poseidon";
+	MainConfig::set_run_path(run_path);
+	MainConfig::reload();
+
+	UniqueFile listener, client, server;
+	::sockaddr_in addr = { };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	::socklen_t addr_len = sizeof(addr);
+	if(!listener.reset(::socket(AF_INET, SOCK_STREAM, 0))
+		|| (::bind(listener.get(), reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) != 0) || (::listen(listener.get(), 1) != 0)
+		|| (::getsockname(listener.get(), reinterpret_cast< ::sockaddr *>(&addr), &addr_len) != 0)
+		|| !client.reset(::socket(AF_INET, SOCK_STREAM, 0))
+		|| (::connect(client.get(), reinterpret_cast<const ::sockaddr *>(&addr), sizeof(addr)) != 0)
+		|| !server.reset(::accept(listener.get(), NULLPTR, NULLPTR)))
+	{
+		std::abort();
+	}
+	const AUTO(session, boost::make_shared<TestSession>(STD_MOVE(server)));
+
+	// 第一个和第三个请求接受 gzip，text/plain 在默认配置下是可以压缩的。
+	session->feed(
+		"GET /alpha HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n"
+		"GET /bravo HTTP/1.1\r\nHost: localhost\r\n\r\n"
+		"GET /charlie HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n");
+
+	// 第一个请求开始分块响应，任务结束时响应还没有完成。
+	session->begin_job(0);
+	session->send_chunked_header(make_chunked_headers());
+	session->send_chunk(StreamBuffer("alpha-1 "));
+	session->end_job(0);
+	// 第二个请求的普通响应必须被缓存。
+	session->begin_job(1);
+	session->send(Http::ST_OK, make_text_headers(), StreamBuffer("bravo"));
+	session->end_job(1);
+	// 第三个请求开始另一个压缩的分块响应。
+	session->begin_job(2);
+	session->send_chunked_header(make_chunked_headers());
+	session->send_chunk(StreamBuffer("charlie-1 "));
+	session->end_job(2);
+	// 任务之外发送的块属于最早的未完成的请求。
+	session->send_chunk(StreamBuffer("alpha-2"));
+	session->send_chunked_trailer(OptionalMap());
+	session->send_chunk(StreamBuffer("charlie-2"));
+	session->send_chunked_trailer(OptionalMap());
+	session->flush();
+
+	std::string str;
+	char temp[4096];
+	for(;;){
+		const AUTO(result, ::recv(client.get(), temp, sizeof(temp), MSG_DONTWAIT));
+		if(result <= 0){
+			break;
+		}
+		str.append(temp, static_cast<std::size_t>(result));
+	}
+	std::vector<Response> responses;
+	if(!parse_responses(responses, str)){
+		std::cerr <<"Malformed response stream:" <<std::endl <<str <<std::endl;
+		return 1;
+	}
+	bool ok = true;
+	ok &= check(responses, 0, "alpha-1 alpha-2", true);
+	ok &= check(responses, 1, "bravo", false);
+	ok &= check(responses, 2, "charlie-1 charlie-2", true);
+	if(responses.size() != 3){
+		std::cerr <<"Expecting 3 responses, got " <<responses.size() <<std::endl;
+		ok = false;
+	}
+	std::cout <<(ok ? "PASSED" : "FAILED") <<std::endl;
+	return ok ? 0 : 1;
+}
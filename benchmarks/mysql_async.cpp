@@ -0,0 +1,210 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+// 对本机的 mysqld 比较阻塞的连接和非阻塞的多路复用连接在不同线程数下的查询吞吐量。
+// 阻塞模式下每个线程一个连接，和 MySqlDaemon 原来的实现一样；非阻塞模式下每个线程通过 epoll 驱动多个连接，
+// 和 mysql_async_connections_per_thread 打开时一样。查询是 DO SLEEP()，用来模拟服务器处理写入的时间。
+// 服务器的地址和账号从 main.conf 中读取。非阻塞模式需要 MariaDB 客户端库。
+// 用法：mysql_async_benchmark [含有 main.conf 的目录] [每个线程的连接数] [每个线程的查询数] [每个查询的毫秒数]
+
+#include "../src/precompiled.hpp"
+#include "../src/singletons/main_config.hpp"
+#include "../src/mysql/connection.hpp"
+#include "../src/mysql/thread_context.hpp"
+#include "../src/thread.hpp"
+#include "../src/atomic.hpp"
+#include "../src/raii.hpp"
+#include "../src/exception.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <boost/bind.hpp>
+#include <sys/epoll.h>
+#include <time.h>
+
+namespace {
+	using namespace Poseidon;
+
+	std::string g_server_addr = "localhost";
+	unsigned g_server_port = 3306;
+	std::string g_username = "root";
+	std::string g_password = "root";
+	std::string g_schema = "poseidon";
+	bool g_use_ssl = false;
+	std::string g_charset = "utf8";
+
+	std::string g_query;
+	volatile unsigned long g_failures = 0;
+
+	double get_seconds(){
+		::timespec ts;
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+	}
+
+	boost::shared_ptr<MySql::Connection> connect(){
+		return MySql::Connection::create(g_server_addr, g_server_port, g_username, g_password, g_schema, g_use_ssl, g_charset);
+	}
+
+	void run_blocking(unsigned long queries){
+		try {
+			const MySql::ThreadContext thread_context;
+			const AUTO(conn, connect());
+			for(unsigned long i = 0; i < queries; ++i){
+				conn->execute_sql(g_query);
+				conn->discard_result();
+			}
+		} catch(std::exception &e){
+			std::cerr <<"Blocking worker failed: " <<e.what() <<std::endl;
+			atomic_add(g_failures, 1, ATOMIC_RELAXED);
+		}
+	}
+
+	struct AsyncConnection {
+		boost::shared_ptr<MySql::Connection> conn;
+		int socket;
+		unsigned long remaining;
+	};
+
+	void wait_for(int epoll, AsyncConnection &ac, int wait_events){
+		::epoll_event event;
+		event.events = 0;
+		if(wait_events & MySql::Connection::WAIT_READ){
+			event.events |= EPOLLIN;
+		}
+		if(wait_events & MySql::Connection::WAIT_WRITE){
+			event.events |= EPOLLOUT;
+		}
+		event.data.ptr = &ac;
+		const int socket = ac.conn->get_socket();
+		if(ac.socket != socket){
+			if(ac.socket >= 0){
+				::epoll_ctl(epoll, EPOLL_CTL_DEL, ac.socket, NULLPTR);
+			}
+			::epoll_ctl(epoll, EPOLL_CTL_ADD, socket, &event);
+			ac.socket = socket;
+		} else {
+			::epoll_ctl(epoll, EPOLL_CTL_MOD, socket, &event);
+		}
+	}
+	// 返回 false 表示这个连接上的查询都已经完成。
+	bool begin_next(int epoll, AsyncConnection &ac){
+		while(ac.remaining != 0){
+			--ac.remaining;
+			const int wait_events = ac.conn->begin_execute_sql(g_query);
+			if(wait_events != 0){
+				wait_for(epoll, ac, wait_events);
+				return true;
+			}
+			ac.conn->end_execute_sql();
+			ac.conn->discard_result();
+		}
+		return false;
+	}
+
+	void run_async(unsigned connections, unsigned long queries){
+		try {
+			const MySql::ThreadContext thread_context;
+			UniqueFile epoll;
+			if(!epoll.reset(::epoll_create(static_cast<int>(connections)))){
+				DEBUG_THROW(Exception, sslit("::epoll_create() failed"));
+			}
+			std::vector<AsyncConnection> conns(connections);
+			unsigned active = 0;
+			for(unsigned i = 0; i < connections; ++i){
+				AUTO_REF(ac, conns.at(i));
+				ac.conn = connect();
+				ac.socket = -1;
+				ac.remaining = queries / connections + (i < queries % connections);
+				active += begin_next(epoll.get(), ac);
+			}
+			while(active != 0){
+				::epoll_event events[64];
+				const int count = ::epoll_wait(epoll.get(), events, COUNT_OF(events), -1);
+				for(int i = 0; i < count; ++i){
+					AUTO_REF(ac, *static_cast<AsyncConnection *>(events[i].data.ptr));
+					int ready_events = 0;
+					if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)){
+						ready_events |= MySql::Connection::WAIT_READ;
+					}
+					if(events[i].events & (EPOLLOUT | EPOLLERR)){
+						ready_events |= MySql::Connection::WAIT_WRITE;
+					}
+					const int wait_events = ac.conn->continue_execute_sql(ready_events);
+					if(wait_events != 0){
+						wait_for(epoll.get(), ac, wait_events);
+						continue;
+					}
+					ac.conn->end_execute_sql();
+					ac.conn->discard_result();
+					active -= !begin_next(epoll.get(), ac);
+				}
+			}
+		} catch(std::exception &e){
+			std::cerr <<"Async worker failed: " <<e.what() <<std::endl;
+			atomic_add(g_failures, 1, ATOMIC_RELAXED);
+		}
+	}
+
+	double measure(unsigned threads, const boost::function<void ()> &proc){
+		std::vector<boost::shared_ptr<Thread> > workers;
+		const double begin = get_seconds();
+		for(unsigned i = 0; i < threads; ++i){
+			workers.push_back(boost::make_shared<Thread>(proc, " B  "));
+		}
+		for(unsigned i = 0; i < threads; ++i){
+			workers.at(i)->join();
+		}
+		return get_seconds() - begin;
+	}
+}
+
+int main(int argc, char **argv){
+	const char *const run_path = (argc > 1) ? argv[1] : "etc/poseidon";
+	const unsigned connections = (argc > 2) ? static_cast<unsigned>(std::strtoul(argv[2], NULLPTR, 0)) : 8;
+	const unsigned long queries = (argc > 3) ? std::strtoul(argv[3], NULLPTR, 0) : 2000;
+	const unsigned sleep_ms = (argc > 4) ? static_cast<unsigned>(std::strtoul(argv[4], NULLPTR, 0)) : 1;
+	if((connections == 0) || (connections > 1024)){
+		std::cerr <<"Connections per thread must be between 1 and 1024." <<std::endl;
+		return 1;
+	}
+	MainConfig::set_run_path(run_path);
+	MainConfig::reload();
+	MainConfig::get(g_server_addr, "mysql_server_addr");
+	MainConfig::get(g_server_port, "mysql_server_port");
+	MainConfig::get(g_username, "mysql_username");
+	MainConfig::get(g_password, "mysql_password");
+	MainConfig::get(g_schema, "mysql_schema");
+	MainConfig::get(g_use_ssl, "mysql_use_ssl");
+	MainConfig::get(g_charset, "mysql_charset");
+
+	char query[64];
+	std::sprintf(query, "DO SLEEP(%u.%03u)", sleep_ms / 1000, sleep_ms % 1000);
+	g_query = query;
+
+	const bool async = MySql::Connection::is_nonblocking_supported();
+	if(!async){
+		std::cout <<"Non-blocking MySQL API is not available; only blocking mode will be measured." <<std::endl;
+	}
+	std::cout <<std::fixed <<std::setprecision(0);
+	static const unsigned thread_counts[] = { 1, 2, 4, 8 };
+	for(std::size_t i = 0; i < COUNT_OF(thread_counts); ++i){
+		const unsigned threads = thread_counts[i];
+		const unsigned long total = queries * threads;
+
+		double elapsed = measure(threads, boost::bind(&run_blocking, queries));
+		std::cout <<std::setw(2) <<threads <<" thread(s), blocking        : "
+		          <<std::setw(8) <<static_cast<double>(total) / elapsed <<" queries/s" <<std::endl;
+		if(!async){
+			continue;
+		}
+		elapsed = measure(threads, boost::bind(&run_async, connections, queries));
+		std::cout <<std::setw(2) <<threads <<" thread(s), " <<std::setw(4) <<connections <<" conn/thread: "
+		          <<std::setw(8) <<static_cast<double>(total) / elapsed <<" queries/s" <<std::endl;
+	}
+	if(atomic_load(g_failures, ATOMIC_RELAXED) != 0){
+		std::cerr <<"Some workers failed; results are not reliable." <<std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,143 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+// 比较 StreamBuffer 在使用和不使用块内存池时 put()、cut_off() 和 splice() 的吞吐量。
+// 跨线程一项在一个线程中构造缓冲区，在另一个线程中销毁，模拟 epoll 线程和任务线程。
+// 广播一项把同一个 4KiB 的帧复制给一万个会话，复制时共享数据块。
+// 用法：stream_buffer_benchmark [轮数]
+
+#include "../src/precompiled.hpp"
+#include "../src/stream_buffer.hpp"
+#include "../src/thread.hpp"
+#include "../src/mutex.hpp"
+#include "../src/condition_variable.hpp"
+#include <iostream>
+#include <deque>
+#include <time.h>
+
+namespace {
+	using namespace Poseidon;
+
+	double get_seconds(){
+		::timespec ts;
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+	}
+
+	// 模拟一个请求：收到若干个小包，拼接之后切出请求，再构造响应。
+	std::size_t run_single(unsigned long rounds){
+		static const char packet[1500] = { };
+		std::size_t total = 0;
+		for(unsigned long i = 0; i < rounds; ++i){
+			StreamBuffer queue;
+			for(unsigned j = 0; j < 4; ++j){
+				StreamBuffer data(packet, sizeof(packet) - j * 100);
+				queue.splice(data);
+			}
+			StreamBuffer request = queue.cut_off(2000);
+			StreamBuffer response;
+			response.put("HTTP/1.1 200 OK\r\nContent-Length: 4096\r\n\r\n");
+			response.put('x', 4096);
+			response.splice(request);
+			total += response.size() + queue.size();
+		}
+		return total;
+	}
+
+	struct Handoff {
+		Mutex mutex;
+		ConditionVariable avail;
+		std::deque<StreamBuffer> queue;
+		bool done;
+	};
+
+	void consume(Handoff *handoff){
+		Mutex::UniqueLock lock(handoff->mutex);
+		for(;;){
+			while(handoff->queue.empty() && !handoff->done){
+				handoff->avail.wait(lock);
+			}
+			if(handoff->queue.empty()){
+				break;
+			}
+			std::deque<StreamBuffer> batch;
+			batch.swap(handoff->queue);
+			lock.unlock();
+			batch.clear();
+			lock.lock();
+		}
+	}
+
+	void run_cross_thread(unsigned long rounds){
+		static const char packet[4096] = { };
+		Handoff handoff;
+		handoff.done = false;
+		Thread consumer(boost::bind(&consume, &handoff), " SBB");
+		for(unsigned long i = 0; i < rounds; ++i){
+			StreamBuffer data(packet, sizeof(packet));
+			data.put(packet, 1000);
+			const Mutex::UniqueLock lock(handoff.mutex);
+			handoff.queue.push_back(StreamBuffer());
+			handoff.queue.back().swap(data);
+			handoff.avail.signal();
+		}
+		{
+			const Mutex::UniqueLock lock(handoff.mutex);
+			handoff.done = true;
+			handoff.avail.signal();
+		}
+		consumer.join();
+	}
+
+	void run_fan_out(unsigned long rounds){
+		static const char frame[4096] = { };
+		const StreamBuffer payload(frame, sizeof(frame));
+		std::vector<StreamBuffer> sessions(10000);
+		const double begin = get_seconds();
+		for(unsigned long i = 0; i < rounds / sessions.size() + 1; ++i){
+			for(AUTO(it, sessions.begin()); it != sessions.end(); ++it){
+				StreamBuffer copy(payload);
+				it->splice(copy);
+			}
+			for(AUTO(it, sessions.begin()); it != sessions.end(); ++it){
+				StreamBuffer().swap(*it);
+			}
+		}
+		const double elapsed = get_seconds() - begin;
+		std::cout <<"broadcast: " <<(elapsed * 1e9 / static_cast<double>((rounds / sessions.size() + 1) * sessions.size())) <<" ns/copy" <<std::endl;
+	}
+
+	void run(bool pool_enabled, unsigned long rounds){
+		StreamBuffer::set_chunk_pool_enabled(pool_enabled);
+		const char *const name = pool_enabled ? "pool" : "operator new";
+
+		double begin = get_seconds();
+		const std::size_t total = run_single(rounds);
+		double elapsed = get_seconds() - begin;
+		std::cout <<name <<": single thread: " <<(elapsed * 1e9 / static_cast<double>(rounds)) <<" ns/request"
+		          <<" (" <<total <<" bytes)" <<std::endl;
+
+		begin = get_seconds();
+		run_cross_thread(rounds);
+		elapsed = get_seconds() - begin;
+		std::cout <<name <<": cross thread: " <<(elapsed * 1e9 / static_cast<double>(rounds)) <<" ns/buffer" <<std::endl;
+	}
+}
+
+int main(int argc, char **argv){
+	unsigned long rounds = 1000000;
+	if(argc > 1){
+		rounds = std::strtoul(argv[1], NULLPTR, 0);
+	}
+	run(false, rounds);
+	run(true, rounds);
+	run_fan_out(rounds);
+
+	std::vector<StreamBuffer::ChunkPoolSnapshot> snapshot;
+	StreamBuffer::make_chunk_pool_snapshot(snapshot);
+	for(AUTO(it, snapshot.begin()); it != snapshot.end(); ++it){
+		std::cout <<"capacity " <<it->chunk_capacity <<": created " <<it->chunks_created
+		          <<", destroyed " <<it->chunks_destroyed <<", cached " <<it->chunks_in_global_cache <<std::endl;
+	}
+	return 0;
+}
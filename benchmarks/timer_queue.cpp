@@ -0,0 +1,163 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+// 比较二叉堆（TimerDaemon 原来的实现）和分层时间轮在不同计时器数量下的开销。
+// 每个计时器的周期都是一秒，和 TcpSessionBase 的关闭计时器一样。
+// 用法：timer_queue_benchmark [模拟的秒数]
+
+#include "../src/precompiled.hpp"
+#include "../src/timer_wheel.hpp"
+#include <iostream>
+#include <time.h>
+
+namespace {
+	using namespace Poseidon;
+
+	CONSTEXPR const boost::uint64_t PERIOD = 1000;
+
+	double get_seconds(){
+		::timespec ts;
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+	}
+
+	struct Result {
+		double insert;
+		double expire;
+		double reset;
+		double cancel;
+	};
+
+	// 重新设定时间时不删除旧元素，而是用 stamp 使其失效，和原来的 TimerDaemon 一样。
+	struct HeapItem {
+		unsigned long stamp;
+		bool cancelled;
+	};
+	struct HeapElement {
+		boost::uint64_t next;
+		HeapItem *item;
+		unsigned long stamp;
+
+		bool operator<(const HeapElement &rhs) const {
+			return next > rhs.next;
+		}
+	};
+
+	Result run_heap(std::size_t count, boost::uint64_t seconds){
+		Result result;
+		std::vector<HeapItem> items(count);
+		std::vector<HeapElement> heap;
+		heap.reserve(count);
+
+		double begin = get_seconds();
+		for(std::size_t i = 0; i < count; ++i){
+			items[i].stamp = 0;
+			items[i].cancelled = false;
+			const HeapElement elem = { i % PERIOD, &items[i], 0 };
+			heap.push_back(elem);
+			std::push_heap(heap.begin(), heap.end());
+		}
+		result.insert = get_seconds() - begin;
+
+		begin = get_seconds();
+		for(boost::uint64_t now = 0; now < seconds * PERIOD; ++now){
+			while(!heap.empty() && (heap.front().next <= now)){
+				std::pop_heap(heap.begin(), heap.end());
+				HeapElement &elem = heap.back();
+				if(elem.item->cancelled || (elem.item->stamp != elem.stamp)){
+					heap.pop_back();
+					continue;
+				}
+				elem.next += PERIOD;
+				std::push_heap(heap.begin(), heap.end());
+			}
+		}
+		result.expire = get_seconds() - begin;
+
+		begin = get_seconds();
+		const boost::uint64_t base = seconds * PERIOD;
+		for(std::size_t i = 0; i < count; ++i){
+			const HeapElement elem = { base + (i * 7) % PERIOD, &items[i], ++items[i].stamp };
+			heap.push_back(elem);
+			std::push_heap(heap.begin(), heap.end());
+		}
+		result.reset = get_seconds() - begin;
+
+		// 取消本身是 O(1) 的，但是失效的元素要等到弹出时才会被清除。
+		begin = get_seconds();
+		for(std::size_t i = 0; i < count; ++i){
+			items[i].cancelled = true;
+		}
+		for(boost::uint64_t now = base; !heap.empty(); ++now){
+			while(!heap.empty() && (heap.front().next <= now)){
+				std::pop_heap(heap.begin(), heap.end());
+				heap.pop_back();
+			}
+		}
+		result.cancel = get_seconds() - begin;
+		return result;
+	}
+
+	Result run_wheel(std::size_t count, boost::uint64_t seconds){
+		Result result;
+		const boost::scoped_array<TimerWheel::Node> storage(new TimerWheel::Node[count]);
+		TimerWheel::Node *const items = storage.get();
+		TimerWheel wheel;
+		std::vector<TimerWheel::Node *> expired;
+
+		double begin = get_seconds();
+		for(std::size_t i = 0; i < count; ++i){
+			wheel.insert(items + i, i % PERIOD);
+		}
+		result.insert = get_seconds() - begin;
+
+		begin = get_seconds();
+		for(boost::uint64_t now = 0; now < seconds * PERIOD; ++now){
+			wheel.advance(now, expired);
+			for(AUTO(it, expired.begin()); it != expired.end(); ++it){
+				wheel.insert(*it, (*it)->get_expiry() + PERIOD);
+			}
+			expired.clear();
+		}
+		result.expire = get_seconds() - begin;
+
+		begin = get_seconds();
+		const boost::uint64_t base = seconds * PERIOD;
+		for(std::size_t i = 0; i < count; ++i){
+			wheel.erase(items + i);
+			wheel.insert(items + i, base + (i * 7) % PERIOD);
+		}
+		result.reset = get_seconds() - begin;
+
+		begin = get_seconds();
+		for(std::size_t i = 0; i < count; ++i){
+			wheel.erase(items + i);
+		}
+		result.cancel = get_seconds() - begin;
+		return result;
+	}
+
+	void print(const char *name, std::size_t count, boost::uint64_t seconds, const Result &result){
+		const double n = static_cast<double>(count);
+		std::cout <<std::setw(6) <<name <<std::setw(10) <<count <<std::fixed <<std::setprecision(1)
+		          <<std::setw(14) <<(result.insert * 1e9 / n)
+		          <<std::setw(14) <<(result.expire * 1e9 / (n * static_cast<double>(seconds)))
+		          <<std::setw(14) <<(result.reset * 1e9 / n)
+		          <<std::setw(14) <<(result.cancel * 1e9 / n) <<std::endl;
+	}
+}
+
+int main(int argc, char **argv){
+	boost::uint64_t seconds = 10;
+	if(argc > 1){
+		seconds = std::strtoull(argv[1], NULLPTR, 0);
+	}
+
+	std::cout <<"  impl    timers     insert/ns     expire/ns      reset/ns     cancel/ns" <<std::endl;
+	static const std::size_t s_counts[] = { 10000, 100000, 1000000 };
+	for(std::size_t i = 0; i < COUNT_OF(s_counts); ++i){
+		print("heap", s_counts[i], seconds, run_heap(s_counts[i], seconds));
+		print("wheel", s_counts[i], seconds, run_wheel(s_counts[i], seconds));
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+// 比较 WebSocket 掩码运算在逐字节循环和 apply_mask() 之下的吞吐量，帧长从 64B 到 16MiB。
+// 缓冲区一项直接在 StreamBuffer 的块上运算，即 Reader 和 Writer 实际使用的路径。
+// 用法：websocket_mask_benchmark [每种帧长处理的总字节数]
+
+#include "../src/precompiled.hpp"
+#include "../src/websocket/masking.hpp"
+#include "../src/stream_buffer.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <time.h>
+
+namespace {
+	using namespace Poseidon;
+
+	double get_seconds(){
+		::timespec ts;
+		::clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+	}
+
+	// 原先 Reader 和 Writer 中的算法。
+	boost::uint32_t mask_bytewise(unsigned char *data, std::size_t size, boost::uint32_t mask){
+		for(std::size_t i = 0; i < size; ++i){
+			data[i] ^= static_cast<unsigned char>(mask);
+			mask = (mask << 24) | (mask >> 8);
+		}
+		return mask;
+	}
+
+	double to_gbps(unsigned long long bytes, double elapsed){
+		return static_cast<double>(bytes) / elapsed / 1e9;
+	}
+
+	void run(std::size_t frame_size, unsigned long long total_bytes){
+		const unsigned long rounds = static_cast<unsigned long>(total_bytes / frame_size) + 1;
+		const unsigned long long bytes = static_cast<unsigned long long>(rounds) * frame_size;
+		std::vector<unsigned char> frame(frame_size, 0x5A);
+		boost::uint32_t mask = 0x9E3779B9u;
+
+		double begin = get_seconds();
+		for(unsigned long i = 0; i < rounds; ++i){
+			mask = mask_bytewise(&frame[0], frame_size, mask);
+		}
+		const double bytewise = to_gbps(bytes, get_seconds() - begin);
+
+		begin = get_seconds();
+		for(unsigned long i = 0; i < rounds; ++i){
+			mask = WebSocket::apply_mask(&frame[0], frame_size, mask);
+		}
+		const double flat = to_gbps(bytes, get_seconds() - begin);
+
+		StreamBuffer buffer(&frame[0], frame_size);
+		begin = get_seconds();
+		for(unsigned long i = 0; i < rounds; ++i){
+			mask = WebSocket::apply_mask(buffer, mask);
+		}
+		const double chunked = to_gbps(bytes, get_seconds() - begin);
+
+		std::cout <<std::setw(10) <<frame_size <<" B: bytewise " <<std::setw(8) <<bytewise <<" GB/s, "
+		          <<WebSocket::get_mask_implementation_name() <<" " <<std::setw(8) <<flat <<" GB/s, "
+		          <<"stream buffer " <<std::setw(8) <<chunked <<" GB/s"
+		          <<" (" <<(mask & 1) <<")" <<std::endl;
+	}
+}
+
+int main(int argc, char **argv){
+	unsigned long long total_bytes = 1ull << 28;
+	if(argc > 1){
+		total_bytes = std::strtoull(argv[1], NULLPTR, 0);
+	}
+	std::cout <<std::fixed <<std::setprecision(2);
+	for(std::size_t frame_size = 64; frame_size <= (16u << 20); frame_size *= 4){
+		run(frame_size, total_bytes);
+	}
+	return 0;
+}
@@ -61,7 +61,8 @@ private:
 
 boost::shared_ptr<Poseidon::Http::UpgradedSessionBase> HttpClient::on_low_level_response_end(std::uint64_t, Poseidon::OptionalMap){
 	LOG_POSEIDON_DEBUG("End of HTTP response: remote = ", get_remote_info());
-	if(!Poseidon::WebSocket::check_handshake_response(m_response_headers, m_sec_websocket_key)){
+	Poseidon::WebSocket::PermessageDeflateParams deflate_params;
+	if(!Poseidon::WebSocket::check_handshake_response(m_response_headers, m_sec_websocket_key, &deflate_params)){
 		LOG_POSEIDON_ERROR("Invalid WebSocket handshake response.");
 		force_shutdown();
 		return { };
@@ -69,6 +70,7 @@ boost::shared_ptr<Poseidon::Http::UpgradedSessionBase> HttpClient::on_low_level_
 
 	LOG_POSEIDON_INFO("Upgrading to WebSocket...");
 	auto client = boost::make_shared<Client>(virtual_shared_from_this<HttpClient>());
+	client->enable_permessage_deflate(deflate_params);
 	m_timer = Poseidon::TimerDaemon::register_timer(1000, 1000,
 		std::bind([](boost::weak_ptr<Client> weak_client){
 			const auto client = weak_client.lock();
@@ -83,7 +85,7 @@ boost::shared_ptr<Poseidon::Http::UpgradedSessionBase> HttpClient::on_low_level_
 }
 
 MODULE_RAII(){
-	auto request_pair = Poseidon::WebSocket::make_handshake_request("/", { }, g_client_connect_addr);
+	auto request_pair = Poseidon::WebSocket::make_handshake_request("/", { }, g_client_connect_addr, true);
 	const Poseidon::IpPort ip_port(g_client_connect_addr, g_client_connect_port);
 	auto client = boost::make_shared<HttpClient>(ip_port, false, std::move(request_pair.second));
 	client->go_resident();
@@ -78,13 +78,16 @@ boost::shared_ptr<Poseidon::Http::UpgradedSessionBase> HttpSession::on_low_level
 		send_http_default_and_shutdown(Poseidon::Http::ST_FORBIDDEN);
 		return { };
 	}
-	auto response_headers = Poseidon::WebSocket::make_handshake_response(m_request_headers);
+	Poseidon::WebSocket::PermessageDeflateParams deflate_params;
+	auto response_headers = Poseidon::WebSocket::make_handshake_response(m_request_headers, &deflate_params);
 	if(response_headers.status_code != Poseidon::Http::ST_SWITCHING_PROTOCOLS){
 		send_http_default_and_shutdown(response_headers.status_code);
 		return { };
 	}
 	Poseidon::Http::LowLevelSession::send(std::move(response_headers), { });
-	return boost::make_shared<Session>(virtual_shared_from_this<HttpSession>());
+	auto session = boost::make_shared<Session>(virtual_shared_from_this<HttpSession>());
+	session->enable_permessage_deflate(deflate_params);
+	return std::move(session);
 }
 
 class Server : public Poseidon::TcpServerBase {
@@ -0,0 +1,138 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#include "precompiled.hpp"
+#include "fiber_context.hpp"
+#include "log.hpp"
+
+namespace Poseidon {
+
+namespace {
+	void ucontext_entry(int proc_low, int proc_high, int param_low, int param_high){
+		void (*proc)(void *);
+		void *param;
+		const int proc_params[2] = { proc_low, proc_high };
+		const int param_params[2] = { param_low, param_high };
+		std::memcpy(&proc, proc_params, sizeof(proc));
+		std::memcpy(&param, param_params, sizeof(param));
+
+		(*proc)(param);
+
+		LOG_POSEIDON_FATAL("Fiber procedure returned?!");
+		std::abort();
+	}
+}
+
+void UcontextFiberContext::swap(UcontextFiberContext &from, UcontextFiberContext &to) NOEXCEPT {
+	if(::swapcontext(&(from.m_uctx), &(to.m_uctx)) != 0){
+		const int err_code = errno;
+		LOG_POSEIDON_FATAL("::swapcontext() failed: err_code = ", err_code);
+		std::abort();
+	}
+}
+
+UcontextFiberContext::UcontextFiberContext() NOEXCEPT {
+#ifndef NDEBUG
+	std::memset(&m_uctx, 0xCC, sizeof(m_uctx));
+#endif
+}
+
+void UcontextFiberContext::reset(void *stack, std::size_t stack_size, void (*proc)(void *), void *param) NOEXCEPT {
+	if(::getcontext(&m_uctx) != 0){
+		const int err_code = errno;
+		LOG_POSEIDON_FATAL("::getcontext() failed: err_code = ", err_code);
+		std::abort();
+	}
+	m_uctx.uc_stack.ss_sp = stack;
+	m_uctx.uc_stack.ss_size = stack_size;
+	m_uctx.uc_link = NULLPTR;
+
+	int proc_params[2] = { };
+	BOOST_STATIC_ASSERT(sizeof(proc) <= sizeof(proc_params));
+	std::memcpy(proc_params, &proc, sizeof(proc));
+	int param_params[2] = { };
+	BOOST_STATIC_ASSERT(sizeof(param) <= sizeof(param_params));
+	std::memcpy(param_params, &param, sizeof(param));
+	::makecontext(&m_uctx, reinterpret_cast<void (*)()>(&ucontext_entry), 4, proc_params[0], proc_params[1], param_params[0], param_params[1]);
+}
+
+#ifdef POSEIDON_FIBER_CONTEXT_HAS_ASM_
+
+extern "C" {
+	void poseidon_fiber_context_switch(void **save_sp, void *load_sp);
+	void poseidon_fiber_context_entry();
+}
+
+// 栈的布局（从低地址到高地址）：MXCSR 和 x87 控制字、r15、r14、r13、r12、rbx、rbp、返回地址。
+// 新的上下文从 poseidon_fiber_context_entry 开始执行，此时 r12 是 proc，r13 是 param。
+__asm__(
+	".text \n"
+	".globl poseidon_fiber_context_switch \n"
+	".hidden poseidon_fiber_context_switch \n"
+	".type poseidon_fiber_context_switch, @function \n"
+	".p2align 4 \n"
+	"poseidon_fiber_context_switch: \n"
+	"	pushq %rbp \n"
+	"	pushq %rbx \n"
+	"	pushq %r12 \n"
+	"	pushq %r13 \n"
+	"	pushq %r14 \n"
+	"	pushq %r15 \n"
+	"	subq $8, %rsp \n"
+	"	stmxcsr (%rsp) \n"
+	"	fnstcw 4(%rsp) \n"
+	"	movq %rsp, (%rdi) \n"
+	"	movq %rsi, %rsp \n"
+	"	ldmxcsr (%rsp) \n"
+	"	fldcw 4(%rsp) \n"
+	"	addq $8, %rsp \n"
+	"	popq %r15 \n"
+	"	popq %r14 \n"
+	"	popq %r13 \n"
+	"	popq %r12 \n"
+	"	popq %rbx \n"
+	"	popq %rbp \n"
+	"	ret \n"
+	".size poseidon_fiber_context_switch, .-poseidon_fiber_context_switch \n"
+
+	".globl poseidon_fiber_context_entry \n"
+	".hidden poseidon_fiber_context_entry \n"
+	".type poseidon_fiber_context_entry, @function \n"
+	".p2align 4 \n"
+	"poseidon_fiber_context_entry: \n"
+	"	movq %r13, %rdi \n"
+	"	callq *%r12 \n"
+	"	ud2 \n"
+	".size poseidon_fiber_context_entry, .-poseidon_fiber_context_entry \n"
+);
+
+void AsmFiberContext::swap(AsmFiberContext &from, AsmFiberContext &to) NOEXCEPT {
+	poseidon_fiber_context_switch(&(from.m_sp), to.m_sp);
+}
+
+AsmFiberContext::AsmFiberContext() NOEXCEPT
+	: m_sp(NULLPTR)
+{ }
+
+void AsmFiberContext::reset(void *stack, std::size_t stack_size, void (*proc)(void *), void *param) NOEXCEPT {
+	// 返回到 poseidon_fiber_context_entry 之后栈指针必须是 16 字节对齐的。
+	const AUTO(top, (reinterpret_cast<boost::uintptr_t>(stack) + stack_size) & ~static_cast<boost::uintptr_t>(15));
+	void **sp = reinterpret_cast<void **>(top);
+	*--sp = reinterpret_cast<void *>(&poseidon_fiber_context_entry);
+	*--sp = NULLPTR; // rbp
+	*--sp = NULLPTR; // rbx
+	*--sp = reinterpret_cast<void *>(proc); // r12
+	*--sp = param; // r13
+	*--sp = NULLPTR; // r14
+	*--sp = NULLPTR; // r15
+	const boost::uint32_t mxcsr = 0x1F80;
+	const boost::uint16_t x87cw = 0x037F;
+	*--sp = NULLPTR;
+	std::memcpy(reinterpret_cast<char *>(sp) + 0, &mxcsr, sizeof(mxcsr));
+	std::memcpy(reinterpret_cast<char *>(sp) + 4, &x87cw, sizeof(x87cw));
+	m_sp = sp;
+}
+
+#endif
+
+}
@@ -0,0 +1,66 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_FIBER_CONTEXT_HPP_
+#define POSEIDON_FIBER_CONTEXT_HPP_
+
+#include "cxx_ver.hpp"
+#include "cxx_util.hpp"
+#include <cstddef>
+#include <ucontext.h>
+
+// 如果定义了 POSEIDON_FIBER_CONTEXT_USE_UCONTEXT，或者目标平台不支持，就使用 ucontext 实现。
+#if defined(__x86_64__) && !defined(POSEIDON_FIBER_CONTEXT_USE_UCONTEXT)
+#	define POSEIDON_FIBER_CONTEXT_HAS_ASM_   1
+#endif
+
+namespace Poseidon {
+
+// 使用 ::swapcontext() 实现。glibc 在每次切换时都会调用 rt_sigprocmask。
+class UcontextFiberContext : NONCOPYABLE {
+public:
+	static const char *get_backend_name() NOEXCEPT {
+		return "ucontext";
+	}
+
+	static void swap(UcontextFiberContext &from, UcontextFiberContext &to) NOEXCEPT;
+
+private:
+	::ucontext_t m_uctx;
+
+public:
+	UcontextFiberContext() NOEXCEPT;
+
+public:
+	// 下一次切换到这个上下文时，在给定的栈上调用 proc(param)。proc 不得返回。
+	void reset(void *stack, std::size_t stack_size, void (*proc)(void *), void *param) NOEXCEPT;
+};
+
+#ifdef POSEIDON_FIBER_CONTEXT_HAS_ASM_
+// 只保存被调用者保存的寄存器、MXCSR、x87 控制字和栈指针，不进入内核。
+class AsmFiberContext : NONCOPYABLE {
+public:
+	static const char *get_backend_name() NOEXCEPT {
+		return "asm";
+	}
+
+	static void swap(AsmFiberContext &from, AsmFiberContext &to) NOEXCEPT;
+
+private:
+	void *m_sp;
+
+public:
+	AsmFiberContext() NOEXCEPT;
+
+public:
+	void reset(void *stack, std::size_t stack_size, void (*proc)(void *), void *param) NOEXCEPT;
+};
+
+typedef AsmFiberContext FiberContext;
+#else
+typedef UcontextFiberContext FiberContext;
+#endif
+
+}
+
+#endif
@@ -0,0 +1,523 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "hpack.hpp"
+#include "http2_frames.hpp"
+#include "exception.hpp"
+#include "../protocol_exception.hpp"
+#include "../log.hpp"
+#include "../profiler.hpp"
+
+namespace Poseidon {
+
+namespace Http {
+	namespace {
+		struct StaticEntry {
+			const char *name;
+			const char *value;
+		};
+
+		// RFC 7541 附录 A。
+		const StaticEntry s_static_table[61] = {
+			{ ":authority", "" },
+			{ ":method", "GET" },
+			{ ":method", "POST" },
+			{ ":path", "/" },
+			{ ":path", "/index.html" },
+			{ ":scheme", "http" },
+			{ ":scheme", "https" },
+			{ ":status", "200" },
+			{ ":status", "204" },
+			{ ":status", "206" },
+			{ ":status", "304" },
+			{ ":status", "400" },
+			{ ":status", "404" },
+			{ ":status", "500" },
+			{ "accept-charset", "" },
+			{ "accept-encoding", "gzip, deflate" },
+			{ "accept-language", "" },
+			{ "accept-ranges", "" },
+			{ "accept", "" },
+			{ "access-control-allow-origin", "" },
+			{ "age", "" },
+			{ "allow", "" },
+			{ "authorization", "" },
+			{ "cache-control", "" },
+			{ "content-disposition", "" },
+			{ "content-encoding", "" },
+			{ "content-language", "" },
+			{ "content-length", "" },
+			{ "content-location", "" },
+			{ "content-range", "" },
+			{ "content-type", "" },
+			{ "cookie", "" },
+			{ "date", "" },
+			{ "etag", "" },
+			{ "expect", "" },
+			{ "expires", "" },
+			{ "from", "" },
+			{ "host", "" },
+			{ "if-match", "" },
+			{ "if-modified-since", "" },
+			{ "if-none-match", "" },
+			{ "if-range", "" },
+			{ "if-unmodified-since", "" },
+			{ "last-modified", "" },
+			{ "link", "" },
+			{ "location", "" },
+			{ "max-forwards", "" },
+			{ "proxy-authenticate", "" },
+			{ "proxy-authorization", "" },
+			{ "range", "" },
+			{ "referer", "" },
+			{ "refresh", "" },
+			{ "retry-after", "" },
+			{ "server", "" },
+			{ "set-cookie", "" },
+			{ "strict-transport-security", "" },
+			{ "transfer-encoding", "" },
+			{ "user-agent", "" },
+			{ "vary", "" },
+			{ "via", "" },
+			{ "www-authenticate", "" },
+		};
+
+		struct HuffmanCode {
+			boost::uint32_t code;
+			unsigned bits;
+		};
+		struct HuffmanLengthInfo {
+			boost::uint32_t first_code;
+			unsigned count;
+			unsigned first_index;
+		};
+
+	// RFC 7541 附录 B。每个符号的编码和位数，最后一项是 EOS。
+	const HuffmanCode s_huffman_codes[257] = {
+		{ 0x00001FF8, 13 }, { 0x007FFFD8, 23 }, { 0x0FFFFFE2, 28 }, { 0x0FFFFFE3, 28 },
+		{ 0x0FFFFFE4, 28 }, { 0x0FFFFFE5, 28 }, { 0x0FFFFFE6, 28 }, { 0x0FFFFFE7, 28 },
+		{ 0x0FFFFFE8, 28 }, { 0x00FFFFEA, 24 }, { 0x3FFFFFFC, 30 }, { 0x0FFFFFE9, 28 },
+		{ 0x0FFFFFEA, 28 }, { 0x3FFFFFFD, 30 }, { 0x0FFFFFEB, 28 }, { 0x0FFFFFEC, 28 },
+		{ 0x0FFFFFED, 28 }, { 0x0FFFFFEE, 28 }, { 0x0FFFFFEF, 28 }, { 0x0FFFFFF0, 28 },
+		{ 0x0FFFFFF1, 28 }, { 0x0FFFFFF2, 28 }, { 0x3FFFFFFE, 30 }, { 0x0FFFFFF3, 28 },
+		{ 0x0FFFFFF4, 28 }, { 0x0FFFFFF5, 28 }, { 0x0FFFFFF6, 28 }, { 0x0FFFFFF7, 28 },
+		{ 0x0FFFFFF8, 28 }, { 0x0FFFFFF9, 28 }, { 0x0FFFFFFA, 28 }, { 0x0FFFFFFB, 28 },
+		{ 0x00000014,  6 }, { 0x000003F8, 10 }, { 0x000003F9, 10 }, { 0x00000FFA, 12 },
+		{ 0x00001FF9, 13 }, { 0x00000015,  6 }, { 0x000000F8,  8 }, { 0x000007FA, 11 },
+		{ 0x000003FA, 10 }, { 0x000003FB, 10 }, { 0x000000F9,  8 }, { 0x000007FB, 11 },
+		{ 0x000000FA,  8 }, { 0x00000016,  6 }, { 0x00000017,  6 }, { 0x00000018,  6 },
+		{ 0x00000000,  5 }, { 0x00000001,  5 }, { 0x00000002,  5 }, { 0x00000019,  6 },
+		{ 0x0000001A,  6 }, { 0x0000001B,  6 }, { 0x0000001C,  6 }, { 0x0000001D,  6 },
+		{ 0x0000001E,  6 }, { 0x0000001F,  6 }, { 0x0000005C,  7 }, { 0x000000FB,  8 },
+		{ 0x00007FFC, 15 }, { 0x00000020,  6 }, { 0x00000FFB, 12 }, { 0x000003FC, 10 },
+		{ 0x00001FFA, 13 }, { 0x00000021,  6 }, { 0x0000005D,  7 }, { 0x0000005E,  7 },
+		{ 0x0000005F,  7 }, { 0x00000060,  7 }, { 0x00000061,  7 }, { 0x00000062,  7 },
+		{ 0x00000063,  7 }, { 0x00000064,  7 }, { 0x00000065,  7 }, { 0x00000066,  7 },
+		{ 0x00000067,  7 }, { 0x00000068,  7 }, { 0x00000069,  7 }, { 0x0000006A,  7 },
+		{ 0x0000006B,  7 }, { 0x0000006C,  7 }, { 0x0000006D,  7 }, { 0x0000006E,  7 },
+		{ 0x0000006F,  7 }, { 0x00000070,  7 }, { 0x00000071,  7 }, { 0x00000072,  7 },
+		{ 0x000000FC,  8 }, { 0x00000073,  7 }, { 0x000000FD,  8 }, { 0x00001FFB, 13 },
+		{ 0x0007FFF0, 19 }, { 0x00001FFC, 13 }, { 0x00003FFC, 14 }, { 0x00000022,  6 },
+		{ 0x00007FFD, 15 }, { 0x00000003,  5 }, { 0x00000023,  6 }, { 0x00000004,  5 },
+		{ 0x00000024,  6 }, { 0x00000005,  5 }, { 0x00000025,  6 }, { 0x00000026,  6 },
+		{ 0x00000027,  6 }, { 0x00000006,  5 }, { 0x00000074,  7 }, { 0x00000075,  7 },
+		{ 0x00000028,  6 }, { 0x00000029,  6 }, { 0x0000002A,  6 }, { 0x00000007,  5 },
+		{ 0x0000002B,  6 }, { 0x00000076,  7 }, { 0x0000002C,  6 }, { 0x00000008,  5 },
+		{ 0x00000009,  5 }, { 0x0000002D,  6 }, { 0x00000077,  7 }, { 0x00000078,  7 },
+		{ 0x00000079,  7 }, { 0x0000007A,  7 }, { 0x0000007B,  7 }, { 0x00007FFE, 15 },
+		{ 0x000007FC, 11 }, { 0x00003FFD, 14 }, { 0x00001FFD, 13 }, { 0x0FFFFFFC, 28 },
+		{ 0x000FFFE6, 20 }, { 0x003FFFD2, 22 }, { 0x000FFFE7, 20 }, { 0x000FFFE8, 20 },
+		{ 0x003FFFD3, 22 }, { 0x003FFFD4, 22 }, { 0x003FFFD5, 22 }, { 0x007FFFD9, 23 },
+		{ 0x003FFFD6, 22 }, { 0x007FFFDA, 23 }, { 0x007FFFDB, 23 }, { 0x007FFFDC, 23 },
+		{ 0x007FFFDD, 23 }, { 0x007FFFDE, 23 }, { 0x00FFFFEB, 24 }, { 0x007FFFDF, 23 },
+		{ 0x00FFFFEC, 24 }, { 0x00FFFFED, 24 }, { 0x003FFFD7, 22 }, { 0x007FFFE0, 23 },
+		{ 0x00FFFFEE, 24 }, { 0x007FFFE1, 23 }, { 0x007FFFE2, 23 }, { 0x007FFFE3, 23 },
+		{ 0x007FFFE4, 23 }, { 0x001FFFDC, 21 }, { 0x003FFFD8, 22 }, { 0x007FFFE5, 23 },
+		{ 0x003FFFD9, 22 }, { 0x007FFFE6, 23 }, { 0x007FFFE7, 23 }, { 0x00FFFFEF, 24 },
+		{ 0x003FFFDA, 22 }, { 0x001FFFDD, 21 }, { 0x000FFFE9, 20 }, { 0x003FFFDB, 22 },
+		{ 0x003FFFDC, 22 }, { 0x007FFFE8, 23 }, { 0x007FFFE9, 23 }, { 0x001FFFDE, 21 },
+		{ 0x007FFFEA, 23 }, { 0x003FFFDD, 22 }, { 0x003FFFDE, 22 }, { 0x00FFFFF0, 24 },
+		{ 0x001FFFDF, 21 }, { 0x003FFFDF, 22 }, { 0x007FFFEB, 23 }, { 0x007FFFEC, 23 },
+		{ 0x001FFFE0, 21 }, { 0x001FFFE1, 21 }, { 0x003FFFE0, 22 }, { 0x001FFFE2, 21 },
+		{ 0x007FFFED, 23 }, { 0x003FFFE1, 22 }, { 0x007FFFEE, 23 }, { 0x007FFFEF, 23 },
+		{ 0x000FFFEA, 20 }, { 0x003FFFE2, 22 }, { 0x003FFFE3, 22 }, { 0x003FFFE4, 22 },
+		{ 0x007FFFF0, 23 }, { 0x003FFFE5, 22 }, { 0x003FFFE6, 22 }, { 0x007FFFF1, 23 },
+		{ 0x03FFFFE0, 26 }, { 0x03FFFFE1, 26 }, { 0x000FFFEB, 20 }, { 0x0007FFF1, 19 },
+		{ 0x003FFFE7, 22 }, { 0x007FFFF2, 23 }, { 0x003FFFE8, 22 }, { 0x01FFFFEC, 25 },
+		{ 0x03FFFFE2, 26 }, { 0x03FFFFE3, 26 }, { 0x03FFFFE4, 26 }, { 0x07FFFFDE, 27 },
+		{ 0x07FFFFDF, 27 }, { 0x03FFFFE5, 26 }, { 0x00FFFFF1, 24 }, { 0x01FFFFED, 25 },
+		{ 0x0007FFF2, 19 }, { 0x001FFFE3, 21 }, { 0x03FFFFE6, 26 }, { 0x07FFFFE0, 27 },
+		{ 0x07FFFFE1, 27 }, { 0x03FFFFE7, 26 }, { 0x07FFFFE2, 27 }, { 0x00FFFFF2, 24 },
+		{ 0x001FFFE4, 21 }, { 0x001FFFE5, 21 }, { 0x03FFFFE8, 26 }, { 0x03FFFFE9, 26 },
+		{ 0x0FFFFFFD, 28 }, { 0x07FFFFE3, 27 }, { 0x07FFFFE4, 27 }, { 0x07FFFFE5, 27 },
+		{ 0x000FFFEC, 20 }, { 0x00FFFFF3, 24 }, { 0x000FFFED, 20 }, { 0x001FFFE6, 21 },
+		{ 0x003FFFE9, 22 }, { 0x001FFFE7, 21 }, { 0x001FFFE8, 21 }, { 0x007FFFF3, 23 },
+		{ 0x003FFFEA, 22 }, { 0x003FFFEB, 22 }, { 0x01FFFFEE, 25 }, { 0x01FFFFEF, 25 },
+		{ 0x00FFFFF4, 24 }, { 0x00FFFFF5, 24 }, { 0x03FFFFEA, 26 }, { 0x007FFFF4, 23 },
+		{ 0x03FFFFEB, 26 }, { 0x07FFFFE6, 27 }, { 0x03FFFFEC, 26 }, { 0x03FFFFED, 26 },
+		{ 0x07FFFFE7, 27 }, { 0x07FFFFE8, 27 }, { 0x07FFFFE9, 27 }, { 0x07FFFFEA, 27 },
+		{ 0x07FFFFEB, 27 }, { 0x0FFFFFFE, 28 }, { 0x07FFFFEC, 27 }, { 0x07FFFFED, 27 },
+		{ 0x07FFFFEE, 27 }, { 0x07FFFFEF, 27 }, { 0x07FFFFF0, 27 }, { 0x03FFFFEE, 26 },
+		{ 0x3FFFFFFF, 30 },
+	};
+	// 按照编码排序的符号。编码是规范的，同一长度的编码是连续的。
+	const boost::uint16_t s_huffman_symbols[257] = {
+		 48,  49,  50,  97,  99, 101, 105, 111, 115, 116,  32,  37,  45,  46,  47,  51,
+		 52,  53,  54,  55,  56,  57,  61,  65,  95,  98, 100, 102, 103, 104, 108, 109,
+		110, 112, 114, 117,  58,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,
+		 77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  89, 106, 107, 113, 118,
+		119, 120, 121, 122,  38,  42,  44,  59,  88,  90,  33,  34,  40,  41,  63,  39,
+		 43, 124,  35,  62,   0,  36,  64,  91,  93, 126,  94, 125,  60,  96, 123,  92,
+		195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+		179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+		163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+		233,   1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+		158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239,   9, 142,
+		144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+		200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+		212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+		  2,   3,   4,   5,   6,   7,   8,  11,  12,  14,  15,  16,  17,  18,  19,  20,
+		 21,  23,  24,  25,  26,  27,  28,  29,  30,  31, 127, 220, 249,  10,  13,  22,
+		256,
+	};
+	// 按照位数索引：该长度的第一个编码，编码的个数，以及第一个编码在 s_huffman_symbols 中的位置。
+	const HuffmanLengthInfo s_huffman_lengths[31] = {
+		{ 0x00000000,  0,   0 }, { 0x00000000,  0,   0 }, { 0x00000000,  0,   0 },
+		{ 0x00000000,  0,   0 }, { 0x00000000,  0,   0 }, { 0x00000000, 10,   0 },
+		{ 0x00000014, 26,  10 }, { 0x0000005C, 32,  36 }, { 0x000000F8,  6,  68 },
+		{ 0x00000000,  0,   0 }, { 0x000003F8,  5,  74 }, { 0x000007FA,  3,  79 },
+		{ 0x00000FFA,  2,  82 }, { 0x00001FF8,  6,  84 }, { 0x00003FFC,  2,  90 },
+		{ 0x00007FFC,  3,  92 }, { 0x00000000,  0,   0 }, { 0x00000000,  0,   0 },
+		{ 0x00000000,  0,   0 }, { 0x0007FFF0,  3,  95 }, { 0x000FFFE6,  8,  98 },
+		{ 0x001FFFDC, 13, 106 }, { 0x003FFFD2, 26, 119 }, { 0x007FFFD8, 29, 145 },
+		{ 0x00FFFFEA, 12, 174 }, { 0x01FFFFEC,  4, 186 }, { 0x03FFFFE0, 15, 190 },
+		{ 0x07FFFFDE, 19, 205 }, { 0x0FFFFFE2, 29, 224 }, { 0x00000000,  0,   0 },
+		{ 0x3FFFFFFC,  4, 253 },
+	};
+		const unsigned EOS_SYMBOL = 256;
+
+		std::size_t get_entry_size(const std::string &name, const std::string &value){
+			return name.size() + value.size() + 32;
+		}
+
+		// 以下函数中 ptr 和 end 指向报头块中未解码的部分。
+		boost::uint64_t decode_integer(const unsigned char *&ptr, const unsigned char *end, unsigned prefix_bits){
+			if(ptr == end){
+				DEBUG_THROW(ProtocolException, sslit("HPACK integer truncated"), H2E_COMPRESSION_ERROR);
+			}
+			const unsigned mask = (1u << prefix_bits) - 1;
+			boost::uint64_t value = *(ptr++) & mask;
+			if(value < mask){
+				return value;
+			}
+			unsigned shift = 0;
+			for(;;){
+				if(ptr == end){
+					DEBUG_THROW(ProtocolException, sslit("HPACK integer truncated"), H2E_COMPRESSION_ERROR);
+				}
+				if(shift > 28){
+					DEBUG_THROW(ProtocolException, sslit("HPACK integer overflow"), H2E_COMPRESSION_ERROR);
+				}
+				const unsigned byte = *(ptr++);
+				value += static_cast<boost::uint64_t>(byte & 0x7F) << shift;
+				shift += 7;
+				if(!(byte & 0x80)){
+					break;
+				}
+			}
+			return value;
+		}
+		void encode_integer(StreamBuffer &dst, unsigned first_byte, unsigned prefix_bits, boost::uint64_t value){
+			const unsigned mask = (1u << prefix_bits) - 1;
+			if(value < mask){
+				dst.put(static_cast<unsigned char>(first_byte | value));
+				return;
+			}
+			dst.put(static_cast<unsigned char>(first_byte | mask));
+			value -= mask;
+			while(value >= 0x80){
+				dst.put(static_cast<unsigned char>((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			dst.put(static_cast<unsigned char>(value));
+		}
+
+		bool huffman_decode(std::string &dst, const unsigned char *src, std::size_t size){
+			boost::uint32_t code = 0;
+			unsigned bits = 0;
+			for(std::size_t i = 0; i < size; ++i){
+				for(unsigned j = 8; j > 0; --j){
+					code = (code << 1) | ((src[i] >> (j - 1)) & 1u);
+					++bits;
+					if(bits > 30){
+						return false;
+					}
+					const AUTO_REF(info, s_huffman_lengths[bits]);
+					if(code - info.first_code >= info.count){
+						continue;
+					}
+					const unsigned sym = s_huffman_symbols[info.first_index + (code - info.first_code)];
+					if(sym == EOS_SYMBOL){
+						return false;
+					}
+					dst.push_back(static_cast<char>(sym));
+					code = 0;
+					bits = 0;
+				}
+			}
+			// 末尾的填充必须是 EOS 的前缀，即全为 1，并且短于 8 位。
+			return (bits < 8) && (code == (1u << bits) - 1);
+		}
+		std::size_t get_huffman_encoded_size(const std::string &src){
+			boost::uint64_t bits = 0;
+			for(std::size_t i = 0; i < src.size(); ++i){
+				bits += s_huffman_codes[static_cast<unsigned char>(src[i])].bits;
+			}
+			return static_cast<std::size_t>((bits + 7) / 8);
+		}
+		void huffman_encode(StreamBuffer &dst, const std::string &src){
+			boost::uint64_t acc = 0;
+			unsigned bits = 0;
+			for(std::size_t i = 0; i < src.size(); ++i){
+				const AUTO_REF(hc, s_huffman_codes[static_cast<unsigned char>(src[i])]);
+				acc = (acc << hc.bits) | hc.code;
+				bits += hc.bits;
+				while(bits >= 8){
+					bits -= 8;
+					dst.put(static_cast<unsigned char>(acc >> bits));
+				}
+			}
+			if(bits > 0){
+				// 用 EOS 的高位填充。
+				dst.put(static_cast<unsigned char>((acc << (8 - bits)) | (0xFFu >> bits)));
+			}
+		}
+
+		std::string decode_string(const unsigned char *&ptr, const unsigned char *end){
+			if(ptr == end){
+				DEBUG_THROW(ProtocolException, sslit("HPACK string truncated"), H2E_COMPRESSION_ERROR);
+			}
+			const bool huffman = (*ptr & 0x80) != 0;
+			const AUTO(length, decode_integer(ptr, end, 7));
+			if(length > static_cast<boost::uint64_t>(end - ptr)){
+				DEBUG_THROW(ProtocolException, sslit("HPACK string truncated"), H2E_COMPRESSION_ERROR);
+			}
+			std::string str;
+			if(huffman){
+				str.reserve(static_cast<std::size_t>(length) * 8 / 5);
+				if(!huffman_decode(str, ptr, static_cast<std::size_t>(length))){
+					DEBUG_THROW(ProtocolException, sslit("Invalid HPACK Huffman string"), H2E_COMPRESSION_ERROR);
+				}
+			} else {
+				str.assign(reinterpret_cast<const char *>(ptr), static_cast<std::size_t>(length));
+			}
+			ptr += length;
+			return str;
+		}
+		void encode_string(StreamBuffer &dst, const std::string &str){
+			const AUTO(huffman_size, get_huffman_encoded_size(str));
+			if(huffman_size < str.size()){
+				encode_integer(dst, 0x80, 7, huffman_size);
+				huffman_encode(dst, str);
+			} else {
+				encode_integer(dst, 0x00, 7, str.size());
+				dst.put(str);
+			}
+		}
+	}
+
+	HpackDynamicTable::HpackDynamicTable(std::size_t max_size)
+		: m_entries(), m_size(0), m_max_size(max_size)
+	{ }
+
+	void HpackDynamicTable::evict(std::size_t max_size){
+		while(m_size > max_size){
+			const AUTO_REF(back, m_entries.back());
+			m_size -= get_entry_size(back.first, back.second);
+			m_entries.pop_back();
+		}
+	}
+
+	void HpackDynamicTable::set_max_size(std::size_t max_size){
+		evict(max_size);
+		m_max_size = max_size;
+	}
+
+	bool HpackDynamicTable::find(HpackHeader &header, std::size_t index) const {
+		if(index == 0){
+			return false;
+		}
+		if(index <= COUNT_OF(s_static_table)){
+			header.first = s_static_table[index - 1].name;
+			header.second = s_static_table[index - 1].value;
+			return true;
+		}
+		index -= COUNT_OF(s_static_table) + 1;
+		if(index >= m_entries.size()){
+			return false;
+		}
+		header = m_entries[index];
+		return true;
+	}
+	void HpackDynamicTable::insert(HpackHeader header){
+		const AUTO(entry_size, get_entry_size(header.first, header.second));
+		if(entry_size > m_max_size){
+			// 比整个表还大的项使表被清空，但是不会被加入。
+			evict(0);
+			return;
+		}
+		evict(m_max_size - entry_size);
+		m_entries.push_front(STD_MOVE(header));
+		m_size += entry_size;
+	}
+
+	std::size_t HpackDynamicTable::search(bool *value_matched, const std::string &name, const std::string &value) const {
+		std::size_t name_index = 0;
+		for(std::size_t i = 0; i < COUNT_OF(s_static_table); ++i){
+			if(name != s_static_table[i].name){
+				continue;
+			}
+			if(value == s_static_table[i].value){
+				*value_matched = true;
+				return i + 1;
+			}
+			if(name_index == 0){
+				name_index = i + 1;
+			}
+		}
+		for(std::size_t i = 0; i < m_entries.size(); ++i){
+			const AUTO_REF(entry, m_entries[i]);
+			if(entry.first != name){
+				continue;
+			}
+			if(entry.second == value){
+				*value_matched = true;
+				return COUNT_OF(s_static_table) + 1 + i;
+			}
+			if(name_index == 0){
+				name_index = COUNT_OF(s_static_table) + 1 + i;
+			}
+		}
+		*value_matched = false;
+		return name_index;
+	}
+
+	HpackDecoder::HpackDecoder(std::size_t table_size_limit, std::size_t max_header_list_size)
+		: m_table(table_size_limit), m_table_size_limit(table_size_limit), m_max_header_list_size(max_header_list_size)
+	{ }
+	HpackDecoder::~HpackDecoder(){ }
+
+	void HpackDecoder::decode(std::vector<HpackHeader> &headers, const StreamBuffer &block){
+		PROFILE_ME;
+
+		const AUTO(bytes, block.dump_byte_string());
+		const unsigned char *ptr = bytes.data();
+		const unsigned char *const end = ptr + bytes.size();
+
+		std::size_t list_size = 0;
+		bool size_update_allowed = true;
+		while(ptr != end){
+			const unsigned first = *ptr;
+			HpackHeader header;
+			bool add_to_table = false;
+			if(first & 0x80){
+				// 6.1 Indexed Header Field
+				const AUTO(index, decode_integer(ptr, end, 7));
+				if(!m_table.find(header, static_cast<std::size_t>(index))){
+					LOG_POSEIDON_WARNING("Invalid HPACK index: ", index);
+					DEBUG_THROW(ProtocolException, sslit("Invalid HPACK index"), H2E_COMPRESSION_ERROR);
+				}
+			} else if((first & 0xE0) == 0x20){
+				// 6.3 Dynamic Table Size Update
+				if(!size_update_allowed){
+					DEBUG_THROW(ProtocolException, sslit("HPACK table size update after header fields"), H2E_COMPRESSION_ERROR);
+				}
+				const AUTO(max_size, decode_integer(ptr, end, 5));
+				if(max_size > m_table_size_limit){
+					LOG_POSEIDON_WARNING("HPACK table size update exceeds limit: max_size = ", max_size);
+					DEBUG_THROW(ProtocolException, sslit("HPACK table size update exceeds limit"), H2E_COMPRESSION_ERROR);
+				}
+				m_table.set_max_size(static_cast<std::size_t>(max_size));
+				continue;
+			} else {
+				// 6.2 Literal Header Field，分别是 with Incremental Indexing、without Indexing 和 Never Indexed。
+				unsigned prefix_bits;
+				if(first & 0x40){
+					prefix_bits = 6;
+					add_to_table = true;
+				} else {
+					prefix_bits = 4;
+				}
+				const AUTO(index, decode_integer(ptr, end, prefix_bits));
+				if(index != 0){
+					if(!m_table.find(header, static_cast<std::size_t>(index))){
+						LOG_POSEIDON_WARNING("Invalid HPACK index: ", index);
+						DEBUG_THROW(ProtocolException, sslit("Invalid HPACK index"), H2E_COMPRESSION_ERROR);
+					}
+				} else {
+					header.first = decode_string(ptr, end);
+				}
+				header.second = decode_string(ptr, end);
+			}
+			size_update_allowed = false;
+
+			list_size += get_entry_size(header.first, header.second);
+			if(add_to_table){
+				m_table.insert(header);
+			}
+			// 超过大小的报头仍然需要解码，否则动态表的状态会与对方不一致。
+			if(list_size <= m_max_header_list_size){
+				headers.push_back(STD_MOVE(header));
+			}
+		}
+		if(list_size > m_max_header_list_size){
+			LOG_POSEIDON_WARNING("HTTP/2 header list is too large: list_size = ", list_size);
+			DEBUG_THROW(Exception, ST_BAD_REQUEST);
+		}
+	}
+
+	HpackEncoder::HpackEncoder(std::size_t max_table_size)
+		: m_table(max_table_size), m_table_size_changed(false)
+	{ }
+	HpackEncoder::~HpackEncoder(){ }
+
+	void HpackEncoder::set_max_table_size(std::size_t max_table_size){
+		m_table.set_max_size(max_table_size);
+		m_table_size_changed = true;
+	}
+
+	void HpackEncoder::encode(StreamBuffer &block, const std::string &name, const std::string &value, bool sensitive){
+		PROFILE_ME;
+
+		if(m_table_size_changed){
+			encode_integer(block, 0x20, 5, m_table.get_max_size());
+			m_table_size_changed = false;
+		}
+
+		bool value_matched;
+		const AUTO(index, m_table.search(&value_matched, name, value));
+		if(value_matched && !sensitive){
+			encode_integer(block, 0x80, 7, index);
+			return;
+		}
+		// 很大的项会把其他项挤出动态表，不值得索引。
+		const bool add_to_table = !sensitive && (get_entry_size(name, value) <= m_table.get_max_size() / 2);
+		if(add_to_table){
+			encode_integer(block, 0x40, 6, index);
+		} else if(sensitive){
+			encode_integer(block, 0x10, 4, index);
+		} else {
+			encode_integer(block, 0x00, 4, index);
+		}
+		if(index == 0){
+			encode_string(block, name);
+		}
+		encode_string(block, value);
+		if(add_to_table){
+			m_table.insert(HpackHeader(name, value));
+		}
+	}
+}
+
+}
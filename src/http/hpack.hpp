@@ -0,0 +1,88 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_HTTP_HPACK_HPP_
+#define POSEIDON_HTTP_HPACK_HPP_
+
+#include "../cxx_ver.hpp"
+#include "../cxx_util.hpp"
+#include "../stream_buffer.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <cstddef>
+
+namespace Poseidon {
+
+namespace Http {
+	// RFC 7541 的报头压缩。名字总是小写的。
+	typedef std::pair<std::string, std::string> HpackHeader;
+
+	class HpackDynamicTable {
+	private:
+		std::deque<HpackHeader> m_entries; // 最新的在前面。
+		std::size_t m_size;
+		std::size_t m_max_size;
+
+	public:
+		explicit HpackDynamicTable(std::size_t max_size);
+
+	private:
+		void evict(std::size_t max_size);
+
+	public:
+		std::size_t get_size() const {
+			return m_size;
+		}
+		std::size_t get_max_size() const {
+			return m_max_size;
+		}
+		void set_max_size(std::size_t max_size);
+
+		// 索引从 1 开始，包含静态表。返回 false 表示索引无效。
+		bool find(HpackHeader &header, std::size_t index) const;
+		void insert(HpackHeader header);
+
+		// 返回 0 表示没有找到。如果只有名字相同，*value_matched 被置为 false。
+		std::size_t search(bool *value_matched, const std::string &name, const std::string &value) const;
+	};
+
+	// 接收方向，每个连接一个。调用者负责同步。
+	class HpackDecoder : NONCOPYABLE {
+	private:
+		HpackDynamicTable m_table;
+		const std::size_t m_table_size_limit;   // 我们在 SETTINGS_HEADER_TABLE_SIZE 中通告的大小。
+		const std::size_t m_max_header_list_size;
+
+	public:
+		HpackDecoder(std::size_t table_size_limit, std::size_t max_header_list_size);
+		~HpackDecoder();
+
+	public:
+		// 解码一个完整的报头块。格式错误时抛出 ProtocolException，这是连接错误，解码器不能再使用。
+		void decode(std::vector<HpackHeader> &headers, const StreamBuffer &block);
+	};
+
+	// 发送方向，每个连接一个。调用者负责同步。
+	class HpackEncoder : NONCOPYABLE {
+	private:
+		HpackDynamicTable m_table;
+		bool m_table_size_changed;
+
+	public:
+		explicit HpackEncoder(std::size_t max_table_size = 4096);
+		~HpackEncoder();
+
+	public:
+		// 对方的 SETTINGS_HEADER_TABLE_SIZE 改变之后调用。下一个报头块的开头会包含大小更新。
+		void set_max_table_size(std::size_t max_table_size);
+
+		// 名字必须是小写的。sensitive 为 true 时（例如 Set-Cookie）不加入动态表，中间代理也不应当索引它。
+		void encode(StreamBuffer &block, const std::string &name, const std::string &value, bool sensitive = false);
+	};
+}
+
+}
+
+#endif
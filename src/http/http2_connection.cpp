@@ -0,0 +1,978 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "http2_connection.hpp"
+#include "exception.hpp"
+#include "urlencoded.hpp"
+#include "../protocol_exception.hpp"
+#include "../log.hpp"
+#include "../profiler.hpp"
+#include "../buffer_streams.hpp"
+
+namespace Poseidon {
+
+namespace Http {
+	namespace Http2Frames {
+		const char CONNECTION_PREFACE[24] = { 'P', 'R', 'I', ' ', '*', ' ', 'H', 'T', 'T', 'P', '/', '2', '.', '0', '\r', '\n', '\r', '\n', 'S', 'M', '\r', '\n', '\r', '\n' };
+	}
+
+	namespace {
+		enum {
+			DEFAULT_WEIGHT          = 16,
+			NO_CONTENT_LENGTH       = -1,
+		};
+
+		boost::uint32_t load_be24(const unsigned char *ptr){
+			return (static_cast<boost::uint32_t>(ptr[0]) << 16) | (static_cast<boost::uint32_t>(ptr[1]) << 8) | ptr[2];
+		}
+		boost::uint32_t load_be32(const unsigned char *ptr){
+			return (static_cast<boost::uint32_t>(ptr[0]) << 24) | (static_cast<boost::uint32_t>(ptr[1]) << 16)
+				| (static_cast<boost::uint32_t>(ptr[2]) << 8) | ptr[3];
+		}
+		void put_be32(StreamBuffer &data, boost::uint32_t val){
+			data.put(static_cast<unsigned char>(val >> 24));
+			data.put(static_cast<unsigned char>(val >> 16));
+			data.put(static_cast<unsigned char>(val >> 8));
+			data.put(static_cast<unsigned char>(val));
+		}
+
+		void put_setting(StreamBuffer &data, unsigned id, boost::uint32_t value){
+			data.put(static_cast<unsigned char>(id >> 8));
+			data.put(static_cast<unsigned char>(id));
+			put_be32(data, value);
+		}
+
+		// HTTP/2 禁止的逐跳报头。
+		bool is_connection_specific(const char *name){
+			return (::strcasecmp(name, "Connection") == 0) || (::strcasecmp(name, "Keep-Alive") == 0)
+				|| (::strcasecmp(name, "Proxy-Connection") == 0) || (::strcasecmp(name, "Transfer-Encoding") == 0)
+				|| (::strcasecmp(name, "Upgrade") == 0);
+		}
+
+		// 处理函数按照 HTTP/1.1 的习惯查找报头（例如 Content-Type），而 HTTP/2 的名字总是小写的。
+		std::string canonicalize_header_name(const std::string &name){
+			std::string ret(name);
+			bool word_begin = true;
+			for(AUTO(it, ret.begin()); it != ret.end(); ++it){
+				if(word_begin && ('a' <= *it) && (*it <= 'z')){
+					*it = static_cast<char>(*it - 'a' + 'A');
+				}
+				word_begin = (*it == '-');
+			}
+			return ret;
+		}
+		std::string lowercase_header_name(const char *name){
+			std::string ret(name);
+			for(AUTO(it, ret.begin()); it != ret.end(); ++it){
+				if(('A' <= *it) && (*it <= 'Z')){
+					*it = static_cast<char>(*it - 'A' + 'a');
+				}
+			}
+			return ret;
+		}
+		bool is_lowercase_header_name(const std::string &name){
+			for(AUTO(it, name.begin()); it != name.end(); ++it){
+				if(('A' <= *it) && (*it <= 'Z')){
+					return false;
+				}
+			}
+			return !name.empty();
+		}
+	}
+
+	Http2Connection::Http2Connection(std::size_t max_concurrent_streams, boost::uint32_t initial_window_size, std::size_t max_header_list_size)
+		: m_max_concurrent_streams(max_concurrent_streams)
+		, m_initial_window_size(std::min<boost::uint32_t>(initial_window_size, MAX_WINDOW_SIZE))
+		, m_max_header_list_size(max_header_list_size)
+		, m_input_state(IS_PREFACE), m_queue()
+		, m_decoder(4096, max_header_list_size), m_encoder(4096)
+		, m_peer_initial_window_size(DEFAULT_WINDOW_SIZE), m_peer_max_frame_size(DEFAULT_MAX_FRAME_SIZE)
+		, m_streams(), m_last_stream_id(0), m_virtual_clock(0)
+		, m_continuation_stream_id(0), m_continuation_end_stream(false), m_header_block()
+		, m_send_window(DEFAULT_WINDOW_SIZE), m_recv_window(DEFAULT_WINDOW_SIZE)
+		, m_settings_acked(false), m_goaway_sent(false)
+	{ }
+	Http2Connection::~Http2Connection(){
+		if(!m_streams.empty()){
+			LOG_POSEIDON_DEBUG("Now that this HTTP/2 connection is to be destroyed, ", m_streams.size(), " stream(s) are discarded.");
+		}
+	}
+
+	void Http2Connection::put_frame_header(StreamBuffer &data, std::size_t length, Http2FrameType type, unsigned flags, boost::uint32_t stream_id){
+		data.put(static_cast<unsigned char>(length >> 16));
+		data.put(static_cast<unsigned char>(length >> 8));
+		data.put(static_cast<unsigned char>(length));
+		data.put(static_cast<unsigned char>(type));
+		data.put(static_cast<unsigned char>(flags));
+		put_be32(data, stream_id & 0x7FFFFFFFu);
+	}
+
+	void Http2Connection::put_settings(StreamBuffer &data){
+		put_frame_header(data, 4 * 6, FT_SETTINGS, 0, 0);
+		put_setting(data, SET_ENABLE_PUSH, 0);
+		put_setting(data, SET_MAX_CONCURRENT_STREAMS, static_cast<boost::uint32_t>(std::min<std::size_t>(m_max_concurrent_streams, 0x7FFFFFFF)));
+		put_setting(data, SET_INITIAL_WINDOW_SIZE, m_initial_window_size);
+		put_setting(data, SET_MAX_HEADER_LIST_SIZE, static_cast<boost::uint32_t>(std::min<std::size_t>(m_max_header_list_size, 0x7FFFFFFF)));
+		// 连接的接收窗口不受 SETTINGS 影响，只能通过 WINDOW_UPDATE 扩大。
+		if(m_initial_window_size > DEFAULT_WINDOW_SIZE){
+			put_frame_header(data, 4, FT_WINDOW_UPDATE, 0, 0);
+			put_be32(data, m_initial_window_size - DEFAULT_WINDOW_SIZE);
+			m_recv_window = m_initial_window_size;
+		}
+	}
+	void Http2Connection::put_rst_stream(StreamBuffer &data, boost::uint32_t stream_id, Http2ErrorCode error_code){
+		put_frame_header(data, 4, FT_RST_STREAM, 0, stream_id);
+		put_be32(data, error_code);
+	}
+	void Http2Connection::put_window_update(StreamBuffer &data, boost::uint32_t stream_id, boost::int64_t &window){
+		// 按照对方实际被允许发送的窗口补充。流的窗口在 SETTINGS 被确认之后才改变，连接的窗口不受 SETTINGS 影响。
+		boost::int64_t target;
+		if(stream_id == 0){
+			target = std::max<boost::int64_t>(m_initial_window_size, DEFAULT_WINDOW_SIZE);
+		} else if(m_settings_acked){
+			target = m_initial_window_size;
+		} else {
+			target = DEFAULT_WINDOW_SIZE;
+		}
+		// 消耗超过一半之后再补充，以免每个 DATA 帧都回复一个 WINDOW_UPDATE。
+		if(window >= target / 2){
+			return;
+		}
+		put_frame_header(data, 4, FT_WINDOW_UPDATE, 0, stream_id);
+		put_be32(data, static_cast<boost::uint32_t>(target - window));
+		window = target;
+	}
+	void Http2Connection::put_header_block(StreamBuffer &data, boost::uint32_t stream_id, StreamBuffer block, bool end_stream){
+		// 超过对方允许的帧长度的报头块拆分成 CONTINUATION 帧，中间不能插入其他帧。
+		Http2FrameType type = FT_HEADERS;
+		unsigned flags = end_stream ? static_cast<unsigned>(FF_END_STREAM) : 0u;
+		do {
+			const AUTO(size, std::min<std::size_t>(block.size(), m_peer_max_frame_size));
+			if(size == block.size()){
+				flags |= FF_END_HEADERS;
+			}
+			put_frame_header(data, size, type, flags, stream_id);
+			AUTO(payload, block.cut_off(size));
+			data.splice(payload);
+			type = FT_CONTINUATION;
+			flags = 0;
+		} while(!block.empty());
+	}
+	void Http2Connection::put_headers(StreamBuffer &data, boost::uint32_t stream_id, const ResponseHeaders &response_headers, bool end_stream){
+		StreamBuffer block;
+		char temp[16];
+		const unsigned len = (unsigned)std::sprintf(temp, "%u", static_cast<unsigned>(response_headers.status_code));
+		m_encoder.encode(block, ":status", std::string(temp, len));
+		const AUTO_REF(headers, response_headers.headers);
+		for(AUTO(it, headers.begin()); it != headers.end(); ++it){
+			if(is_connection_specific(it->first.get())){
+				continue;
+			}
+			const AUTO(name, lowercase_header_name(it->first.get()));
+			m_encoder.encode(block, name, it->second, (name == "set-cookie") || (name == "authorization"));
+		}
+		put_header_block(data, stream_id, STD_MOVE(block), end_stream);
+	}
+	void Http2Connection::put_trailer(StreamBuffer &data, boost::uint32_t stream_id, const OptionalMap &headers){
+		StreamBuffer block;
+		for(AUTO(it, headers.begin()); it != headers.end(); ++it){
+			if(is_connection_specific(it->first.get())){
+				continue;
+			}
+			m_encoder.encode(block, lowercase_header_name(it->first.get()), it->second);
+		}
+		put_header_block(data, stream_id, STD_MOVE(block), true);
+	}
+	void Http2Connection::put_error_response(StreamBuffer &data, boost::uint32_t stream_id, StatusCode status_code){
+		const AUTO(it, m_streams.find(stream_id));
+		if((it == m_streams.end()) || it->second.response_started){
+			return;
+		}
+		it->second.response_started = true;
+		it->second.response_ended = true;
+
+		ResponseHeaders response_headers;
+		response_headers.version = 20000;
+		response_headers.status_code = status_code;
+		response_headers.headers.set(sslit("Content-Length"), "0");
+		put_headers(data, stream_id, response_headers, true);
+		// 请求还没有接收完，对方不需要再发送了。
+		if(!it->second.request_complete){
+			put_rst_stream(data, stream_id, H2E_NO_ERROR);
+		}
+		close_stream(stream_id);
+	}
+	void Http2Connection::stream_error(StreamBuffer &data, boost::uint32_t stream_id, Http2ErrorCode error_code){
+		LOG_POSEIDON_DEBUG("HTTP/2 stream error: stream_id = ", stream_id, ", error_code = ", error_code);
+		put_rst_stream(data, stream_id, error_code);
+		close_stream(stream_id);
+	}
+
+	void Http2Connection::on_frame(StreamBuffer &data, Http2FrameType type, unsigned flags, boost::uint32_t stream_id, StreamBuffer payload){
+		PROFILE_ME;
+		LOG_POSEIDON_TRACE("Received HTTP/2 frame: type = ", type, ", flags = ", flags, ", stream_id = ", stream_id, ", length = ", payload.size());
+
+		if((m_continuation_stream_id != 0) && ((type != FT_CONTINUATION) || (stream_id != m_continuation_stream_id))){
+			DEBUG_THROW(ProtocolException, sslit("Expecting CONTINUATION"), H2E_PROTOCOL_ERROR);
+		}
+
+		unsigned char temp[8];
+		switch(type){
+		case FT_DATA: {
+			if(stream_id == 0){
+				DEBUG_THROW(ProtocolException, sslit("DATA on stream 0"), H2E_PROTOCOL_ERROR);
+			}
+			const AUTO(frame_size, static_cast<boost::int64_t>(payload.size()));
+			m_recv_window -= frame_size;
+			if(m_recv_window < 0){
+				DEBUG_THROW(ProtocolException, sslit("Connection flow control window exceeded"), H2E_FLOW_CONTROL_ERROR);
+			}
+			put_window_update(data, 0, m_recv_window);
+			if(flags & FF_PADDED){
+				const int pad_length = payload.get();
+				if((pad_length < 0) || (static_cast<std::size_t>(pad_length) > payload.size())){
+					DEBUG_THROW(ProtocolException, sslit("Invalid padding"), H2E_PROTOCOL_ERROR);
+				}
+				payload = payload.cut_off(payload.size() - static_cast<std::size_t>(pad_length));
+			}
+			const AUTO(it, m_streams.find(stream_id));
+			if(it == m_streams.end()){
+				if(stream_id > m_last_stream_id){
+					DEBUG_THROW(ProtocolException, sslit("DATA on idle stream"), H2E_PROTOCOL_ERROR);
+				}
+				// 被我们重置的流，对方可能还没有收到 RST_STREAM。
+				break;
+			}
+			AUTO_REF(stream, it->second);
+			if(!stream.headers_received || stream.request_complete){
+				stream_error(data, stream_id, H2E_STREAM_CLOSED);
+				break;
+			}
+			stream.recv_window -= frame_size;
+			if(stream.recv_window < 0){
+				stream_error(data, stream_id, H2E_FLOW_CONTROL_ERROR);
+				break;
+			}
+			if(stream.entity.size() + payload.size() > get_max_request_length()){
+				LOG_POSEIDON_WARNING("HTTP/2 request entity too large: stream_id = ", stream_id);
+				put_error_response(data, stream_id, ST_PAYLOAD_TOO_LARGE);
+				break;
+			}
+			stream.entity.splice(payload);
+			if(flags & FF_END_STREAM){
+				on_request_complete(data, stream_id);
+				break;
+			}
+			put_window_update(data, stream_id, stream.recv_window);
+			break; }
+
+		case FT_HEADERS: {
+			if((stream_id == 0) || (stream_id % 2 == 0)){
+				DEBUG_THROW(ProtocolException, sslit("HEADERS on invalid stream"), H2E_PROTOCOL_ERROR);
+			}
+			if(flags & FF_PADDED){
+				const int pad_length = payload.get();
+				if((pad_length < 0) || (static_cast<std::size_t>(pad_length) > payload.size())){
+					DEBUG_THROW(ProtocolException, sslit("Invalid padding"), H2E_PROTOCOL_ERROR);
+				}
+				payload = payload.cut_off(payload.size() - static_cast<std::size_t>(pad_length));
+			}
+			boost::uint32_t parent = 0;
+			unsigned weight = DEFAULT_WEIGHT;
+			bool exclusive = false;
+			if(flags & FF_PRIORITY){
+				if(payload.get(temp, 5) != 5){
+					DEBUG_THROW(ProtocolException, sslit("HEADERS frame truncated"), H2E_FRAME_SIZE_ERROR);
+				}
+				const AUTO(dependency, load_be32(temp));
+				parent = dependency & 0x7FFFFFFFu;
+				exclusive = dependency & 0x80000000u;
+				weight = temp[4] + 1u;
+			}
+			if(stream_id > m_last_stream_id){
+				m_last_stream_id = stream_id;
+				// 即使拒绝这个流，报头块也必须解码，否则 HPACK 状态会不一致。
+				if(m_goaway_sent){
+					LOG_POSEIDON_DEBUG("Ignoring HTTP/2 stream after GOAWAY: stream_id = ", stream_id);
+				} else if(m_streams.size() >= m_max_concurrent_streams){
+					LOG_POSEIDON_WARNING("Too many concurrent HTTP/2 streams: max_concurrent_streams = ", m_max_concurrent_streams);
+					put_rst_stream(data, stream_id, H2E_REFUSED_STREAM);
+				} else if(parent == stream_id){
+					put_rst_stream(data, stream_id, H2E_PROTOCOL_ERROR);
+				} else {
+					Stream stream = { };
+					stream.expected_length = static_cast<boost::uint64_t>(NO_CONTENT_LENGTH);
+					stream.send_window = m_peer_initial_window_size;
+					stream.recv_window = m_settings_acked ? m_initial_window_size : static_cast<boost::uint32_t>(DEFAULT_WINDOW_SIZE);
+					stream.weight = DEFAULT_WEIGHT;
+					stream.virtual_time = m_virtual_clock;
+					m_streams.insert(std::make_pair(stream_id, STD_MOVE(stream)));
+					set_priority(stream_id, parent, weight, exclusive);
+				}
+			} else {
+				const AUTO(it, m_streams.find(stream_id));
+				if((it != m_streams.end()) && (it->second.request_complete || !(flags & FF_END_STREAM))){
+					// trailer 必须结束这个流。
+					stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+				}
+			}
+			m_header_block.clear();
+			m_header_block.splice(payload);
+			if(flags & FF_END_HEADERS){
+				on_header_block(data, stream_id, flags & FF_END_STREAM);
+			} else {
+				m_continuation_stream_id = stream_id;
+				m_continuation_end_stream = flags & FF_END_STREAM;
+			}
+			break; }
+
+		case FT_PRIORITY: {
+			if(stream_id == 0){
+				DEBUG_THROW(ProtocolException, sslit("PRIORITY on stream 0"), H2E_PROTOCOL_ERROR);
+			}
+			if(payload.get(temp, 5) != 5){
+				stream_error(data, stream_id, H2E_FRAME_SIZE_ERROR);
+				break;
+			}
+			const AUTO(dependency, load_be32(temp));
+			const boost::uint32_t parent = dependency & 0x7FFFFFFFu;
+			if(parent == stream_id){
+				stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+				break;
+			}
+			if(m_streams.find(stream_id) != m_streams.end()){
+				set_priority(stream_id, parent, temp[4] + 1u, dependency & 0x80000000u);
+			}
+			break; }
+
+		case FT_RST_STREAM: {
+			if(stream_id == 0){
+				DEBUG_THROW(ProtocolException, sslit("RST_STREAM on stream 0"), H2E_PROTOCOL_ERROR);
+			}
+			if(payload.size() != 4){
+				DEBUG_THROW(ProtocolException, sslit("Invalid RST_STREAM frame"), H2E_FRAME_SIZE_ERROR);
+			}
+			if(stream_id > m_last_stream_id){
+				DEBUG_THROW(ProtocolException, sslit("RST_STREAM on idle stream"), H2E_PROTOCOL_ERROR);
+			}
+			payload.get(temp, 4);
+			LOG_POSEIDON_DEBUG("HTTP/2 stream reset by peer: stream_id = ", stream_id, ", error_code = ", load_be32(temp));
+			close_stream(stream_id);
+			break; }
+
+		case FT_SETTINGS: {
+			if(stream_id != 0){
+				DEBUG_THROW(ProtocolException, sslit("SETTINGS on non-zero stream"), H2E_PROTOCOL_ERROR);
+			}
+			if(flags & FF_ACK){
+				if(!payload.empty()){
+					DEBUG_THROW(ProtocolException, sslit("SETTINGS ACK with payload"), H2E_FRAME_SIZE_ERROR);
+				}
+				if(m_settings_acked){
+					break;
+				}
+				m_settings_acked = true;
+				// 对方已经按照差值调整了已经存在的流的窗口。窗口缩小时可能已经耗尽，对方无法再发送 DATA 帧，因此在这里补充。
+				const AUTO(delta, static_cast<boost::int64_t>(m_initial_window_size) - DEFAULT_WINDOW_SIZE);
+				for(AUTO(it, m_streams.begin()); it != m_streams.end(); ++it){
+					it->second.recv_window += delta;
+					if(!it->second.request_complete){
+						put_window_update(data, it->first, it->second.recv_window);
+					}
+				}
+				break;
+			}
+			if(payload.size() % 6 != 0){
+				DEBUG_THROW(ProtocolException, sslit("Invalid SETTINGS frame"), H2E_FRAME_SIZE_ERROR);
+			}
+			while(payload.get(temp, 6) == 6){
+				const unsigned id = (static_cast<unsigned>(temp[0]) << 8) | temp[1];
+				const AUTO(value, load_be32(temp + 2));
+				switch(id){
+				case SET_HEADER_TABLE_SIZE:
+					m_encoder.set_max_table_size(std::min<boost::uint32_t>(value, 4096));
+					break;
+				case SET_ENABLE_PUSH:
+					if(value > 1){
+						DEBUG_THROW(ProtocolException, sslit("Invalid SETTINGS_ENABLE_PUSH"), H2E_PROTOCOL_ERROR);
+					}
+					break;
+				case SET_INITIAL_WINDOW_SIZE: {
+					if(value > MAX_WINDOW_SIZE){
+						DEBUG_THROW(ProtocolException, sslit("Invalid SETTINGS_INITIAL_WINDOW_SIZE"), H2E_FLOW_CONTROL_ERROR);
+					}
+					// 已经存在的流的发送窗口按照差值调整，可能变成负数。
+					const AUTO(delta, static_cast<boost::int64_t>(value) - static_cast<boost::int64_t>(m_peer_initial_window_size));
+					m_peer_initial_window_size = value;
+					for(AUTO(it, m_streams.begin()); it != m_streams.end(); ++it){
+						it->second.send_window += delta;
+						if(it->second.send_window > MAX_WINDOW_SIZE){
+							DEBUG_THROW(ProtocolException, sslit("Stream flow control window overflow"), H2E_FLOW_CONTROL_ERROR);
+						}
+					}
+					break; }
+				case SET_MAX_FRAME_SIZE:
+					if((value < DEFAULT_MAX_FRAME_SIZE) || (value > MAX_FRAME_SIZE_LIMIT)){
+						DEBUG_THROW(ProtocolException, sslit("Invalid SETTINGS_MAX_FRAME_SIZE"), H2E_PROTOCOL_ERROR);
+					}
+					m_peer_max_frame_size = value;
+					break;
+				default:
+					// 未知的设置被忽略。
+					break;
+				}
+			}
+			put_frame_header(data, 0, FT_SETTINGS, FF_ACK, 0);
+			break; }
+
+		case FT_PUSH_PROMISE:
+			DEBUG_THROW(ProtocolException, sslit("PUSH_PROMISE from client"), H2E_PROTOCOL_ERROR);
+
+		case FT_PING:
+			if(stream_id != 0){
+				DEBUG_THROW(ProtocolException, sslit("PING on non-zero stream"), H2E_PROTOCOL_ERROR);
+			}
+			if(payload.size() != 8){
+				DEBUG_THROW(ProtocolException, sslit("Invalid PING frame"), H2E_FRAME_SIZE_ERROR);
+			}
+			if(!(flags & FF_ACK)){
+				put_frame_header(data, 8, FT_PING, FF_ACK, 0);
+				data.splice(payload);
+			}
+			break;
+
+		case FT_GOAWAY:
+			if(stream_id != 0){
+				DEBUG_THROW(ProtocolException, sslit("GOAWAY on non-zero stream"), H2E_PROTOCOL_ERROR);
+			}
+			if(payload.get(temp, 8) != 8){
+				DEBUG_THROW(ProtocolException, sslit("Invalid GOAWAY frame"), H2E_FRAME_SIZE_ERROR);
+			}
+			LOG_POSEIDON_DEBUG("Received HTTP/2 GOAWAY: last_stream_id = ", load_be32(temp) & 0x7FFFFFFFu, ", error_code = ", load_be32(temp + 4));
+			break;
+
+		case FT_WINDOW_UPDATE: {
+			if(payload.get(temp, 4) != 4){
+				DEBUG_THROW(ProtocolException, sslit("Invalid WINDOW_UPDATE frame"), H2E_FRAME_SIZE_ERROR);
+			}
+			const boost::uint32_t increment = load_be32(temp) & 0x7FFFFFFFu;
+			if(stream_id == 0){
+				if(increment == 0){
+					DEBUG_THROW(ProtocolException, sslit("Zero WINDOW_UPDATE increment"), H2E_PROTOCOL_ERROR);
+				}
+				m_send_window += increment;
+				if(m_send_window > MAX_WINDOW_SIZE){
+					DEBUG_THROW(ProtocolException, sslit("Connection flow control window overflow"), H2E_FLOW_CONTROL_ERROR);
+				}
+				break;
+			}
+			const AUTO(it, m_streams.find(stream_id));
+			if(it == m_streams.end()){
+				break;
+			}
+			if(increment == 0){
+				stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+				break;
+			}
+			it->second.send_window += increment;
+			if(it->second.send_window > MAX_WINDOW_SIZE){
+				stream_error(data, stream_id, H2E_FLOW_CONTROL_ERROR);
+			}
+			break; }
+
+		case FT_CONTINUATION:
+			if(stream_id != m_continuation_stream_id){
+				DEBUG_THROW(ProtocolException, sslit("Unexpected CONTINUATION"), H2E_PROTOCOL_ERROR);
+			}
+			m_header_block.splice(payload);
+			if(m_header_block.size() > m_max_header_list_size + DEFAULT_MAX_FRAME_SIZE){
+				DEBUG_THROW(ProtocolException, sslit("Header block too large"), H2E_ENHANCE_YOUR_CALM);
+			}
+			if(flags & FF_END_HEADERS){
+				m_continuation_stream_id = 0;
+				on_header_block(data, stream_id, m_continuation_end_stream);
+			}
+			break;
+
+		default:
+			// 未知的帧类型必须被忽略。
+			LOG_POSEIDON_DEBUG("Ignoring unknown HTTP/2 frame: type = ", type);
+			break;
+		}
+	}
+	void Http2Connection::on_header_block(StreamBuffer &data, boost::uint32_t stream_id, bool end_stream){
+		PROFILE_ME;
+
+		StreamBuffer block;
+		block.swap(m_header_block);
+		std::vector<HpackHeader> headers;
+		try {
+			m_decoder.decode(headers, block);
+		} catch(Exception &e){
+			// 报头列表过长，但是报头块已经被完整解码，连接仍然可以使用。
+			put_error_response(data, stream_id, e.get_status_code());
+			return;
+		}
+
+		const AUTO(it, m_streams.find(stream_id));
+		if(it == m_streams.end()){
+			return;
+		}
+		AUTO_REF(stream, it->second);
+
+		if(stream.headers_received){
+			// trailer 中不允许出现伪报头。
+			for(AUTO(hit, headers.begin()); hit != headers.end(); ++hit){
+				if(!is_lowercase_header_name(hit->first) || (hit->first[0] == ':')){
+					stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+					return;
+				}
+				stream.request_headers.headers.append(SharedNts(canonicalize_header_name(hit->first)), STD_MOVE(hit->second));
+			}
+			on_request_complete(data, stream_id);
+			return;
+		}
+
+		// https://tools.ietf.org/html/rfc7540#section-8.1.2
+		const std::string *method = NULLPTR, *scheme = NULLPTR, *path = NULLPTR, *authority = NULLPTR;
+		bool regular_seen = false;
+		std::string cookie;
+		AUTO_REF(request_headers, stream.request_headers);
+		for(AUTO(hit, headers.begin()); hit != headers.end(); ++hit){
+			const AUTO_REF(name, hit->first);
+			if(!is_lowercase_header_name(name)){
+				LOG_POSEIDON_WARNING("Invalid HTTP/2 header name: ", name);
+				stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+				return;
+			}
+			if(name[0] == ':'){
+				const std::string **slot;
+				if(name == ":method"){
+					slot = &method;
+				} else if(name == ":scheme"){
+					slot = &scheme;
+				} else if(name == ":path"){
+					slot = &path;
+				} else if(name == ":authority"){
+					slot = &authority;
+				} else {
+					slot = NULLPTR;
+				}
+				if(!slot || *slot || regular_seen){
+					LOG_POSEIDON_WARNING("Invalid HTTP/2 pseudo header: ", name);
+					stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+					return;
+				}
+				*slot = &(hit->second);
+				continue;
+			}
+			regular_seen = true;
+			if(is_connection_specific(name.c_str()) || ((name == "te") && (hit->second != "trailers"))){
+				LOG_POSEIDON_WARNING("Connection-specific header in HTTP/2 request: ", name);
+				stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+				return;
+			}
+			if(name == "cookie"){
+				// 拆分的 Cookie 合并成一个。
+				if(!cookie.empty()){
+					cookie += "; ";
+				}
+				cookie += hit->second;
+				continue;
+			}
+			request_headers.headers.append(SharedNts(canonicalize_header_name(name)), STD_MOVE(hit->second));
+		}
+		if(!method || !scheme || !path || path->empty()){
+			LOG_POSEIDON_WARNING("Missing HTTP/2 pseudo header(s): stream_id = ", stream_id);
+			stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+			return;
+		}
+		if(!cookie.empty()){
+			request_headers.headers.set(sslit("Cookie"), STD_MOVE(cookie));
+		}
+		if(authority && !request_headers.headers.has("Host")){
+			request_headers.headers.set(sslit("Host"), *authority);
+		}
+		stream.headers_received = true;
+
+		request_headers.verb = get_verb_from_string(method->c_str());
+		if((request_headers.verb == V_INVALID_VERB) || (request_headers.verb == V_CONNECT)){
+			LOG_POSEIDON_WARNING("Bad verb: ", *method);
+			put_error_response(data, stream_id, ST_NOT_IMPLEMENTED);
+			return;
+		}
+		request_headers.uri = *path;
+		request_headers.version = 20000;
+		const AUTO(pos, request_headers.uri.find('?'));
+		if(pos != std::string::npos){
+			Buffer_istream is;
+			is.set_buffer(StreamBuffer(request_headers.uri.data() + pos + 1, request_headers.uri.size() - pos - 1));
+			url_decode_params(is, request_headers.get_params);
+			request_headers.uri.erase(pos);
+		}
+
+		const AUTO_REF(content_length, request_headers.headers.get("Content-Length"));
+		if(!content_length.empty()){
+			char *endptr;
+			stream.expected_length = ::strtoull(content_length.c_str(), &endptr, 10);
+			if(*endptr){
+				LOG_POSEIDON_WARNING("Bad request header Content-Length: ", content_length);
+				stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+				return;
+			}
+			if(stream.expected_length > get_max_request_length()){
+				LOG_POSEIDON_WARNING("HTTP/2 request entity too large: content_length = ", stream.expected_length);
+				put_error_response(data, stream_id, ST_PAYLOAD_TOO_LARGE);
+				return;
+			}
+		}
+
+		if(end_stream){
+			on_request_complete(data, stream_id);
+		}
+	}
+	void Http2Connection::on_request_complete(StreamBuffer &data, boost::uint32_t stream_id){
+		PROFILE_ME;
+
+		const AUTO(it, m_streams.find(stream_id));
+		if(it == m_streams.end()){
+			return;
+		}
+		AUTO_REF(stream, it->second);
+		stream.request_complete = true;
+		if((stream.expected_length != static_cast<boost::uint64_t>(NO_CONTENT_LENGTH)) && (stream.expected_length != stream.entity.size())){
+			LOG_POSEIDON_WARNING("HTTP/2 request entity length mismatch: expected_length = ", stream.expected_length,
+				", entity_length = ", stream.entity.size());
+			stream_error(data, stream_id, H2E_PROTOCOL_ERROR);
+			return;
+		}
+		RequestHeaders request_headers;
+		swap(request_headers, stream.request_headers);
+		StreamBuffer entity;
+		entity.swap(stream.entity);
+
+		// 处理函数可能立即发送响应，在此之前的帧（特别是 SETTINGS）必须先发出去。
+		StreamBuffer pending;
+		pending.swap(data);
+		commit(STD_MOVE(pending));
+		on_http2_request(stream_id, STD_MOVE(request_headers), STD_MOVE(entity));
+	}
+
+	void Http2Connection::set_priority(boost::uint32_t stream_id, boost::uint32_t parent, unsigned weight, bool exclusive){
+		const AUTO(it, m_streams.find(stream_id));
+		if(it == m_streams.end()){
+			return;
+		}
+		if(m_streams.find(parent) == m_streams.end()){
+			// 依赖于不存在的流时使用默认优先级。
+			parent = 0;
+			weight = DEFAULT_WEIGHT;
+			exclusive = false;
+		}
+		// 如果新的父节点依赖于这个流，先把它移动到这个流原来的位置。
+		for(boost::uint32_t ancestor = parent; ancestor != 0; ){
+			const AUTO(ait, m_streams.find(ancestor));
+			if(ait == m_streams.end()){
+				break;
+			}
+			if(ait->second.parent == stream_id){
+				ait->second.parent = it->second.parent;
+				break;
+			}
+			ancestor = ait->second.parent;
+		}
+		if(exclusive){
+			for(AUTO(cit, m_streams.begin()); cit != m_streams.end(); ++cit){
+				if((cit->first != stream_id) && (cit->second.parent == parent)){
+					cit->second.parent = stream_id;
+				}
+			}
+		}
+		it->second.parent = parent;
+		it->second.weight = weight;
+	}
+	bool Http2Connection::is_stream_sendable(const Stream &stream) const {
+		if(stream.outgoing.empty()){
+			return stream.outgoing_end;
+		}
+		return (stream.send_window > 0) && (m_send_window > 0);
+	}
+	void Http2Connection::flush_data(StreamBuffer &data){
+		PROFILE_ME;
+
+		// 加权公平队列：每次选择虚拟时间最小的流发送一帧，发送之后虚拟时间按照 长度 / 权重 增加。
+		// 祖先有数据可以发送的流需要等待，依赖关系中靠前的流优先。
+		for(;;){
+			AUTO(best, m_streams.end());
+			for(AUTO(it, m_streams.begin()); it != m_streams.end(); ++it){
+				if(!is_stream_sendable(it->second)){
+					continue;
+				}
+				bool blocked = false;
+				boost::uint32_t ancestor = it->second.parent;
+				for(std::size_t depth = 0; (ancestor != 0) && (depth < m_streams.size()); ++depth){
+					const AUTO(ait, m_streams.find(ancestor));
+					if(ait == m_streams.end()){
+						break;
+					}
+					if(is_stream_sendable(ait->second)){
+						blocked = true;
+						break;
+					}
+					ancestor = ait->second.parent;
+				}
+				if(blocked){
+					continue;
+				}
+				if((best == m_streams.end()) || (it->second.virtual_time < best->second.virtual_time)){
+					best = it;
+				}
+			}
+			if(best == m_streams.end()){
+				break;
+			}
+			const AUTO(stream_id, best->first);
+			AUTO_REF(stream, best->second);
+			m_virtual_clock = stream.virtual_time;
+			if(!stream.outgoing.empty()){
+				const AUTO(window, static_cast<std::size_t>(std::min(stream.send_window, m_send_window)));
+				const AUTO(size, std::min(std::min<std::size_t>(stream.outgoing.size(), m_peer_max_frame_size), window));
+				const bool end_stream = stream.outgoing_end && !stream.has_trailer && (size == stream.outgoing.size());
+				put_frame_header(data, size, FT_DATA, end_stream ? static_cast<unsigned>(FF_END_STREAM) : 0u, stream_id);
+				AUTO(payload, stream.outgoing.cut_off(size));
+				data.splice(payload);
+				stream.send_window -= static_cast<boost::int64_t>(size);
+				m_send_window -= static_cast<boost::int64_t>(size);
+				stream.virtual_time += size * 256 / stream.weight + 1;
+				if(!end_stream){
+					continue;
+				}
+			} else if(stream.has_trailer){
+				put_trailer(data, stream_id, stream.trailer);
+			} else {
+				put_frame_header(data, 0, FT_DATA, FF_END_STREAM, stream_id);
+			}
+			stream.response_ended = true;
+			if(!stream.request_complete){
+				put_rst_stream(data, stream_id, H2E_NO_ERROR);
+			}
+			close_stream(stream_id);
+		}
+	}
+	void Http2Connection::close_stream(boost::uint32_t stream_id){
+		const AUTO(it, m_streams.find(stream_id));
+		if(it == m_streams.end()){
+			return;
+		}
+		// 子节点移动到父节点下面。
+		const AUTO(parent, it->second.parent);
+		for(AUTO(cit, m_streams.begin()); cit != m_streams.end(); ++cit){
+			if(cit->second.parent == stream_id){
+				cit->second.parent = parent;
+			}
+		}
+		m_streams.erase(it);
+
+		on_http2_stream_closed(stream_id);
+	}
+	void Http2Connection::enqueue_data(boost::uint32_t stream_id, StreamBuffer &entity){
+		const AUTO(it, m_streams.find(stream_id));
+		if(it == m_streams.end()){
+			return;
+		}
+		AUTO_REF(stream, it->second);
+		if(stream.outgoing.empty()){
+			// 刚刚变成活动的流从当前的虚拟时间开始，不能用以前积攒的配额插队。
+			stream.virtual_time = std::max(stream.virtual_time, m_virtual_clock);
+		}
+		stream.outgoing.splice(entity);
+	}
+
+	long Http2Connection::commit(StreamBuffer data){
+		if(data.empty()){
+			return true;
+		}
+		return on_encoded_data_avail(STD_MOVE(data));
+	}
+
+	bool Http2Connection::put_encoded_data(StreamBuffer encoded){
+		PROFILE_ME;
+
+		if(m_input_state == IS_CLOSED){
+			return false;
+		}
+		m_queue.splice(encoded);
+
+		StreamBuffer data;
+		try {
+			if(m_input_state == IS_PREFACE){
+				if(m_queue.size() < sizeof(CONNECTION_PREFACE)){
+					return true;
+				}
+				char preface[sizeof(CONNECTION_PREFACE)];
+				m_queue.get(preface, sizeof(preface));
+				if(std::memcmp(preface, CONNECTION_PREFACE, sizeof(preface)) != 0){
+					DEBUG_THROW(ProtocolException, sslit("Invalid HTTP/2 connection preface"), H2E_PROTOCOL_ERROR);
+				}
+				m_input_state = IS_FRAMES;
+				put_settings(data);
+			}
+			for(;;){
+				unsigned char header[FRAME_HEADER_SIZE];
+				if(m_queue.peek(header, sizeof(header)) < sizeof(header)){
+					break;
+				}
+				const AUTO(length, load_be24(header));
+				if(length > DEFAULT_MAX_FRAME_SIZE){
+					DEBUG_THROW(ProtocolException, sslit("HTTP/2 frame too large"), H2E_FRAME_SIZE_ERROR);
+				}
+				if(m_queue.size() < sizeof(header) + length){
+					break;
+				}
+				m_queue.discard(sizeof(header));
+				AUTO(payload, m_queue.cut_off(length));
+				on_frame(data, header[3], header[4], load_be32(header + 5) & 0x7FFFFFFFu, STD_MOVE(payload));
+				if(m_input_state == IS_CLOSED){
+					break;
+				}
+			}
+			flush_data(data);
+		} catch(ProtocolException &e){
+			LOG_POSEIDON_WARNING("HTTP/2 connection error: code = ", e.get_code(), ", what = ", e.what());
+			const AUTO(error_code, static_cast<Http2ErrorCode>(e.get_code()));
+			put_frame_header(data, 8, FT_GOAWAY, 0, 0);
+			put_be32(data, m_last_stream_id);
+			put_be32(data, error_code);
+			m_goaway_sent = true;
+			m_input_state = IS_CLOSED;
+			m_queue.clear();
+			commit(STD_MOVE(data));
+			return false;
+		}
+		commit(STD_MOVE(data));
+		return true;
+	}
+
+	long Http2Connection::put_response(boost::uint32_t stream_id, ResponseHeaders response_headers, StreamBuffer entity){
+		PROFILE_ME;
+
+		if(response_headers.status_code / 100 == 1){
+			// 1xx 响应（例如 100 Continue）在 HTTP/2 中没有意义，对方不会等待它。
+			return true;
+		}
+		const AUTO(it, m_streams.find(stream_id));
+		if((it == m_streams.end()) || it->second.response_started){
+			LOG_POSEIDON_DEBUG("HTTP/2 stream is gone or has been responded: stream_id = ", stream_id);
+			return false;
+		}
+		it->second.response_started = true;
+
+		AUTO_REF(headers, response_headers.headers);
+		char temp[64];
+		const unsigned len = (unsigned)std::sprintf(temp, "%llu", (unsigned long long)entity.size());
+		headers.set(sslit("Content-Length"), std::string(temp, len));
+		if(entity.empty()){
+			headers.erase("Content-Type");
+		}
+
+		StreamBuffer data;
+		if(entity.empty()){
+			it->second.response_ended = true;
+			put_headers(data, stream_id, response_headers, true);
+			if(!it->second.request_complete){
+				put_rst_stream(data, stream_id, H2E_NO_ERROR);
+			}
+			close_stream(stream_id);
+		} else {
+			put_headers(data, stream_id, response_headers, false);
+			it->second.outgoing_end = true;
+			enqueue_data(stream_id, entity);
+		}
+		flush_data(data);
+		return commit(STD_MOVE(data));
+	}
+	long Http2Connection::put_chunked_header(boost::uint32_t stream_id, ResponseHeaders response_headers){
+		PROFILE_ME;
+
+		if(response_headers.status_code / 100 == 1){
+			return true;
+		}
+		const AUTO(it, m_streams.find(stream_id));
+		if((it == m_streams.end()) || it->second.response_started){
+			LOG_POSEIDON_DEBUG("HTTP/2 stream is gone or has been responded: stream_id = ", stream_id);
+			return false;
+		}
+		it->second.response_started = true;
+
+		StreamBuffer data;
+		put_headers(data, stream_id, response_headers, false);
+		return commit(STD_MOVE(data));
+	}
+	long Http2Connection::put_chunk(boost::uint32_t stream_id, StreamBuffer entity){
+		PROFILE_ME;
+
+		if(entity.empty()){
+			LOG_POSEIDON_ERROR("You are not allowed to send an empty chunk");
+			DEBUG_THROW(BasicException, sslit("You are not allowed to send an empty chunk"));
+		}
+		const AUTO(it, m_streams.find(stream_id));
+		if((it == m_streams.end()) || !it->second.response_started || it->second.outgoing_end){
+			LOG_POSEIDON_DEBUG("HTTP/2 stream is gone or not in chunked mode: stream_id = ", stream_id);
+			return false;
+		}
+		enqueue_data(stream_id, entity);
+
+		StreamBuffer data;
+		flush_data(data);
+		return commit(STD_MOVE(data));
+	}
+	long Http2Connection::put_chunked_trailer(boost::uint32_t stream_id, OptionalMap headers){
+		PROFILE_ME;
+
+		const AUTO(it, m_streams.find(stream_id));
+		if((it == m_streams.end()) || !it->second.response_started || it->second.outgoing_end){
+			LOG_POSEIDON_DEBUG("HTTP/2 stream is gone or not in chunked mode: stream_id = ", stream_id);
+			return false;
+		}
+		AUTO_REF(stream, it->second);
+		if(stream.outgoing.empty()){
+			stream.virtual_time = std::max(stream.virtual_time, m_virtual_clock);
+		}
+		stream.outgoing_end = true;
+		stream.has_trailer = !headers.empty();
+		stream.trailer.swap(headers);
+
+		StreamBuffer data;
+		flush_data(data);
+		return commit(STD_MOVE(data));
+	}
+
+	long Http2Connection::reset_stream(boost::uint32_t stream_id, Http2ErrorCode error_code){
+		PROFILE_ME;
+
+		if(m_streams.find(stream_id) == m_streams.end()){
+			return false;
+		}
+		StreamBuffer data;
+		stream_error(data, stream_id, error_code);
+		flush_data(data);
+		return commit(STD_MOVE(data));
+	}
+	long Http2Connection::put_goaway(Http2ErrorCode error_code){
+		PROFILE_ME;
+
+		if(m_goaway_sent){
+			return true;
+		}
+		m_goaway_sent = true;
+
+		StreamBuffer data;
+		put_frame_header(data, 8, FT_GOAWAY, 0, 0);
+		put_be32(data, m_last_stream_id);
+		put_be32(data, error_code);
+		return commit(STD_MOVE(data));
+	}
+}
+
+}
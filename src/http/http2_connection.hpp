@@ -0,0 +1,154 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_HTTP_HTTP2_CONNECTION_HPP_
+#define POSEIDON_HTTP_HTTP2_CONNECTION_HPP_
+
+#include "../cxx_ver.hpp"
+#include "../cxx_util.hpp"
+#include "../stream_buffer.hpp"
+#include "../optional_map.hpp"
+#include <map>
+#include <cstddef>
+#include <boost/cstdint.hpp>
+#include "http2_frames.hpp"
+#include "hpack.hpp"
+#include "request_headers.hpp"
+#include "response_headers.hpp"
+#include "status_codes.hpp"
+
+namespace Poseidon {
+
+namespace Http {
+	// RFC 7540 服务端的协议状态机，不涉及套接字。调用者负责同步。
+	// 每个流的请求被完整地缓存之后才交给 on_http2_request()，因此处理函数看到的请求和 HTTP/1.1 一样。
+	class Http2Connection : NONCOPYABLE {
+	private:
+		enum InputState {
+			IS_PREFACE,
+			IS_FRAMES,
+			IS_CLOSED,
+		};
+
+		struct Stream {
+			bool headers_received;
+			bool request_complete;   // 对方已经发送了 END_STREAM。
+			bool response_started;
+			bool response_ended;     // END_STREAM 已经进入发送队列。
+
+			RequestHeaders request_headers;
+			StreamBuffer entity;
+			boost::uint64_t expected_length; // 没有 content-length 时为 (boost::uint64_t)-1。
+
+			boost::int64_t send_window;
+			boost::int64_t recv_window;
+			StreamBuffer outgoing;
+			bool outgoing_end;
+			bool has_trailer;
+			OptionalMap trailer;
+
+			boost::uint32_t parent;
+			unsigned weight;
+			boost::uint64_t virtual_time;
+		};
+
+	private:
+		const std::size_t m_max_concurrent_streams;
+		const boost::uint32_t m_initial_window_size;
+		const std::size_t m_max_header_list_size;
+
+		InputState m_input_state;
+		StreamBuffer m_queue;
+
+		HpackDecoder m_decoder;
+		HpackEncoder m_encoder;
+
+		// 对方的 SETTINGS。
+		boost::uint32_t m_peer_initial_window_size;
+		boost::uint32_t m_peer_max_frame_size;
+
+		std::map<boost::uint32_t, Stream> m_streams;
+		boost::uint32_t m_last_stream_id;
+		boost::uint64_t m_virtual_clock;
+
+		// 正在接收的 HEADERS + CONTINUATION。
+		boost::uint32_t m_continuation_stream_id;
+		bool m_continuation_end_stream;
+		StreamBuffer m_header_block;
+
+		boost::int64_t m_send_window;
+		boost::int64_t m_recv_window;
+
+		// 我们的 SETTINGS 被确认之前，对方按照默认的初始窗口发送。
+		bool m_settings_acked;
+		bool m_goaway_sent;
+
+	public:
+		Http2Connection(std::size_t max_concurrent_streams, boost::uint32_t initial_window_size, std::size_t max_header_list_size);
+		virtual ~Http2Connection();
+
+	private:
+		static void put_frame_header(StreamBuffer &data, std::size_t length, Http2FrameType type, unsigned flags, boost::uint32_t stream_id);
+
+		void put_settings(StreamBuffer &data);
+		void put_rst_stream(StreamBuffer &data, boost::uint32_t stream_id, Http2ErrorCode error_code);
+		void put_window_update(StreamBuffer &data, boost::uint32_t stream_id, boost::int64_t &window);
+		void put_header_block(StreamBuffer &data, boost::uint32_t stream_id, StreamBuffer block, bool end_stream);
+		void put_headers(StreamBuffer &data, boost::uint32_t stream_id, const ResponseHeaders &response_headers, bool end_stream);
+		void put_trailer(StreamBuffer &data, boost::uint32_t stream_id, const OptionalMap &headers);
+		void put_error_response(StreamBuffer &data, boost::uint32_t stream_id, StatusCode status_code);
+		void stream_error(StreamBuffer &data, boost::uint32_t stream_id, Http2ErrorCode error_code);
+
+		void on_frame(StreamBuffer &data, Http2FrameType type, unsigned flags, boost::uint32_t stream_id, StreamBuffer payload);
+		void on_header_block(StreamBuffer &data, boost::uint32_t stream_id, bool end_stream);
+		void on_request_complete(StreamBuffer &data, boost::uint32_t stream_id);
+
+		void set_priority(boost::uint32_t stream_id, boost::uint32_t parent, unsigned weight, bool exclusive);
+		bool is_stream_sendable(const Stream &stream) const;
+		void flush_data(StreamBuffer &data);
+		void close_stream(boost::uint32_t stream_id);
+		void enqueue_data(boost::uint32_t stream_id, StreamBuffer &entity);
+
+		long commit(StreamBuffer data);
+
+	protected:
+		// 每个流缓存的请求实体的上限，超过时响应 413。
+		virtual boost::uint64_t get_max_request_length() const = 0;
+
+		// 请求被完整接收。
+		virtual void on_http2_request(boost::uint32_t stream_id, RequestHeaders request_headers, StreamBuffer entity) = 0;
+		// 流被关闭或者重置。
+		virtual void on_http2_stream_closed(boost::uint32_t stream_id) = 0;
+
+		virtual long on_encoded_data_avail(StreamBuffer encoded) = 0;
+
+	public:
+		bool has_been_closed() const {
+			return m_input_state == IS_CLOSED;
+		}
+		// 没有尚未完成的流。
+		bool is_idle() const {
+			return m_streams.empty();
+		}
+		std::size_t get_stream_count() const {
+			return m_streams.size();
+		}
+
+		// 出现连接错误时发送 GOAWAY，返回 false。调用者应当在数据发送之后关闭连接。
+		bool put_encoded_data(StreamBuffer encoded);
+
+		// 返回 false 表示流已经不存在。1xx 响应被忽略。
+		long put_response(boost::uint32_t stream_id, ResponseHeaders response_headers, StreamBuffer entity);
+		long put_chunked_header(boost::uint32_t stream_id, ResponseHeaders response_headers);
+		long put_chunk(boost::uint32_t stream_id, StreamBuffer entity);
+		long put_chunked_trailer(boost::uint32_t stream_id, OptionalMap headers);
+
+		long reset_stream(boost::uint32_t stream_id, Http2ErrorCode error_code);
+		// 不再接受新的流，已有的流仍然可以完成。
+		long put_goaway(Http2ErrorCode error_code);
+	};
+}
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_HTTP_HTTP2_FRAMES_HPP_
+#define POSEIDON_HTTP_HTTP2_FRAMES_HPP_
+
+namespace Poseidon {
+
+namespace Http {
+	typedef unsigned Http2FrameType;
+	typedef unsigned Http2ErrorCode;
+
+	namespace Http2Frames {
+		// https://tools.ietf.org/html/rfc7540#section-6
+		enum {
+			FT_DATA                 = 0x00,
+			FT_HEADERS              = 0x01,
+			FT_PRIORITY             = 0x02,
+			FT_RST_STREAM           = 0x03,
+			FT_SETTINGS             = 0x04,
+			FT_PUSH_PROMISE         = 0x05,
+			FT_PING                 = 0x06,
+			FT_GOAWAY               = 0x07,
+			FT_WINDOW_UPDATE        = 0x08,
+			FT_CONTINUATION         = 0x09,
+		};
+
+		enum {
+			FF_END_STREAM           = 0x01,
+			FF_ACK                  = 0x01,
+			FF_END_HEADERS          = 0x04,
+			FF_PADDED               = 0x08,
+			FF_PRIORITY             = 0x20,
+		};
+
+		// https://tools.ietf.org/html/rfc7540#section-6.5.2
+		enum {
+			SET_HEADER_TABLE_SIZE       = 0x01,
+			SET_ENABLE_PUSH             = 0x02,
+			SET_MAX_CONCURRENT_STREAMS  = 0x03,
+			SET_INITIAL_WINDOW_SIZE     = 0x04,
+			SET_MAX_FRAME_SIZE          = 0x05,
+			SET_MAX_HEADER_LIST_SIZE    = 0x06,
+		};
+
+		// https://tools.ietf.org/html/rfc7540#section-7
+		enum {
+			H2E_NO_ERROR            = 0x00,
+			H2E_PROTOCOL_ERROR      = 0x01,
+			H2E_INTERNAL_ERROR      = 0x02,
+			H2E_FLOW_CONTROL_ERROR  = 0x03,
+			H2E_SETTINGS_TIMEOUT    = 0x04,
+			H2E_STREAM_CLOSED       = 0x05,
+			H2E_FRAME_SIZE_ERROR    = 0x06,
+			H2E_REFUSED_STREAM      = 0x07,
+			H2E_CANCEL              = 0x08,
+			H2E_COMPRESSION_ERROR   = 0x09,
+			H2E_CONNECT_ERROR       = 0x0A,
+			H2E_ENHANCE_YOUR_CALM   = 0x0B,
+			H2E_INADEQUATE_SECURITY = 0x0C,
+			H2E_HTTP_1_1_REQUIRED   = 0x0D,
+		};
+
+		enum {
+			FRAME_HEADER_SIZE           = 9,
+			DEFAULT_WINDOW_SIZE         = 65535,
+			DEFAULT_MAX_FRAME_SIZE      = 16384,
+			MAX_WINDOW_SIZE             = 0x7FFFFFFF,
+			MAX_FRAME_SIZE_LIMIT        = 0xFFFFFF,
+		};
+
+		// 客户端发送的连接前言，先于任何帧。
+		extern const char CONNECTION_PREFACE[24];
+	}
+
+	using namespace Http2Frames;
+}
+
+}
+
+#endif
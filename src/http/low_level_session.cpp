@@ -6,15 +6,64 @@
 #include "exception.hpp"
 #include "upgraded_session_base.hpp"
 #include "header_option.hpp"
+#include "http2_connection.hpp"
 #include "../log.hpp"
 #include "../profiler.hpp"
 #include "../stream_buffer.hpp"
+#include "../singletons/main_config.hpp"
+#include "../singletons/epoll_daemon.hpp"
 
 namespace Poseidon {
 
+namespace {
+	std::size_t config_get_max_pipelining_depth(){
+		AUTO(max_pipelining_depth, MainConfig::get<std::size_t>("http_max_pipelining_depth", 16));
+		if(max_pipelining_depth < 1){
+			max_pipelining_depth = 1;
+		}
+		return max_pipelining_depth;
+	}
+	bool config_get_http2_enabled(){
+		return MainConfig::get<bool>("http2_enabled", false);
+	}
+}
+
 namespace Http {
+	class LowLevelSession::Http2Adapter : public Http2Connection {
+	private:
+		LowLevelSession *const m_session;
+
+	public:
+		explicit Http2Adapter(LowLevelSession *session)
+			: Http2Connection(
+				MainConfig::get<std::size_t>("http2_max_concurrent_streams", 100),
+				MainConfig::get<boost::uint32_t>("http2_initial_window_size", 65535),
+				MainConfig::get<std::size_t>("http2_max_header_list_size", 65536))
+			, m_session(session)
+		{ }
+
+	protected:
+		boost::uint64_t get_max_request_length() const OVERRIDE {
+			return m_session->get_low_level_max_request_length();
+		}
+		void on_http2_request(boost::uint32_t stream_id, RequestHeaders request_headers, StreamBuffer entity) OVERRIDE {
+			m_session->on_http2_request(stream_id, STD_MOVE(request_headers), STD_MOVE(entity));
+		}
+		void on_http2_stream_closed(boost::uint32_t stream_id) OVERRIDE {
+			m_session->on_http2_stream_closed(stream_id);
+		}
+		long on_encoded_data_avail(StreamBuffer encoded) OVERRIDE {
+			return m_session->TcpSessionBase::send(STD_MOVE(encoded));
+		}
+	};
+
 	LowLevelSession::LowLevelSession(Move<UniqueFile> socket)
 		: TcpSessionBase(STD_MOVE(socket)), ServerReader(), ServerWriter()
+		, m_max_pipelining_depth(config_get_max_pipelining_depth())
+		, m_pipeline(), m_pipeline_front_seq(0), m_response_seq(RESPONSE_SEQ_FRONT), m_shutdown_seq(RESPONSE_SEQ_FRONT)
+		, m_last_request_seq(0), m_parsing_paused(false), m_read_hup_deferred(false)
+		, m_http2_enabled(config_get_http2_enabled()), m_protocol_detected(false), m_preface_queue()
+		, m_http2(), m_http2_streams(), m_http2_shutdown_pending(false)
 	{ }
 	LowLevelSession::~LowLevelSession(){ }
 
@@ -51,9 +100,54 @@ namespace Http {
 			return;
 		}
 
+		if(!m_protocol_detected){
+			m_preface_queue.splice(data);
+			if(m_http2_enabled){
+				// 只要已经收到的字节还可能是连接前言，就继续等待。
+				char preface[sizeof(CONNECTION_PREFACE)];
+				const AUTO(size, m_preface_queue.peek(preface, sizeof(preface)));
+				if(std::memcmp(preface, CONNECTION_PREFACE, size) == 0){
+					if(size < sizeof(preface)){
+						return;
+					}
+					LOG_POSEIDON_DEBUG("Switching to HTTP/2: remote = ", get_remote_info());
+					m_http2.reset(new Http2Adapter(this));
+				}
+			}
+			m_protocol_detected = true;
+			data.swap(m_preface_queue);
+		}
+		if(m_http2){
+			bool ok;
+			{
+				const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+				ok = m_http2->put_encoded_data(STD_MOVE(data));
+				if(ok){
+					http2_check_shutdown();
+				}
+			}
+			if(!ok){
+				// GOAWAY 已经发出。
+				shutdown_read();
+				shutdown_write();
+			}
+			return;
+		}
+
+		if(m_parsing_paused){
+			ServerReader::get_queue().splice(data);
+			return;
+		}
+		parse_requests(STD_MOVE(data));
+	}
+
+	void LowLevelSession::parse_requests(StreamBuffer data){
+		PROFILE_ME;
+
+		m_parsing_paused = false;
 		ServerReader::put_encoded_data(STD_MOVE(data));
 
-		upgraded_session = m_upgraded_session;
+		const AUTO(upgraded_session, m_upgraded_session);
 		if(upgraded_session){
 			upgraded_session->on_connect();
 
@@ -64,10 +158,56 @@ namespace Http {
 			}
 		}
 	}
+	bool LowLevelSession::is_pipeline_full() const {
+		const Mutex::UniqueLock lock(m_pipeline_mutex);
+		return m_pipeline.size() >= m_max_pipelining_depth;
+	}
+
+	bool LowLevelSession::defer_read_hup(){
+		if(!m_parsing_paused){
+			return false;
+		}
+		m_read_hup_deferred = true;
+		return true;
+	}
+
+	int LowLevelSession::poll_read_and_process(bool readable){
+		PROFILE_ME;
+
+		if(m_parsing_paused){
+			// complete_response() 腾出了位置，先处理已经读入的请求。
+			try {
+				parse_requests(StreamBuffer());
+			} catch(std::exception &e){
+				LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				force_shutdown();
+				return EPIPE;
+			} catch(...){
+				LOG_POSEIDON_ERROR("Unknown exception thrown.");
+				force_shutdown();
+				return EPIPE;
+			}
+			if(m_parsing_paused){
+				return EWOULDBLOCK;
+			}
+			if(m_read_hup_deferred){
+				m_read_hup_deferred = false;
+				on_read_hup();
+			}
+		}
+		return TcpSessionBase::poll_read_and_process(readable);
+	}
 
 	void LowLevelSession::on_request_headers(RequestHeaders request_headers, boost::uint64_t content_length){
 		PROFILE_ME;
 
+		PipelineElement elem = { pick_content_encoding(request_headers), false, false, VAL_INIT, StreamBuffer() };
+		{
+			const Mutex::UniqueLock lock(m_pipeline_mutex);
+			m_last_request_seq = m_pipeline_front_seq + m_pipeline.size();
+			m_pipeline.push_back(STD_MOVE(elem));
+		}
+
 		on_low_level_request_headers(STD_MOVE(request_headers), content_length);
 	}
 	void LowLevelSession::on_request_entity(boost::uint64_t entity_offset, StreamBuffer entity){
@@ -84,15 +224,251 @@ namespace Http {
 			m_upgraded_session = STD_MOVE(upgraded_session);
 			return false;
 		}
+		if(is_pipeline_full()){
+			// 剩下的数据留在队列中。
+			LOG_POSEIDON_DEBUG("HTTP pipeline is full, pausing: remote = ", get_remote_info());
+			m_parsing_paused = true;
+			return false;
+		}
 		return true;
 	}
 
+	boost::uint64_t LowLevelSession::get_low_level_max_request_length() const {
+		return MainConfig::get<boost::uint64_t>("http_max_request_length", 16384);
+	}
+
 	long LowLevelSession::on_encoded_data_avail(StreamBuffer encoded){
 		PROFILE_ME;
 
+		const Mutex::UniqueLock lock(m_pipeline_mutex);
+		if((m_response_seq != RESPONSE_SEQ_FRONT) && (m_response_seq > m_pipeline_front_seq)){
+			const AUTO(index, m_response_seq - m_pipeline_front_seq);
+			if(index < m_pipeline.size()){
+				// 前面还有未完成的响应。
+				m_pipeline.at(index).pending.splice(encoded);
+				return true;
+			}
+		}
+		// 持有锁发送，以免与 complete_response() 中发送的缓存数据交错。
 		return TcpSessionBase::send(STD_MOVE(encoded));
 	}
 
+	void LowLevelSession::set_response_seq(boost::uint64_t seq){
+		const Mutex::UniqueLock lock(m_pipeline_mutex);
+		m_response_seq = seq;
+	}
+	void LowLevelSession::complete_response(boost::uint64_t seq){
+		PROFILE_ME;
+
+		if(m_http2){
+			const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+			const AUTO(it, find_http2_stream(seq));
+			if((it != m_http2_streams.end()) && !it->second.response_started){
+				// 处理函数没有发送响应，流不能一直挂着。
+				LOG_POSEIDON_DEBUG("No response was sent on HTTP/2 stream: stream_id = ", it->second.stream_id);
+				m_http2->reset_stream(it->second.stream_id, H2E_INTERNAL_ERROR);
+			}
+			http2_check_shutdown();
+			return;
+		}
+
+		bool resume_reading = false;
+		bool shutdown_now = false;
+		{
+			const Mutex::UniqueLock lock(m_pipeline_mutex);
+			if(seq == RESPONSE_SEQ_FRONT){
+				seq = m_pipeline_front_seq;
+			}
+			if(seq < m_pipeline_front_seq){
+				return;
+			}
+			const AUTO(index, seq - m_pipeline_front_seq);
+			if(index >= m_pipeline.size()){
+				return;
+			}
+			AUTO_REF(elem, m_pipeline.at(index));
+			if(elem.chunked){
+				// 分块响应在 send_chunked_trailer() 中完成。
+				return;
+			}
+			elem.complete = true;
+
+			const bool was_throttled = (m_pipeline.size() >= m_max_pipelining_depth);
+			while(!m_pipeline.empty() && m_pipeline.front().complete){
+				m_pipeline.pop_front();
+				++m_pipeline_front_seq;
+				if((m_shutdown_seq != RESPONSE_SEQ_FRONT) && (m_pipeline_front_seq > m_shutdown_seq)){
+					shutdown_now = true;
+					break;
+				}
+				if(m_pipeline.empty()){
+					break;
+				}
+				// 下一个响应成为队首，之前缓存的数据可以发送了。
+				AUTO_REF(pending, m_pipeline.front().pending);
+				if(!pending.empty()){
+					TcpSessionBase::send(STD_MOVE(pending));
+					pending.clear();
+				}
+			}
+			resume_reading = was_throttled && (m_pipeline.size() < m_max_pipelining_depth);
+		}
+		if(resume_reading){
+			EpollDaemon::mark_socket_readable(this);
+		}
+		if(shutdown_now){
+			shutdown_write();
+		}
+	}
+	bool LowLevelSession::shutdown_write_after_response(boost::uint64_t seq) NOEXCEPT {
+		if(m_http2){
+			// 不再接受新的流，已有的流完成之后关闭。
+			try {
+				const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+				m_http2_shutdown_pending = true;
+				m_http2->put_goaway(H2E_NO_ERROR);
+				if(!m_http2->is_idle()){
+					return false;
+				}
+			} catch(std::exception &e){
+				LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				force_shutdown();
+				return false;
+			}
+			return shutdown_write();
+		}
+		{
+			const Mutex::UniqueLock lock(m_pipeline_mutex);
+			if(seq == RESPONSE_SEQ_FRONT){
+				seq = m_pipeline_front_seq;
+			}
+			if((seq >= m_pipeline_front_seq) && (seq - m_pipeline_front_seq < m_pipeline.size())){
+				// 前面的响应还没有发送完。
+				if((m_shutdown_seq == RESPONSE_SEQ_FRONT) || (m_shutdown_seq > seq)){
+					m_shutdown_seq = seq;
+				}
+				return false;
+			}
+		}
+		return shutdown_write();
+	}
+
+	ContentEncoding LowLevelSession::get_response_content_encoding(StatusCode status_code){
+		// 1xx 响应之后还有最终响应。
+		if(status_code / 100 == 1){
+			return CE_IDENTITY;
+		}
+		const Mutex::UniqueLock lock(m_pipeline_mutex);
+		AUTO(seq, m_response_seq);
+		const AUTO(elem, find_pipeline_element(seq));
+		if(!elem){
+			return CE_IDENTITY;
+		}
+		return elem->content_encoding;
+	}
+	boost::uint64_t LowLevelSession::get_response_seq() const {
+		const Mutex::UniqueLock lock(m_pipeline_mutex);
+		return m_response_seq;
+	}
+	LowLevelSession::PipelineElement *LowLevelSession::find_pipeline_element(boost::uint64_t &seq){
+		if(seq == RESPONSE_SEQ_FRONT){
+			seq = m_pipeline_front_seq;
+		}
+		if((seq < m_pipeline_front_seq) || (seq - m_pipeline_front_seq >= m_pipeline.size())){
+			return NULLPTR;
+		}
+		return &(m_pipeline.at(seq - m_pipeline_front_seq));
+	}
+	bool LowLevelSession::is_chunked_response_pending(){
+		const Mutex::UniqueLock lock(m_pipeline_mutex);
+		AUTO(seq, m_response_seq);
+		const AUTO(elem, find_pipeline_element(seq));
+		return elem && elem->chunked;
+	}
+
+	void LowLevelSession::on_http2_request(boost::uint32_t stream_id, RequestHeaders request_headers, StreamBuffer entity){
+		PROFILE_ME;
+
+		const AUTO(seq, ++m_last_request_seq);
+		Http2StreamElement elem = { stream_id, pick_content_encoding(request_headers), false };
+		m_http2_streams.insert(std::make_pair(seq, elem));
+
+		try {
+			const AUTO(content_length, static_cast<boost::uint64_t>(entity.size()));
+			on_low_level_request_headers(STD_MOVE(request_headers), content_length);
+			if(!entity.empty()){
+				on_low_level_request_entity(0, STD_MOVE(entity));
+			}
+			const AUTO(upgraded_session, on_low_level_request_end(content_length, OptionalMap()));
+			if(upgraded_session){
+				LOG_POSEIDON_WARNING("Protocol upgrade is not supported over HTTP/2: remote = ", get_remote_info());
+				m_http2->reset_stream(stream_id, H2E_HTTP_1_1_REQUIRED);
+			}
+		} catch(Exception &e){
+			// 只有这个流受影响。
+			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+				"Http::Exception thrown: status_code = ", e.get_status_code(), ", what = ", e.what());
+			ResponseHeaders response_headers;
+			response_headers.version = 20000;
+			response_headers.status_code = e.get_status_code();
+			response_headers.reason = get_status_code_desc(e.get_status_code()).desc_short;
+			response_headers.headers = e.get_headers();
+			AUTO(default_entity, make_default_response_entity(response_headers));
+			http2_send(seq, STD_MOVE(response_headers), STD_MOVE(default_entity));
+		}
+	}
+	void LowLevelSession::on_http2_stream_closed(boost::uint32_t stream_id){
+		PROFILE_ME;
+
+		for(AUTO(it, m_http2_streams.begin()); it != m_http2_streams.end(); ++it){
+			if(it->second.stream_id == stream_id){
+				m_http2_streams.erase(it);
+				break;
+			}
+		}
+	}
+	std::map<boost::uint64_t, LowLevelSession::Http2StreamElement>::iterator LowLevelSession::find_http2_stream(boost::uint64_t seq){
+		if(seq == RESPONSE_SEQ_FRONT){
+			return m_http2_streams.begin();
+		}
+		return m_http2_streams.find(seq);
+	}
+	bool LowLevelSession::http2_send(boost::uint64_t seq, ResponseHeaders response_headers, StreamBuffer entity){
+		PROFILE_ME;
+
+		const AUTO(it, find_http2_stream(seq));
+		if(it == m_http2_streams.end()){
+			LOG_POSEIDON_DEBUG("HTTP/2 stream not found: seq = ", seq);
+			return false;
+		}
+		// 1xx 响应被忽略，之后还有最终响应。
+		if(response_headers.status_code / 100 == 1){
+			return true;
+		}
+		it->second.response_started = true;
+		const AUTO(stream_id, it->second.stream_id);
+		compress_response_entity(response_headers, entity, it->second.content_encoding);
+		const bool ret = m_http2->put_response(stream_id, STD_MOVE(response_headers), STD_MOVE(entity));
+		http2_check_shutdown();
+		return ret;
+	}
+	void LowLevelSession::http2_check_shutdown(){
+		if(m_http2_shutdown_pending && m_http2->is_idle()){
+			shutdown_write();
+		}
+	}
+
+	bool LowLevelSession::is_throttled() const {
+		if(is_pipeline_full()){
+			return true;
+		}
+		return TcpSessionBase::is_throttled();
+	}
+
+	const char *LowLevelSession::get_alpn_protocols(){
+		return config_get_http2_enabled() ? "h2,http/1.1" : "http/1.1";
+	}
+
 	boost::shared_ptr<UpgradedSessionBase> LowLevelSession::get_upgraded_session() const {
 		const Mutex::UniqueLock lock(m_upgraded_session_mutex);
 		return m_upgraded_session;
@@ -101,7 +477,19 @@ namespace Http {
 	bool LowLevelSession::send(ResponseHeaders response_headers, StreamBuffer entity){
 		PROFILE_ME;
 
-		return ServerWriter::put_response(STD_MOVE(response_headers), STD_MOVE(entity), true);
+		if(m_http2){
+			const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+			return http2_send(get_response_seq(), STD_MOVE(response_headers), STD_MOVE(entity));
+		}
+
+		const AUTO(status_code, response_headers.status_code);
+		const AUTO(content_encoding, get_response_content_encoding(status_code));
+		const bool ret = ServerWriter::put_response(STD_MOVE(response_headers), STD_MOVE(entity), true, content_encoding);
+		// 101 之后不再有 HTTP 响应。
+		if((status_code / 100 != 1) || (status_code == ST_SWITCHING_PROTOCOLS)){
+			complete_response(get_response_seq());
+		}
+		return ret;
 	}
 	bool LowLevelSession::send(StatusCode status_code){
 		PROFILE_ME;
@@ -133,23 +521,106 @@ namespace Http {
 		response_headers.status_code = status_code;
 		response_headers.reason = get_status_code_desc(status_code).desc_short;
 		response_headers.headers = STD_MOVE(headers);
-		return ServerWriter::put_default_response(STD_MOVE(response_headers));
+		if(m_http2){
+			AUTO(entity, make_default_response_entity(response_headers));
+			return send(STD_MOVE(response_headers), STD_MOVE(entity));
+		}
+		const AUTO(content_encoding, get_response_content_encoding(status_code));
+		const bool ret = ServerWriter::put_default_response(STD_MOVE(response_headers), content_encoding);
+		if((status_code / 100 != 1) || (status_code == ST_SWITCHING_PROTOCOLS)){
+			complete_response(get_response_seq());
+		}
+		return ret;
 	}
 
 	bool LowLevelSession::send_chunked_header(ResponseHeaders response_headers){
 		PROFILE_ME;
 
-		return ServerWriter::put_chunked_header(STD_MOVE(response_headers));
+		if(m_http2){
+			// HTTP/2 的分块响应不压缩。
+			const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+			const AUTO(it, find_http2_stream(get_response_seq()));
+			if(it == m_http2_streams.end()){
+				return false;
+			}
+			if(response_headers.status_code / 100 == 1){
+				return true;
+			}
+			it->second.response_started = true;
+			return m_http2->put_chunked_header(it->second.stream_id, STD_MOVE(response_headers));
+		}
+
+		const AUTO(content_encoding, get_response_content_encoding(response_headers.status_code));
+		boost::shared_ptr<Deflator> deflator;
+		const bool ret = ServerWriter::put_chunked_header(STD_MOVE(response_headers), content_encoding, deflator);
+		{
+			// 压缩状态属于这个请求，后面的请求的分块响应不能覆盖它。
+			const Mutex::UniqueLock lock(m_pipeline_mutex);
+			AUTO(seq, m_response_seq);
+			const AUTO(elem, find_pipeline_element(seq));
+			if(elem){
+				elem->chunked = true;
+				elem->chunked_deflator = STD_MOVE(deflator);
+			}
+		}
+		return ret;
 	}
 	bool LowLevelSession::send_chunk(StreamBuffer entity){
 		PROFILE_ME;
 
-		return ServerWriter::put_chunk(STD_MOVE(entity));
+		if(m_http2){
+			const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+			const AUTO(it, find_http2_stream(get_response_seq()));
+			if(it == m_http2_streams.end()){
+				return false;
+			}
+			return m_http2->put_chunk(it->second.stream_id, STD_MOVE(entity));
+		}
+
+		boost::shared_ptr<Deflator> deflator;
+		{
+			const Mutex::UniqueLock lock(m_pipeline_mutex);
+			AUTO(seq, m_response_seq);
+			const AUTO(elem, find_pipeline_element(seq));
+			if(elem){
+				deflator = elem->chunked_deflator;
+			}
+		}
+		return ServerWriter::put_chunk(STD_MOVE(entity), deflator);
 	}
 	bool LowLevelSession::send_chunked_trailer(OptionalMap headers){
 		PROFILE_ME;
 
-		return ServerWriter::put_chunked_trailer(STD_MOVE(headers));
+		if(m_http2){
+			const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+			const AUTO(it, find_http2_stream(get_response_seq()));
+			if(it == m_http2_streams.end()){
+				return false;
+			}
+			const bool ret = m_http2->put_chunked_trailer(it->second.stream_id, STD_MOVE(headers));
+			http2_check_shutdown();
+			return ret;
+		}
+
+		boost::shared_ptr<Deflator> deflator;
+		AUTO(seq, get_response_seq());
+		{
+			const Mutex::UniqueLock lock(m_pipeline_mutex);
+			const AUTO(elem, find_pipeline_element(seq));
+			if(elem){
+				deflator.swap(elem->chunked_deflator);
+			}
+		}
+		const bool ret = ServerWriter::put_chunked_trailer(STD_MOVE(headers), deflator);
+		{
+			const Mutex::UniqueLock lock(m_pipeline_mutex);
+			const AUTO(elem, find_pipeline_element(seq));
+			if(elem){
+				elem->chunked = false;
+			}
+		}
+		complete_response(seq);
+		return ret;
 	}
 
 	bool LowLevelSession::send_default_and_shutdown(StatusCode status_code, const OptionalMap &headers) NOEXCEPT {
@@ -158,9 +629,25 @@ namespace Http {
 		try {
 			AUTO(real_headers, headers);
 			real_headers.set(sslit("Connection"), "Close");
+			if(m_http2){
+				// HTTP/2 中只有这个流受影响。如果响应已经开始，只能重置这个流。
+				if(!send_default(status_code, STD_MOVE(real_headers))){
+					const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+					const AUTO(it, find_http2_stream(get_response_seq()));
+					if(it != m_http2_streams.end()){
+						m_http2->reset_stream(it->second.stream_id, H2E_INTERNAL_ERROR);
+					}
+				}
+				return true;
+			}
+			if(is_chunked_response_pending()){
+				// 分块响应已经开始，不能再发送默认响应，后面的响应也无法发送了。
+				force_shutdown();
+				return false;
+			}
 			send_default(status_code, STD_MOVE(real_headers));
 			shutdown_read();
-			return shutdown_write();
+			return shutdown_write_after_response(get_response_seq());
 		} catch(std::exception &e){
 			LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
 			force_shutdown();
@@ -177,9 +664,25 @@ namespace Http {
 		try {
 			AUTO(real_headers, STD_MOVE_IDN(headers));
 			real_headers.set(sslit("Connection"), "Close");
+			if(m_http2){
+				// HTTP/2 中只有这个流受影响。如果响应已经开始，只能重置这个流。
+				if(!send_default(status_code, STD_MOVE(real_headers))){
+					const RecursiveMutex::UniqueLock lock(m_http2_mutex);
+					const AUTO(it, find_http2_stream(get_response_seq()));
+					if(it != m_http2_streams.end()){
+						m_http2->reset_stream(it->second.stream_id, H2E_INTERNAL_ERROR);
+					}
+				}
+				return true;
+			}
+			if(is_chunked_response_pending()){
+				// 分块响应已经开始，不能再发送默认响应，后面的响应也无法发送了。
+				force_shutdown();
+				return false;
+			}
 			send_default(status_code, STD_MOVE(real_headers));
 			shutdown_read();
-			return shutdown_write();
+			return shutdown_write_after_response(get_response_seq());
 		} catch(std::exception &e){
 			LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
 			force_shutdown();
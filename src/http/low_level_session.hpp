@@ -6,6 +6,10 @@
 
 #include "../tcp_session_base.hpp"
 #include "../mutex.hpp"
+#include "../recursive_mutex.hpp"
+#include <deque>
+#include <map>
+#include <boost/scoped_ptr.hpp>
 #include "server_reader.hpp"
 #include "server_writer.hpp"
 #include "request_headers.hpp"
@@ -21,10 +25,55 @@ namespace Http {
 	class LowLevelSession : public TcpSessionBase, protected ServerReader, protected ServerWriter {
 		friend UpgradedSessionBase;
 
+	private:
+		class Http2Adapter;
+
 	private:
 		mutable Mutex m_upgraded_session_mutex;
 		boost::shared_ptr<UpgradedSessionBase> m_upgraded_session;
 
+		// 每个尚未完成响应的请求占用一个元素，按照请求的顺序排列。
+		// 只有队首的响应直接发送，其余的响应被缓存，在前面的响应完成之后依次发送。
+		struct PipelineElement {
+			ContentEncoding content_encoding; // Accept-Encoding 协商结果。
+			bool complete;
+			// 分块响应已经开始但是还没有发送 trailer，这期间 complete_response() 不会结束这个响应。
+			bool chunked;
+			boost::shared_ptr<Deflator> chunked_deflator;
+			StreamBuffer pending;
+		};
+
+		const std::size_t m_max_pipelining_depth;
+
+		mutable Mutex m_pipeline_mutex;
+		std::deque<PipelineElement> m_pipeline;
+		boost::uint64_t m_pipeline_front_seq;
+		boost::uint64_t m_response_seq;
+		boost::uint64_t m_shutdown_seq; // RESPONSE_SEQ_FRONT 表示没有推迟的关闭。
+
+		boost::uint64_t m_last_request_seq; // 只在 epoll 线程中访问。
+		// 管线满了之后暂停解析，已经读入的数据留在 ServerReader 的队列中，complete_response() 唤醒 epoll 线程之后继续。
+		bool m_parsing_paused; // 只在 epoll 线程中访问。
+		bool m_read_hup_deferred; // 只在 epoll 线程中访问。
+
+		// 连接的前 24 个字节是 HTTP/2 连接前言（明文的 prior knowledge，或者 TLS 上 ALPN 协商出 h2）时切换到 HTTP/2。
+		// 此时每个流作为一个请求，绕过上面的管线，响应按照序号找到对应的流。
+		struct Http2StreamElement {
+			boost::uint32_t stream_id;
+			ContentEncoding content_encoding;
+			bool response_started;
+		};
+
+		const bool m_http2_enabled;
+		bool m_protocol_detected; // 只在 epoll 线程中访问。
+		StreamBuffer m_preface_queue;
+
+		// 在分派第一个 HTTP/2 请求之前设置，此后不再改变。
+		boost::scoped_ptr<Http2Adapter> m_http2;
+		mutable RecursiveMutex m_http2_mutex;
+		std::map<boost::uint64_t, Http2StreamElement> m_http2_streams;
+		bool m_http2_shutdown_pending;
+
 	public:
 		explicit LowLevelSession(Move<UniqueFile> socket);
 		~LowLevelSession();
@@ -34,8 +83,17 @@ namespace Http {
 			// Epoll 线程读取不需要锁。
 			return m_upgraded_session;
 		}
+		// 最近一个请求的序号，只能在 epoll 线程中调用。
+		boost::uint64_t get_low_level_request_seq() const {
+			return m_last_request_seq;
+		}
+
+		// 暂停解析期间收到的读端关闭需要推迟到已经读入的请求都被解析之后，只能在 epoll 线程中调用。
+		// 返回 true 表示已经推迟，解析完之后会再次调用 on_read_hup()。
+		bool defer_read_hup();
 
 		// TcpSessionBase
+		int poll_read_and_process(bool readable) OVERRIDE;
 		void on_connect() OVERRIDE;
 		void on_read_hup() OVERRIDE;
 		void on_close(int err_code) OVERRIDE;
@@ -53,8 +111,51 @@ namespace Http {
 		virtual void on_low_level_request_headers(RequestHeaders request_headers, boost::uint64_t content_length) = 0;
 		virtual void on_low_level_request_entity(boost::uint64_t entity_offset, StreamBuffer entity) = 0;
 		virtual boost::shared_ptr<UpgradedSessionBase> on_low_level_request_end(boost::uint64_t content_length, OptionalMap headers) = 0;
+		// HTTP/2 的请求在交给上面的函数之前被完整缓存，这是每个流缓存的上限。
+		virtual boost::uint64_t get_low_level_max_request_length() const;
+
+		// 此后发送的数据属于哪一个请求的响应。RESPONSE_SEQ_FRONT 表示最早的未完成的请求。
+		void set_response_seq(boost::uint64_t seq);
+		// 标记一个请求的响应已经完成，并发送在它后面缓存的响应。重复调用没有效果。
+		// 最终响应（不含 1xx 响应）在发送之后会自动调用这个函数。分块响应只在发送 trailer 之后完成，在此之前调用没有效果。
+		void complete_response(boost::uint64_t seq);
+		// 在这个请求及其之前的所有响应发送之后关闭写端，后面的响应被丢弃。
+		bool shutdown_write_after_response(boost::uint64_t seq) NOEXCEPT;
+
+	private:
+		void parse_requests(StreamBuffer data);
+		bool is_pipeline_full() const;
+
+		ContentEncoding get_response_content_encoding(StatusCode status_code);
+		boost::uint64_t get_response_seq() const;
+		// 要求调用者持有 m_pipeline_mutex。seq 为 RESPONSE_SEQ_FRONT 时被替换为队首的序号。请求已经完成时返回 NULLPTR。
+		PipelineElement *find_pipeline_element(boost::uint64_t &seq);
+		bool is_chunked_response_pending();
+
+		void on_http2_request(boost::uint32_t stream_id, RequestHeaders request_headers, StreamBuffer entity);
+		void on_http2_stream_closed(boost::uint32_t stream_id);
+		// 以下函数要求调用者持有 m_http2_mutex。
+		std::map<boost::uint64_t, Http2StreamElement>::iterator find_http2_stream(boost::uint64_t seq);
+		bool http2_send(boost::uint64_t seq, ResponseHeaders response_headers, StreamBuffer entity);
+		void http2_check_shutdown();
 
 	public:
+		enum {
+			RESPONSE_SEQ_FRONT = (boost::uint64_t)-1,
+		};
+
+		std::size_t get_max_pipelining_depth() const {
+			return m_max_pipelining_depth;
+		}
+		// 返回 true 表示这个连接使用 HTTP/2。
+		bool is_http2() const {
+			return !!m_http2;
+		}
+		// 用于 TLS 的 ALPN，逗号分隔。
+		static const char *get_alpn_protocols();
+
+		bool is_throttled() const OVERRIDE;
+
 		boost::shared_ptr<UpgradedSessionBase> get_upgraded_session() const;
 
 		bool send(ResponseHeaders response_headers, StreamBuffer entity = StreamBuffer());
@@ -12,19 +12,267 @@
 #include "../string.hpp"
 #include "../singletons/main_config.hpp"
 #include "../buffer_streams.hpp"
+#include "../config_file.hpp"
+#include "../mutex.hpp"
+#include "../atomic.hpp"
+#include "../time.hpp"
+#include "../checked_arithmetic.hpp"
+#include <boost/make_shared.hpp>
 
 namespace Poseidon {
 
 namespace Http {
+	namespace {
+		volatile boost::uint64_t g_next_config_check_time = 0;
+		Mutex g_config_mutex;
+		boost::shared_ptr<const ConfigFile> g_config;
+
+		volatile std::size_t g_max_header_line_length = 8192;
+		volatile std::size_t g_max_headers_per_request = 64;
+
+		// 每个请求都会用到这些配置项，只在配置文件重新加载之后读取。
+		void reload_header_limits(){
+			const AUTO(now, get_fast_mono_clock());
+			AUTO(next_check_time, atomic_load(g_next_config_check_time, ATOMIC_RELAXED));
+			if(now < next_check_time){
+				return;
+			}
+			if(!atomic_compare_exchange(g_next_config_check_time, next_check_time, saturated_add(now, (boost::uint64_t)1000), ATOMIC_RELAXED, ATOMIC_RELAXED)){
+				return;
+			}
+			AUTO(config, MainConfig::get_config());
+			const Mutex::UniqueLock lock(g_config_mutex);
+			if(config == g_config){
+				return;
+			}
+			g_config.swap(config);
+
+			std::size_t max_header_line_length = 8192;
+			g_config->get(max_header_line_length, "http_max_header_line_length");
+			LOG_POSEIDON_DEBUG("http_max_header_line_length = ", max_header_line_length);
+			atomic_store(g_max_header_line_length, max_header_line_length, ATOMIC_RELAXED);
+
+			std::size_t max_headers_per_request = 64;
+			g_config->get(max_headers_per_request, "http_max_headers_per_request");
+			LOG_POSEIDON_DEBUG("http_max_headers_per_request = ", max_headers_per_request);
+			atomic_store(g_max_headers_per_request, max_headers_per_request, ATOMIC_RELAXED);
+		}
+
+		std::size_t get_max_header_line_length(){
+			return atomic_load(g_max_header_line_length, ATOMIC_RELAXED);
+		}
+		std::size_t get_max_headers_per_request(){
+			return atomic_load(g_max_headers_per_request, ATOMIC_RELAXED);
+		}
+	}
+
 	ServerReader::ServerReader()
-		: m_size_expecting(EXPECTING_NEW_LINE), m_state(S_FIRST_HEADER)
+		: m_size_expecting(EXPECTING_NEW_LINE), m_state(S_HEADER_BLOCK)
+		, m_header_block(), m_header_lines(), m_line_begin(0)
 	{ }
 	ServerReader::~ServerReader(){
-		if(m_state != S_FIRST_HEADER){
+		if((m_state != S_HEADER_BLOCK) || (m_header_block && !m_header_block->empty())){
 			LOG_POSEIDON_DEBUG("Now that this reader is to be destroyed, a premature request has to be discarded.");
 		}
 	}
 
+	bool ServerReader::scan_header_block(){
+		PROFILE_ME;
+
+		if(!m_header_block){
+			m_header_block = boost::make_shared<std::vector<char> >();
+		} else if(m_header_block->empty() && !m_header_block.unique()){
+			// 上一个请求的报头仍在使用中。新的缓冲区按照上一个的大小预留空间。
+			const std::size_t capacity = m_header_block->capacity();
+			m_header_block = boost::make_shared<std::vector<char> >();
+			m_header_block->reserve(capacity);
+		}
+		AUTO_REF(block, *m_header_block);
+		if(block.empty()){
+			reload_header_limits();
+			m_header_lines.clear();
+			m_line_begin = 0;
+		}
+		const AUTO(max_line_length, get_max_header_line_length());
+		const AUTO(max_headers, get_max_headers_per_request());
+
+		for(;;){
+			const void *data;
+			std::size_t size;
+			StreamBuffer::EnumerationCookie cookie;
+			do {
+				// discard() 可能在开头留下空的块。
+				if(!m_queue.enumerate_chunk(&data, &size, cookie)){
+					return false;
+				}
+			} while(size == 0);
+			// memchr() 在 glibc 中使用 SIMD 实现，一次检查 16 或 32 个字节。
+			const AUTO(begin, static_cast<const char *>(data));
+			const AUTO(lf, static_cast<const char *>(std::memchr(begin, '\n', size)));
+			const std::size_t count = lf ? static_cast<std::size_t>(lf - begin + 1) : size;
+			block.insert(block.end(), begin, begin + count);
+			m_queue.discard(count);
+			if(!lf){
+				if(block.size() - m_line_begin > max_line_length){
+					LOG_POSEIDON_WARNING("HTTP header line is too long: size = ", block.size() - m_line_begin);
+					DEBUG_THROW(Exception, ST_BAD_REQUEST); // XXX 用一个别的状态码？
+				}
+				continue;
+			}
+
+			std::size_t line_end = block.size() - 1;
+			if((line_end > m_line_begin) && (block[line_end - 1] == '\r')){
+				--line_end;
+			}
+			if(line_end - m_line_begin > max_line_length){
+				LOG_POSEIDON_WARNING("HTTP header line is too long: size = ", line_end - m_line_begin);
+				DEBUG_THROW(Exception, ST_BAD_REQUEST); // XXX 用一个别的状态码？
+			}
+			if(line_end == m_line_begin){
+				if(m_header_lines.empty()){
+					// 忽略请求行之前的空行。
+					block.clear();
+					m_line_begin = 0;
+					continue;
+				}
+				return true;
+			}
+			if(m_header_lines.size() > max_headers){
+				LOG_POSEIDON_WARNING("Too many HTTP headers: headers = ", m_header_lines.size() - 1);
+				DEBUG_THROW(Exception, ST_BAD_REQUEST); // XXX 用一个别的状态码？
+			}
+			m_header_lines.push_back(std::make_pair(m_line_begin, line_end));
+			m_line_begin = block.size();
+		}
+	}
+	void ServerReader::parse_header_block(bool dont_parse_get_params){
+		PROFILE_ME;
+
+		AUTO_REF(block, *m_header_block);
+		// 行尾的 CR 或 LF 被改写为 NUL，可以直接作为 C 字符串使用。
+		for(AUTO(it, m_header_lines.begin()); it != m_header_lines.end(); ++it){
+			block[it->second] = 0;
+		}
+
+		m_request_headers = RequestHeaders();
+		m_content_length = 0;
+		m_content_offset = 0;
+
+		char *const line = &block[m_header_lines.front().first];
+		const std::size_t line_size = m_header_lines.front().second - m_header_lines.front().first;
+		for(std::size_t i = 0; i < line_size; ++i){
+			const unsigned ch = static_cast<unsigned char>(line[i]);
+			if((ch < 0x20) || (ch >= 0x7F)){
+				LOG_POSEIDON_WARNING("Invalid HTTP request header: line = ", line);
+				DEBUG_THROW(BasicException, sslit("Invalid HTTP request header"));
+			}
+		}
+
+		char *const verb_end = static_cast<char *>(std::memchr(line, ' ', line_size));
+		if(!verb_end){
+			LOG_POSEIDON_WARNING("Bad request header: expecting verb, line = ", line);
+			DEBUG_THROW(Exception, ST_BAD_REQUEST);
+		}
+		*verb_end = 0;
+		m_request_headers.verb = get_verb_from_string(line);
+		if(m_request_headers.verb == V_INVALID_VERB){
+			LOG_POSEIDON_WARNING("Bad verb: ", line);
+			DEBUG_THROW(Exception, ST_NOT_IMPLEMENTED);
+		}
+
+		char *const uri = verb_end + 1;
+		char *const uri_end = std::strchr(uri, ' ');
+		if(!uri_end){
+			LOG_POSEIDON_WARNING("Bad request header: expecting URI end, line = ", uri);
+			DEBUG_THROW(Exception, ST_BAD_REQUEST);
+		}
+		m_request_headers.uri.assign(uri, uri_end);
+
+		const char *const ver = uri_end + 1;
+		long ver_end = 0;
+		char ver_major_str[16], ver_minor_str[16];
+		if(std::sscanf(ver, "HTTP/%15[0-9].%15[0-9]%ln", ver_major_str, ver_minor_str, &ver_end) != 2){
+			LOG_POSEIDON_WARNING("Bad request header: expecting HTTP version, line = ", ver);
+			DEBUG_THROW(Exception, ST_BAD_REQUEST);
+		}
+		if(ver[ver_end] != 0){
+			LOG_POSEIDON_WARNING("Bad request header: junk after HTTP version, line = ", ver);
+			DEBUG_THROW(Exception, ST_BAD_REQUEST);
+		}
+		m_request_headers.version = std::strtoul(ver_major_str, NULLPTR, 10) * 10000 + std::strtoul(ver_minor_str, NULLPTR, 10);
+		if((m_request_headers.version != 10000) && (m_request_headers.version != 10001)){
+			LOG_POSEIDON_WARNING("Bad request header: HTTP version not supported, ver_major_str = ", ver_major_str,
+				", ver_minor_str = ", ver_minor_str);
+			DEBUG_THROW(Exception, ST_VERSION_NOT_SUPPORTED);
+		}
+
+		if(!dont_parse_get_params){
+			const AUTO(pos, m_request_headers.uri.find('?'));
+			if(pos != std::string::npos){
+				Buffer_istream is;
+				is.set_buffer(StreamBuffer(m_request_headers.uri.data() + pos + 1, m_request_headers.uri.size() - pos - 1));
+				url_decode_params(is, m_request_headers.get_params);
+				m_request_headers.uri.erase(pos);
+			}
+		}
+
+		for(std::size_t i = 1; i < m_header_lines.size(); ++i){
+			char *const begin = &block[m_header_lines.at(i).first];
+			char *const end = &block[m_header_lines.at(i).second];
+			char *const colon = static_cast<char *>(std::memchr(begin, ':', static_cast<std::size_t>(end - begin)));
+			if(!colon){
+				LOG_POSEIDON_WARNING("Invalid HTTP header: ", begin);
+				DEBUG_THROW(Exception, ST_BAD_REQUEST);
+			}
+			*colon = 0;
+			const char *value_begin = colon + 1;
+			const char *value_end = end;
+			while((value_begin != value_end) && ((*value_begin == ' ') || (*value_begin == '\t'))){
+				++value_begin;
+			}
+			while((value_begin != value_end) && ((value_end[-1] == ' ') || (value_end[-1] == '\t'))){
+				--value_end;
+			}
+			// 名字与报头块共享所有权，不需要复制。
+			m_request_headers.headers.append(SharedNts(m_header_block, begin), std::string(value_begin, value_end));
+		}
+		block.clear();
+
+		const AUTO_REF(transfer_encoding, m_request_headers.headers.get("Transfer-Encoding"));
+		if(transfer_encoding.empty() || (::strcasecmp(transfer_encoding.c_str(), "identity") == 0)){
+			const AUTO_REF(content_length, m_request_headers.headers.get("Content-Length"));
+			if(content_length.empty()){
+				m_content_length = 0;
+			} else {
+				char *endptr;
+				m_content_length = ::strtoull(content_length.c_str(), &endptr, 10);
+				if(*endptr){
+					LOG_POSEIDON_WARNING("Bad request header Content-Length: ", content_length);
+					DEBUG_THROW(Exception, ST_BAD_REQUEST);
+				}
+				if(m_content_length > CONTENT_LENGTH_MAX){
+					LOG_POSEIDON_WARNING("Inacceptable Content-Length: ", content_length);
+					DEBUG_THROW(Exception, ST_PAYLOAD_TOO_LARGE);
+				}
+			}
+		} else if(::strcasecmp(transfer_encoding.c_str(), "chunked") == 0){
+			m_content_length = CONTENT_CHUNKED;
+		} else {
+			LOG_POSEIDON_WARNING("Inacceptable Transfer-Encoding: ", transfer_encoding);
+			DEBUG_THROW(BasicException, sslit("Inacceptable Transfer-Encoding"));
+		}
+
+		on_request_headers(STD_MOVE(m_request_headers), m_content_length);
+
+		if(m_content_length == CONTENT_CHUNKED){
+			m_size_expecting = EXPECTING_NEW_LINE;
+			m_state = S_CHUNK_HEADER;
+		} else {
+			m_size_expecting = std::min<boost::uint64_t>(m_content_length, 4096);
+			m_state = S_IDENTITY;
+		}
+	}
+
 	bool ServerReader::put_encoded_data(StreamBuffer encoded, bool dont_parse_get_params){
 		PROFILE_ME;
 
@@ -32,6 +280,14 @@ namespace Http {
 
 		bool has_next_request = true;
 		do {
+			if(m_state == S_HEADER_BLOCK){
+				if(!scan_header_block()){
+					break;
+				}
+				parse_header_block(dont_parse_get_params);
+				continue;
+			}
+
 			const bool expecting_new_line = (m_size_expecting == EXPECTING_NEW_LINE);
 
 			if(expecting_new_line){
@@ -53,8 +309,7 @@ namespace Http {
 				}
 				if(lf_offset < 0){
 					// 没找到换行符。
-					const AUTO(max_line_length, MainConfig::get<std::size_t>("http_max_header_line_length", 8192));
-					if(m_queue.size() > max_line_length){
+					if(m_queue.size() > get_max_header_line_length()){
 						LOG_POSEIDON_WARNING("HTTP header line is too long: size = ", m_queue.size());
 						DEBUG_THROW(Exception, ST_BAD_REQUEST); // XXX 用一个别的状态码？
 					}
@@ -78,137 +333,9 @@ namespace Http {
 			switch(m_state){
 				boost::uint64_t temp64;
 
-			case S_FIRST_HEADER:
-				if(!expected.empty()){
-					m_request_headers = RequestHeaders();
-					m_content_length = 0;
-					m_content_offset = 0;
-
-					std::string line = expected.dump_string();
-
-					for(AUTO(it, line.begin()); it != line.end(); ++it){
-						const unsigned ch = static_cast<unsigned char>(*it);
-						if((ch < 0x20) || (ch >= 0x7F)){
-							LOG_POSEIDON_WARNING("Invalid HTTP request header: line = ", line);
-							DEBUG_THROW(BasicException, sslit("Invalid HTTP request header"));
-						}
-					}
-
-					AUTO(pos, line.find(' '));
-					if(pos == std::string::npos){
-						LOG_POSEIDON_WARNING("Bad request header: expecting verb, line = ", line);
-						DEBUG_THROW(Exception, ST_BAD_REQUEST);
-					}
-					line[pos] = 0;
-					m_request_headers.verb = get_verb_from_string(line.c_str());
-					if(m_request_headers.verb == V_INVALID_VERB){
-						LOG_POSEIDON_WARNING("Bad verb: ", line);
-						DEBUG_THROW(Exception, ST_NOT_IMPLEMENTED);
-					}
-					line.erase(0, pos + 1);
-
-					pos = line.find(' ');
-					if(pos == std::string::npos){
-						LOG_POSEIDON_WARNING("Bad request header: expecting URI end, line = ", line);
-						DEBUG_THROW(Exception, ST_BAD_REQUEST);
-					}
-					m_request_headers.uri.assign(line, 0, pos);
-					line.erase(0, pos + 1);
-
-					long ver_end = 0;
-					char ver_major_str[16], ver_minor_str[16];
-					if(std::sscanf(line.c_str(), "HTTP/%15[0-9].%15[0-9]%ln", ver_major_str, ver_minor_str, &ver_end) != 2){
-						LOG_POSEIDON_WARNING("Bad request header: expecting HTTP version, line = ", line);
-						DEBUG_THROW(Exception, ST_BAD_REQUEST);
-					}
-					if(static_cast<unsigned long>(ver_end) != line.size()){
-						LOG_POSEIDON_WARNING("Bad request header: junk after HTTP version, line = ", line);
-						DEBUG_THROW(Exception, ST_BAD_REQUEST);
-					}
-					m_request_headers.version = std::strtoul(ver_major_str, NULLPTR, 10) * 10000 + std::strtoul(ver_minor_str, NULLPTR, 10);
-					if((m_request_headers.version != 10000) && (m_request_headers.version != 10001)){
-						LOG_POSEIDON_WARNING("Bad request header: HTTP version not supported, ver_major_str = ", ver_major_str,
-							", ver_minor_str = ", ver_minor_str);
-						DEBUG_THROW(Exception, ST_VERSION_NOT_SUPPORTED);
-					}
-
-					if(!dont_parse_get_params){
-						pos = m_request_headers.uri.find('?');
-						if(pos != std::string::npos){
-							Buffer_istream is;
-							is.set_buffer(StreamBuffer(m_request_headers.uri.data() + pos + 1, m_request_headers.uri.size() - pos - 1));
-							url_decode_params(is, m_request_headers.get_params);
-							m_request_headers.uri.erase(pos);
-						}
-					}
-
-					m_size_expecting = EXPECTING_NEW_LINE;
-					m_state = S_HEADERS;
-				} else {
-					m_size_expecting = EXPECTING_NEW_LINE;
-					// m_state = S_FIRST_HEADER;
-				}
-				break;
-
-			case S_HEADERS:
-				if(!expected.empty()){
-					const AUTO(headers, m_request_headers.headers.size());
-					const AUTO(max_headers, MainConfig::get<std::size_t>("http_max_headers_per_request", 64));
-					if(headers >= max_headers){
-						LOG_POSEIDON_WARNING("Too many HTTP headers: headers = ", headers);
-						DEBUG_THROW(Exception, ST_BAD_REQUEST); // XXX 用一个别的状态码？
-					}
-
-					std::string line = expected.dump_string();
-
-					AUTO(pos, line.find(':'));
-					if(pos == std::string::npos){
-						LOG_POSEIDON_WARNING("Invalid HTTP header: ", line);
-						DEBUG_THROW(Exception, ST_BAD_REQUEST);
-					}
-					SharedNts key(line.data(), pos);
-					line.erase(0, pos + 1);
-					std::string value(trim(STD_MOVE(line)));
-					m_request_headers.headers.append(STD_MOVE(key), STD_MOVE(value));
-
-					m_size_expecting = EXPECTING_NEW_LINE;
-					// m_state = S_HEADERS;
-				} else {
-					const AUTO_REF(transfer_encoding, m_request_headers.headers.get("Transfer-Encoding"));
-					if(transfer_encoding.empty() || (::strcasecmp(transfer_encoding.c_str(), "identity") == 0)){
-						const AUTO_REF(content_length, m_request_headers.headers.get("Content-Length"));
-						if(content_length.empty()){
-							m_content_length = 0;
-						} else {
-							char *endptr;
-							m_content_length = ::strtoull(content_length.c_str(), &endptr, 10);
-							if(*endptr){
-								LOG_POSEIDON_WARNING("Bad request header Content-Length: ", content_length);
-								DEBUG_THROW(Exception, ST_BAD_REQUEST);
-							}
-							if(m_content_length > CONTENT_LENGTH_MAX){
-								LOG_POSEIDON_WARNING("Inacceptable Content-Length: ", content_length);
-								DEBUG_THROW(Exception, ST_PAYLOAD_TOO_LARGE);
-							}
-						}
-					} else if(::strcasecmp(transfer_encoding.c_str(), "chunked") == 0){
-						m_content_length = CONTENT_CHUNKED;
-					} else {
-						LOG_POSEIDON_WARNING("Inacceptable Transfer-Encoding: ", transfer_encoding);
-						DEBUG_THROW(BasicException, sslit("Inacceptable Transfer-Encoding"));
-					}
-
-					on_request_headers(STD_MOVE(m_request_headers), m_content_length);
-
-					if(m_content_length == CONTENT_CHUNKED){
-						m_size_expecting = EXPECTING_NEW_LINE;
-						m_state = S_CHUNK_HEADER;
-					} else {
-						m_size_expecting = std::min<boost::uint64_t>(m_content_length, 4096);
-						m_state = S_IDENTITY;
-					}
-				}
-				break;
+			case S_HEADER_BLOCK:
+				// 报头块在上面整块处理，不会走到这里。
+				DEBUG_THROW(BasicException, sslit("Unexpected HTTP reader state"));
 
 			case S_IDENTITY:
 				temp64 = std::min<boost::uint64_t>(expected.size(), m_content_length - m_content_offset);
@@ -224,7 +351,7 @@ namespace Http {
 					has_next_request = on_request_end(m_content_offset, VAL_INIT);
 
 					m_size_expecting = EXPECTING_NEW_LINE;
-					m_state = S_FIRST_HEADER;
+					m_state = S_HEADER_BLOCK;
 				}
 				break;
 
@@ -296,7 +423,7 @@ namespace Http {
 					has_next_request = on_request_end(m_content_offset, STD_MOVE(m_chunked_trailer));
 
 					m_size_expecting = EXPECTING_NEW_LINE;
-					m_state = S_FIRST_HEADER;
+					m_state = S_HEADER_BLOCK;
 				}
 				break;
 			}
@@ -5,8 +5,11 @@
 #define POSEIDON_HTTP_SERVER_READER_HPP_
 
 #include <string>
+#include <vector>
+#include <utility>
 #include <cstddef>
 #include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
 #include "../stream_buffer.hpp"
 #include "../optional_map.hpp"
 #include "request_headers.hpp"
@@ -17,8 +20,7 @@ namespace Http {
 	class ServerReader {
 	private:
 		enum State {
-			S_FIRST_HEADER      = 0,
-			S_HEADERS           = 1,
+			S_HEADER_BLOCK      = 0,
 			S_IDENTITY          = 2,
 			S_CHUNK_HEADER      = 3,
 			S_CHUNK_DATA        = 4,
@@ -43,6 +45,12 @@ namespace Http {
 		boost::uint64_t m_size_expecting;
 		State m_state;
 
+		// 请求行和报头被整块复制到这里，报头的名字直接指向其中，不再单独分配内存。
+		boost::shared_ptr<std::vector<char> > m_header_block;
+		// 每一行在 m_header_block 中的起止位置，不含行尾的 CR LF。
+		std::vector<std::pair<std::size_t, std::size_t> > m_header_lines;
+		std::size_t m_line_begin;
+
 		RequestHeaders m_request_headers;
 		boost::uint64_t m_content_length;
 		boost::uint64_t m_content_offset;
@@ -55,6 +63,11 @@ namespace Http {
 		ServerReader();
 		virtual ~ServerReader();
 
+	private:
+		// 返回 true 表示已经收到了完整的报头块。
+		bool scan_header_block();
+		void parse_header_block(bool dont_parse_get_params);
+
 	protected:
 		// 如果 Transfer-Encoding 为 chunked， content_length 的值为 CONTENT_CHUNKED。
 		virtual void on_request_headers(RequestHeaders request_headers, boost::uint64_t content_length) = 0;
@@ -7,16 +7,168 @@
 #include "../log.hpp"
 #include "../profiler.hpp"
 #include "../string.hpp"
+#include "../zlib.hpp"
+#include "../singletons/main_config.hpp"
+#include "../config_file.hpp"
+#include "../mutex.hpp"
+#include "../atomic.hpp"
+#include "../time.hpp"
+#include "../checked_arithmetic.hpp"
+#include <boost/make_shared.hpp>
 
 namespace Poseidon {
 
 namespace Http {
-	ServerWriter::ServerWriter(){ }
+	namespace {
+		volatile boost::uint64_t g_next_config_check_time = 0;
+		Mutex g_config_mutex;
+		boost::shared_ptr<const ConfigFile> g_config;
+		boost::shared_ptr<const std::vector<std::string> > g_compressible_content_types;
+
+		volatile std::size_t g_compression_min_size = 1024;
+		volatile int g_compression_level = 6;
+
+		// 每个响应都会用到这些配置项，只在配置文件重新加载之后读取。
+		void reload_compression_config(){
+			const AUTO(now, get_fast_mono_clock());
+			AUTO(next_check_time, atomic_load(g_next_config_check_time, ATOMIC_RELAXED));
+			if(now < next_check_time){
+				return;
+			}
+			if(!atomic_compare_exchange(g_next_config_check_time, next_check_time, saturated_add(now, (boost::uint64_t)1000), ATOMIC_RELAXED, ATOMIC_RELAXED)){
+				return;
+			}
+			AUTO(config, MainConfig::get_config());
+			const Mutex::UniqueLock lock(g_config_mutex);
+			if(config == g_config){
+				return;
+			}
+			g_config.swap(config);
+
+			AUTO(content_types, boost::make_shared<std::vector<std::string> >());
+			g_config->get_all(*content_types, "http_compressible_content_type");
+			LOG_POSEIDON_DEBUG("http_compressible_content_type: ", content_types->size(), " pattern(s)");
+			g_compressible_content_types = STD_MOVE_IDN(content_types);
+
+			std::size_t compression_min_size = 1024;
+			g_config->get(compression_min_size, "http_compression_min_size");
+			LOG_POSEIDON_DEBUG("http_compression_min_size = ", compression_min_size);
+			atomic_store(g_compression_min_size, compression_min_size, ATOMIC_RELAXED);
+
+			int compression_level = 6;
+			g_config->get(compression_level, "http_compression_level");
+			LOG_POSEIDON_DEBUG("http_compression_level = ", compression_level);
+			atomic_store(g_compression_level, compression_level, ATOMIC_RELAXED);
+		}
+
+		boost::shared_ptr<const std::vector<std::string> > get_compressible_content_types(){
+			const Mutex::UniqueLock lock(g_config_mutex);
+			return g_compressible_content_types;
+		}
+		std::size_t get_compression_min_size(){
+			return atomic_load(g_compression_min_size, ATOMIC_RELAXED);
+		}
+		int get_compression_level(){
+			return atomic_load(g_compression_level, ATOMIC_RELAXED);
+		}
+
+		bool is_content_type_compressible(const std::string &content_type){
+			const AUTO(base, trim(content_type.substr(0, content_type.find(';'))));
+			if(base.empty()){
+				return false;
+			}
+			const AUTO(patterns, get_compressible_content_types());
+			if(!patterns){
+				return false;
+			}
+			for(AUTO(it, patterns->begin()); it != patterns->end(); ++it){
+				const AUTO_REF(pattern, *it);
+				// 以 /* 结尾的类型匹配所有子类型。
+				if((pattern.size() >= 2) && (pattern.compare(pattern.size() - 2, 2, "/*") == 0)){
+					if(::strncasecmp(base.c_str(), pattern.c_str(), pattern.size() - 1) == 0){
+						return true;
+					}
+				} else if(::strcasecmp(base.c_str(), pattern.c_str()) == 0){
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// 如果应当压缩，返回 true，并设置 Content-Encoding 和 Vary。
+		bool prepare_compression(ResponseHeaders &response_headers, ContentEncoding content_encoding){
+			if((content_encoding != CE_DEFLATE) && (content_encoding != CE_GZIP)){
+				return false;
+			}
+			const AUTO(status_code, response_headers.status_code);
+			if((status_code / 100 == 1) || (status_code == ST_NO_CONTENT) || (status_code == ST_NOT_MODIFIED)){
+				return false;
+			}
+			AUTO_REF(headers, response_headers.headers);
+			if(headers.has("Content-Encoding") || headers.has("Content-Range")){
+				return false;
+			}
+			if(!is_content_type_compressible(headers.get("Content-Type"))){
+				return false;
+			}
+			headers.set(sslit("Content-Encoding"), (content_encoding == CE_GZIP) ? "gzip" : "deflate");
+			headers.append(sslit("Vary"), "Accept-Encoding");
+			return true;
+		}
+	}
+
+	bool compress_response_entity(ResponseHeaders &response_headers, StreamBuffer &entity, ContentEncoding content_encoding){
+		PROFILE_ME;
+
+		reload_compression_config();
+		if(entity.size() < get_compression_min_size()){
+			return false;
+		}
+		if(!prepare_compression(response_headers, content_encoding)){
+			return false;
+		}
+		Deflator deflator(content_encoding == CE_GZIP, get_compression_level());
+		deflator.put(entity);
+		AUTO(compressed, deflator.finalize());
+		LOG_POSEIDON_TRACE("Compressed HTTP response: ", entity.size(), " -> ", compressed.size());
+		entity.swap(compressed);
+		return true;
+	}
+	StreamBuffer make_default_response_entity(ResponseHeaders &response_headers){
+		PROFILE_ME;
+
+		StreamBuffer entity;
+
+		const AUTO(status_code, response_headers.status_code);
+		if(status_code / 100 >= 4){
+			AUTO_REF(headers, response_headers.headers);
+
+			headers.set(sslit("Content-Type"), "text/html");
+			entity.put("<html><head><title>");
+			const AUTO(desc, get_status_code_desc(status_code));
+			entity.put(desc.desc_short);
+			entity.put("</title></head><body><h1>");
+			entity.put(desc.desc_short);
+			entity.put("</h1><hr /><p>");
+			entity.put(desc.desc_long);
+			entity.put("</p></body></html>");
+		}
+
+		return entity;
+	}
+
+	ServerWriter::ServerWriter()
+		: m_chunked_deflator()
+	{ }
 	ServerWriter::~ServerWriter(){ }
 
-	long ServerWriter::put_response(ResponseHeaders response_headers, StreamBuffer entity, bool set_content_length){
+	long ServerWriter::put_response(ResponseHeaders response_headers, StreamBuffer entity, bool set_content_length,
+		ContentEncoding content_encoding)
+	{
 		PROFILE_ME;
 
+		compress_response_entity(response_headers, entity, content_encoding);
+
 		StreamBuffer data;
 
 		const unsigned ver_major = response_headers.version / 10000, ver_minor = response_headers.version % 10000;
@@ -54,32 +206,39 @@ namespace Http {
 
 		return on_encoded_data_avail(STD_MOVE(data));
 	}
-	long ServerWriter::put_default_response(ResponseHeaders response_headers){
+	long ServerWriter::put_default_response(ResponseHeaders response_headers, ContentEncoding content_encoding){
 		PROFILE_ME;
 
-		StreamBuffer entity;
+		AUTO(entity, make_default_response_entity(response_headers));
+		return put_response(STD_MOVE(response_headers), STD_MOVE(entity), true, content_encoding);
+	}
 
-		const AUTO(status_code, response_headers.status_code);
-		if(status_code / 100 >= 4){
-			AUTO_REF(headers, response_headers.headers);
+	long ServerWriter::put_chunked_header(ResponseHeaders response_headers, ContentEncoding content_encoding){
+		PROFILE_ME;
 
-			headers.set(sslit("Content-Type"), "text/html");
-			entity.put("<html><head><title>");
-			const AUTO(desc, get_status_code_desc(status_code));
-			entity.put(desc.desc_short);
-			entity.put("</title></head><body><h1>");
-			entity.put(desc.desc_short);
-			entity.put("</h1><hr /><p>");
-			entity.put(desc.desc_long);
-			entity.put("</p></body></html>");
-		}
+		return put_chunked_header(STD_MOVE(response_headers), content_encoding, m_chunked_deflator);
+	}
+	long ServerWriter::put_chunk(StreamBuffer entity){
+		PROFILE_ME;
 
-		return put_response(STD_MOVE(response_headers), STD_MOVE(entity), true);
+		return put_chunk(STD_MOVE(entity), m_chunked_deflator);
 	}
+	long ServerWriter::put_chunked_trailer(OptionalMap headers){
+		PROFILE_ME;
 
-	long ServerWriter::put_chunked_header(ResponseHeaders response_headers){
+		return put_chunked_trailer(STD_MOVE(headers), m_chunked_deflator);
+	}
+
+	long ServerWriter::put_chunked_header(ResponseHeaders response_headers, ContentEncoding content_encoding, boost::shared_ptr<Deflator> &deflator){
 		PROFILE_ME;
 
+		reload_compression_config();
+		deflator.reset();
+		if(prepare_compression(response_headers, content_encoding)){
+			deflator = boost::make_shared<Deflator>(content_encoding == CE_GZIP, get_compression_level());
+			response_headers.headers.erase("Content-Length");
+		}
+
 		StreamBuffer data;
 
 		const unsigned ver_major = response_headers.version / 10000, ver_minor = response_headers.version % 10000;
@@ -106,7 +265,7 @@ namespace Http {
 
 		return on_encoded_data_avail(STD_MOVE(data));
 	}
-	long ServerWriter::put_chunk(StreamBuffer entity){
+	long ServerWriter::put_chunk(StreamBuffer entity, const boost::shared_ptr<Deflator> &deflator){
 		PROFILE_ME;
 
 		if(entity.empty()){
@@ -114,6 +273,18 @@ namespace Http {
 			DEBUG_THROW(BasicException, sslit("You are not allowed to send an empty chunk"));
 		}
 
+		if(deflator){
+			// 每个块都立即 flush()，长轮询和流式响应不会被缓冲。
+			deflator->put(entity);
+			deflator->flush();
+			entity.clear();
+			entity.swap(deflator->get_buffer());
+			if(entity.empty()){
+				// 数据都留在压缩器里，等下一个块或者结尾再发送。这不是错误。
+				return true;
+			}
+		}
+
 		StreamBuffer chunk;
 
 		char temp[64];
@@ -124,11 +295,22 @@ namespace Http {
 
 		return on_encoded_data_avail(STD_MOVE(chunk));
 	}
-	long ServerWriter::put_chunked_trailer(OptionalMap headers){
+	long ServerWriter::put_chunked_trailer(OptionalMap headers, boost::shared_ptr<Deflator> &deflator){
 		PROFILE_ME;
 
 		StreamBuffer data;
 
+		if(deflator){
+			AUTO(entity, deflator->finalize());
+			deflator.reset();
+			if(!entity.empty()){
+				char temp[64];
+				unsigned len = (unsigned)std::sprintf(temp, "%llx\r\n", (unsigned long long)entity.size());
+				data.put(temp, len);
+				data.splice(entity);
+				data.put("\r\n");
+			}
+		}
 		data.put("0\r\n");
 		for(AUTO(it, headers.begin()); it != headers.end(); ++it){
 			data.put(it->first.get());
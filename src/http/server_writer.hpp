@@ -7,14 +7,27 @@
 #include <string>
 #include <cstddef>
 #include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
 #include "../stream_buffer.hpp"
 #include "../optional_map.hpp"
 #include "response_headers.hpp"
+#include "request_headers.hpp"
 
 namespace Poseidon {
 
+class Deflator;
+
 namespace Http {
+	// 如果实体足够大并且类型在 http_compressible_content_type 中，按照 content_encoding 压缩，并设置 Content-Encoding 和 Vary。
+	extern bool compress_response_entity(ResponseHeaders &response_headers, StreamBuffer &entity, ContentEncoding content_encoding);
+	// 4xx 和 5xx 响应的默认页面，同时设置 Content-Type。
+	extern StreamBuffer make_default_response_entity(ResponseHeaders &response_headers);
+
 	class ServerWriter {
+	private:
+		// 分块发送的响应被压缩时使用，每个块之后 flush()。
+		boost::shared_ptr<Deflator> m_chunked_deflator;
+
 	public:
 		ServerWriter();
 		virtual ~ServerWriter();
@@ -23,12 +36,20 @@ namespace Http {
 		virtual long on_encoded_data_avail(StreamBuffer encoded) = 0;
 
 	public:
-		long put_response(ResponseHeaders response_headers, StreamBuffer entity, bool set_content_length);
-		long put_default_response(ResponseHeaders response_headers);
+		// content_encoding 是客户端接受的编码。只有类型在 http_compressible_content_type 中的响应才会被压缩。
+		long put_response(ResponseHeaders response_headers, StreamBuffer entity, bool set_content_length,
+			ContentEncoding content_encoding = CE_IDENTITY);
+		long put_default_response(ResponseHeaders response_headers, ContentEncoding content_encoding = CE_IDENTITY);
 
-		long put_chunked_header(ResponseHeaders response_headers);
+		long put_chunked_header(ResponseHeaders response_headers, ContentEncoding content_encoding = CE_IDENTITY);
 		long put_chunk(StreamBuffer entity);
 		long put_chunked_trailer(OptionalMap headers);
+
+	protected:
+		// 同时有多个未完成的分块响应时（例如 HTTP 管线），由派生类为每个响应保存压缩器。
+		long put_chunked_header(ResponseHeaders response_headers, ContentEncoding content_encoding, boost::shared_ptr<Deflator> &deflator);
+		long put_chunk(StreamBuffer entity, const boost::shared_ptr<Deflator> &deflator);
+		long put_chunked_trailer(OptionalMap headers, boost::shared_ptr<Deflator> &deflator);
 	};
 }
 
@@ -10,6 +10,7 @@
 #include "../singletons/job_dispatcher.hpp"
 #include "../stream_buffer.hpp"
 #include "../job_base.hpp"
+#include "../job_promise.hpp"
 #include "../atomic.hpp"
 
 namespace Poseidon {
@@ -29,10 +30,11 @@ namespace Http {
 	private:
 		const SocketBase::DelayedShutdownGuard m_guard;
 		const boost::weak_ptr<Session> m_weak_session;
+		const boost::uint64_t m_seq;
 
 	protected:
-		explicit SyncJobBase(const boost::shared_ptr<Session> &session)
-			: m_guard(session), m_weak_session(session)
+		SyncJobBase(const boost::shared_ptr<Session> &session, boost::uint64_t seq)
+			: m_guard(session), m_weak_session(session), m_seq(seq)
 		{ }
 
 	private:
@@ -47,6 +49,8 @@ namespace Http {
 				return;
 			}
 
+			// 这个任务中发送的数据都属于这个请求的响应。
+			session->set_response_seq(m_seq);
 			try {
 				really_perform(session);
 			} catch(Exception &e){
@@ -62,23 +66,35 @@ namespace Http {
 					"Unknown exception thrown.");
 				session->force_shutdown();
 			}
+			session->set_response_seq(RESPONSE_SEQ_FRONT);
+			session->m_deferrable = false;
+			session->m_deferred_promise.reset();
+			session->m_deferred_callback.clear();
 		}
 
 	protected:
+		boost::uint64_t get_seq() const {
+			return m_seq;
+		}
+
+		// 如果响应被推迟，等待 promise 之后再继续；否则标记响应完成，并处理 keep-alive。
+		void finish_response(const boost::shared_ptr<Session> &session, bool keep_alive);
+
 		virtual void really_perform(const boost::shared_ptr<Session> &session) = 0;
 	};
 
 	class Session::ReadHupJob : public Session::SyncJobBase {
 	public:
-		explicit ReadHupJob(const boost::shared_ptr<Session> &session)
-			: SyncJobBase(session)
+		ReadHupJob(const boost::shared_ptr<Session> &session, boost::uint64_t last_seq)
+			: SyncJobBase(session, last_seq)
 		{ }
 
 	protected:
 		void really_perform(const boost::shared_ptr<Session> &session) OVERRIDE {
 			PROFILE_ME;
 
-			session->shutdown_write();
+			// 已经收到的请求仍然需要响应。
+			session->shutdown_write_after_response(get_seq());
 		}
 	};
 
@@ -87,8 +103,8 @@ namespace Http {
 		RequestHeaders m_request_headers;
 
 	public:
-		ExpectJob(const boost::shared_ptr<Session> &session, RequestHeaders request_headers)
-			: SyncJobBase(session)
+		ExpectJob(const boost::shared_ptr<Session> &session, boost::uint64_t seq, RequestHeaders request_headers)
+			: SyncJobBase(session, seq)
 			, m_request_headers(STD_MOVE(request_headers))
 		{ }
 
@@ -107,9 +123,9 @@ namespace Http {
 		bool m_keep_alive;
 
 	public:
-		RequestJob(const boost::shared_ptr<Session> &session,
+		RequestJob(const boost::shared_ptr<Session> &session, boost::uint64_t seq,
 			RequestHeaders request_headers, StreamBuffer entity, bool keep_alive)
-			: SyncJobBase(session)
+			: SyncJobBase(session, seq)
 			, m_request_headers(STD_MOVE(request_headers)), m_entity(STD_MOVE(entity)), m_keep_alive(keep_alive)
 		{ }
 
@@ -117,28 +133,106 @@ namespace Http {
 		void really_perform(const boost::shared_ptr<Session> &session) OVERRIDE {
 			PROFILE_ME;
 
+			session->m_deferrable = true;
 			session->on_sync_request(STD_MOVE(m_request_headers), STD_MOVE(m_entity));
+			session->m_deferrable = false;
+
+			finish_response(session, m_keep_alive);
+		}
+	};
+
+	// 不属于任何会话，等待 promise 时不会阻塞会话中后续的请求。
+	class Session::PromiseWaitJob : public JobBase {
+	private:
+		const boost::shared_ptr<const JobPromise> m_promise;
+		boost::shared_ptr<JobBase> m_next;
+
+	public:
+		PromiseWaitJob(boost::shared_ptr<const JobPromise> promise, boost::shared_ptr<JobBase> next)
+			: m_promise(STD_MOVE(promise)), m_next(STD_MOVE(next))
+		{ }
 
-			if(m_keep_alive){
-				const AUTO(keep_alive_timeout, MainConfig::get<boost::uint64_t>("http_keep_alive_timeout", 5000));
-				session->set_timeout(keep_alive_timeout);
-			} else {
-				session->shutdown_write();
+	private:
+		boost::weak_ptr<const void> get_category() const FINAL {
+			return VAL_INIT;
+		}
+		void perform() FINAL {
+			PROFILE_ME;
+
+			try {
+				yield(m_promise);
+			} catch(std::exception &e){
+				// 由 callback 检查 promise。
+				LOG_POSEIDON_DEBUG("std::exception thrown: what = ", e.what());
 			}
+			JobDispatcher::enqueue(STD_MOVE(m_next), VAL_INIT);
 		}
 	};
 
+	class Session::DeferredResponseJob : public Session::SyncJobBase {
+	private:
+		const boost::function<void ()> m_callback;
+		const bool m_keep_alive;
+
+	public:
+		DeferredResponseJob(const boost::shared_ptr<Session> &session, boost::uint64_t seq,
+			boost::function<void ()> callback, bool keep_alive)
+			: SyncJobBase(session, seq)
+			, m_callback(STD_MOVE_IDN(callback)), m_keep_alive(keep_alive)
+		{ }
+
+	protected:
+		void really_perform(const boost::shared_ptr<Session> &session) OVERRIDE {
+			PROFILE_ME;
+
+			session->m_deferrable = true;
+			m_callback();
+			session->m_deferrable = false;
+
+			finish_response(session, m_keep_alive);
+		}
+	};
+
+	void Session::SyncJobBase::finish_response(const boost::shared_ptr<Session> &session, bool keep_alive){
+		PROFILE_ME;
+
+		if(session->m_deferred_promise){
+			AUTO(next, boost::make_shared<DeferredResponseJob>(session, m_seq, STD_MOVE(session->m_deferred_callback), keep_alive));
+			JobDispatcher::enqueue(
+				boost::make_shared<PromiseWaitJob>(STD_MOVE(session->m_deferred_promise), STD_MOVE_IDN(next)),
+				VAL_INIT);
+			session->m_deferred_promise.reset();
+			session->m_deferred_callback.clear();
+			return;
+		}
+
+		// 处理函数没有发送最终响应时，也不能阻塞后面的响应。
+		session->complete_response(m_seq);
+
+		if(keep_alive){
+			const AUTO(keep_alive_timeout, MainConfig::get<boost::uint64_t>("http_keep_alive_timeout", 5000));
+			session->set_timeout(keep_alive_timeout);
+		} else {
+			session->shutdown_write_after_response(m_seq);
+		}
+	}
+
 	Session::Session(Move<UniqueFile> socket)
 		: LowLevelSession(STD_MOVE(socket))
-		, m_max_request_length(config_get_max_request_length()), m_size_total(0), m_request_headers()
+		, m_max_request_length(config_get_max_request_length()), m_size_total(0), m_request_headers(), m_request_seq(0)
+		, m_deferrable(false)
 	{ }
 	Session::~Session(){ }
 
 	void Session::on_read_hup(){
 		PROFILE_ME;
 
+		if(defer_read_hup()){
+			return;
+		}
+
 		JobDispatcher::enqueue(
-			boost::make_shared<ReadHupJob>(virtual_shared_from_this<Session>()),
+			boost::make_shared<ReadHupJob>(virtual_shared_from_this<Session>(), get_low_level_request_seq()),
 			VAL_INIT);
 
 		LowLevelSession::on_read_hup();
@@ -152,11 +246,12 @@ namespace Http {
 		m_size_total = 0;
 		m_request_headers = STD_MOVE(request_headers);
 		m_entity.clear();
+		m_request_seq = get_low_level_request_seq();
 
 		const AUTO_REF(expect, m_request_headers.headers.get("Expect"));
 		if(!expect.empty()){
 			JobDispatcher::enqueue(
-				boost::make_shared<ExpectJob>(virtual_shared_from_this<Session>(), m_request_headers),
+				boost::make_shared<ExpectJob>(virtual_shared_from_this<Session>(), m_request_seq, m_request_headers),
 				VAL_INIT);
 		}
 	}
@@ -183,7 +278,7 @@ namespace Http {
 		const bool keep_alive = is_keep_alive_enabled(m_request_headers);
 
 		JobDispatcher::enqueue(
-			boost::make_shared<RequestJob>(virtual_shared_from_this<Session>(),
+			boost::make_shared<RequestJob>(virtual_shared_from_this<Session>(), m_request_seq,
 				STD_MOVE(m_request_headers), STD_MOVE(m_entity), keep_alive),
 			VAL_INIT);
 
@@ -193,6 +288,10 @@ namespace Http {
 		return VAL_INIT;
 	}
 
+	boost::uint64_t Session::get_low_level_max_request_length() const {
+		return get_max_request_length();
+	}
+
 	void Session::on_sync_expect(RequestHeaders request_headers){
 		PROFILE_ME;
 
@@ -215,6 +314,21 @@ namespace Http {
 		}
 	}
 
+	void Session::defer_response(boost::shared_ptr<const JobPromise> promise, boost::function<void ()> callback){
+		PROFILE_ME;
+
+		if(!m_deferrable){
+			LOG_POSEIDON_ERROR("defer_response() can only be called from on_sync_request() or a deferred callback.");
+			DEBUG_THROW(BasicException, sslit("Response can't be deferred here"));
+		}
+		if(!promise){
+			LOG_POSEIDON_ERROR("Null promise?");
+			DEBUG_THROW(BasicException, sslit("Null promise"));
+		}
+		m_deferred_promise = STD_MOVE(promise);
+		m_deferred_callback = STD_MOVE_IDN(callback);
+	}
+
 	boost::uint64_t Session::get_max_request_length() const {
 		return atomic_load(m_max_request_length, ATOMIC_CONSUME);
 	}
@@ -5,9 +5,12 @@
 #define POSEIDON_HTTP_SESSION_HPP_
 
 #include "low_level_session.hpp"
+#include <boost/function.hpp>
 
 namespace Poseidon {
 
+class JobPromise;
+
 namespace Http {
 	class Session : public LowLevelSession {
 	private:
@@ -15,6 +18,8 @@ namespace Http {
 		class ReadHupJob;
 		class ExpectJob;
 		class RequestJob;
+		class PromiseWaitJob;
+		class DeferredResponseJob;
 		class ErrorJob;
 
 	private:
@@ -22,6 +27,12 @@ namespace Http {
 		boost::uint64_t m_size_total;
 		RequestHeaders m_request_headers;
 		StreamBuffer m_entity;
+		boost::uint64_t m_request_seq;
+
+		// 以下成员只在本会话的任务中访问，这些任务不会并发执行。
+		bool m_deferrable;
+		boost::shared_ptr<const JobPromise> m_deferred_promise;
+		boost::function<void ()> m_deferred_callback;
 
 	public:
 		explicit Session(Move<UniqueFile> socket);
@@ -45,11 +56,17 @@ namespace Http {
 		void on_low_level_request_headers(RequestHeaders request_headers, boost::uint64_t content_length) OVERRIDE;
 		void on_low_level_request_entity(boost::uint64_t entity_offset, StreamBuffer entity) OVERRIDE;
 		boost::shared_ptr<UpgradedSessionBase> on_low_level_request_end(boost::uint64_t content_length, OptionalMap headers) OVERRIDE;
+		boost::uint64_t get_low_level_max_request_length() const OVERRIDE;
 
 		// 可覆写。
 		virtual void on_sync_expect(RequestHeaders request_headers);
 		virtual void on_sync_request(RequestHeaders request_headers, StreamBuffer entity) = 0;
 
+		// 只能在 on_sync_request() 或者被推迟的 callback 中调用。
+		// 当前请求的响应推迟到 promise 被满足（或者等待超时）之后，由 callback 在本会话的任务中发送。
+		// 在此期间后续的请求照常处理，它们的响应被缓存，按照请求的顺序发送。
+		void defer_response(boost::shared_ptr<const JobPromise> promise, boost::function<void ()> callback);
+
 	public:
 		boost::uint64_t get_max_request_length() const;
 		void set_max_request_length(boost::uint64_t max_request_length);
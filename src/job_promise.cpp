@@ -10,7 +10,7 @@
 namespace Poseidon {
 
 JobPromise::JobPromise() NOEXCEPT
-	: m_satisfied(false), m_except()
+	: m_satisfied(false), m_except(), m_waiting_fibers()
 { }
 JobPromise::~JobPromise(){
 	if(!m_satisfied){
@@ -42,6 +42,30 @@ void JobPromise::check_and_rethrow() const {
 	}
 }
 
+void JobPromise::wake_waiting_fibers() NOEXCEPT {
+	// 持有 m_mutex 时调用。这保证 remove_waiting_fiber() 返回之后，该 fiber 不会再被唤醒。
+	for(AUTO(it, m_waiting_fibers.begin()); it != m_waiting_fibers.end(); ++it){
+		JobDispatcher::wake_fiber(*it);
+	}
+	m_waiting_fibers.clear();
+}
+
+bool JobPromise::add_waiting_fiber(void *fiber) const {
+	const RecursiveMutex::UniqueLock lock(m_mutex);
+	if(m_satisfied){
+		return false;
+	}
+	m_waiting_fibers.push_back(fiber);
+	return true;
+}
+void JobPromise::remove_waiting_fiber(void *fiber) const NOEXCEPT {
+	const RecursiveMutex::UniqueLock lock(m_mutex);
+	const AUTO(it, std::find(m_waiting_fibers.begin(), m_waiting_fibers.end(), fiber));
+	if(it != m_waiting_fibers.end()){
+		m_waiting_fibers.erase(it);
+	}
+}
+
 void JobPromise::set_success(){
 	const RecursiveMutex::UniqueLock lock(m_mutex);
 	if(m_satisfied){
@@ -49,6 +73,7 @@ void JobPromise::set_success(){
 	}
 	m_satisfied = true;
 //	m_except = VAL_INIT;
+	wake_waiting_fibers();
 }
 #ifdef POSEIDON_CXX11
 void JobPromise::set_exception(std::exception_ptr except)
@@ -62,6 +87,7 @@ void JobPromise::set_exception(boost::exception_ptr except)
 	}
 	m_satisfied = true;
 	m_except = STD_MOVE_IDN(except);
+	wake_waiting_fibers();
 }
 
 void yield(const boost::shared_ptr<const JobPromise> &promise, bool insignificant){
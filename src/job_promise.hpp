@@ -9,6 +9,7 @@
 #include "recursive_mutex.hpp"
 #include <boost/shared_ptr.hpp>
 #include <boost/type_traits/remove_const.hpp>
+#include <vector>
 
 #ifdef POSEIDON_CXX11
 #	include <exception>
@@ -28,6 +29,11 @@ protected:
 #else
 	boost::exception_ptr m_except;
 #endif
+	// 正在等待此 promise 的 fiber。它们的类型只有 JobDispatcher 知道。
+	mutable std::vector<void *> m_waiting_fibers;
+
+private:
+	void wake_waiting_fibers() NOEXCEPT;
 
 public:
 	JobPromise() NOEXCEPT;
@@ -41,6 +47,11 @@ public:
 	bool would_throw() const NOEXCEPT;
 	void check_and_rethrow() const;
 
+	// 以下两个函数供 JobDispatcher 使用。
+	// 如果 promise 已被满足，则不会添加 fiber，并返回 false。
+	bool add_waiting_fiber(void *fiber) const;
+	void remove_waiting_fiber(void *fiber) const NOEXCEPT;
+
 	void set_success();
 #ifdef POSEIDON_CXX11
 	void set_exception(std::exception_ptr except);
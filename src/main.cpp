@@ -20,6 +20,7 @@
 #include "singletons/event_dispatcher.hpp"
 #include "singletons/filesystem_daemon.hpp"
 #include "singletons/profile_depository.hpp"
+#include "singletons/http_client_pool.hpp"
 #include "profiler.hpp"
 
 namespace Poseidon {
@@ -90,6 +91,7 @@ namespace {
 				START(ModuleDepository);
 				START(TimerDaemon);
 				START(EpollDaemon);
+				START(HttpClientPool);
 				START(EventDispatcher);
 				START(SystemHttpServer);
 
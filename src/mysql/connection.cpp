@@ -6,8 +6,11 @@
 #include "thread_context.hpp"
 #include "exception.hpp"
 #include "formatting.hpp"
+#include "statement_params.hpp"
 #include <stdlib.h>
 #include <mysql.h>
+#include <mysqld_error.h>
+#include <errmsg.h>
 #include "../raii.hpp"
 #include "../log.hpp"
 #include "../time.hpp"
@@ -35,6 +38,15 @@ namespace MySql {
 			}
 		};
 
+		struct StatementCloser {
+			CONSTEXPR ::MYSQL_STMT *operator()() const NOEXCEPT {
+				return NULLPTR;
+			}
+			void operator()(::MYSQL_STMT *stmt) const NOEXCEPT {
+				::mysql_stmt_close(stmt);
+			}
+		};
+
 		struct FieldComparator {
 			bool operator()(const char *lhs, const char *rhs) const NOEXCEPT {
 				return std::strcmp(lhs, rhs) < 0;
@@ -43,25 +55,112 @@ namespace MySql {
 
 #define DEBUG_THROW_MYSQL_EXCEPTION(mysql_, schema_)	\
 		DEBUG_THROW(::Poseidon::MySql::Exception, schema_, ::mysql_errno(mysql_), ::Poseidon::SharedNts(::mysql_error(mysql_)))
+#define DEBUG_THROW_MYSQL_STMT_EXCEPTION(stmt_, schema_)	\
+		DEBUG_THROW(::Poseidon::MySql::Exception, schema_, ::mysql_stmt_errno(stmt_), ::Poseidon::SharedNts(::mysql_stmt_error(stmt_)))
+
+		// 和 format_time() 及 scan_time() 一样，0 和 -1 分别对应 0000 年和 9999 年。
+		void encode_time(::MYSQL_TIME &mt, boost::uint64_t ms){
+			DateTime dt = { 1234, 1, 1, 0, 0, 0, 0 };
+			if(ms == 0){
+				dt.yr = 0;
+			} else if(ms == (boost::uint64_t)-1){
+				dt.yr = 9999;
+			} else {
+				dt = break_down_time(ms);
+			}
+			std::memset(&mt, 0, sizeof(mt));
+			mt.year        = dt.yr;
+			mt.month       = dt.mon;
+			mt.day         = dt.day;
+			mt.hour        = dt.hr;
+			mt.minute      = dt.min;
+			mt.second      = dt.sec;
+			mt.second_part = dt.ms * 1000ul;
+			mt.time_type   = MYSQL_TIMESTAMP_DATETIME;
+		}
+		boost::uint64_t decode_time(const ::MYSQL_TIME &mt){
+			if(mt.year == 0){
+				return 0;
+			} else if(mt.year == 9999){
+				return (boost::uint64_t)-1;
+			}
+			DateTime dt = { 1234, 1, 1, 0, 0, 0, 0 };
+			dt.yr  = mt.year;
+			dt.mon = std::max(mt.month, 1u);
+			dt.day = std::max(mt.day, 1u);
+			dt.hr  = mt.hour;
+			dt.min = mt.minute;
+			dt.sec = mt.second;
+			dt.ms  = static_cast<unsigned>(mt.second_part / 1000);
+			return assemble_time(dt);
+		}
+
+		// 断线重连之后，或者表结构改变之后，需要重新预处理。
+		bool is_statement_lost(unsigned err_code){
+			return (err_code == CR_SERVER_GONE_ERROR) || (err_code == ER_UNKNOWN_STMT_HANDLER) || (err_code == ER_NEED_REPREPARE);
+		}
 
 		class DelegatedConnection : public Connection {
+		private:
+			struct PreparedStatement {
+				UniqueHandle<StatementCloser> stmt;
+				unsigned long thread_id; // 预处理时的连接，断线重连之后改变。
+				boost::uint64_t last_used;
+			};
+
+			// 二进制结果中的一列。
+			struct BoundColumn {
+				enum Kind {
+					K_SIGNED,
+					K_UNSIGNED,
+					K_DOUBLE,
+					K_DATETIME,
+					K_STRING,
+				};
+
+				Kind kind;
+				long long integer;
+				double real;
+				::MYSQL_TIME time;
+				char data[257];        // 绑定的缓冲区，结尾留出一个字节的空字符。
+				std::string overflow;  // 数据被截断时使用。
+				bool truncated;
+				unsigned long length;
+				::my_bool is_null;
+				::my_bool error;
+			};
+
 		private:
 			const ThreadContext m_context;
 			const SharedNts m_schema;
+			const std::size_t m_max_prepared_statements;
 
 			::MYSQL m_mysql_storage;
 			UniqueHandle<Closer> m_mysql;
 
+			std::map<std::string, boost::shared_ptr<PreparedStatement> > m_statements;
+			boost::uint64_t m_statement_clock;
+			::MYSQL_STMT *m_stmt; // 最近一次执行的预处理语句，没有时为空。
+
 			UniqueHandle<ResultDeleter> m_result;
 			boost::container::flat_map<const char *, std::size_t, FieldComparator> m_fields;
 			::MYSQL_ROW m_row;
 			unsigned long *m_lengths;
+			std::vector<BoundColumn> m_columns;
+			bool m_has_bound_row;
+			mutable char m_scratch[64];
+
+			int m_async_ret;
+			bool m_async_busy;
 
 		public:
 			DelegatedConnection(const char *server_addr, unsigned server_port,
-				const char *user_name, const char *password, const char *schema, bool use_ssl, const char *charset)
-				: m_schema(schema)
-				, m_row(NULLPTR), m_lengths(NULLPTR)
+				const char *user_name, const char *password, const char *schema, bool use_ssl, const char *charset,
+				std::size_t max_prepared_statements, bool found_rows)
+				: m_schema(schema), m_max_prepared_statements(max_prepared_statements)
+				, m_statement_clock(0), m_stmt(NULLPTR)
+				, m_row(NULLPTR), m_lengths(NULLPTR), m_has_bound_row(false)
+				, m_async_ret(0), m_async_busy(false)
 			{
 				if(!m_mysql.reset(::mysql_init(&m_mysql_storage))){
 					DEBUG_THROW(SystemException, ENOMEM);
@@ -77,8 +176,17 @@ namespace MySql {
 				if(::mysql_options(m_mysql.get(), MYSQL_SET_CHARSET_NAME, charset) != 0){
 					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
 				}
+#ifdef MYSQL_WAIT_READ
+				// 阻塞的接口仍然可以使用。
+				if(::mysql_options(m_mysql.get(), MYSQL_OPT_NONBLOCK, NULLPTR) != 0){
+					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
+				}
+#endif
 
 				unsigned long flags = 0;
+				if(found_rows){
+					flags |= CLIENT_FOUND_ROWS;
+				}
 				if(use_ssl){
 					flags |= CLIENT_SSL;
 				}
@@ -87,8 +195,69 @@ namespace MySql {
 				}
 			}
 
+			~DelegatedConnection(){
+				do_discard_result();
+				m_statements.clear();
+			}
+
 		private:
+			bool has_bound_result() const {
+				return m_stmt && m_result;
+			}
+
+			bool find_column_and_check(const BoundColumn *&column, const char *name) const {
+				if(!m_has_bound_row){
+					LOG_POSEIDON_WARNING("No more results available.");
+					return false;
+				}
+				const AUTO(it, m_fields.find(name));
+				if(it == m_fields.end()){
+					LOG_POSEIDON_WARNING("Field not found: name = ", name);
+					return false;
+				}
+				column = &m_columns[it->second];
+				if(column->is_null){
+					LOG_POSEIDON_DEBUG("Field is null: name = ", name);
+					return false;
+				}
+				return true;
+			}
 			bool find_field_and_check(const char *&data, std::size_t &size, const char *name) const {
+				if(has_bound_result()){
+					const BoundColumn *column;
+					if(!find_column_and_check(column, name)){
+						return false;
+					}
+					// 二进制的值按照文本协议的格式转换成字符串。
+					switch(column->kind){
+					case BoundColumn::K_SIGNED:
+						size = (unsigned)::snprintf(m_scratch, sizeof(m_scratch), "%lld", column->integer);
+						data = m_scratch;
+						break;
+					case BoundColumn::K_UNSIGNED:
+						size = (unsigned)::snprintf(m_scratch, sizeof(m_scratch), "%llu", static_cast<unsigned long long>(column->integer));
+						data = m_scratch;
+						break;
+					case BoundColumn::K_DOUBLE:
+						size = (unsigned)::snprintf(m_scratch, sizeof(m_scratch), "%.17g", column->real);
+						data = m_scratch;
+						break;
+					case BoundColumn::K_DATETIME:
+						size = format_time(m_scratch, sizeof(m_scratch), decode_time(column->time), true);
+						data = m_scratch;
+						break;
+					default:
+						if(column->truncated){
+							data = column->overflow.c_str();
+							size = column->overflow.size();
+						} else {
+							data = column->data;
+							size = column->length;
+						}
+						break;
+					}
+					return true;
+				}
 				if(!m_row){
 					LOG_POSEIDON_WARNING("No more results available.");
 					return false;
@@ -107,43 +276,312 @@ namespace MySql {
 				return true;
 			}
 
+			void load_fields(){
+				const AUTO(fields, ::mysql_fetch_fields(m_result.get()));
+				const AUTO(count, ::mysql_num_fields(m_result.get()));
+				m_fields.reserve(count);
+				for(std::size_t i = 0; i < count; ++i){
+					const char *const name = fields[i].name;
+					if(!m_fields.insert(std::make_pair(name, i)).second){
+						LOG_POSEIDON_ERROR("Duplicate field in MySQL result set: ", name);
+						DEBUG_THROW(BasicException, sslit("Duplicate field"));
+					}
+					LOG_POSEIDON_TRACE("MySQL result field: name = ", name, ", index = ", i);
+				}
+			}
+			void bind_result_columns(){
+				const AUTO(fields, ::mysql_fetch_fields(m_result.get()));
+				const AUTO(count, ::mysql_num_fields(m_result.get()));
+				if(count == 0){
+					return;
+				}
+				m_columns.resize(count);
+				std::vector< ::MYSQL_BIND> binds(count);
+				for(std::size_t i = 0; i < count; ++i){
+					AUTO_REF(column, m_columns.at(i));
+					AUTO_REF(bind, binds.at(i));
+					switch(fields[i].type){
+					case MYSQL_TYPE_TINY:
+					case MYSQL_TYPE_SHORT:
+					case MYSQL_TYPE_INT24:
+					case MYSQL_TYPE_LONG:
+					case MYSQL_TYPE_LONGLONG:
+					case MYSQL_TYPE_YEAR:
+						column.kind = (fields[i].flags & UNSIGNED_FLAG) ? BoundColumn::K_UNSIGNED : BoundColumn::K_SIGNED;
+						bind.buffer_type = MYSQL_TYPE_LONGLONG;
+						bind.buffer = &column.integer;
+						bind.is_unsigned = (column.kind == BoundColumn::K_UNSIGNED);
+						break;
+					case MYSQL_TYPE_FLOAT:
+					case MYSQL_TYPE_DOUBLE:
+						column.kind = BoundColumn::K_DOUBLE;
+						bind.buffer_type = MYSQL_TYPE_DOUBLE;
+						bind.buffer = &column.real;
+						break;
+					case MYSQL_TYPE_DATE:
+					case MYSQL_TYPE_DATETIME:
+					case MYSQL_TYPE_TIMESTAMP:
+						column.kind = BoundColumn::K_DATETIME;
+						bind.buffer_type = MYSQL_TYPE_DATETIME;
+						bind.buffer = &column.time;
+						break;
+					default:
+						column.kind = BoundColumn::K_STRING;
+						bind.buffer_type = MYSQL_TYPE_BLOB;
+						bind.buffer = column.data;
+						bind.buffer_length = sizeof(column.data) - 1;
+						break;
+					}
+					bind.length = &column.length;
+					bind.is_null = &column.is_null;
+					bind.error = &column.error;
+				}
+				if(::mysql_stmt_bind_result(m_stmt, &binds[0]) != 0){
+					DEBUG_THROW_MYSQL_STMT_EXCEPTION(m_stmt, m_schema);
+				}
+			}
+
+			::MYSQL_STMT *require_statement(const char *sql, std::size_t len){
+				const AUTO(thread_id, ::mysql_thread_id(m_mysql.get()));
+				std::string key(sql, len);
+				AUTO(it, m_statements.find(key));
+				if(it != m_statements.end()){
+					if(it->second->thread_id == thread_id){
+						it->second->last_used = ++m_statement_clock;
+						return it->second->stmt.get();
+					}
+					LOG_POSEIDON_DEBUG("MySQL connection was re-established, preparing statement again: sql = ", key);
+					m_statements.erase(it);
+				}
+				while(!m_statements.empty() && (m_statements.size() >= m_max_prepared_statements)){
+					AUTO(victim, m_statements.begin());
+					for(AUTO(test_it, m_statements.begin()); test_it != m_statements.end(); ++test_it){
+						if(test_it->second->last_used < victim->second->last_used){
+							victim = test_it;
+						}
+					}
+					LOG_POSEIDON_TRACE("Evicting prepared statement: sql = ", victim->first);
+					m_statements.erase(victim);
+				}
+
+				AUTO(statement, boost::make_shared<PreparedStatement>());
+				if(!statement->stmt.reset(::mysql_stmt_init(m_mysql.get()))){
+					DEBUG_THROW(SystemException, ENOMEM);
+				}
+				if(::mysql_stmt_prepare(statement->stmt.get(), sql, len) != 0){
+					DEBUG_THROW_MYSQL_STMT_EXCEPTION(statement->stmt.get(), m_schema);
+				}
+				LOG_POSEIDON_DEBUG("Prepared MySQL statement: sql = ", key);
+				statement->thread_id = thread_id;
+				statement->last_used = ++m_statement_clock;
+				const AUTO(stmt, statement->stmt.get());
+				m_statements.insert(std::make_pair(STD_MOVE(key), STD_MOVE(statement)));
+				return stmt;
+			}
+
 		public:
 			void do_execute_sql(const char *sql, std::size_t len){
 				do_discard_result();
+				m_stmt = NULLPTR;
 
 				if(::mysql_real_query(m_mysql.get(), sql, len) != 0){
 					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
 				}
+				use_result();
+			}
+
+#ifdef MYSQL_WAIT_READ
+			static int translate_wait_status(int status){
+				int events = 0;
+				if(status & MYSQL_WAIT_READ){
+					events |= WAIT_READ;
+				}
+				if(status & MYSQL_WAIT_WRITE){
+					events |= WAIT_WRITE;
+				}
+				if(status & MYSQL_WAIT_EXCEPT){
+					events |= WAIT_EXCEPT;
+				}
+				if(status & MYSQL_WAIT_TIMEOUT){
+					events |= WAIT_TIMEOUT;
+				}
+				return events;
+			}
+			static int untranslate_wait_status(int events){
+				int status = 0;
+				if(events & WAIT_READ){
+					status |= MYSQL_WAIT_READ;
+				}
+				if(events & WAIT_WRITE){
+					status |= MYSQL_WAIT_WRITE;
+				}
+				if(events & WAIT_EXCEPT){
+					status |= MYSQL_WAIT_EXCEPT;
+				}
+				if(events & WAIT_TIMEOUT){
+					status |= MYSQL_WAIT_TIMEOUT;
+				}
+				return status;
+			}
+
+			int do_begin_execute_sql(const char *sql, std::size_t len){
+				DEBUG_THROW_ASSERT(!m_async_busy);
+
+				do_discard_result();
+				m_stmt = NULLPTR;
+
+				const int status = ::mysql_real_query_start(&m_async_ret, m_mysql.get(), sql, len);
+				m_async_busy = (status != 0);
+				return translate_wait_status(status);
+			}
+			int do_continue_execute_sql(int ready_events){
+				DEBUG_THROW_ASSERT(m_async_busy);
+
+				const int status = ::mysql_real_query_cont(&m_async_ret, m_mysql.get(), untranslate_wait_status(ready_events));
+				m_async_busy = (status != 0);
+				return translate_wait_status(status);
+			}
+			void do_end_execute_sql(){
+				DEBUG_THROW_ASSERT(!m_async_busy);
+
+				if(m_async_ret != 0){
+					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
+				}
+				// 通过非阻塞接口执行的都是不返回结果的写操作，所以这里阻塞不会有什么影响。
+				use_result();
+			}
+			int do_get_socket() const {
+				return ::mysql_get_socket(m_mysql.get());
+			}
+			unsigned do_get_timeout() const {
+				return ::mysql_get_timeout_value_ms(m_mysql.get());
+			}
+#endif
 
+			void use_result(){
 				if(!m_result.reset(::mysql_use_result(m_mysql.get()))){
 					if(::mysql_errno(m_mysql.get()) != 0){
 						DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
 					}
 					// 没有返回结果。
 				} else {
-					const AUTO(fields, ::mysql_fetch_fields(m_result.get()));
-					const AUTO(count, ::mysql_num_fields(m_result.get()));
-					m_fields.reserve(count);
-					for(std::size_t i = 0; i < count; ++i){
-						const char *const name = fields[i].name;
-						if(!m_fields.insert(std::make_pair(name, i)).second){
-							LOG_POSEIDON_ERROR("Duplicate field in MySQL result set: ", name);
-							DEBUG_THROW(BasicException, sslit("Duplicate field"));
-						}
-						LOG_POSEIDON_TRACE("MySQL result field: name = ", name, ", index = ", i);
+					load_fields();
+				}
+			}
+			void do_execute_prepared(const char *sql, std::size_t len, const StatementParams &params){
+				do_discard_result();
+				m_stmt = NULLPTR;
+
+				// MYSQL_BIND 的缓冲区不是 const 的，但是参数只会被读取。
+				const std::size_t count = params.size();
+				std::vector< ::MYSQL_BIND> binds(count);
+				std::vector< ::MYSQL_TIME> times(count);
+				std::vector<unsigned long> lengths(count);
+				for(std::size_t i = 0; i < count; ++i){
+					const AUTO_REF(elem, params.at(i));
+					AUTO_REF(bind, binds.at(i));
+					switch(elem.type){
+					case StatementParams::T_NULL:
+						bind.buffer_type = MYSQL_TYPE_NULL;
+						break;
+					case StatementParams::T_SIGNED:
+					case StatementParams::T_UNSIGNED:
+						bind.buffer_type = MYSQL_TYPE_LONGLONG;
+						bind.buffer = const_cast<boost::int64_t *>(&elem.i);
+						bind.is_unsigned = (elem.type == StatementParams::T_UNSIGNED);
+						break;
+					case StatementParams::T_DOUBLE:
+						bind.buffer_type = MYSQL_TYPE_DOUBLE;
+						bind.buffer = const_cast<double *>(&elem.d);
+						break;
+					case StatementParams::T_STRING:
+					case StatementParams::T_BLOB:
+						bind.buffer_type = (elem.type == StatementParams::T_BLOB) ? MYSQL_TYPE_BLOB : MYSQL_TYPE_STRING;
+						bind.buffer = const_cast<char *>(elem.str.data());
+						bind.buffer_length = elem.str.size();
+						lengths.at(i) = elem.str.size();
+						bind.length = &lengths.at(i);
+						break;
+					case StatementParams::T_DATETIME:
+						encode_time(times.at(i), static_cast<boost::uint64_t>(elem.i));
+						bind.buffer_type = MYSQL_TYPE_DATETIME;
+						bind.buffer = &times.at(i);
+						break;
+					default:
+						LOG_POSEIDON_ERROR("Unknown statement parameter type: type = ", static_cast<int>(elem.type));
+						DEBUG_THROW(BasicException, sslit("Unknown statement parameter type"));
 					}
 				}
+
+				::MYSQL_STMT *stmt;
+				for(unsigned retry = 0; ; ++retry){
+					stmt = require_statement(sql, len);
+					if(::mysql_stmt_param_count(stmt) != count){
+						LOG_POSEIDON_ERROR("Statement parameter count mismatch: expecting ", ::mysql_stmt_param_count(stmt), ", got ", count);
+						DEBUG_THROW(BasicException, sslit("Statement parameter count mismatch"));
+					}
+					if((count != 0) && (::mysql_stmt_bind_param(stmt, &binds[0]) != 0)){
+						DEBUG_THROW_MYSQL_STMT_EXCEPTION(stmt, m_schema);
+					}
+					if(::mysql_stmt_execute(stmt) == 0){
+						break;
+					}
+					const unsigned err_code = ::mysql_stmt_errno(stmt);
+					if((retry != 0) || !is_statement_lost(err_code)){
+						DEBUG_THROW_MYSQL_STMT_EXCEPTION(stmt, m_schema);
+					}
+					// 语句没有被执行，可以安全地重试一次。
+					LOG_POSEIDON_INFO("Prepared statement lost, retrying: err_code = ", err_code, ", err_msg = ", ::mysql_stmt_error(stmt));
+					m_statements.erase(std::string(sql, len));
+					if((err_code == CR_SERVER_GONE_ERROR) && (::mysql_ping(m_mysql.get()) != 0)){
+						DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
+					}
+				}
+				m_stmt = stmt;
+
+				if(!m_result.reset(::mysql_stmt_result_metadata(stmt))){
+					if(::mysql_stmt_errno(stmt) != 0){
+						DEBUG_THROW_MYSQL_STMT_EXCEPTION(stmt, m_schema);
+					}
+					// 没有返回结果。
+				} else {
+					load_fields();
+					bind_result_columns();
+				}
 			}
 			void do_discard_result() NOEXCEPT {
+				if(has_bound_result()){
+					::mysql_stmt_free_result(m_stmt);
+				}
 				m_result.reset();
 				m_fields.clear();
 				m_row = NULLPTR;
 				m_lengths = NULLPTR;
+				m_columns.clear();
+				m_has_bound_row = false;
 			}
 
+			void do_set_auto_reconnect(bool enabled){
+				const ::my_bool value = enabled;
+				if(::mysql_options(m_mysql.get(), MYSQL_OPT_RECONNECT, &value) != 0){
+					DEBUG_THROW_MYSQL_EXCEPTION(m_mysql.get(), m_schema);
+				}
+			}
+			unsigned long do_get_thread_id() const {
+				return ::mysql_thread_id(m_mysql.get());
+			}
 			boost::uint64_t do_get_insert_id() const {
+				if(m_stmt){
+					return ::mysql_stmt_insert_id(m_stmt);
+				}
 				return ::mysql_insert_id(m_mysql.get());
 			}
+			boost::uint64_t do_get_affected_rows() const {
+				if(m_stmt){
+					return ::mysql_stmt_affected_rows(m_stmt);
+				}
+				return ::mysql_affected_rows(m_mysql.get());
+			}
 
 			bool do_fetch_row(){
 				if(m_fields.empty()){
@@ -151,6 +589,42 @@ namespace MySql {
 					return false;
 				}
 
+				if(has_bound_result()){
+					m_has_bound_row = false;
+					const int err = ::mysql_stmt_fetch(m_stmt);
+					if(err == MYSQL_NO_DATA){
+						LOG_POSEIDON_DEBUG("No more data.");
+						return false;
+					}
+					if((err != 0) && (err != MYSQL_DATA_TRUNCATED)){
+						DEBUG_THROW_MYSQL_STMT_EXCEPTION(m_stmt, m_schema);
+					}
+					for(std::size_t i = 0; i < m_columns.size(); ++i){
+						AUTO_REF(column, m_columns.at(i));
+						column.truncated = false;
+						if((column.kind != BoundColumn::K_STRING) || column.is_null){
+							continue;
+						}
+						if(column.length < sizeof(column.data)){
+							column.data[column.length] = 0;
+							continue;
+						}
+						// 缓冲区不够大，单独取出这一列。
+						column.overflow.resize(column.length);
+						::MYSQL_BIND bind;
+						std::memset(&bind, 0, sizeof(bind));
+						bind.buffer_type = MYSQL_TYPE_BLOB;
+						bind.buffer = &column.overflow[0];
+						bind.buffer_length = column.length;
+						if(::mysql_stmt_fetch_column(m_stmt, &bind, static_cast<unsigned>(i), 0) != 0){
+							DEBUG_THROW_MYSQL_STMT_EXCEPTION(m_stmt, m_schema);
+						}
+						column.truncated = true;
+					}
+					m_has_bound_row = true;
+					return true;
+				}
+
 				const AUTO(row, ::mysql_fetch_row(m_result.get()));
 				if(!row){
 					LOG_POSEIDON_DEBUG("No more data.");
@@ -163,6 +637,15 @@ namespace MySql {
 			}
 
 			boost::int64_t do_get_signed(const char *name) const {
+				if(has_bound_result()){
+					const BoundColumn *column;
+					if(!find_column_and_check(column, name)){
+						return VAL_INIT;
+					}
+					if((column->kind == BoundColumn::K_SIGNED) || (column->kind == BoundColumn::K_UNSIGNED)){
+						return column->integer;
+					}
+				}
 				const char *data;
 				std::size_t size;
 				if(!find_field_and_check(data, size, name)){
@@ -177,6 +660,15 @@ namespace MySql {
 				return val;
 			}
 			boost::uint64_t do_get_unsigned(const char *name) const {
+				if(has_bound_result()){
+					const BoundColumn *column;
+					if(!find_column_and_check(column, name)){
+						return VAL_INIT;
+					}
+					if((column->kind == BoundColumn::K_SIGNED) || (column->kind == BoundColumn::K_UNSIGNED)){
+						return static_cast<boost::uint64_t>(column->integer);
+					}
+				}
 				const char *data;
 				std::size_t size;
 				if(!find_field_and_check(data, size, name)){
@@ -191,6 +683,15 @@ namespace MySql {
 				return val;
 			}
 			double do_get_double(const char *name) const {
+				if(has_bound_result()){
+					const BoundColumn *column;
+					if(!find_column_and_check(column, name)){
+						return VAL_INIT;
+					}
+					if(column->kind == BoundColumn::K_DOUBLE){
+						return column->real;
+					}
+				}
 				const char *data;
 				std::size_t size;
 				if(!find_field_and_check(data, size, name)){
@@ -213,6 +714,15 @@ namespace MySql {
 				return std::string(data, size);
 			}
 			boost::uint64_t do_get_datetime(const char *name) const {
+				if(has_bound_result()){
+					const BoundColumn *column;
+					if(!find_column_and_check(column, name)){
+						return VAL_INIT;
+					}
+					if(column->kind == BoundColumn::K_DATETIME){
+						return decode_time(column->time);
+					}
+				}
 				const char *data;
 				std::size_t size;
 				if(!find_field_and_check(data, size, name)){
@@ -244,10 +754,19 @@ namespace MySql {
 	}
 
 	boost::shared_ptr<Connection> Connection::create(const char *server_addr, unsigned server_port,
-		const char *user_name, const char *password, const char *schema, bool use_ssl, const char *charset)
+		const char *user_name, const char *password, const char *schema, bool use_ssl, const char *charset,
+		std::size_t max_prepared_statements, bool found_rows)
 	{
 		return boost::make_shared<DelegatedConnection>(server_addr, server_port,
-			user_name, password, schema, use_ssl, charset);
+			user_name, password, schema, use_ssl, charset, max_prepared_statements, found_rows);
+	}
+
+	bool Connection::is_nonblocking_supported(){
+#ifdef MYSQL_WAIT_READ
+		return true;
+#else
+		return false;
+#endif
 	}
 
 	Connection::~Connection(){ }
@@ -255,13 +774,59 @@ namespace MySql {
 	void Connection::execute_sql(const char *sql, std::size_t len){
 		static_cast<DelegatedConnection &>(*this).do_execute_sql(sql, len);
 	}
+	void Connection::execute_prepared(const char *sql, std::size_t len, const StatementParams &params){
+		static_cast<DelegatedConnection &>(*this).do_execute_prepared(sql, len, params);
+	}
 	void Connection::discard_result() NOEXCEPT {
 		static_cast<DelegatedConnection &>(*this).do_discard_result();
 	}
 
+#ifdef MYSQL_WAIT_READ
+	int Connection::begin_execute_sql(const char *sql, std::size_t len){
+		return static_cast<DelegatedConnection &>(*this).do_begin_execute_sql(sql, len);
+	}
+	int Connection::continue_execute_sql(int ready_events){
+		return static_cast<DelegatedConnection &>(*this).do_continue_execute_sql(ready_events);
+	}
+	void Connection::end_execute_sql(){
+		static_cast<DelegatedConnection &>(*this).do_end_execute_sql();
+	}
+	int Connection::get_socket() const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_socket();
+	}
+	unsigned Connection::get_timeout() const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_timeout();
+	}
+#else
+	int Connection::begin_execute_sql(const char * /* sql */, std::size_t /* len */){
+		DEBUG_THROW(BasicException, sslit("Non-blocking MySQL API is not available"));
+	}
+	int Connection::continue_execute_sql(int /* ready_events */){
+		DEBUG_THROW(BasicException, sslit("Non-blocking MySQL API is not available"));
+	}
+	void Connection::end_execute_sql(){
+		DEBUG_THROW(BasicException, sslit("Non-blocking MySQL API is not available"));
+	}
+	int Connection::get_socket() const {
+		DEBUG_THROW(BasicException, sslit("Non-blocking MySQL API is not available"));
+	}
+	unsigned Connection::get_timeout() const {
+		DEBUG_THROW(BasicException, sslit("Non-blocking MySQL API is not available"));
+	}
+#endif
+
+	void Connection::set_auto_reconnect(bool enabled){
+		static_cast<DelegatedConnection &>(*this).do_set_auto_reconnect(enabled);
+	}
+	unsigned long Connection::get_thread_id() const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_thread_id();
+	}
 	boost::uint64_t Connection::get_insert_id() const {
 		return static_cast<const DelegatedConnection &>(*this).do_get_insert_id();
 	}
+	boost::uint64_t Connection::get_affected_rows() const {
+		return static_cast<const DelegatedConnection &>(*this).do_get_affected_rows();
+	}
 	bool Connection::fetch_row(){
 		return static_cast<DelegatedConnection &>(*this).do_fetch_row();
 	}
@@ -8,6 +8,7 @@
 #include "../cxx_util.hpp"
 #include <string>
 #include <cstring>
+#include <cstddef>
 #include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -16,18 +17,26 @@ namespace Poseidon {
 class Uuid;
 
 namespace MySql {
+	class StatementParams;
+
 	class Connection : NONCOPYABLE {
 	public:
+		// found_rows 为 true 时使用 CLIENT_FOUND_ROWS 连接，UPDATE 返回匹配的行数，而不是值确实改变了的行数。
 		static boost::shared_ptr<Connection> create(const char *server_addr, unsigned server_port,
-			const char *user_name, const char *password, const char *schema, bool use_ssl, const char *charset);
+			const char *user_name, const char *password, const char *schema, bool use_ssl, const char *charset,
+			std::size_t max_prepared_statements = 64, bool found_rows = false);
 
 		static boost::shared_ptr<Connection> create(const std::string &server_addr, unsigned server_port,
-			const std::string &user_name, const std::string &password, const std::string &schema, bool use_ssl, const std::string &charset)
+			const std::string &user_name, const std::string &password, const std::string &schema, bool use_ssl, const std::string &charset,
+			std::size_t max_prepared_statements = 64, bool found_rows = false)
 		{
 			return create(server_addr.c_str(), server_port,
-				user_name.c_str(), password.c_str(), schema.c_str(), use_ssl, charset.c_str());
+				user_name.c_str(), password.c_str(), schema.c_str(), use_ssl, charset.c_str(), max_prepared_statements, found_rows);
 		}
 
+		// 非阻塞接口需要 MariaDB 客户端库提供的 mysql_real_query_start() 等函数。
+		static bool is_nonblocking_supported();
+
 	public:
 		virtual ~Connection() = 0;
 
@@ -39,9 +48,44 @@ namespace MySql {
 		void execute_sql(const std::string &sql){
 			execute_sql(sql.data(), sql.size());
 		}
+		// 服务器端预处理语句，参数和结果都以二进制形式传递，之后同样使用 fetch_row() 和 get_*() 读取结果。
+		// 语句按照 SQL 文本缓存在连接中，超过上限时淘汰最久未使用的。断线重连之后自动重新预处理。
+		void execute_prepared(const char *sql, std::size_t len, const StatementParams &params);
+		void execute_prepared(const char *sql, const StatementParams &params){
+			execute_prepared(sql, std::strlen(sql), params);
+		}
+		void execute_prepared(const std::string &sql, const StatementParams &params){
+			execute_prepared(sql.data(), sql.size(), params);
+		}
 		void discard_result() NOEXCEPT;
 
+		// 非阻塞接口。begin_execute_sql() 和 continue_execute_sql() 返回需要等待的事件，为零表示请求已经完成，
+		// 此时调用 end_execute_sql() 检查结果，之后和 execute_sql() 一样读取结果。
+		// 等待期间不能调用这个连接上的其他函数。
+		enum {
+			WAIT_READ       = 0x01,
+			WAIT_WRITE      = 0x02,
+			WAIT_EXCEPT     = 0x04,
+			WAIT_TIMEOUT    = 0x08,
+		};
+		int begin_execute_sql(const char *sql, std::size_t len);
+		int begin_execute_sql(const std::string &sql){
+			return begin_execute_sql(sql.data(), sql.size());
+		}
+		int continue_execute_sql(int ready_events);
+		void end_execute_sql();
+		// 等待的套接字，每次等待之前都要重新获取，因为断线重连之后会改变。
+		int get_socket() const;
+		// 设置了 WAIT_TIMEOUT 时等待的毫秒数。
+		unsigned get_timeout() const;
+
+		// 默认开启。事务中应当关闭，否则断线之后的语句会在新的连接上自动提交。
+		void set_auto_reconnect(bool enabled);
+		// 服务器端的连接 ID。断线自动重连之后改变，此时连接上未提交的事务已经丢失。
+		unsigned long get_thread_id() const;
 		boost::uint64_t get_insert_id() const;
+		// 创建时指定了 found_rows 的连接上，UPDATE 返回的是匹配的行数，即使值没有改变。
+		boost::uint64_t get_affected_rows() const;
 		bool fetch_row();
 
 		boost::int64_t get_signed(const char *name) const;
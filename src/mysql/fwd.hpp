@@ -12,6 +12,7 @@ namespace MySql {
 	class StringEscaper;
 	class DateTimeFormatter;
 	class UuidFormatter;
+	class StatementParams;
 
 	class Connection;
 	class ObjectBase;
@@ -43,6 +43,16 @@ namespace MySql {
 	void ObjectBase::set_combined_write_stamp(void *stamp) const {
 		atomic_store(m_combined_write_stamp, stamp, ATOMIC_RELEASE);
 	}
+	bool ObjectBase::is_persisted() const {
+		return atomic_load(m_persisted, ATOMIC_CONSUME);
+	}
+	void ObjectBase::set_persisted(bool persisted) const {
+		atomic_store(m_persisted, persisted, ATOMIC_RELEASE);
+	}
+
+	std::size_t ObjectBase::get_shard_hash() const {
+		return boost::hash<const void *>()(this);
+	}
 	void ObjectBase::async_save(bool to_replace, bool urgent) const {
 		enable_auto_saving();
 		MySqlDaemon::enqueue_for_saving(virtual_shared_from_this<ObjectBase>(), to_replace, urgent);
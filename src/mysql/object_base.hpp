@@ -9,6 +9,7 @@
 #include "connection.hpp"
 #include "formatting.hpp"
 #include "exception.hpp"
+#include "statement_params.hpp"
 #include <string>
 #include <vector>
 #include <exception>
@@ -19,6 +20,7 @@
 #include <boost/make_shared.hpp>
 #include <boost/function.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
 #include "../atomic.hpp"
 #include "../shared_nts.hpp"
 #include "../log.hpp"
@@ -36,13 +38,14 @@ namespace MySql {
 	private:
 		mutable volatile bool m_auto_saves;
 		mutable void *volatile m_combined_write_stamp;
+		mutable volatile bool m_persisted;
 
 	protected:
 		mutable RecursiveMutex m_mutex;
 
 	public:
 		ObjectBase()
-			: m_auto_saves(false), m_combined_write_stamp(NULLPTR)
+			: m_auto_saves(false), m_combined_write_stamp(NULLPTR), m_persisted(false)
 		{ }
 		// 不要不写析构函数，否则 RTTI 将无法在动态库中使用。
 		~ObjectBase();
@@ -57,9 +60,28 @@ namespace MySql {
 		void *get_combined_write_stamp() const;
 		void set_combined_write_stamp(void *stamp) const;
 
+		// 已知数据库中存在这一行。从数据库中加载或者完整写入成功之后设置，此后 REPLACE 改为只写入修改过的字段的 UPDATE。
+		bool is_persisted() const;
+		void set_persisted(bool persisted) const;
+
 		virtual const char *get_table() const = 0;
+		// 分片的表按照这个值选择线程。使用 MYSQL_OBJECT_SHARD_KEY 时使用这个字段的值，否则使用主键，都没有时使用对象的地址。
+		virtual std::size_t get_shard_hash() const;
 
 		virtual void generate_sql(std::ostream &os) const = 0;
+		// 多行的 INSERT 和 REPLACE 使用。两者的列顺序相同。
+		virtual void generate_sql_columns(std::ostream &os) const = 0;
+		virtual void generate_sql_values(std::ostream &os) const = 0;
+		// 预处理语句使用，和 generate_sql_columns() 的顺序相同。
+		virtual void generate_sql_params(StatementParams &params) const = 0;
+		// 声明了 MYSQL_OBJECT_PRIMARY_KEYS 的对象可以使用 UPDATE 写入。
+		virtual bool is_updatable() const = 0;
+		virtual void set_all_fields_dirty(bool dirty) const = 0;
+		// 生成 UPDATE 语句中 SET 之后的部分，只包含修改过的字段，同时清除这些字段的修改标记。
+		// 返回写入的字段数，为零时不生成任何内容。
+		virtual std::size_t generate_sql_update(std::ostream &os) const = 0;
+		// 生成按照主键选择这一行的 WHERE 子句，包括开头的 WHERE。
+		virtual void generate_sql_where(std::ostream &os) const = 0;
 		virtual void fetch(const boost::shared_ptr<const Connection> &conn) = 0;
 		void async_save(bool to_replace, bool urgent = false) const;
 	};
@@ -69,10 +91,11 @@ namespace MySql {
 	private:
 		ObjectBase *const m_parent;
 		ValueT m_value;
+		mutable bool m_dirty;
 
 	public:
 		explicit Field(ObjectBase *parent, ValueT value = ValueT())
-			: m_parent(parent), m_value(STD_MOVE_IDN(value))
+			: m_parent(parent), m_value(STD_MOVE_IDN(value)), m_dirty(false)
 		{ }
 
 	public:
@@ -86,12 +109,22 @@ namespace MySql {
 		void set(ValueT value, bool invalidates_parent = true){
 			const RecursiveMutex::UniqueLock lock(m_parent->m_mutex);
 			m_value = STD_MOVE_IDN(value);
+			m_dirty = true;
 
 			if(invalidates_parent){
 				m_parent->invalidate();
 			}
 		}
 
+		bool is_dirty() const {
+			const RecursiveMutex::UniqueLock lock(m_parent->m_mutex);
+			return m_dirty;
+		}
+		void set_dirty(bool dirty) const {
+			const RecursiveMutex::UniqueLock lock(m_parent->m_mutex);
+			m_dirty = dirty;
+		}
+
 		void dump(std::ostream &os) const {
 			const RecursiveMutex::UniqueLock lock(m_parent->m_mutex);
 			os <<m_value;
@@ -99,6 +132,7 @@ namespace MySql {
 		void parse(std::istream &is, bool invalidates_parent = true){
 			const RecursiveMutex::UniqueLock lock(m_parent->m_mutex);
 			is >>m_value;
+			m_dirty = true;
 
 			if(invalidates_parent){
 				m_parent->invalidate();
@@ -115,6 +149,14 @@ namespace MySql {
 		}
 	};
 
+	template<typename ValueT>
+	inline std::size_t hash_shard_key(const ValueT &val){
+		return boost::hash<ValueT>()(val);
+	}
+	inline std::size_t hash_shard_key(const Uuid &val){
+		return boost::hash_range(val.begin(), val.end());
+	}
+
 	template<typename ValueT>
 	inline std::ostream &operator<<(std::ostream &os, const ObjectBase::Field<ValueT> &rhs){
 		rhs.dump(os);
@@ -117,6 +117,40 @@ public:
 	const char *get_table() const OVERRIDE {
 		return TOKEN_TO_STR(MYSQL_OBJECT_NAME);
 	}
+#if defined(MYSQL_OBJECT_SHARD_KEY)
+	// 分片键在对象第一次保存之后不应再修改，否则前后的操作可能被分配到不同的线程上。
+	::std::size_t get_shard_hash() const OVERRIDE {
+		return ::Poseidon::MySql::hash_shard_key(MYSQL_OBJECT_SHARD_KEY.get());
+	}
+#elif defined(MYSQL_OBJECT_PRIMARY_KEYS)
+	// 没有指定分片键时使用主键，这样主键相同的不同对象上的操作也按顺序执行。
+	::std::size_t get_shard_hash() const OVERRIDE {
+		const ::Poseidon::RecursiveMutex::UniqueLock lock_(m_mutex);
+		::std::size_t seed_ = 0;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                ::boost::hash_combine(seed_, ::Poseidon::MySql::hash_shard_key(id_.unlocked_get()));
+#define FIELD_SIGNED(id_)                 ::boost::hash_combine(seed_, ::Poseidon::MySql::hash_shard_key(id_.unlocked_get()));
+#define FIELD_UNSIGNED(id_)               ::boost::hash_combine(seed_, ::Poseidon::MySql::hash_shard_key(id_.unlocked_get()));
+#define FIELD_DOUBLE(id_)                 ::boost::hash_combine(seed_, ::Poseidon::MySql::hash_shard_key(id_.unlocked_get()));
+#define FIELD_STRING(id_)                 ::boost::hash_combine(seed_, ::Poseidon::MySql::hash_shard_key(id_.unlocked_get()));
+#define FIELD_DATETIME(id_)               ::boost::hash_combine(seed_, ::Poseidon::MySql::hash_shard_key(id_.unlocked_get()));
+#define FIELD_UUID(id_)                   ::boost::hash_combine(seed_, ::Poseidon::MySql::hash_shard_key(id_.unlocked_get()));
+#define FIELD_BLOB(id_)                   ::boost::hash_combine(seed_, ::Poseidon::MySql::hash_shard_key(id_.unlocked_get()));
+
+		MYSQL_OBJECT_PRIMARY_KEYS
+
+		return seed_;
+	}
+#endif
 
 	void generate_sql(::std::ostream &os_) const OVERRIDE {
 		static CONSTEXPR const char delims_[2][4] = { "", ", " };
@@ -142,6 +176,174 @@ public:
 
 		MYSQL_OBJECT_FIELDS
 	}
+	void generate_sql_columns(::std::ostream &os_) const OVERRIDE {
+		static CONSTEXPR const char delims_[2][4] = { "", ", " };
+		bool flag_ = false;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "`";
+#define FIELD_SIGNED(id_)                 os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "`";
+#define FIELD_UNSIGNED(id_)               os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "`";
+#define FIELD_DOUBLE(id_)                 os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "`";
+#define FIELD_STRING(id_)                 os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "`";
+#define FIELD_DATETIME(id_)               os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "`";
+#define FIELD_UUID(id_)                   os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "`";
+#define FIELD_BLOB(id_)                   os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "`";
+
+		MYSQL_OBJECT_FIELDS
+	}
+	void generate_sql_values(::std::ostream &os_) const OVERRIDE {
+		static CONSTEXPR const char delims_[2][4] = { "", ", " };
+		bool flag_ = false;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                os_ <<delims_[flag_++] <<id_;
+#define FIELD_SIGNED(id_)                 os_ <<delims_[flag_++] <<id_;
+#define FIELD_UNSIGNED(id_)               os_ <<delims_[flag_++] <<id_;
+#define FIELD_DOUBLE(id_)                 os_ <<delims_[flag_++] <<id_;
+#define FIELD_STRING(id_)                 os_ <<delims_[flag_++] << ::Poseidon::MySql::StringEscaper(id_);
+#define FIELD_DATETIME(id_)               os_ <<delims_[flag_++] << ::Poseidon::MySql::DateTimeFormatter(id_);
+#define FIELD_UUID(id_)                   os_ <<delims_[flag_++] << ::Poseidon::MySql::UuidFormatter(id_);
+#define FIELD_BLOB(id_)                   os_ <<delims_[flag_++] << ::Poseidon::MySql::StringEscaper(id_);
+
+		MYSQL_OBJECT_FIELDS
+	}
+	void generate_sql_params(::Poseidon::MySql::StatementParams &params_) const OVERRIDE {
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                params_.push_signed   ( id_.get() );
+#define FIELD_SIGNED(id_)                 params_.push_signed   ( id_.get() );
+#define FIELD_UNSIGNED(id_)               params_.push_unsigned ( id_.get() );
+#define FIELD_DOUBLE(id_)                 params_.push_double   ( id_.get() );
+#define FIELD_STRING(id_)                 params_.push_string   ( id_.get() );
+#define FIELD_DATETIME(id_)               params_.push_datetime ( id_.get() );
+#define FIELD_UUID(id_)                   params_.push_uuid     ( id_.get() );
+#define FIELD_BLOB(id_)                   params_.push_blob     ( id_.get() );
+
+		MYSQL_OBJECT_FIELDS
+	}
+	bool is_updatable() const OVERRIDE {
+#ifdef MYSQL_OBJECT_PRIMARY_KEYS
+		return true;
+#else
+		return false;
+#endif
+	}
+	void set_all_fields_dirty(bool dirty_) const OVERRIDE {
+		const ::Poseidon::RecursiveMutex::UniqueLock lock_(m_mutex);
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                id_.set_dirty(dirty_);
+#define FIELD_SIGNED(id_)                 id_.set_dirty(dirty_);
+#define FIELD_UNSIGNED(id_)               id_.set_dirty(dirty_);
+#define FIELD_DOUBLE(id_)                 id_.set_dirty(dirty_);
+#define FIELD_STRING(id_)                 id_.set_dirty(dirty_);
+#define FIELD_DATETIME(id_)               id_.set_dirty(dirty_);
+#define FIELD_UUID(id_)                   id_.set_dirty(dirty_);
+#define FIELD_BLOB(id_)                   id_.set_dirty(dirty_);
+
+		MYSQL_OBJECT_FIELDS
+	}
+	void generate_sql_where(::std::ostream &os_) const OVERRIDE {
+#ifdef MYSQL_OBJECT_PRIMARY_KEYS
+		const ::Poseidon::RecursiveMutex::UniqueLock lock_(m_mutex);
+		static CONSTEXPR const char conjs_[2][8] = { " WHERE ", " AND " };
+		bool where_ = false;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                os_ <<conjs_[where_++] <<"`" TOKEN_TO_STR(id_) "` = " <<id_;
+#define FIELD_SIGNED(id_)                 os_ <<conjs_[where_++] <<"`" TOKEN_TO_STR(id_) "` = " <<id_;
+#define FIELD_UNSIGNED(id_)               os_ <<conjs_[where_++] <<"`" TOKEN_TO_STR(id_) "` = " <<id_;
+#define FIELD_DOUBLE(id_)                 os_ <<conjs_[where_++] <<"`" TOKEN_TO_STR(id_) "` = " <<id_;
+#define FIELD_STRING(id_)                 os_ <<conjs_[where_++] <<"`" TOKEN_TO_STR(id_) "` = " << ::Poseidon::MySql::StringEscaper(id_);
+#define FIELD_DATETIME(id_)               os_ <<conjs_[where_++] <<"`" TOKEN_TO_STR(id_) "` = " << ::Poseidon::MySql::DateTimeFormatter(id_);
+#define FIELD_UUID(id_)                   os_ <<conjs_[where_++] <<"`" TOKEN_TO_STR(id_) "` = " << ::Poseidon::MySql::UuidFormatter(id_);
+#define FIELD_BLOB(id_)                   os_ <<conjs_[where_++] <<"`" TOKEN_TO_STR(id_) "` = " << ::Poseidon::MySql::StringEscaper(id_);
+
+		MYSQL_OBJECT_PRIMARY_KEYS
+#else
+		(void)os_;
+#endif
+	}
+	// 主键字段用于 WHERE 子句，不应修改。
+	::std::size_t generate_sql_update(::std::ostream &os_) const OVERRIDE {
+#ifdef MYSQL_OBJECT_PRIMARY_KEYS
+		const ::Poseidon::RecursiveMutex::UniqueLock lock_(m_mutex);
+		static CONSTEXPR const char delims_[2][4] = { "", ", " };
+		bool flag_ = false;
+		::std::size_t count_ = 0;
+
+#undef FIELD_BOOLEAN
+#undef FIELD_SIGNED
+#undef FIELD_UNSIGNED
+#undef FIELD_DOUBLE
+#undef FIELD_STRING
+#undef FIELD_DATETIME
+#undef FIELD_UUID
+#undef FIELD_BLOB
+
+#define FIELD_BOOLEAN(id_)                if(id_.is_dirty()){ os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "` = " <<id_; id_.set_dirty(false); ++count_; }
+#define FIELD_SIGNED(id_)                 if(id_.is_dirty()){ os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "` = " <<id_; id_.set_dirty(false); ++count_; }
+#define FIELD_UNSIGNED(id_)               if(id_.is_dirty()){ os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "` = " <<id_; id_.set_dirty(false); ++count_; }
+#define FIELD_DOUBLE(id_)                 if(id_.is_dirty()){ os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "` = " <<id_; id_.set_dirty(false); ++count_; }
+#define FIELD_STRING(id_)                 if(id_.is_dirty()){ os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "` = " << ::Poseidon::MySql::StringEscaper(id_); id_.set_dirty(false); ++count_; }
+#define FIELD_DATETIME(id_)               if(id_.is_dirty()){ os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "` = " << ::Poseidon::MySql::DateTimeFormatter(id_); id_.set_dirty(false); ++count_; }
+#define FIELD_UUID(id_)                   if(id_.is_dirty()){ os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "` = " << ::Poseidon::MySql::UuidFormatter(id_); id_.set_dirty(false); ++count_; }
+#define FIELD_BLOB(id_)                   if(id_.is_dirty()){ os_ <<delims_[flag_++] <<"`" TOKEN_TO_STR(id_) "` = " << ::Poseidon::MySql::StringEscaper(id_); id_.set_dirty(false); ++count_; }
+
+		MYSQL_OBJECT_FIELDS
+
+		if(count_ == 0){
+			return 0;
+		}
+		generate_sql_where(os_);
+
+		return count_;
+#else
+		(void)os_;
+		return 0;
+#endif
+	}
 	void fetch(const ::boost::shared_ptr<const ::Poseidon::MySql::Connection> &conn_) OVERRIDE {
 
 #undef FIELD_BOOLEAN
@@ -163,6 +365,9 @@ public:
 #define FIELD_BLOB(id_)                   id_.set(conn_->get_blob     ( TOKEN_TO_STR(id_) ), false);
 
 		MYSQL_OBJECT_FIELDS
+
+		set_all_fields_dirty(false);
+		set_persisted(true);
 	}
 };
 
@@ -170,3 +375,5 @@ public:
 
 #undef MYSQL_OBJECT_NAME
 #undef MYSQL_OBJECT_FIELDS
+#undef MYSQL_OBJECT_SHARD_KEY
+#undef MYSQL_OBJECT_PRIMARY_KEYS
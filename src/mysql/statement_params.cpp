@@ -0,0 +1,116 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "statement_params.hpp"
+#include "formatting.hpp"
+#include "../buffer_streams.hpp"
+#include "../uuid.hpp"
+
+namespace Poseidon {
+
+namespace MySql {
+	void StatementParams::push_null(){
+		m_elements.push_back(VAL_INIT);
+		AUTO_REF(elem, m_elements.back());
+		elem.type = T_NULL;
+	}
+	void StatementParams::push_signed(boost::int64_t val){
+		m_elements.push_back(VAL_INIT);
+		AUTO_REF(elem, m_elements.back());
+		elem.type = T_SIGNED;
+		elem.i = val;
+	}
+	void StatementParams::push_unsigned(boost::uint64_t val){
+		m_elements.push_back(VAL_INIT);
+		AUTO_REF(elem, m_elements.back());
+		elem.type = T_UNSIGNED;
+		elem.i = static_cast<boost::int64_t>(val);
+	}
+	void StatementParams::push_double(double val){
+		m_elements.push_back(VAL_INIT);
+		AUTO_REF(elem, m_elements.back());
+		elem.type = T_DOUBLE;
+		elem.d = val;
+	}
+	void StatementParams::push_string(std::string val){
+		m_elements.push_back(VAL_INIT);
+		AUTO_REF(elem, m_elements.back());
+		elem.type = T_STRING;
+		elem.str.swap(val);
+	}
+	void StatementParams::push_datetime(boost::uint64_t val){
+		m_elements.push_back(VAL_INIT);
+		AUTO_REF(elem, m_elements.back());
+		elem.type = T_DATETIME;
+		elem.i = static_cast<boost::int64_t>(val);
+	}
+	void StatementParams::push_uuid(const Uuid &val){
+		m_elements.push_back(VAL_INIT);
+		AUTO_REF(elem, m_elements.back());
+		elem.type = T_STRING;
+		val.to_string(elem.str);
+	}
+	void StatementParams::push_blob(const std::basic_string<unsigned char> &val){
+		m_elements.push_back(VAL_INIT);
+		AUTO_REF(elem, m_elements.back());
+		elem.type = T_BLOB;
+		elem.str.assign(val.begin(), val.end());
+	}
+
+	std::string StatementParams::interpolate(const std::string &query) const {
+		Buffer_ostream os;
+		std::size_t index = 0;
+		char quote = 0;
+		for(std::size_t pos = 0; pos < query.size(); ++pos){
+			const char ch = query[pos];
+			if(quote != 0){
+				os <<ch;
+				if((ch == '\\') && (pos + 1 < query.size())){
+					os <<query[++pos];
+				} else if(ch == quote){
+					quote = 0;
+				}
+				continue;
+			}
+			if((ch == '\'') || (ch == '\"') || (ch == '`')){
+				os <<ch;
+				quote = ch;
+				continue;
+			}
+			if((ch != '?') || (index >= m_elements.size())){
+				os <<ch;
+				continue;
+			}
+			const AUTO_REF(elem, m_elements.at(index++));
+			switch(elem.type){
+			case T_NULL:
+				os <<"NULL";
+				break;
+			case T_SIGNED:
+				os <<elem.i;
+				break;
+			case T_UNSIGNED:
+				os <<static_cast<boost::uint64_t>(elem.i);
+				break;
+			case T_DOUBLE:
+				os <<elem.d;
+				break;
+			case T_STRING:
+			case T_BLOB:
+				os <<StringEscaper(elem.str);
+				break;
+			case T_DATETIME: {
+				const AUTO(time, static_cast<boost::uint64_t>(elem.i));
+				os <<DateTimeFormatter(time);
+				break; }
+			default:
+				os <<"NULL";
+				break;
+			}
+		}
+		return os.get_buffer().dump_string();
+	}
+}
+
+}
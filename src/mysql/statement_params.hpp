@@ -0,0 +1,84 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_MYSQL_STATEMENT_PARAMS_HPP_
+#define POSEIDON_MYSQL_STATEMENT_PARAMS_HPP_
+
+#include "../cxx_ver.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace Poseidon {
+
+class Uuid;
+
+namespace MySql {
+	// 预处理语句的参数，按照占位符的顺序排列。
+	class StatementParams {
+	public:
+		enum Type {
+			T_NULL,
+			T_SIGNED,
+			T_UNSIGNED,
+			T_DOUBLE,
+			T_STRING,
+			T_DATETIME,
+			T_BLOB,
+		};
+
+		struct Element {
+			Type type;
+			boost::int64_t i;  // T_SIGNED, T_UNSIGNED 和 T_DATETIME 使用。
+			double d;
+			std::string str;   // T_STRING 和 T_BLOB 使用。
+		};
+
+	private:
+		std::vector<Element> m_elements;
+
+	public:
+		bool empty() const {
+			return m_elements.empty();
+		}
+		std::size_t size() const {
+			return m_elements.size();
+		}
+		const Element &at(std::size_t index) const {
+			return m_elements.at(index);
+		}
+		void reserve(std::size_t count){
+			m_elements.reserve(count);
+		}
+		void clear(){
+			m_elements.clear();
+		}
+
+		void push_null();
+		void push_signed(boost::int64_t val);
+		void push_unsigned(boost::uint64_t val);
+		void push_double(double val);
+		void push_string(std::string val);
+		void push_datetime(boost::uint64_t val);
+		// 和 UuidFormatter 一样以字符串的形式传递。
+		void push_uuid(const Uuid &val);
+		void push_blob(const std::basic_string<unsigned char> &val);
+
+		// 把占位符替换为转义过的值，用于日志和 SQL 转储。引号中的问号不是占位符。
+		std::string interpolate(const std::string &query) const;
+
+		void swap(StatementParams &rhs) NOEXCEPT {
+			using std::swap;
+			swap(m_elements, rhs.m_elements);
+		}
+	};
+
+	inline void swap(StatementParams &lhs, StatementParams &rhs) NOEXCEPT {
+		lhs.swap(rhs);
+	}
+}
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "../precompiled.hpp"
 #include "epoll_daemon.hpp"
+#include "main_config.hpp"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
@@ -19,12 +20,64 @@
 #include "../checked_arithmetic.hpp"
 #include "../system_exception.hpp"
 #include "../errno.hpp"
+#include "../mutex.hpp"
+#include "../timer_wheel.hpp"
 
 namespace Poseidon {
 
 namespace {
+	std::size_t g_thread_count = 1;
+	std::size_t g_batch_size   = 256;
+
+	volatile boost::uint64_t g_tcp_request_timeout  = 5000;
+	volatile boost::uint64_t g_tcp_response_timeout = 30000;
+	volatile std::size_t     g_read_budget          = 65536;
+	volatile std::size_t     g_write_budget         = 1048576;
+
 	volatile bool g_running = false;
-	Thread g_thread;
+
+	// 配置文件被重新加载之后重新读取上面的配置项。每秒至多检查一次。
+	volatile boost::uint64_t g_next_config_check_time = 0;
+	Mutex g_config_mutex;
+	boost::shared_ptr<const ConfigFile> g_config;
+
+	void reload_socket_config(boost::uint64_t now){
+		PROFILE_ME;
+
+		AUTO(next_check_time, atomic_load(g_next_config_check_time, ATOMIC_RELAXED));
+		if(now < next_check_time){
+			return;
+		}
+		if(!atomic_compare_exchange(g_next_config_check_time, next_check_time, saturated_add(now, (boost::uint64_t)1000), ATOMIC_RELAXED, ATOMIC_RELAXED)){
+			return;
+		}
+		AUTO(config, MainConfig::get_config());
+		const Mutex::UniqueLock lock(g_config_mutex);
+		if(config == g_config){
+			return;
+		}
+		g_config.swap(config);
+
+		boost::uint64_t tcp_request_timeout = 5000;
+		g_config->get(tcp_request_timeout, "tcp_request_timeout");
+		LOG_POSEIDON_DEBUG("tcp_request_timeout = ", tcp_request_timeout);
+		atomic_store(g_tcp_request_timeout, tcp_request_timeout, ATOMIC_RELAXED);
+
+		boost::uint64_t tcp_response_timeout = 30000;
+		g_config->get(tcp_response_timeout, "tcp_response_timeout");
+		LOG_POSEIDON_DEBUG("tcp_response_timeout = ", tcp_response_timeout);
+		atomic_store(g_tcp_response_timeout, tcp_response_timeout, ATOMIC_RELAXED);
+
+		std::size_t read_budget = 65536;
+		g_config->get(read_budget, "epoll_read_budget");
+		LOG_POSEIDON_DEBUG("epoll_read_budget = ", read_budget);
+		atomic_store(g_read_budget, std::max<std::size_t>(read_budget, 1), ATOMIC_RELAXED);
+
+		std::size_t write_budget = 1048576;
+		g_config->get(write_budget, "epoll_write_budget");
+		LOG_POSEIDON_DEBUG("epoll_write_budget = ", write_budget);
+		atomic_store(g_write_budget, std::max<std::size_t>(write_budget, 1), ATOMIC_RELAXED);
+	}
 
 	class WeakableSocket {
 	private:
@@ -49,8 +102,24 @@ namespace {
 		}
 	};
 
+	// 空闲检查的时间轮节点。析构时从时间轮中摘除，因此只能在持有分片的互斥锁时销毁。
+	struct IdleNode : public TimerWheel::Node {
+		TimerWheel *const wheel;
+		const SocketBase *const ptr;
+
+		IdleNode(TimerWheel *wheel_, const SocketBase *ptr_)
+			: wheel(wheel_), ptr(ptr_)
+		{ }
+		~IdleNode(){
+			if(is_linked()){
+				wheel->erase(this);
+			}
+		}
+	};
+
 	struct SocketElement {
 		boost::shared_ptr<const WeakableSocket> weakable;
+		boost::shared_ptr<IdleNode> idle_node;
 
 		const SocketBase *ptr;
 		boost::uint64_t read_time;
@@ -59,11 +128,15 @@ namespace {
 
 		mutable bool readable;
 		mutable bool writeable;
+		// 每次 mark_socket_writeable() 递增。写回结果时如果和收集时不同，说明期间有新的数据，不能停止写入。
+		mutable unsigned long write_seq;
+		// 每次收到 EPOLLIN 或者 mark_socket_readable() 递增。写回结果时如果和收集时不同，说明期间被唤醒过，不能推迟读取。
+		mutable unsigned long read_seq;
 
-		SocketElement(bool owning, const boost::shared_ptr<SocketBase> &socket, boost::uint64_t now)
-			: weakable(boost::make_shared<WeakableSocket>(owning, socket))
+		SocketElement(bool owning, const boost::shared_ptr<SocketBase> &socket, TimerWheel *wheel, boost::uint64_t now)
+			: weakable(boost::make_shared<WeakableSocket>(owning, socket)), idle_node(boost::make_shared<IdleNode>(wheel, socket.get()))
 			, ptr(socket.get()), read_time(now), write_time(now), err_code(-1)
-			, readable(false), writeable(false)
+			, readable(false), writeable(false), write_seq(0), read_seq(0)
 		{ }
 	};
 	MULTI_INDEX_MAP(SocketMap, SocketElement,
@@ -73,250 +146,573 @@ namespace {
 		MULTI_MEMBER_INDEX(err_code)
 	)
 
-	RecursiveMutex g_mutex;
-	UniqueFile g_epoll;
-	SocketMap g_socket_map;
+	struct PumpElement {
+		boost::shared_ptr<SocketBase> socket;
+		bool ready;
+		int err_code;
+		bool to_erase;
+		bool reschedule;
+		boost::uint64_t next_time;
+		unsigned long seq;
+	};
 
-	bool wait_for_sockets(unsigned timeout) NOEXCEPT {
-		PROFILE_ME;
+	// 每个分片拥有独立的 epoll、套接字表和互斥锁，由一个独立的线程驱动。
+	class EpollShard : NONCOPYABLE {
+	private:
+		Thread m_thread;
+
+		mutable RecursiveMutex m_mutex;
+		UniqueFile m_epoll;
+		// 所有套接字按下一次空闲检查的时间排列。必须在 m_socket_map 之前构造。
+		TimerWheel m_idle_wheel;
+		SocketMap m_socket_map;
+
+		// 以下成员只在本分片的线程中访问。
+		std::vector<PumpElement> m_batch;
+		std::vector<TimerWheel::Node *> m_idle_expired;
 
-		::epoll_event events[256];
-		const int result = ::epoll_wait(g_epoll.get(), events, COUNT_OF(events), (int)timeout);
-		if(result < 0){
-			const int err_code = errno;
-			if(err_code != EINTR){
-				LOG_POSEIDON_ERROR("::epoll_wait() failed! errno was ", err_code);
+		volatile boost::uint64_t m_iterations;
+		volatile boost::uint64_t m_sockets_pumped;
+		volatile std::size_t m_last_batch_size;
+		volatile std::size_t m_max_batch_size;
+
+	public:
+		EpollShard()
+			: m_idle_wheel(get_fast_mono_clock())
+			, m_iterations(0), m_sockets_pumped(0), m_last_batch_size(0), m_max_batch_size(0)
+		{
+			m_batch.reserve(g_batch_size);
+			if(!m_epoll.reset(::epoll_create(4096))){
+				const int err_code = errno;
+				LOG_POSEIDON_FATAL("Failed to create epoll! errno was ", err_code);
+				std::abort();
 			}
-			return false;
 		}
-		if(result == 0){
-			return false;
+
+	private:
+		bool wait_for_sockets(unsigned timeout) NOEXCEPT {
+			PROFILE_ME;
+
+			::epoll_event events[256];
+			const int result = ::epoll_wait(m_epoll.get(), events, COUNT_OF(events), (int)timeout);
+			if(result < 0){
+				const int err_code = errno;
+				if(err_code != EINTR){
+					LOG_POSEIDON_ERROR("::epoll_wait() failed! errno was ", err_code);
+				}
+				return false;
+			}
+			if(result == 0){
+				return false;
+			}
+			const AUTO(now, get_fast_mono_clock());
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			for(unsigned i = 0; i < (unsigned)result; ++i){
+				const AUTO(ptr, static_cast<SocketBase *>(events[i].data.ptr));
+				const AUTO(it, m_socket_map.find<0>(ptr));
+				if(it == m_socket_map.end()){
+					LOG_POSEIDON_TRACE("Socket reported by epoll is not registered: ptr = ", static_cast<void *>(ptr));
+					continue;
+				}
+				const AUTO(socket, it->weakable->lock());
+				if(!socket){
+					m_socket_map.erase<0>(it);
+					continue;
+				}
+				if(events[i].events & EPOLLIN){
+					it->readable = true;
+					++(it->read_seq);
+					m_socket_map.set_key<0, 1>(it, now);
+				}
+				if(events[i].events & EPOLLOUT){
+					it->writeable = true;
+					m_socket_map.set_key<0, 2>(it, now);
+				}
+				if(events[i].events & (EPOLLHUP | EPOLLERR)){
+					int err_code;
+					if(socket->did_time_out()){
+						err_code = ETIMEDOUT;
+					} else if(events[i].events & EPOLLERR){
+						::socklen_t err_len = sizeof(err_code);
+						if(::getsockopt(socket->get_fd(), SOL_SOCKET, SO_ERROR, &err_code, &err_len) != 0){
+							err_code = errno;
+							LOG_POSEIDON_WARNING("::getsockopt() failed, errno was ", err_code, ": fd = ", socket->get_fd());
+						}
+					} else {
+						err_code = 0;
+					}
+					m_socket_map.set_key<0, 3>(it, err_code);
+				}
+			}
+			return true;
 		}
-		const AUTO(now, get_fast_mono_clock());
-		const RecursiveMutex::UniqueLock lock(g_mutex);
-		for(unsigned i = 0; i < (unsigned)result; ++i){
-			const AUTO(ptr, static_cast<SocketBase *>(events[i].data.ptr));
-			const AUTO(it, g_socket_map.find<0>(ptr));
-			if(it == g_socket_map.end()){
-				LOG_POSEIDON_TRACE("Socket reported by epoll is not registered: ptr = ", static_cast<void *>(ptr));
-				continue;
-			}
-			const AUTO(socket, it->weakable->lock());
-			if(!socket){
-				g_socket_map.erase<0>(it);
-				continue;
-			}
-			if(events[i].events & EPOLLIN){
-				it->readable = true;
-				g_socket_map.set_key<0, 1>(it, now);
-			}
-			if(events[i].events & EPOLLOUT){
-				it->writeable = true;
-				g_socket_map.set_key<0, 2>(it, now);
-			}
-			if(events[i].events & (EPOLLHUP | EPOLLERR)){
+
+		// 在一次加锁中收集至多 g_batch_size 个就绪的套接字，解锁后逐个处理，最后再加锁一次写回结果。
+		std::size_t pump_readable_sockets() NOEXCEPT {
+			PROFILE_ME;
+
+			const AUTO(now, get_fast_mono_clock());
+			std::size_t count = 0;
+			m_batch.clear();
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				AUTO(it, m_socket_map.begin<1>());
+				while((it != m_socket_map.end<1>()) && (m_batch.size() < g_batch_size)){
+					if(now < it->read_time){
+						break;
+					}
+					const AUTO(socket, it->weakable->lock());
+					if(!socket){
+						it = m_socket_map.erase<1>(it);
+						++count;
+						continue;
+					}
+					PumpElement elem = { socket, it->readable, 0, false, false, 0, it->read_seq };
+					m_batch.push_back(elem);
+					++it;
+				}
+			}
+			if(m_batch.empty()){
+				return count;
+			}
+
+			for(AUTO(it, m_batch.begin()); it != m_batch.end(); ++it){
+				const AUTO_REF(socket, it->socket);
+				if(socket->is_throttled()){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+						"Session is throttled: typeid = ", typeid(*socket).name());
+					it->reschedule = true;
+					it->next_time = now + 5000;
+					continue;
+				}
+
 				int err_code;
-				if(socket->did_time_out()){
-					err_code = ETIMEDOUT;
-				} else if(events[i].events & EPOLLERR){
-					::socklen_t err_len = sizeof(err_code);
-					if(::getsockopt(socket->get_fd(), SOL_SOCKET, SO_ERROR, &err_code, &err_len) != 0){
-						err_code = errno;
-						LOG_POSEIDON_WARNING("::getsockopt() failed, errno was ", err_code, ": fd = ", socket->get_fd());
+				try {
+					err_code = socket->poll_read_and_process(it->ready);
+				} catch(std::exception &e){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*socket).name());
+					socket->SocketBase::force_shutdown();
+					err_code = EPIPE;
+				} catch(...){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"Unknown exception thrown: typeid = ", typeid(*socket).name());
+					socket->SocketBase::force_shutdown();
+					err_code = EPIPE;
+				}
+				if((err_code == EWOULDBLOCK) || (err_code == EAGAIN)){
+					it->reschedule = true;
+					it->next_time = (boost::uint64_t)-1;
+				} else if((err_code != 0) && (err_code != EINTR)){
+					LOG_POSEIDON_DEBUG("Socket read error: typeid = ", typeid(*socket).name(), ", err_code = ", err_code);
+					it->to_erase = true;
+				}
+			}
+
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				for(AUTO(it, m_batch.begin()); it != m_batch.end(); ++it){
+					const AUTO(map_it, m_socket_map.find<0>(it->socket.get()));
+					if(map_it == m_socket_map.end<0>()){
+						continue;
+					}
+					if(it->to_erase){
+						m_socket_map.erase<0>(map_it);
+					} else if(it->reschedule && (map_it->read_seq == it->seq)){
+						m_socket_map.set_key<0, 1>(map_it, it->next_time);
 					}
-				} else {
-					err_code = 0;
 				}
-				g_socket_map.set_key<0, 3>(it, err_code);
 			}
+			count += m_batch.size();
+			m_batch.clear();
+			return count;
 		}
-		return true;
-	}
 
-	bool pump_one_readable_socket() NOEXCEPT {
-		PROFILE_ME;
-
-		const AUTO(now, get_fast_mono_clock());
-		boost::shared_ptr<SocketBase> socket;
-		bool readable;
-		{
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.begin<1>());
-			if(it == g_socket_map.end<1>()){
-				return false;
+		std::size_t pump_writeable_sockets() NOEXCEPT {
+			PROFILE_ME;
+
+			const AUTO(now, get_fast_mono_clock());
+			std::size_t count = 0;
+			m_batch.clear();
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				AUTO(it, m_socket_map.begin<2>());
+				while((it != m_socket_map.end<2>()) && (m_batch.size() < g_batch_size)){
+					if(now < it->write_time){
+						break;
+					}
+					const AUTO(socket, it->weakable->lock());
+					if(!socket){
+						it = m_socket_map.erase<2>(it);
+						++count;
+						continue;
+					}
+					PumpElement elem = { socket, it->writeable, 0, false, false, 0, it->write_seq };
+					m_batch.push_back(elem);
+					++it;
+				}
 			}
-			if(now < it->read_time){
-				return false;
+			if(m_batch.empty()){
+				return count;
 			}
-			socket = it->weakable->lock();
-			if(!socket){
-				g_socket_map.erase<1>(it);
-				return true;
+
+			// poll_write() 返回的写锁只在处理这个套接字期间保持。此后调用的 mark_socket_writeable() 由 write_seq 记录。
+			for(AUTO(it, m_batch.begin()); it != m_batch.end(); ++it){
+				const AUTO_REF(socket, it->socket);
+
+				Mutex::UniqueLock write_lock;
+				int err_code;
+				try {
+					err_code = socket->poll_write(write_lock, it->ready);
+				} catch(std::exception &e){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*socket).name());
+					socket->SocketBase::force_shutdown();
+					err_code = EPIPE;
+				} catch(...){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"Unknown exception thrown: typeid = ", typeid(*socket).name());
+					socket->SocketBase::force_shutdown();
+					err_code = EPIPE;
+				}
+				if((err_code == EWOULDBLOCK) || (err_code == EAGAIN)){
+					it->reschedule = true;
+					it->next_time = (boost::uint64_t)-1;
+				} else if((err_code != 0) && (err_code != EINTR)){
+					LOG_POSEIDON_DEBUG("Socket write error: typeid = ", typeid(*socket).name(), ", err_code = ", err_code);
+					it->to_erase = true;
+				}
 			}
-			readable = it->readable;
-		}
 
-		if(socket->is_throttled()){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-				"Session is throttled: typeid = ", typeid(*socket).name());
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.find<0>(socket.get()));
-			if(it != g_socket_map.end<0>()){
-				g_socket_map.set_key<0, 1>(it, now + 5000);
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				for(AUTO(it, m_batch.begin()); it != m_batch.end(); ++it){
+					const AUTO(map_it, m_socket_map.find<0>(it->socket.get()));
+					if(map_it == m_socket_map.end<0>()){
+						continue;
+					}
+					if(it->to_erase){
+						m_socket_map.erase<0>(map_it);
+					} else if(it->reschedule && (map_it->write_seq == it->seq)){
+						m_socket_map.set_key<0, 2>(map_it, it->next_time);
+					}
+				}
 			}
-			return true;
+			count += m_batch.size();
+			m_batch.clear();
+			return count;
 		}
 
-		int err_code;
-		try {
-			err_code = socket->poll_read_and_process(readable);
-		} catch(std::exception &e){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-				"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*socket).name());
-			socket->SocketBase::force_shutdown();
-			err_code = EPIPE;
-		} catch(...){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-				"Unknown exception thrown: typeid = ", typeid(*socket).name());
-			socket->SocketBase::force_shutdown();
-			err_code = EPIPE;
+		std::size_t pump_closed_sockets() NOEXCEPT {
+			PROFILE_ME;
+
+			std::size_t count = 0;
+			m_batch.clear();
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				AUTO(it, m_socket_map.lower_bound<3>(0));
+				while((it != m_socket_map.end<3>()) && (m_batch.size() < g_batch_size)){
+					const AUTO(socket, it->weakable->lock());
+					if(!socket){
+						it = m_socket_map.erase<3>(it);
+						++count;
+						continue;
+					}
+					PumpElement elem = { socket, false, it->err_code, true, false, 0, 0 };
+					m_batch.push_back(elem);
+					++it;
+				}
+			}
+			if(m_batch.empty()){
+				return count;
+			}
+
+			for(AUTO(it, m_batch.begin()); it != m_batch.end(); ++it){
+				const AUTO_REF(socket, it->socket);
+				const int err_code = it->err_code;
+				try {
+					socket->on_close(err_code);
+				} catch(std::exception &e){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*socket).name());
+					socket->SocketBase::force_shutdown();
+				} catch(...){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"Unknown exception thrown: typeid = ", typeid(*socket).name());
+					socket->SocketBase::force_shutdown();
+				}
+				LOG_POSEIDON_DEBUG("Socket closed: typeid = ", typeid(*socket).name(), ", err_code = ", err_code);
+			}
+
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				for(AUTO(it, m_batch.begin()); it != m_batch.end(); ++it){
+					const AUTO(map_it, m_socket_map.find<0>(it->socket.get()));
+					if(map_it == m_socket_map.end<0>()){
+						continue;
+					}
+					m_socket_map.erase<0>(map_it);
+				}
+			}
+			count += m_batch.size();
+			m_batch.clear();
+			return count;
 		}
-		if((err_code == EWOULDBLOCK) || (err_code == EAGAIN)){
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.find<0>(socket.get()));
-			if(it != g_socket_map.end<0>()){
-				g_socket_map.set_key<0, 1>(it, (boost::uint64_t)-1);
-			}
-		} else if((err_code != 0) && (err_code != EINTR)){
-			LOG_POSEIDON_DEBUG("Socket read error: typeid = ", typeid(*socket).name(), ", err_code = ", err_code);
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.find<0>(socket.get()));
-			if(it != g_socket_map.end<0>()){
-				g_socket_map.erase<0>(it);
+
+		// 只处理检查时间已经到达的套接字。poll_idle() 返回新的检查时间，这里重新插入时间轮。
+		std::size_t pump_idle_sockets() NOEXCEPT {
+			PROFILE_ME;
+
+			const AUTO(now, get_fast_mono_clock());
+			try {
+				reload_socket_config(now);
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
+			}
+
+			m_batch.clear();
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				m_idle_expired.clear();
+				try {
+					m_idle_wheel.advance(now, m_idle_expired);
+				} catch(std::exception &e){
+					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				}
+				for(AUTO(it, m_idle_expired.begin()); it != m_idle_expired.end(); ++it){
+					const AUTO(map_it, m_socket_map.find<0>(static_cast<IdleNode *>(*it)->ptr));
+					if(map_it == m_socket_map.end<0>()){
+						continue;
+					}
+					const AUTO(socket, map_it->weakable->lock());
+					if(!socket){
+						continue;
+					}
+					PumpElement elem = { socket, false, 0, false, false, 0, 0 };
+					try {
+						m_batch.push_back(elem);
+					} catch(std::exception &e){
+						LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+						m_idle_wheel.insert(*it, saturated_add(now, (boost::uint64_t)1000));
+					}
+				}
+				m_idle_expired.clear();
+			}
+			if(m_batch.empty()){
+				return 0;
+			}
+
+			for(AUTO(it, m_batch.begin()); it != m_batch.end(); ++it){
+				const AUTO_REF(socket, it->socket);
+				try {
+					it->next_time = socket->poll_idle(now);
+				} catch(std::exception &e){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*socket).name());
+					socket->SocketBase::force_shutdown();
+					it->next_time = (boost::uint64_t)-1;
+				} catch(...){
+					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
+						"Unknown exception thrown: typeid = ", typeid(*socket).name());
+					socket->SocketBase::force_shutdown();
+					it->next_time = (boost::uint64_t)-1;
+				}
 			}
+
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				for(AUTO(it, m_batch.begin()); it != m_batch.end(); ++it){
+					const AUTO(map_it, m_socket_map.find<0>(it->socket.get()));
+					if(map_it == m_socket_map.end<0>()){
+						continue;
+					}
+					const AUTO(node, map_it->idle_node.get());
+					// 在 poll_idle() 期间可能已经通过 schedule_idle_check() 重新插入过了。
+					if(node->is_linked() && (node->get_expiry() <= it->next_time)){
+						continue;
+					}
+					if(node->is_linked()){
+						m_idle_wheel.erase(node);
+					}
+					if(it->next_time != (boost::uint64_t)-1){
+						m_idle_wheel.insert(node, it->next_time);
+					}
+				}
+			}
+			const AUTO(count, m_batch.size());
+			m_batch.clear();
+			return count;
 		}
-		return true;
-	}
 
-	bool pump_one_writeable_socket() NOEXCEPT {
-		PROFILE_ME;
+		void thread_proc(){
+			PROFILE_ME;
+			LOG_POSEIDON_INFO("Epoll thread started.");
+
+			unsigned timeout = 0;
+			for(;;){
+				bool busy;
+				do {
+					busy = wait_for_sockets(0);
+					std::size_t batch_size = 0;
+					batch_size += pump_readable_sockets();
+					batch_size += pump_writeable_sockets();
+					batch_size += pump_closed_sockets();
+					batch_size += pump_idle_sockets();
+					if(batch_size != 0){
+						atomic_add(m_iterations, 1, ATOMIC_RELAXED);
+						atomic_add(m_sockets_pumped, batch_size, ATOMIC_RELAXED);
+						atomic_store(m_last_batch_size, batch_size, ATOMIC_RELAXED);
+						if(atomic_load(m_max_batch_size, ATOMIC_RELAXED) < batch_size){
+							atomic_store(m_max_batch_size, batch_size, ATOMIC_RELAXED);
+						}
+						busy = true;
+					}
+					timeout = std::min(timeout * 2u + 1u, !busy * 100u);
+				} while(busy);
 
-		const AUTO(now, get_fast_mono_clock());
-		boost::shared_ptr<SocketBase> socket;
-		bool writeable;
-		{
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.begin<2>());
-			if(it == g_socket_map.end<2>()){
-				return false;
+				if(!atomic_load(g_running, ATOMIC_CONSUME)){
+					break;
+				}
+				wait_for_sockets(timeout);
 			}
-			if(now < it->write_time){
-				return false;
+
+			LOG_POSEIDON_INFO("Epoll thread stopped.");
+		}
+
+	public:
+		void start(){
+			Thread(boost::bind(&EpollShard::thread_proc, this), "   N").swap(m_thread);
+		}
+		void safe_join(){
+			if(m_thread.joinable()){
+				m_thread.join();
 			}
-			socket = it->weakable->lock();
-			if(!socket){
-				g_socket_map.erase<2>(it);
-				return true;
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			m_socket_map.clear();
+			m_idle_wheel.clear();
+		}
+
+		void make_thread_snapshot(EpollDaemon::ThreadSnapshotElement &elem) const {
+			{
+				const RecursiveMutex::UniqueLock lock(m_mutex);
+				elem.socket_count = m_socket_map.size();
 			}
-			writeable = it->writeable;
+			elem.iterations = atomic_load(m_iterations, ATOMIC_RELAXED);
+			elem.sockets_pumped = atomic_load(m_sockets_pumped, ATOMIC_RELAXED);
+			elem.last_batch_size = atomic_load(m_last_batch_size, ATOMIC_RELAXED);
+			elem.max_batch_size = atomic_load(m_max_batch_size, ATOMIC_RELAXED);
 		}
 
-		Mutex::UniqueLock write_lock;
-		int err_code;
-		try {
-			err_code = socket->poll_write(write_lock, writeable);
-		} catch(std::exception &e){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-				"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*socket).name());
-			socket->SocketBase::force_shutdown();
-			err_code = EPIPE;
-		} catch(...){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-				"Unknown exception thrown: typeid = ", typeid(*socket).name());
-			socket->SocketBase::force_shutdown();
-			err_code = EPIPE;
+		void make_snapshot(std::vector<EpollDaemon::SnapshotElement> &snapshot) const {
+			PROFILE_ME;
+
+			const AUTO(now, get_fast_mono_clock());
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			snapshot.reserve(snapshot.size() + m_socket_map.size());
+			for(AUTO(it, m_socket_map.begin()); it != m_socket_map.end(); ++it){
+				const AUTO(socket, it->weakable->lock());
+				if(!socket){
+					continue;
+				}
+				EpollDaemon::SnapshotElement elem = { };
+				elem.remote = socket->get_remote_info();
+				elem.local = socket->get_local_info();
+				elem.ms_online = saturated_sub(now, socket->get_creation_time());
+				elem.established = it->writeable;
+				snapshot.push_back(STD_MOVE(elem));
+			}
 		}
-		if((err_code == EWOULDBLOCK) || (err_code == EAGAIN)){
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.find<0>(socket.get()));
-			if(it != g_socket_map.end<0>()){
-				g_socket_map.set_key<0, 2>(it, (boost::uint64_t)-1);
-			}
-		} else if((err_code != 0) && (err_code != EINTR)){
-			LOG_POSEIDON_DEBUG("Socket write error: typeid = ", typeid(*socket).name(), ", err_code = ", err_code);
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.find<0>(socket.get()));
-			if(it != g_socket_map.end<0>()){
-				g_socket_map.erase<0>(it);
+		void add_socket(const boost::shared_ptr<SocketBase> &socket, bool take_ownership){
+			PROFILE_ME;
+
+			const AUTO(now, get_fast_mono_clock());
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			const AUTO(result, m_socket_map.insert(SocketElement(take_ownership, socket, &m_idle_wheel, now)));
+			if(!result.second){
+				LOG_POSEIDON_ERROR("Socket is already in epoll: socket = ", socket,
+					", typeid = ", typeid(*socket).name(), ", fd = ", socket->get_fd());
+				DEBUG_THROW(Exception, sslit("Socket is already in epoll"));
 			}
+			try {
+				::epoll_event event = { };
+				event.events = static_cast< ::uint32_t>(EPOLLIN | EPOLLOUT | EPOLLET);
+				event.data.ptr = socket.get();
+				if(::epoll_ctl(m_epoll.get(), EPOLL_CTL_ADD, socket->get_fd(), &event) != 0){
+					const int err_code = errno;
+					LOG_POSEIDON_ERROR("::epoll_ctl() failed, errno was ", err_code, ": socket = ", socket,
+						", typeid = ", typeid(*socket).name(), ", fd = ", socket->get_fd());
+					DEBUG_THROW(SystemException, err_code);
+				}
+			} catch(...){
+				m_socket_map.erase(result.first);
+				throw;
+			}
+			// 由 poll_idle() 决定下一次检查的时间。
+			m_idle_wheel.insert(result.first->idle_node.get(), now);
 		}
-		return true;
-	}
+		bool mark_socket_writeable(const SocketBase *ptr) NOEXCEPT {
+			PROFILE_ME;
 
-	bool pump_one_closed_socket() NOEXCEPT {
-		PROFILE_ME;
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			const AUTO(it, m_socket_map.find<0>(ptr));
+			if(it == m_socket_map.end()){
+				LOG_POSEIDON_TRACE("Socket not found in epoll: ptr = ", ptr);
+				return false;
+			}
+			const AUTO(now, get_fast_mono_clock());
+			++(it->write_seq);
+			m_socket_map.set_key<0, 2>(it, now);
+			return true;
+		}
+		bool mark_socket_readable(const SocketBase *ptr) NOEXCEPT {
+			PROFILE_ME;
 
-		// const AUTO(now, get_fast_mono_clock());
-		boost::shared_ptr<SocketBase> socket;
-		int err_code;
-		{
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.lower_bound<3>(0));
-			if(it == g_socket_map.end<3>()){
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			const AUTO(it, m_socket_map.find<0>(ptr));
+			if(it == m_socket_map.end()){
+				LOG_POSEIDON_TRACE("Socket not found in epoll: ptr = ", ptr);
 				return false;
 			}
-			socket = it->weakable->lock();
-			if(!socket){
-				g_socket_map.erase<3>(it);
+			const AUTO(now, get_fast_mono_clock());
+			// 即使已经在等待读取，也可能正在被处理，处理结果不能覆盖这次唤醒。
+			++(it->read_seq);
+			if(it->read_time <= now){
 				return true;
 			}
-			err_code = it->err_code;
+			m_socket_map.set_key<0, 1>(it, now);
+			return true;
 		}
+		bool schedule_idle_check(const SocketBase *ptr, boost::uint64_t time) NOEXCEPT {
+			PROFILE_ME;
 
-		try {
-			socket->on_close(err_code);
-		} catch(std::exception &e){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-				"std::exception thrown: what = ", e.what(), ", typeid = ", typeid(*socket).name());
-			socket->SocketBase::force_shutdown();
-		} catch(...){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
-				"Unknown exception thrown: typeid = ", typeid(*socket).name());
-			socket->SocketBase::force_shutdown();
-		}
-		{
-			LOG_POSEIDON_DEBUG("Socket closed: typeid = ", typeid(*socket).name(), ", err_code = ", err_code);
-			const RecursiveMutex::UniqueLock lock(g_mutex);
-			const AUTO(it, g_socket_map.find<0>(socket.get()));
-			if(it != g_socket_map.end<0>()){
-				g_socket_map.erase<0>(it);
+			const RecursiveMutex::UniqueLock lock(m_mutex);
+			const AUTO(it, m_socket_map.find<0>(ptr));
+			if(it == m_socket_map.end()){
+				LOG_POSEIDON_TRACE("Socket not found in epoll: ptr = ", ptr);
+				return false;
+			}
+			const AUTO(node, it->idle_node.get());
+			if(node->is_linked()){
+				if(node->get_expiry() <= time){
+					return true;
+				}
+				m_idle_wheel.erase(node);
 			}
+			m_idle_wheel.insert(node, time);
+			return true;
 		}
-		return true;
-	}
+	};
 
-	void thread_proc(){
-		PROFILE_ME;
-		LOG_POSEIDON_INFO("Epoll daemon started.");
-
-		unsigned timeout = 0;
-		for(;;){
-			bool busy;
-			do {
-				busy = wait_for_sockets(0);
-				busy += pump_one_readable_socket();
-				busy += pump_one_writeable_socket();
-				busy += pump_one_closed_socket();
-				timeout = std::min(timeout * 2u + 1u, !busy * 100u);
-			} while(busy);
-
-			if(!atomic_load(g_running, ATOMIC_CONSUME)){
-				break;
-			}
-			wait_for_sockets(timeout);
-		}
+	std::vector<boost::shared_ptr<EpollShard> > g_shards;
 
-		LOG_POSEIDON_INFO("Epoll daemon stopped.");
+	// 按文件描述符散列。一个套接字在其生存期内总是由同一个分片处理，
+	// 因此 mark_socket_writeable() 无需查表即可找到其所在的分片。
+	EpollShard *get_shard_by_socket(const SocketBase *ptr) NOEXCEPT {
+		if(g_shards.empty()){
+			return NULLPTR;
+		}
+		const AUTO(index, static_cast<std::size_t>(static_cast<unsigned>(ptr->get_fd())) % g_shards.size());
+		return g_shards.at(index).get();
 	}
 }
 
@@ -327,12 +723,23 @@ void EpollDaemon::start(){
 	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Starting epoll daemon...");
 
-	if(!g_epoll.reset(::epoll_create(4096))){
-		const int err_code = errno;
-		LOG_POSEIDON_FATAL("Failed to create epoll! errno was ", err_code);
-		std::abort();
+	MainConfig::get(g_thread_count, "epoll_thread_count");
+	LOG_POSEIDON_DEBUG("epoll_thread_count = ", g_thread_count);
+
+	MainConfig::get(g_batch_size, "epoll_batch_size");
+	LOG_POSEIDON_DEBUG("epoll_batch_size = ", g_batch_size);
+
+	g_batch_size = std::max<std::size_t>(g_batch_size, 1);
+
+	reload_socket_config(get_fast_mono_clock());
+
+	g_shards.resize(std::max<std::size_t>(g_thread_count, 1));
+	for(std::size_t i = 0; i < g_shards.size(); ++i){
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Creating epoll thread ", i);
+		AUTO(shard, boost::make_shared<EpollShard>());
+		shard->start();
+		g_shards.at(i) = STD_MOVE_IDN(shard);
 	}
-	Thread(&thread_proc, "   N").swap(g_thread);
 }
 void EpollDaemon::stop(){
 	if(atomic_exchange(g_running, false, ATOMIC_ACQ_REL) == false){
@@ -340,70 +747,83 @@ void EpollDaemon::stop(){
 	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping epoll daemon...");
 
-	if(g_thread.joinable()){
-		g_thread.join();
+	for(std::size_t i = 0; i < g_shards.size(); ++i){
+		const AUTO_REF(shard, g_shards.at(i));
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Waiting for epoll thread ", i, " to terminate...");
+		shard->safe_join();
 	}
-	g_socket_map.clear();
-	g_epoll.reset();
 }
 
 void EpollDaemon::make_snapshot(std::vector<EpollDaemon::SnapshotElement> &snapshot){
 	PROFILE_ME;
 
-	const AUTO(now, get_fast_mono_clock());
-	const RecursiveMutex::UniqueLock lock(g_mutex);
-	snapshot.reserve(snapshot.size() + g_socket_map.size());
-	for(AUTO(it, g_socket_map.begin()); it != g_socket_map.end(); ++it){
-		const AUTO(socket, it->weakable->lock());
-		if(!socket){
-			continue;
-		}
-		SnapshotElement elem = { };
-		elem.remote = socket->get_remote_info();
-		elem.local = socket->get_local_info();
-		elem.ms_online = saturated_sub(now, socket->get_creation_time());
-		elem.established = it->writeable;
+	for(AUTO(it, g_shards.begin()); it != g_shards.end(); ++it){
+		(*it)->make_snapshot(snapshot);
+	}
+}
+void EpollDaemon::make_thread_snapshot(std::vector<EpollDaemon::ThreadSnapshotElement> &snapshot){
+	PROFILE_ME;
+
+	snapshot.reserve(snapshot.size() + g_shards.size());
+	for(std::size_t i = 0; i < g_shards.size(); ++i){
+		ThreadSnapshotElement elem = { };
+		elem.thread_index = i;
+		g_shards.at(i)->make_thread_snapshot(elem);
 		snapshot.push_back(STD_MOVE(elem));
 	}
 }
 void EpollDaemon::add_socket(const boost::shared_ptr<SocketBase> &socket, bool take_ownership){
 	PROFILE_ME;
 
-	const AUTO(now, get_fast_mono_clock());
-	const RecursiveMutex::UniqueLock lock(g_mutex);
-	const AUTO(result, g_socket_map.insert(SocketElement(take_ownership, socket, now)));
-	if(!result.second){
-		LOG_POSEIDON_ERROR("Socket is already in epoll: socket = ", socket,
-			", typeid = ", typeid(*socket).name(), ", fd = ", socket->get_fd());
-		DEBUG_THROW(Exception, sslit("Socket is already in epoll"));
-	}
-	try {
-		::epoll_event event = { };
-		event.events = static_cast< ::uint32_t>(EPOLLIN | EPOLLOUT | EPOLLET);
-		event.data.ptr = socket.get();
-		if(::epoll_ctl(g_epoll.get(), EPOLL_CTL_ADD, socket->get_fd(), &event) != 0){
-			const int err_code = errno;
-			LOG_POSEIDON_ERROR("::epoll_ctl() failed, errno was ", err_code, ": socket = ", socket,
-				", typeid = ", typeid(*socket).name(), ", fd = ", socket->get_fd());
-			DEBUG_THROW(SystemException, err_code);
-		}
-	} catch(...){
-		g_socket_map.erase(result.first);
-		throw;
+	const AUTO(shard, get_shard_by_socket(socket.get()));
+	if(!shard){
+		LOG_POSEIDON_ERROR("Epoll daemon is not running.");
+		DEBUG_THROW(Exception, sslit("Epoll daemon is not running"));
 	}
+	shard->add_socket(socket, take_ownership);
 }
 bool EpollDaemon::mark_socket_writeable(const SocketBase *ptr) NOEXCEPT {
 	PROFILE_ME;
 
-	const RecursiveMutex::UniqueLock lock(g_mutex);
-	const AUTO(it, g_socket_map.find<0>(ptr));
-	if(it == g_socket_map.end()){
-		LOG_POSEIDON_TRACE("Socket not found in epoll: ptr = ", ptr);
+	const AUTO(shard, get_shard_by_socket(ptr));
+	if(!shard){
+		LOG_POSEIDON_TRACE("Epoll daemon is not running: ptr = ", ptr);
+		return false;
+	}
+	return shard->mark_socket_writeable(ptr);
+}
+bool EpollDaemon::mark_socket_readable(const SocketBase *ptr) NOEXCEPT {
+	PROFILE_ME;
+
+	const AUTO(shard, get_shard_by_socket(ptr));
+	if(!shard){
+		LOG_POSEIDON_TRACE("Epoll daemon is not running: ptr = ", ptr);
+		return false;
+	}
+	return shard->mark_socket_readable(ptr);
+}
+bool EpollDaemon::schedule_idle_check(const SocketBase *ptr, boost::uint64_t time) NOEXCEPT {
+	PROFILE_ME;
+
+	const AUTO(shard, get_shard_by_socket(ptr));
+	if(!shard){
+		LOG_POSEIDON_TRACE("Epoll daemon is not running: ptr = ", ptr);
 		return false;
 	}
-	const AUTO(now, get_fast_mono_clock());
-	g_socket_map.set_key<0, 2>(it, now);
-	return true;
+	return shard->schedule_idle_check(ptr, time);
+}
+
+boost::uint64_t EpollDaemon::get_tcp_request_timeout() NOEXCEPT {
+	return atomic_load(g_tcp_request_timeout, ATOMIC_RELAXED);
+}
+boost::uint64_t EpollDaemon::get_tcp_response_timeout() NOEXCEPT {
+	return atomic_load(g_tcp_response_timeout, ATOMIC_RELAXED);
+}
+std::size_t EpollDaemon::get_read_budget() NOEXCEPT {
+	return atomic_load(g_read_budget, ATOMIC_RELAXED);
+}
+std::size_t EpollDaemon::get_write_budget() NOEXCEPT {
+	return atomic_load(g_write_budget, ATOMIC_RELAXED);
 }
 
 }
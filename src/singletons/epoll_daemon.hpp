@@ -25,12 +25,33 @@ public:
 		bool established;
 	};
 
+	struct ThreadSnapshotElement {
+		std::size_t thread_index;
+		std::size_t socket_count;
+		boost::uint64_t iterations;     // 处理过至少一个套接字的循环次数。
+		boost::uint64_t sockets_pumped; // 所有循环中处理过的套接字总数。
+		std::size_t last_batch_size;    // 最近一次循环中处理过的套接字数。
+		std::size_t max_batch_size;
+	};
+
 	static void start();
 	static void stop();
 
 	static void make_snapshot(std::vector<SnapshotElement> &snapshot);
+	static void make_thread_snapshot(std::vector<ThreadSnapshotElement> &snapshot);
 	static void add_socket(const boost::shared_ptr<SocketBase> &socket, bool take_ownership = false);
 	static bool mark_socket_writeable(const SocketBase *ptr) NOEXCEPT;
+	// 被节流的套接字在解除节流之后调用，立即恢复读取，而不必等待下一次检查。
+	static bool mark_socket_readable(const SocketBase *ptr) NOEXCEPT;
+	// 如果给定的时间早于当前的检查时间，则提前调用 SocketBase::poll_idle()。
+	static bool schedule_idle_check(const SocketBase *ptr, boost::uint64_t time) NOEXCEPT;
+
+	// 这些配置项在启动和重新加载配置文件时读取，不必每次查询配置文件。
+	static boost::uint64_t get_tcp_request_timeout() NOEXCEPT;
+	static boost::uint64_t get_tcp_response_timeout() NOEXCEPT;
+	// 每次唤醒时一个套接字至多读取或写入的字节数。
+	static std::size_t get_read_budget() NOEXCEPT;
+	static std::size_t get_write_budget() NOEXCEPT;
 };
 
 }
@@ -0,0 +1,455 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "http_client_pool.hpp"
+#include "main_config.hpp"
+#include "dns_daemon.hpp"
+#include "job_dispatcher.hpp"
+#include "../log.hpp"
+#include "../atomic.hpp"
+#include "../exception.hpp"
+#include "../mutex.hpp"
+#include "../job_base.hpp"
+#include "../job_promise.hpp"
+#include "../sock_addr.hpp"
+#include "../time.hpp"
+#include "../checked_arithmetic.hpp"
+#include "../http/low_level_client.hpp"
+#include "../http/upgraded_session_base.hpp"
+#include "../profiler.hpp"
+
+namespace Poseidon {
+
+typedef HttpClientPool::Response Response;
+
+namespace {
+	struct PoolKey {
+		std::string host;
+		unsigned port;
+		bool use_ssl;
+
+		bool operator<(const PoolKey &rhs) const {
+			const int cmp = host.compare(rhs.host);
+			if(cmp != 0){
+				return cmp < 0;
+			}
+			if(port != rhs.port){
+				return port < rhs.port;
+			}
+			return use_ssl < rhs.use_ssl;
+		}
+	};
+
+	class PooledClient;
+
+	struct IdleElement {
+		boost::shared_ptr<PooledClient> client;
+		boost::uint64_t expiry_time;
+	};
+
+	struct Pool {
+		std::vector<IdleElement> idle; // 最近放回的在后面，优先复用，其余的更早超时。
+		std::size_t busy_count;
+		boost::uint64_t hits;
+		boost::uint64_t misses;
+		boost::uint64_t retries;
+
+		Pool()
+			: idle(), busy_count(0), hits(0), misses(0), retries(0)
+		{ }
+	};
+
+	volatile bool g_running = false;
+	std::size_t g_max_idle_per_host = 16;
+	boost::uint64_t g_idle_timeout = 10000;
+	bool g_verify_peer = true;
+
+	Mutex g_mutex;
+	std::map<PoolKey, Pool> g_pools;
+
+	template<typename ExceptionT>
+	void set_promise_exception(JobPromise &promise, const ExceptionT &e){
+#ifdef POSEIDON_CXX11
+		promise.set_exception(std::make_exception_ptr(e));
+#else
+		promise.set_exception(boost::copy_exception(e));
+#endif
+	}
+
+	void connect_and_send(const PoolKey &key, boost::shared_ptr<JobPromiseContainer<Response> > promise,
+		Http::RequestHeaders request_headers, StreamBuffer entity, bool is_retry);
+
+	class PooledClient : public Http::LowLevelClient {
+	private:
+		const PoolKey m_key;
+
+		mutable Mutex m_mutex;
+		bool m_closed;
+		bool m_reused;
+		boost::shared_ptr<JobPromiseContainer<Response> > m_promise;
+		// 只有 GET 请求在连接被复用时可以重试，因此只有此时保存请求。
+		bool m_retryable;
+		Http::RequestHeaders m_request_headers;
+		StreamBuffer m_request_entity;
+
+		// 以下成员只在 epoll 线程中访问。
+		bool m_response_received;
+		bool m_content_till_eof;
+		Http::ResponseHeaders m_response_headers;
+		StreamBuffer m_entity;
+
+	public:
+		PooledClient(const SockAddr &addr, PoolKey key)
+			: Http::LowLevelClient(addr, key.use_ssl, g_verify_peer)
+			, m_key(STD_MOVE(key))
+			, m_closed(false), m_reused(false), m_promise(), m_retryable(false), m_request_headers(), m_request_entity()
+			, m_response_received(false), m_content_till_eof(false), m_response_headers(), m_entity()
+		{ }
+
+	protected:
+		void on_read_hup() OVERRIDE {
+			PROFILE_ME;
+
+			Http::LowLevelClient::on_read_hup();
+
+			shutdown_write();
+		}
+		void on_close(int err_code) OVERRIDE {
+			PROFILE_ME;
+
+			Http::LowLevelClient::on_close(err_code);
+
+			boost::shared_ptr<JobPromiseContainer<Response> > promise;
+			bool retry;
+			Http::RequestHeaders request_headers;
+			StreamBuffer request_entity;
+			{
+				const Mutex::UniqueLock lock(m_mutex);
+				m_closed = true;
+				promise.swap(m_promise);
+				// 对方可能在我们发送请求的同时关闭了空闲的连接。
+				retry = promise && m_reused && m_retryable && !m_response_received;
+				if(retry){
+					request_headers = STD_MOVE(m_request_headers);
+					request_entity.swap(m_request_entity);
+				}
+			}
+			{
+				const Mutex::UniqueLock lock(g_mutex);
+				const AUTO(pit, g_pools.find(m_key));
+				if(pit != g_pools.end()){
+					AUTO_REF(idle, pit->second.idle);
+					for(AUTO(it, idle.begin()); it != idle.end(); ++it){
+						if(it->client.get() == this){
+							idle.erase(it);
+							break;
+						}
+					}
+					if(promise){
+						--(pit->second.busy_count);
+					}
+				}
+			}
+			if(!promise){
+				return;
+			}
+			if(retry){
+				LOG_POSEIDON_DEBUG("Reused HTTP connection was closed before any response: host:port = ", m_key.host, ":", m_key.port);
+				connect_and_send(m_key, STD_MOVE(promise), STD_MOVE(request_headers), STD_MOVE(request_entity), true);
+				return;
+			}
+			LOG_POSEIDON_DEBUG("HTTP connection was closed before the response completed: host:port = ", m_key.host, ":", m_key.port,
+				", err_code = ", err_code);
+			set_promise_exception(*promise, Exception(__FILE__, __LINE__, __PRETTY_FUNCTION__,
+				sslit("HTTP connection was closed before the response completed")));
+		}
+
+		void on_low_level_response_headers(Http::ResponseHeaders response_headers, boost::uint64_t content_length) OVERRIDE {
+			PROFILE_ME;
+
+			m_response_received = true;
+			m_content_till_eof = (content_length == CONTENT_TILL_EOF);
+			m_response_headers = STD_MOVE(response_headers);
+			m_entity.clear();
+		}
+		void on_low_level_response_entity(boost::uint64_t /* entity_offset */, StreamBuffer entity) OVERRIDE {
+			PROFILE_ME;
+
+			m_entity.splice(entity);
+		}
+		boost::shared_ptr<Http::UpgradedSessionBase> on_low_level_response_end(boost::uint64_t /* content_length */, OptionalMap headers) OVERRIDE {
+			PROFILE_ME;
+
+			for(AUTO(it, headers.begin()); it != headers.end(); ++it){
+				m_response_headers.headers.append(it->first, STD_MOVE(it->second));
+			}
+			const bool keep_alive = !m_content_till_eof && Http::is_keep_alive_enabled(m_response_headers);
+
+			Response response;
+			response.response_headers = STD_MOVE(m_response_headers);
+			response.entity.swap(m_entity);
+			m_response_received = false;
+
+			boost::shared_ptr<JobPromiseContainer<Response> > promise;
+			{
+				const Mutex::UniqueLock lock(m_mutex);
+				promise.swap(m_promise);
+			}
+			if(!promise){
+				LOG_POSEIDON_WARNING("Unexpected HTTP response: host:port = ", m_key.host, ":", m_key.port);
+				force_shutdown();
+				return VAL_INIT;
+			}
+			// 先放回池中再满足 promise，这样等待者发起的下一个请求就可以复用这个连接。
+			bool reusable = keep_alive;
+			{
+				const Mutex::UniqueLock lock(g_mutex);
+				const AUTO(pit, g_pools.find(m_key));
+				if(pit != g_pools.end()){
+					AUTO_REF(pool, pit->second);
+					--pool.busy_count;
+					if(reusable && atomic_load(g_running, ATOMIC_CONSUME) && (pool.idle.size() < g_max_idle_per_host)){
+						IdleElement elem = { virtual_shared_from_this<PooledClient>(), saturated_add(get_fast_mono_clock(), g_idle_timeout) };
+						pool.idle.push_back(STD_MOVE(elem));
+						set_timeout(g_idle_timeout);
+					} else {
+						reusable = false;
+					}
+				} else {
+					reusable = false;
+				}
+			}
+			if(!reusable){
+				shutdown_read();
+				shutdown_write();
+			}
+			promise->set_success(STD_MOVE(response));
+			return VAL_INIT;
+		}
+
+	public:
+		// 如果连接已经关闭，返回 false，promise 不被接管。
+		bool send_request(boost::shared_ptr<JobPromiseContainer<Response> > promise, bool reused,
+			Http::RequestHeaders request_headers, StreamBuffer entity)
+		{
+			PROFILE_ME;
+
+			{
+				const Mutex::UniqueLock lock(m_mutex);
+				if(m_closed || has_been_shutdown_write()){
+					return false;
+				}
+				m_reused = reused;
+				m_promise = STD_MOVE(promise);
+				m_retryable = (request_headers.verb == Http::V_GET);
+				if(m_retryable){
+					m_request_headers = request_headers;
+					m_request_entity = entity;
+				} else {
+					m_request_headers = VAL_INIT;
+					m_request_entity.clear();
+				}
+			}
+			// 空闲时设置的超时不再适用。
+			set_timeout((boost::uint64_t)-1);
+			// 如果发送失败，连接已经被关闭，on_close() 会处理 promise。
+			try {
+				Http::LowLevelClient::send(STD_MOVE(request_headers), STD_MOVE(entity));
+			} catch(...){
+				// 异常由调用者处理，on_close() 不能再处理同一个 promise。
+				bool owned;
+				{
+					const Mutex::UniqueLock lock(m_mutex);
+					owned = !!m_promise;
+					m_promise.reset();
+				}
+				force_shutdown();
+				if(!owned){
+					// on_close() 已经接管了 promise。
+					return true;
+				}
+				throw;
+			}
+			return true;
+		}
+	};
+
+	class ConnectJob : public JobBase {
+	private:
+		const PoolKey m_key;
+		const boost::shared_ptr<JobPromiseContainer<Response> > m_promise;
+		Http::RequestHeaders m_request_headers;
+		StreamBuffer m_entity;
+
+	public:
+		ConnectJob(PoolKey key, boost::shared_ptr<JobPromiseContainer<Response> > promise,
+			Http::RequestHeaders request_headers, StreamBuffer entity)
+			: m_key(STD_MOVE(key)), m_promise(STD_MOVE(promise))
+			, m_request_headers(STD_MOVE(request_headers)), m_entity(STD_MOVE(entity))
+		{ }
+
+	protected:
+		boost::weak_ptr<const void> get_category() const OVERRIDE {
+			return VAL_INIT;
+		}
+		void perform() OVERRIDE {
+			PROFILE_ME;
+
+			try {
+				const AUTO(addr_promise, DnsDaemon::enqueue_for_looking_up(m_key.host, m_key.port));
+				yield(addr_promise);
+				AUTO(client, boost::make_shared<PooledClient>(addr_promise->get(), m_key));
+				client->go_resident();
+				if(client->send_request(m_promise, false, STD_MOVE(m_request_headers), STD_MOVE(m_entity))){
+					return;
+				}
+				DEBUG_THROW(Exception, sslit("HTTP connection was closed before the request could be sent"));
+			} catch(Exception &e){
+				LOG_POSEIDON_INFO("Exception thrown: what = ", e.what());
+				set_promise_exception(*m_promise, e);
+			} catch(std::exception &e){
+				LOG_POSEIDON_INFO("std::exception thrown: what = ", e.what());
+				set_promise_exception(*m_promise, std::runtime_error(e.what()));
+			}
+			const Mutex::UniqueLock lock(g_mutex);
+			const AUTO(pit, g_pools.find(m_key));
+			if(pit != g_pools.end()){
+				--(pit->second.busy_count);
+			}
+		}
+	};
+
+	void connect_and_send(const PoolKey &key, boost::shared_ptr<JobPromiseContainer<Response> > promise,
+		Http::RequestHeaders request_headers, StreamBuffer entity, bool is_retry)
+	{
+		PROFILE_ME;
+
+		{
+			const Mutex::UniqueLock lock(g_mutex);
+			AUTO_REF(pool, g_pools[key]);
+			if(is_retry){
+				++pool.retries;
+			} else {
+				++pool.misses;
+			}
+			++pool.busy_count;
+		}
+		JobDispatcher::enqueue(
+			boost::make_shared<ConnectJob>(key, STD_MOVE(promise), STD_MOVE(request_headers), STD_MOVE(entity)),
+			VAL_INIT);
+	}
+}
+
+void HttpClientPool::start(){
+	if(atomic_exchange(g_running, true, ATOMIC_ACQ_REL) != false){
+		LOG_POSEIDON_FATAL("Only one daemon is allowed at the same time.");
+		std::abort();
+	}
+	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Starting HTTP client pool...");
+
+	MainConfig::get(g_max_idle_per_host, "http_client_pool_max_idle_per_host");
+	LOG_POSEIDON_DEBUG("http_client_pool_max_idle_per_host = ", g_max_idle_per_host);
+
+	MainConfig::get(g_idle_timeout, "http_client_pool_idle_timeout");
+	LOG_POSEIDON_DEBUG("http_client_pool_idle_timeout = ", g_idle_timeout);
+
+	MainConfig::get(g_verify_peer, "http_client_pool_verify_peer");
+	LOG_POSEIDON_DEBUG("http_client_pool_verify_peer = ", g_verify_peer);
+}
+void HttpClientPool::stop(){
+	if(atomic_exchange(g_running, false, ATOMIC_ACQ_REL) == false){
+		return;
+	}
+	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping HTTP client pool...");
+
+	std::map<PoolKey, Pool> pools;
+	{
+		const Mutex::UniqueLock lock(g_mutex);
+		pools.swap(g_pools);
+	}
+	for(AUTO(pit, pools.begin()); pit != pools.end(); ++pit){
+		AUTO_REF(idle, pit->second.idle);
+		for(AUTO(it, idle.begin()); it != idle.end(); ++it){
+			it->client->force_shutdown();
+		}
+	}
+}
+
+void HttpClientPool::make_snapshot(std::vector<HttpClientPool::SnapshotElement> &snapshot){
+	PROFILE_ME;
+
+	const Mutex::UniqueLock lock(g_mutex);
+	snapshot.reserve(snapshot.size() + g_pools.size());
+	for(AUTO(it, g_pools.begin()); it != g_pools.end(); ++it){
+		SnapshotElement elem;
+		elem.host = it->first.host;
+		elem.port = it->first.port;
+		elem.use_ssl = it->first.use_ssl;
+		elem.idle_count = it->second.idle.size();
+		elem.busy_count = it->second.busy_count;
+		elem.hits = it->second.hits;
+		elem.misses = it->second.misses;
+		elem.retries = it->second.retries;
+		snapshot.push_back(STD_MOVE(elem));
+	}
+}
+
+boost::shared_ptr<const JobPromiseContainer<Response> > HttpClientPool::enqueue_for_request(std::string host, unsigned port, bool use_ssl,
+	Http::RequestHeaders request_headers, StreamBuffer entity)
+{
+	PROFILE_ME;
+
+	if(!request_headers.headers.has("Host")){
+		if(port == (use_ssl ? 443u : 80u)){
+			request_headers.headers.set(sslit("Host"), host);
+		} else {
+			request_headers.headers.set(sslit("Host"), host + ':' + boost::lexical_cast<std::string>(port));
+		}
+	}
+
+	AUTO(promise, boost::make_shared<JobPromiseContainer<Response> >());
+	PoolKey key = { STD_MOVE(host), port, use_ssl };
+	for(;;){
+		boost::shared_ptr<PooledClient> client;
+		{
+			const Mutex::UniqueLock lock(g_mutex);
+			AUTO_REF(pool, g_pools[key]);
+			const AUTO(now, get_fast_mono_clock());
+			while(!pool.idle.empty()){
+				AUTO_REF(elem, pool.idle.back());
+				if((now < elem.expiry_time) && !elem.client->has_been_shutdown_write()){
+					client.swap(elem.client);
+					pool.idle.pop_back();
+					break;
+				}
+				elem.client->force_shutdown();
+				pool.idle.pop_back();
+			}
+			if(!client){
+				break;
+			}
+			++pool.busy_count;
+		}
+		bool sent;
+		try {
+			sent = client->send_request(promise, true, request_headers, entity);
+		} catch(...){
+			const Mutex::UniqueLock lock(g_mutex);
+			--(g_pools[key].busy_count);
+			throw;
+		}
+		const Mutex::UniqueLock lock(g_mutex);
+		AUTO_REF(pool, g_pools[key]);
+		if(sent){
+			++pool.hits;
+			return STD_MOVE_IDN(promise);
+		}
+		// 连接在取出之后被关闭，on_close() 不会处理这个请求。
+		--pool.busy_count;
+	}
+	connect_and_send(key, promise, STD_MOVE(request_headers), STD_MOVE(entity), false);
+	return STD_MOVE_IDN(promise);
+}
+
+}
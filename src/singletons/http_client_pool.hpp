@@ -0,0 +1,55 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_SINGLETONS_HTTP_CLIENT_POOL_HPP_
+#define POSEIDON_SINGLETONS_HTTP_CLIENT_POOL_HPP_
+
+#include "../cxx_ver.hpp"
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "../stream_buffer.hpp"
+#include "../http/request_headers.hpp"
+#include "../http/response_headers.hpp"
+
+namespace Poseidon {
+
+template<typename> class JobPromiseContainer;
+
+class HttpClientPool {
+private:
+	HttpClientPool();
+
+public:
+	struct Response {
+		Http::ResponseHeaders response_headers;
+		StreamBuffer entity;
+	};
+
+	struct SnapshotElement {
+		std::string host;
+		unsigned port;
+		bool use_ssl;
+		std::size_t idle_count;     // 空闲的 keep-alive 连接数。
+		std::size_t busy_count;     // 正在等待响应的连接数。
+		boost::uint64_t hits;       // 复用空闲连接的请求数。
+		boost::uint64_t misses;     // 建立新连接的请求数。
+		boost::uint64_t retries;    // 复用的连接在收到响应之前被对方关闭，在新的连接上重试的请求数。
+	};
+
+	static void start();
+	static void stop();
+
+	static void make_snapshot(std::vector<SnapshotElement> &snapshot);
+
+	// 异步接口。连接按照 (host, port, use_ssl) 复用，复用连接时不进行 DNS 查询。
+	// 如果请求中没有 Host 则自动添加。不支持协议升级。
+	static boost::shared_ptr<const JobPromiseContainer<Response> > enqueue_for_request(std::string host, unsigned port, bool use_ssl,
+		Http::RequestHeaders request_headers, StreamBuffer entity = StreamBuffer());
+};
+
+}
+
+#endif
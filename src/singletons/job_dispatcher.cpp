@@ -4,24 +4,28 @@
 #include "../precompiled.hpp"
 #include "job_dispatcher.hpp"
 #include "main_config.hpp"
-#include <ucontext.h>
 #include <sys/mman.h>
 #include "../job_base.hpp"
 #include "../job_promise.hpp"
 #include "../atomic.hpp"
 #include "../exception.hpp"
 #include "../log.hpp"
+#include "../thread.hpp"
 #include "../profiler.hpp"
 #include "../mutex.hpp"
 #include "../recursive_mutex.hpp"
 #include "../condition_variable.hpp"
 #include "../time.hpp"
 #include "../checked_arithmetic.hpp"
+#include "../fiber_context.hpp"
 
 namespace Poseidon {
 
 namespace {
-	boost::uint64_t g_job_timeout = 60000;
+	boost::uint64_t g_job_timeout     = 60000;
+	std::size_t     g_thread_count    = 1;
+	std::size_t     g_stack_size      = 256 * 1024;
+	std::size_t     g_stack_pool_size = 256;
 
 	enum FiberState {
 		FS_READY   = 0,
@@ -43,133 +47,182 @@ namespace {
 		{ }
 	};
 
-	class FiberStackAllocator : NONCOPYABLE {
-	public:
-		struct Storage FINAL {
-			static void *operator new(std::size_t cb){
-				assert(cb == sizeof(Storage));
-				(void)cb;
-
-				void *const ptr = mmap(NULLPTR, sizeof(Storage), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
-				if(ptr == MAP_FAILED){
-					const int err_code = errno;
-					LOG_POSEIDON_ERROR("Failed to allocate stack: err_code = ", err_code);
-					throw std::bad_alloc();
-				}
-				return ptr;
-			}
-			static void operator delete(void *ptr) NOEXCEPT {
-				if(::munmap(ptr, sizeof(Storage)) != 0){
-					const int err_code = errno;
-					LOG_POSEIDON_ERROR("Failed to deallocate stack: err_code = ", err_code);
-					std::abort();
-				}
+	std::size_t g_page_size = 4096;
+
+	// 以下统计信息被所有工作线程共享。
+	volatile std::size_t g_stack_count          = 0;
+	volatile std::size_t g_stack_count_peak     = 0;
+	volatile std::size_t g_stacks_in_use        = 0;
+	volatile std::size_t g_stacks_in_use_peak   = 0;
+
+	// 所有已经映射的栈，仅用于统计驻留内存。只有在 mmap() 和 munmap() 时才会修改。
+	Mutex g_stack_registry_mutex;
+	boost::container::flat_set<void *> g_stack_registry;
+
+	void update_peak(volatile std::size_t &peak, std::size_t value) NOEXCEPT {
+		std::size_t old = atomic_load(peak, ATOMIC_RELAXED);
+		while(old < value){
+			if(atomic_compare_exchange(peak, old, value, ATOMIC_RELAXED, ATOMIC_RELAXED)){
+				break;
 			}
+		}
+	}
 
-			char bytes[256 * 1024];
-		};
+	// 栈的最低处是一个 PROT_NONE 的保护页，栈溢出会引发段错误，而不会破坏相邻的内存。
+	// 因为使用了 MAP_NORESERVE，只有实际被访问过的页才会占用物理内存。
+	void *map_stack(){
+		const std::size_t map_size = g_page_size + g_stack_size;
+		void *const ptr = ::mmap(NULLPTR, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+		if(ptr == MAP_FAILED){
+			const int err_code = errno;
+			LOG_POSEIDON_ERROR("Failed to allocate stack: err_code = ", err_code);
+			throw std::bad_alloc();
+		}
+		try {
+			if(::mprotect(ptr, g_page_size, PROT_NONE) != 0){
+				const int err_code = errno;
+				LOG_POSEIDON_ERROR("Failed to protect stack guard page: err_code = ", err_code);
+				throw std::bad_alloc();
+			}
+			const Mutex::UniqueLock lock(g_stack_registry_mutex);
+			g_stack_registry.insert(ptr);
+		} catch(...){
+			::munmap(ptr, map_size);
+			throw;
+		}
+		update_peak(g_stack_count_peak, atomic_add(g_stack_count, 1, ATOMIC_RELAXED));
+		return ptr;
+	}
+	void unmap_stack(void *ptr) NOEXCEPT {
+		{
+			const Mutex::UniqueLock lock(g_stack_registry_mutex);
+			g_stack_registry.erase(ptr);
+		}
+		if(::munmap(ptr, g_page_size + g_stack_size) != 0){
+			const int err_code = errno;
+			LOG_POSEIDON_FATAL("Failed to deallocate stack: err_code = ", err_code);
+			std::abort();
+		}
+		atomic_sub(g_stack_count, 1, ATOMIC_RELAXED);
+	}
 
+	// 每个工作线程拥有自己的分配器，因此不需要加锁。
+	class FiberStackAllocator : NONCOPYABLE {
 	private:
-		mutable Mutex m_mutex;
-		boost::array<boost::scoped_ptr<Storage>, 64> m_pool;
-		std::size_t m_size;
+		boost::container::vector<void *> m_pool;
 
 	public:
 		FiberStackAllocator()
-			: m_mutex(), m_pool(), m_size(0)
+			: m_pool()
 		{ }
+		~FiberStackAllocator(){
+			for(AUTO(it, m_pool.begin()); it != m_pool.end(); ++it){
+				unmap_stack(*it);
+			}
+		}
 
 	public:
-		void allocate(boost::scoped_ptr<Storage> &ptr){
-			const Mutex::UniqueLock lock(m_mutex);
-			if(m_size == 0){
-				ptr.reset(new Storage);
+		void *allocate(){
+			void *ptr;
+			if(m_pool.empty()){
+				ptr = map_stack();
 			} else {
-				ptr.swap(m_pool.at(--m_size));
+				ptr = m_pool.back();
+				m_pool.pop_back();
 			}
+			update_peak(g_stacks_in_use_peak, atomic_add(g_stacks_in_use, 1, ATOMIC_RELAXED));
+			return ptr;
 		}
-		void deallocate(boost::scoped_ptr<Storage> &ptr) NOEXCEPT {
-			const Mutex::UniqueLock lock(m_mutex);
-			if(m_size == m_pool.size()){
-				ptr.reset();
-			} else {
-				ptr.swap(m_pool.at(m_size++));
+		void deallocate(void *ptr) NOEXCEPT {
+			atomic_sub(g_stacks_in_use, 1, ATOMIC_RELAXED);
+			if(m_pool.size() >= g_stack_pool_size){
+				unmap_stack(ptr);
+				return;
+			}
+			try {
+				m_pool.push_back(ptr);
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
+				unmap_stack(ptr);
 			}
 		}
-	} g_stack_allocator;
+	};
+
+	class JobWorker;
+	struct FiberControl;
+
+	typedef boost::container::multimap<boost::uint64_t, FiberControl *> SuspendedFiberMap;
 
 	struct FiberControl : NONCOPYABLE {
 		struct Initializer { };
 
+		boost::weak_ptr<const void> category;
+
+		// 以下成员受 owner 的互斥锁保护。
+		JobWorker *owner;
+		bool suspended;
+		bool insignificant;
+		SuspendedFiberMap::iterator suspended_it;
+
 		RecursiveMutex queue_mutex;
 		boost::container::deque<JobElement> queue;
 
 		FiberState state;
-		boost::scoped_ptr<FiberStackAllocator::Storage> stack;
-		::ucontext_t inner;
-		::ucontext_t outer;
+		// 在 fiber 第一次被调度时由工作线程分配，这样排队中的 fiber 不占用栈。
+		void *stack;
+		FiberContext inner;
+		FiberContext outer;
 
 		explicit FiberControl(Initializer){
+			owner = NULLPTR;
+			suspended = false;
+			insignificant = false;
 			state = FS_READY;
-			g_stack_allocator.allocate(stack);
-#ifndef NDEBUG
-			std::memset(&inner, 0xCC, sizeof(outer));
-			std::memset(&outer, 0xCC, sizeof(outer));
-#endif
+			stack = NULLPTR;
 		}
 		~FiberControl(){
 			assert(state == FS_READY);
-			g_stack_allocator.deallocate(stack);
-#ifndef NDEBUG
-			std::memset(&inner, 0xCC, sizeof(outer));
-			std::memset(&outer, 0xCC, sizeof(outer));
-#endif
+			if(stack){
+				unmap_stack(stack);
+			}
 		}
 	};
 
 	__thread FiberControl *volatile t_current_fiber = 0; // XXX: NULLPTR
 
+	// 每个 category 对应一个 fiber。fiber 从创建到销毁的过程中，在任一时刻都恰好属于一个工作线程
+	// （在其就绪队列中、挂起列表中或者正在运行），因此同一 category 的任务不会并发执行，并且保持先进先出的顺序。
 	Mutex g_fiber_map_mutex;
-	ConditionVariable g_new_job;
 	boost::container::map<boost::weak_ptr<const void>, FiberControl> g_fiber_map;
 
-	void fiber_proc(int low, int high) NOEXCEPT {
-		PROFILE_ME;
-
-		FiberControl *fiber;
-		const int params[2] = { low, high };
-		std::memcpy(&fiber, params, sizeof(fiber));
-
-		LOG_POSEIDON_TRACE("Entering fiber ", static_cast<void *>(fiber));
-		try {
-			fiber->queue.front().job->perform();
-		} catch(std::exception &e){
-			LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
-		} catch(...){
-			LOG_POSEIDON_WARNING("Unknown exception thrown");
+	void fiber_proc(void *param) NOEXCEPT {
+		const AUTO(fiber, static_cast<FiberControl *>(param));
+		{
+			PROFILE_ME;
+
+			LOG_POSEIDON_TRACE("Entering fiber ", static_cast<void *>(fiber));
+			try {
+				fiber->queue.front().job->perform();
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
+			} catch(...){
+				LOG_POSEIDON_WARNING("Unknown exception thrown");
+			}
+			LOG_POSEIDON_TRACE("Exited from fiber ", static_cast<void *>(fiber));
 		}
-		LOG_POSEIDON_TRACE("Exited from fiber ", static_cast<void *>(fiber));
 
+		// 这个函数不会返回。下一次调度时，上下文会被重新初始化。
 		fiber->state = FS_READY;
+		FiberContext::swap(fiber->inner, fiber->outer);
+		LOG_POSEIDON_FATAL("Finished fiber resumed?!");
+		std::abort();
 	}
 
 	void schedule_fiber(FiberControl *fiber) NOEXCEPT {
 		PROFILE_ME;
 
 		if(fiber->state == FS_READY){
-			if(::getcontext(&(fiber->inner)) != 0){
-				const int err_code = errno;
-				LOG_POSEIDON_FATAL("::getcontext() failed: err_code = ", err_code);
-				std::abort();
-			}
-			fiber->inner.uc_stack.ss_sp = fiber->stack.get();
-			fiber->inner.uc_stack.ss_size = sizeof(*(fiber->stack));
-			fiber->inner.uc_link = &(fiber->outer);
-
-			int params[2] = { };
-			BOOST_STATIC_ASSERT(sizeof(fiber) <= sizeof(params));
-			std::memcpy(params, &fiber, sizeof(fiber));
-			::makecontext(&(fiber->inner), reinterpret_cast<void (*)()>(&fiber_proc), 2, params[0], params[1]);
+			fiber->inner.reset(static_cast<char *>(fiber->stack) + g_page_size, g_stack_size, &fiber_proc, fiber);
 		}
 
 		t_current_fiber = fiber;
@@ -180,32 +233,236 @@ namespace {
 				std::abort();
 			}
 			fiber->state = FS_RUNNING;
-			if(::swapcontext(&(fiber->outer), &(fiber->inner)) != 0){
-				const int err_code = errno;
-				LOG_POSEIDON_FATAL("::swapcontext() failed: err_code = ", err_code);
-				std::abort();
-			}
+			FiberContext::swap(fiber->outer, fiber->inner);
 		}
 		Profiler::end_stack_switch(profiler_hook);
 		t_current_fiber = NULLPTR;
 	}
 
-	bool pump_one_fiber(FiberControl *fiber, bool force_expiry) NOEXCEPT {
+	class JobWorker : NONCOPYABLE {
+	private:
+		const std::size_t m_index;
+		Thread m_thread;
+
+		FiberStackAllocator m_stack_allocator;
+
+		mutable Mutex m_mutex;
+		ConditionVariable m_new_fiber;
+		boost::container::deque<FiberControl *> m_ready;
+		// 等待 JobPromise 的 fiber，按超时时间排序。promise 被满足时由 JobPromise 唤醒，这里只用来处理超时。
+		SuspendedFiberMap m_suspended;
+		// 在条件变量上等待时为 true。其他线程据此挑选空闲的工作线程来偷取 fiber。
+		volatile bool m_idle;
+
+	public:
+		explicit JobWorker(std::size_t index)
+			: m_index(index), m_idle(false)
+		{ }
+
+	private:
+		FiberControl *pop_fiber() NOEXCEPT;
+		FiberControl *steal_fiber() NOEXCEPT;
+		void requeue_fiber(FiberControl *fiber);
+
+		void suspend_fiber(FiberControl *fiber) NOEXCEPT;
+		bool pump_expired_fibers(bool force_expiry) NOEXCEPT;
+		bool pump_one_ready_fiber() NOEXCEPT;
+
+		void thread_proc();
+
+	public:
+		void start();
+		void safe_join();
+
+		void run(const volatile bool &running, bool draining);
+
+		std::size_t get_ready_count() const {
+			const Mutex::UniqueLock lock(m_mutex);
+			return m_ready.size();
+		}
+		// 返回 fiber 入队之前就绪队列的长度。
+		std::size_t push_fiber(FiberControl *fiber){
+			const Mutex::UniqueLock lock(m_mutex);
+			const AUTO(count, m_ready.size());
+			m_ready.push_back(fiber);
+			m_new_fiber.signal();
+			return count;
+		}
+		void resume_fiber(FiberControl *fiber) NOEXCEPT {
+			const Mutex::UniqueLock lock(m_mutex);
+			if(!fiber->suspended){
+				return;
+			}
+			m_suspended.erase(fiber->suspended_it);
+			fiber->suspended = false;
+			m_ready.push_back(fiber);
+			m_new_fiber.signal();
+		}
+		void notify() NOEXCEPT {
+			const Mutex::UniqueLock lock(m_mutex);
+			m_new_fiber.signal();
+		}
+		// 如果这个工作线程空闲，叫醒它并返回 true。每次空闲只会被叫醒一次，因此多个生产者不会叫醒同一个线程。
+		bool try_wake_idle() NOEXCEPT {
+			bool idle = true;
+			if(!atomic_compare_exchange(m_idle, idle, false, ATOMIC_ACQ_REL, ATOMIC_RELAXED)){
+				return false;
+			}
+			notify();
+			return true;
+		}
+		// 只有尚未开始执行的 fiber 可以被偷走。被挂起的 fiber 必须在原来的线程中恢复，
+		// 因为任务代码中可能缓存了线程局部变量的地址。
+		FiberControl *try_give_away_fiber() NOEXCEPT {
+			const Mutex::UniqueLock lock(m_mutex);
+			for(AUTO(it, m_ready.rbegin()); it != m_ready.rend(); ++it){
+				const AUTO(fiber, *it);
+				if(fiber->state != FS_READY){
+					continue;
+				}
+				m_ready.erase(--(it.base()));
+				return fiber;
+			}
+			return NULLPTR;
+		}
+	};
+
+	volatile bool g_running = false;
+	volatile std::size_t g_next_worker = 0;
+	std::vector<boost::shared_ptr<JobWorker> > g_workers;
+
+	// busy_index 所指的工作线程正忙，从它后面开始找一个空闲的工作线程叫醒，让它来偷。
+	void wake_idle_worker(std::size_t busy_index) NOEXCEPT {
+		const std::size_t count = g_workers.size();
+		for(std::size_t i = 1; i < count; ++i){
+			if(g_workers.at((busy_index + i) % count)->try_wake_idle()){
+				return;
+			}
+		}
+	}
+
+	FiberControl *JobWorker::pop_fiber() NOEXCEPT {
+		const Mutex::UniqueLock lock(m_mutex);
+		if(m_ready.empty()){
+			return NULLPTR;
+		}
+		const AUTO(fiber, m_ready.front());
+		m_ready.pop_front();
+		return fiber;
+	}
+	FiberControl *JobWorker::steal_fiber() NOEXCEPT {
 		PROFILE_ME;
 
-		const AUTO(now, get_fast_mono_clock());
+		const std::size_t count = g_workers.size();
+		for(std::size_t i = 1; i < count; ++i){
+			const AUTO_REF(victim, g_workers.at((m_index + i) % count));
+			if(victim->get_ready_count() == 0){
+				continue;
+			}
+			const AUTO(fiber, victim->try_give_away_fiber());
+			if(fiber){
+				LOG_POSEIDON_TRACE("Stole fiber ", static_cast<void *>(fiber), " from job worker ", (m_index + i) % count);
+				return fiber;
+			}
+		}
+		return NULLPTR;
+	}
 
-		JobElement *elem;
+	void JobWorker::requeue_fiber(FiberControl *fiber){
+		if(push_fiber(fiber) != 0){
+			// 和 JobDispatcher::enqueue() 一样，本线程正忙，叫醒一个空闲的工作线程让它来偷。
+			wake_idle_worker(m_index);
+		}
+	}
+
+	void JobWorker::suspend_fiber(FiberControl *fiber) NOEXCEPT {
+		PROFILE_ME;
+
+		boost::shared_ptr<const JobPromise> promise;
+		boost::uint64_t expiry_time;
+		bool insignificant;
 		{
 			const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
-			if(fiber->queue.empty()){
+			const AUTO_REF(elem, fiber->queue.front());
+			promise = elem.promise;
+			expiry_time = elem.expiry_time;
+			insignificant = elem.insignificant;
+		}
+		if(!promise){
+			requeue_fiber(fiber);
+			return;
+		}
+		{
+			const Mutex::UniqueLock lock(m_mutex);
+			fiber->owner = this;
+			fiber->suspended = true;
+			fiber->insignificant = insignificant;
+			fiber->suspended_it = m_suspended.emplace(expiry_time, fiber);
+		}
+		try {
+			if(promise->add_waiting_fiber(fiber)){
+				return;
+			}
+		} catch(std::exception &e){
+			LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+		}
+		// promise 已经被满足，或者无法等待它。
+		resume_fiber(fiber);
+	}
+	bool JobWorker::pump_expired_fibers(bool force_expiry) NOEXCEPT {
+		PROFILE_ME;
+
+		const AUTO(now, get_fast_mono_clock());
+		boost::container::vector<FiberControl *> expired;
+		{
+			const Mutex::UniqueLock lock(m_mutex);
+			for(AUTO(it, m_suspended.begin()); it != m_suspended.end(); ++it){
+				const AUTO(fiber, it->second);
+				if(now >= it->first){
+					expired.push_back(fiber);
+					continue;
+				}
+				if(!force_expiry){
+					break;
+				}
+				if(fiber->insignificant){
+					expired.push_back(fiber);
+				}
+			}
+		}
+		if(expired.empty()){
+			return false;
+		}
+		for(AUTO(it, expired.begin()); it != expired.end(); ++it){
+			const AUTO(fiber, *it);
+			boost::shared_ptr<const JobPromise> promise;
+			{
+				const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
+				promise = fiber->queue.front().promise;
+			}
+			// 这个函数返回之后，promise 不会再唤醒这个 fiber。
+			promise->remove_waiting_fiber(fiber);
+			resume_fiber(fiber);
+		}
+		return true;
+	}
+	bool JobWorker::pump_one_ready_fiber() NOEXCEPT {
+		PROFILE_ME;
+
+		AUTO(fiber, pop_fiber());
+		if(!fiber){
+			fiber = steal_fiber();
+			if(!fiber){
 				return false;
 			}
+		}
+
+		JobElement *elem;
+		{
+			const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
+			assert(!fiber->queue.empty());
 			elem = &(fiber->queue.front());
 			if(elem->promise && !elem->promise->is_satisfied()){
-				if((now < elem->expiry_time) && !(elem->insignificant && force_expiry)){
-					return false;
-				}
 				LOG_POSEIDON_WARNING("Job timed out");
 			}
 			elem->promise.reset();
@@ -213,84 +470,195 @@ namespace {
 		if((fiber->state == FS_READY) && elem->withdrawn && *(elem->withdrawn)){
 			LOG_POSEIDON_DEBUG("Job is withdrawn");
 		} else {
-			schedule_fiber(fiber);
+			if(!fiber->stack){
+				try {
+					fiber->stack = m_stack_allocator.allocate();
+				} catch(std::exception &e){
+					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				}
+			}
+			if(fiber->stack){
+				schedule_fiber(fiber);
+			} else {
+				LOG_POSEIDON_ERROR("No stack available for fiber. The job is dropped.");
+			}
 		}
-		if(fiber->state == FS_READY){
+		if(fiber->state == FS_YIELDED){
+			suspend_fiber(fiber);
+			return true;
+		}
+
+		const Mutex::UniqueLock lock(g_fiber_map_mutex);
+		bool empty;
+		{
 			const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
 			fiber->queue.pop_front();
+			empty = fiber->queue.empty();
+		}
+		if(empty){
+			if(fiber->stack){
+				m_stack_allocator.deallocate(fiber->stack);
+				fiber->stack = NULLPTR;
+			}
+			const AUTO(category, fiber->category);
+			g_fiber_map.erase(category);
+		} else {
+			requeue_fiber(fiber);
 		}
 		return true;
 	}
-	bool pump_one_round(bool force_expiry) NOEXCEPT {
+
+	void JobWorker::thread_proc(){
 		PROFILE_ME;
+		LOG_POSEIDON_INFO("Job worker started.");
 
-		bool busy = false;
-		Mutex::UniqueLock lock(g_fiber_map_mutex);
-		AUTO(it, g_fiber_map.begin());
+		run(g_running, true);
+
+		LOG_POSEIDON_INFO("Job worker stopped.");
+	}
+
+	void JobWorker::start(){
+		Thread(boost::bind(&JobWorker::thread_proc, this), "J   ").swap(m_thread);
+	}
+	void JobWorker::safe_join(){
+		if(m_thread.joinable()){
+			m_thread.join();
+		}
+	}
+
+	void JobWorker::run(const volatile bool &running, bool draining){
 		for(;;){
-			if(it == g_fiber_map.end()){
-				break;
+			bool busy;
+			do {
+				const bool force_expiry = !atomic_load(running, ATOMIC_CONSUME);
+				busy = pump_expired_fibers(force_expiry);
+				busy += pump_one_ready_fiber();
+			} while(busy);
+
+			if(!atomic_load(running, ATOMIC_CONSUME)){
+				if(!draining){
+					break;
+				}
+				std::size_t pending_fibers;
+				{
+					const Mutex::UniqueLock lock(g_fiber_map_mutex);
+					pending_fibers = g_fiber_map.size();
+				}
+				if(pending_fibers == 0){
+					break;
+				}
 			}
-			AUTO(fiber, &(it->second));
-			lock.unlock();
-			{
-				busy += pump_one_fiber(fiber, force_expiry);
+
+			Mutex::UniqueLock lock(m_mutex);
+			if(!m_ready.empty()){
+				continue;
+			}
+			// 只在下一个 fiber 超时的时候醒来。
+			// 但是主线程的 running 是由信号处理函数修改的，无法通知我们；在退出过程中，我们还需要等待其他工作线程中的 fiber 结束。
+			boost::uint64_t timeout = (boost::uint64_t)-1;
+			if(!m_suspended.empty()){
+				timeout = saturated_sub(m_suspended.begin()->first, get_fast_mono_clock());
 			}
-			lock.lock();
-			if(fiber->queue.empty()){
-				it = g_fiber_map.erase(it);
+			if((m_index == 0) || !atomic_load(running, ATOMIC_CONSUME)){
+				timeout = std::min<boost::uint64_t>(timeout, 100);
+			}
+			atomic_store(m_idle, true, ATOMIC_RELEASE);
+			if(timeout == (boost::uint64_t)-1){
+				m_new_fiber.wait(lock);
 			} else {
-				++it;
+				m_new_fiber.timed_wait(lock, timeout);
 			}
+			atomic_store(m_idle, false, ATOMIC_RELEASE);
 		}
-		return busy;
 	}
 }
 
 void JobDispatcher::start(){
+	if(atomic_exchange(g_running, true, ATOMIC_ACQ_REL) != false){
+		LOG_POSEIDON_FATAL("Only one daemon is allowed at the same time.");
+		std::abort();
+	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Starting job dispatcher...");
 
 	MainConfig::get(g_job_timeout, "job_timeout");
 	LOG_POSEIDON_DEBUG("job_timeout = ", g_job_timeout);
+
+	MainConfig::get(g_thread_count, "job_thread_count");
+	LOG_POSEIDON_DEBUG("job_thread_count = ", g_thread_count);
+
+	MainConfig::get(g_stack_size, "job_fiber_stack_size");
+	LOG_POSEIDON_DEBUG("job_fiber_stack_size = ", g_stack_size);
+
+	MainConfig::get(g_stack_pool_size, "job_fiber_stack_pool_size");
+	LOG_POSEIDON_DEBUG("job_fiber_stack_pool_size = ", g_stack_pool_size);
+
+	g_page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+	g_stack_size = std::max(g_stack_size, g_page_size);
+	g_stack_size = (g_stack_size + g_page_size - 1) / g_page_size * g_page_size;
+
+	// 第 0 个工作线程是主线程，它在 do_modal() 中运行。
+	g_workers.resize(std::max<std::size_t>(g_thread_count, 1));
+	for(std::size_t i = 0; i < g_workers.size(); ++i){
+		g_workers.at(i) = boost::make_shared<JobWorker>(i);
+	}
+	for(std::size_t i = 1; i < g_workers.size(); ++i){
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Creating job worker ", i);
+		g_workers.at(i)->start();
+	}
 }
 void JobDispatcher::stop(){
+	if(atomic_exchange(g_running, false, ATOMIC_ACQ_REL) == false){
+		return;
+	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping job dispatcher...");
 
-	boost::uint64_t last_info_time = 0;
-	for(;;){
-		std::size_t pending_fibers;
-		{
-			const Mutex::UniqueLock lock(g_fiber_map_mutex);
-			pending_fibers = g_fiber_map.size();
-		}
-		if(pending_fibers == 0){
-			break;
-		}
+	std::size_t pending_fibers;
+	{
+		const Mutex::UniqueLock lock(g_fiber_map_mutex);
+		pending_fibers = g_fiber_map.size();
+	}
+	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "There are ", pending_fibers, " fiber(s) remaining.");
 
-		const AUTO(now, get_fast_mono_clock());
-		if(last_info_time + 500 < now){
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "There are ", pending_fibers, " fiber(s) remaining.");
-			last_info_time = now;
-		}
+	for(std::size_t i = 1; i < g_workers.size(); ++i){
+		g_workers.at(i)->notify();
+	}
 
-		pump_one_round(true);
+	g_workers.at(0)->run(g_running, true);
+	for(std::size_t i = 1; i < g_workers.size(); ++i){
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Waiting for job worker ", i, " to terminate...");
+		g_workers.at(i)->safe_join();
 	}
 }
 
 void JobDispatcher::do_modal(const volatile bool &running){
-	unsigned timeout = 0;
-	for(;;){
-		bool busy;
-		do {
-			busy = pump_one_round(!atomic_load(running, ATOMIC_CONSUME));
-			timeout = std::min(timeout * 2u + 1u, !busy * 100u);
-		} while(busy);
-
-		Mutex::UniqueLock lock(g_fiber_map_mutex);
-		if(!atomic_load(running, ATOMIC_CONSUME)){
-			break;
-		}
-		g_new_job.timed_wait(lock, timeout);
+	g_workers.at(0)->run(running, false);
+}
+
+void JobDispatcher::make_fiber_stack_snapshot(JobDispatcher::FiberStackSnapshot &snapshot){
+	PROFILE_ME;
+
+	snapshot.stack_size         = g_stack_size;
+	snapshot.stack_count        = atomic_load(g_stack_count, ATOMIC_RELAXED);
+	snapshot.stack_count_peak   = atomic_load(g_stack_count_peak, ATOMIC_RELAXED);
+	snapshot.stacks_in_use      = atomic_load(g_stacks_in_use, ATOMIC_RELAXED);
+	snapshot.stacks_in_use_peak = atomic_load(g_stacks_in_use_peak, ATOMIC_RELAXED);
+	snapshot.bytes_mapped       = 0;
+	snapshot.bytes_resident     = 0;
+
+	boost::container::vector<unsigned char> pages(g_stack_size / g_page_size);
+	const Mutex::UniqueLock lock(g_stack_registry_mutex);
+	for(AUTO(it, g_stack_registry.begin()); it != g_stack_registry.end(); ++it){
+		snapshot.bytes_mapped += g_page_size + g_stack_size;
+		if(::mincore(static_cast<char *>(*it) + g_page_size, g_stack_size, pages.data()) != 0){
+			const int err_code = errno;
+			LOG_POSEIDON_WARNING("::mincore() failed: err_code = ", err_code);
+			continue;
+		}
+		for(AUTO(pit, pages.begin()); pit != pages.end(); ++pit){
+			if(*pit & 1){
+				snapshot.bytes_resident += g_page_size;
+			}
+		}
 	}
 }
 
@@ -306,15 +674,32 @@ void JobDispatcher::enqueue(boost::shared_ptr<JobBase> job, boost::shared_ptr<co
 	const Mutex::UniqueLock lock(g_fiber_map_mutex);
 	AUTO(it, g_fiber_map.find(category));
 	if(it == g_fiber_map.end()){
+		if(g_workers.empty()){
+			LOG_POSEIDON_ERROR("Job dispatcher is not running.");
+			DEBUG_THROW(Exception, sslit("Job dispatcher is not running"));
+		}
 		it = g_fiber_map.emplace(category, FiberControl::Initializer()).first;
+		const AUTO(fiber, &(it->second));
+		fiber->category = category;
+		fiber->queue.push_back(JobElement(STD_MOVE(job), STD_MOVE(withdrawn)));
+		const AUTO(index, atomic_add(g_next_worker, 1, ATOMIC_RELAXED) % g_workers.size());
+		if(g_workers.at(index)->push_fiber(fiber) != 0){
+			// 空闲的工作线程不会自己醒来，叫醒一个让它来偷。
+			wake_idle_worker(index);
+		}
+		return;
 	}
 	const AUTO(fiber, &(it->second));
 	{
 		const RecursiveMutex::UniqueLock queue_lock(fiber->queue_mutex);
 		fiber->queue.push_back(JobElement(STD_MOVE(job), STD_MOVE(withdrawn)));
 	}
-	g_new_job.signal();
 }
+void JobDispatcher::wake_fiber(void *opaque) NOEXCEPT {
+	const AUTO(fiber, static_cast<FiberControl *>(opaque));
+	fiber->owner->resume_fiber(fiber);
+}
+
 void JobDispatcher::yield(const boost::shared_ptr<const JobPromise> &promise, bool insignificant){
 	PROFILE_ME;
 
@@ -338,11 +723,7 @@ void JobDispatcher::yield(const boost::shared_ptr<const JobPromise> &promise, bo
 		const AUTO(profiler_hook, Profiler::begin_stack_switch());
 		{
 			fiber->state = FS_YIELDED;
-			if(::swapcontext(&(fiber->inner), &(fiber->outer)) != 0){
-				const int err_code = errno;
-				LOG_POSEIDON_FATAL("::swapcontext() failed: err_code = ", err_code);
-				std::abort();
-			}
+			FiberContext::swap(fiber->inner, fiber->outer);
 		}
 		Profiler::end_stack_switch(profiler_hook);
 		LOG_POSEIDON_TRACE("Resumed to fiber ", static_cast<void *>(fiber));
@@ -6,6 +6,8 @@
 
 #include "../cxx_ver.hpp"
 #include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>
 
 namespace Poseidon {
 
@@ -17,13 +19,27 @@ private:
 	JobDispatcher();
 
 public:
+	struct FiberStackSnapshot {
+		std::size_t stack_size;         // 不含保护页。
+		std::size_t stack_count;        // 已映射的栈数，包含各工作线程缓存的。
+		std::size_t stack_count_peak;
+		std::size_t stacks_in_use;
+		std::size_t stacks_in_use_peak;
+		boost::uint64_t bytes_mapped;
+		boost::uint64_t bytes_resident; // 实际占用物理内存的字节数。
+	};
+
 	static void start();
 	static void stop();
 
 	static void do_modal(const volatile bool &running);
 
+	static void make_fiber_stack_snapshot(FiberStackSnapshot &snapshot);
+
 	static void enqueue(boost::shared_ptr<JobBase> job, boost::shared_ptr<const bool> withdrawn);
 	static void yield(const boost::shared_ptr<const JobPromise> &promise, bool insignificant);
+	// 由 JobPromise 在被满足时调用，把挂起的 fiber 放回就绪队列。
+	static void wake_fiber(void *fiber) NOEXCEPT;
 };
 
 }
@@ -5,16 +5,19 @@
 #include "mysql_daemon.hpp"
 #include "main_config.hpp"
 #include <boost/container/flat_map.hpp>
+#include <boost/container/flat_set.hpp>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/epoll.h>
 #include <mysqld_error.h>
 #include <errmsg.h>
 #include "../mysql/object_base.hpp"
 #include "../mysql/exception.hpp"
 #include "../mysql/connection.hpp"
 #include "../mysql/thread_context.hpp"
+#include "../mysql/statement_params.hpp"
 #include "../thread.hpp"
 #include "../mutex.hpp"
 #include "../condition_variable.hpp"
@@ -26,6 +29,7 @@
 #include "../profiler.hpp"
 #include "../time.hpp"
 #include "../errno.hpp"
+#include "../system_exception.hpp"
 #include "../buffer_streams.hpp"
 
 namespace Poseidon {
@@ -49,9 +53,19 @@ namespace {
 	std::size_t     g_max_retry_count   = 3;
 	boost::uint64_t g_retry_init_delay  = 1000;
 	std::size_t     g_max_thread_count  = 8;
-
-
-	inline boost::shared_ptr<MySql::Connection> real_create_connection(bool from_slave){
+	std::size_t     g_save_batch_max_rows   = 100;
+	std::size_t     g_save_batch_max_bytes  = 1048576;
+	bool            g_use_prepared_statements   = true;
+	std::size_t     g_max_prepared_statements   = 64;
+	std::size_t     g_async_connections_per_thread  = 0;
+	std::size_t     g_shard_count       = 1;
+	std::size_t     g_group_commit_max_statements   = 100;
+	boost::uint64_t g_group_commit_max_time         = 50;
+	boost::container::flat_set<SharedNts> g_sharded_tables;
+
+
+	// 守护线程自己的连接使用 CLIENT_FOUND_ROWS，以区分没有改变的 UPDATE 和不存在的行。
+	inline boost::shared_ptr<MySql::Connection> real_create_connection(bool from_slave, bool found_rows){
 		AUTO(addr, &g_server_addr);
 		AUTO(port, &g_server_port);
 		if(from_slave){
@@ -62,7 +76,7 @@ namespace {
 				port = &g_slave_port;
 			}
 		}
-		return MySql::Connection::create(*addr, *port, g_username, g_password, g_schema, g_use_ssl, g_charset);
+		return MySql::Connection::create(*addr, *port, g_username, g_password, g_schema, g_use_ssl, g_charset, g_max_prepared_statements, found_rows);
 	}
 
 	// 对于日志文件的写操作应当互斥。
@@ -120,6 +134,24 @@ namespace {
 		LOG_POSEIDON_ERROR("Error writing SQL dump: what = ", e.what());
 	}
 
+	// 两个对象可能对应同一行时，写入必须按照入队的顺序执行。
+	// 有主键的对象按照主键比较，没有主键的对象无法判断，同一个表中的都视为同一行。
+	bool may_refer_to_same_row(const boost::shared_ptr<const MySql::ObjectBase> &lhs, const boost::shared_ptr<const MySql::ObjectBase> &rhs){
+		if(lhs == rhs){
+			return true;
+		}
+		if(std::strcmp(lhs->get_table(), rhs->get_table()) != 0){
+			return false;
+		}
+		if(!lhs->is_updatable() || !rhs->is_updatable()){
+			return true;
+		}
+		Buffer_ostream lhs_os, rhs_os;
+		lhs->generate_sql_where(lhs_os);
+		rhs->generate_sql_where(rhs_os);
+		return lhs_os.get_buffer().dump_string() == rhs_os.get_buffer().dump_string();
+	}
+
 	// 数据库线程操作。
 	class OperationBase : NONCOPYABLE {
 	private:
@@ -144,6 +176,23 @@ namespace {
 		virtual void generate_sql(std::string &query) const = 0;
 		virtual void execute(const boost::shared_ptr<MySql::Connection> &conn, const std::string &query) const = 0;
 
+		// 在数据库线程中执行之前调用。返回 false 表示没有需要写入的内容，不必执行。
+		virtual bool prepare_execution() const {
+			return true;
+		}
+		// 返回 true 时 execute() 不使用 generate_sql() 的结果，只在需要转储时才生成 SQL。
+		virtual bool is_prepared() const {
+			return false;
+		}
+		// 只执行 generate_sql() 生成的语句、不读取结果集的写操作，可以在异步连接上执行。
+		virtual bool is_write_only() const {
+			return false;
+		}
+		// 在异步连接上执行完毕之后调用。返回 false 表示需要重新调用 generate_sql() 并再执行一次。
+		virtual bool check_async_result(const boost::shared_ptr<MySql::Connection> & /* conn */) const {
+			return true;
+		}
+
 		virtual bool is_isolated() const {
 			if(!m_promise){
 				return false;
@@ -182,13 +231,86 @@ namespace {
 		const boost::shared_ptr<const MySql::ObjectBase> m_object;
 		const bool m_to_replace;
 
+		// 第一次执行时确定写入方式，重试时不变。只在数据库线程中写入。
+		mutable volatile bool m_snapshot_taken;
+		mutable bool m_update;              // 使用 UPDATE 只写入修改过的字段。
+		mutable std::string m_update_query; // 为空表示没有修改过的字段。
+
 	public:
 		SaveOperation(boost::shared_ptr<JobPromise> promise,
 			boost::shared_ptr<const MySql::ObjectBase> object, bool to_replace)
 			: OperationBase(STD_MOVE(promise))
 			, m_object(STD_MOVE(object)), m_to_replace(to_replace)
+			, m_snapshot_taken(false), m_update(false)
 		{ }
 
+	private:
+		void fall_back_to_replace() const {
+			// 没有匹配的行，这一行可能已被删除，写入所有字段。
+			LOG_POSEIDON_DEBUG("UPDATE matched no rows, falling back to REPLACE: table = ", get_table());
+			m_object->set_persisted(false);
+			m_object->set_all_fields_dirty(false);
+			m_update = false;
+		}
+		void take_snapshot() const {
+			if(atomic_load(m_snapshot_taken, ATOMIC_CONSUME)){
+				return;
+			}
+			if(m_to_replace && m_object->is_persisted() && m_object->is_updatable()){
+				Buffer_ostream os;
+				os <<"UPDATE `" <<m_object->get_table() <<"` SET ";
+				if(m_object->generate_sql_update(os) != 0){
+					m_update_query = os.get_buffer().dump_string();
+				}
+				m_update = true;
+			} else {
+				// 写入所有字段。先清除修改标记，此后的修改会重新设置。
+				m_object->set_all_fields_dirty(false);
+			}
+			atomic_store(m_snapshot_taken, true, ATOMIC_RELEASE);
+		}
+
+	public:
+		const boost::shared_ptr<const MySql::ObjectBase> &get_object() const {
+			return m_object;
+		}
+		bool is_to_replace() const {
+			return m_to_replace;
+		}
+		bool is_update() const {
+			take_snapshot();
+			return m_update;
+		}
+		// 不生成快照，只用于安排执行方式。生成快照之前的结果只是预测。
+		bool may_update() const {
+			if(atomic_load(m_snapshot_taken, ATOMIC_CONSUME)){
+				return m_update;
+			}
+			return m_to_replace && m_object->is_persisted() && m_object->is_updatable();
+		}
+		// 多行语句的开头，不含任何一行的值。
+		void generate_batch_sql_prefix(std::string &query) const {
+			Buffer_ostream os;
+			if(m_to_replace){
+				os <<"REPLACE";
+			} else {
+				os <<"INSERT";
+			}
+			os <<" INTO `" <<m_object->get_table() <<"` (";
+			m_object->generate_sql_columns(os);
+			os <<") VALUES ";
+			query = os.get_buffer().dump_string();
+		}
+		// 同时生成快照，成功之后对象被标记为已经写入。调用之前应当检查 may_update()。
+		void generate_batch_sql_row(std::string &row) const {
+			take_snapshot();
+			Buffer_ostream os;
+			os <<"(";
+			m_object->generate_sql_values(os);
+			os <<")";
+			row = os.get_buffer().dump_string();
+		}
+
 	protected:
 		bool should_use_slave() const {
 			return false;
@@ -200,6 +322,11 @@ namespace {
 			return m_object->get_table();
 		}
 		void generate_sql(std::string &query) const OVERRIDE {
+			// 其他线程中也可能调用，此时不能生成快照。
+			if(atomic_load(m_snapshot_taken, ATOMIC_CONSUME) && m_update){
+				query = m_update_query;
+				return;
+			}
 			Buffer_ostream os;
 			if(m_to_replace){
 				os <<"REPLACE";
@@ -213,7 +340,83 @@ namespace {
 		void execute(const boost::shared_ptr<MySql::Connection> &conn, const std::string &query) const OVERRIDE {
 			PROFILE_ME;
 
-			conn->execute_sql(query);
+			if(is_update()){
+				if(m_update_query.empty()){
+					return;
+				}
+				conn->execute_sql(m_update_query);
+				if(conn->get_affected_rows() != 0){
+					return;
+				}
+				fall_back_to_replace();
+				if(!is_prepared()){
+					std::string replace_query;
+					generate_sql(replace_query);
+					conn->execute_sql(replace_query);
+					return;
+				}
+			} else if(!is_prepared()){
+				conn->execute_sql(query);
+				return;
+			}
+			Buffer_ostream os;
+			if(m_to_replace){
+				os <<"REPLACE";
+			} else {
+				os <<"INSERT";
+			}
+			os <<" INTO `" <<get_table() <<"` (";
+			m_object->generate_sql_columns(os);
+			os <<") VALUES (";
+			MySql::StatementParams params;
+			m_object->generate_sql_params(params);
+			for(std::size_t i = 0; i < params.size(); ++i){
+				if(i != 0){
+					os <<", ";
+				}
+				os <<"?";
+			}
+			os <<")";
+			conn->execute_prepared(os.get_buffer().dump_string(), params);
+		}
+
+		bool prepare_execution() const OVERRIDE {
+			return !is_update() || !m_update_query.empty();
+		}
+		bool is_prepared() const OVERRIDE {
+			return g_use_prepared_statements && !is_update();
+		}
+		bool is_write_only() const OVERRIDE {
+			return true;
+		}
+		// UPDATE 没有匹配的行时改为 REPLACE 再执行一次。
+		bool check_async_result(const boost::shared_ptr<MySql::Connection> &conn) const OVERRIDE {
+			if(!is_update() || (conn->get_affected_rows() != 0)){
+				return true;
+			}
+			fall_back_to_replace();
+			return false;
+		}
+
+		void set_success() OVERRIDE {
+			if(atomic_load(m_snapshot_taken, ATOMIC_CONSUME) && !m_update){
+				m_object->set_persisted(true);
+			}
+			OperationBase::set_success();
+		}
+		void set_exception(
+#ifdef POSEIDON_CXX11
+			std::exception_ptr ep
+#else
+			boost::exception_ptr ep
+#endif
+			) OVERRIDE
+		{
+			if(atomic_load(m_snapshot_taken, ATOMIC_CONSUME)){
+				// 没有写入的字段留给下一次保存。
+				m_object->set_all_fields_dirty(true);
+			}
+			OperationBase::set_exception(STD_MOVE(ep));
 		}
 	};
 
@@ -221,12 +424,14 @@ namespace {
 	private:
 		const boost::shared_ptr<MySql::ObjectBase> m_object;
 		const std::string m_query;
+		const MySql::StatementParams m_params;
+		const bool m_prepared;
 
 	public:
 		LoadOperation(boost::shared_ptr<JobPromise> promise,
-			boost::shared_ptr<MySql::ObjectBase> object, std::string query)
+			boost::shared_ptr<MySql::ObjectBase> object, std::string query, MySql::StatementParams params, bool prepared)
 			: OperationBase(STD_MOVE(promise))
-			, m_object(STD_MOVE(object)), m_query(STD_MOVE(query))
+			, m_object(STD_MOVE(object)), m_query(STD_MOVE(query)), m_params(STD_MOVE_IDN(params)), m_prepared(prepared)
 		{ }
 
 	protected:
@@ -240,34 +445,48 @@ namespace {
 			return m_object->get_table();
 		}
 		void generate_sql(std::string &query) const OVERRIDE {
-			query = m_query;
+			if(!m_prepared){
+				query = m_query;
+			} else {
+				query = m_params.interpolate(m_query);
+			}
 		}
 		void execute(const boost::shared_ptr<MySql::Connection> &conn, const std::string &query) const OVERRIDE {
 			PROFILE_ME;
 
 			if(is_isolated()){
-				LOG_POSEIDON_DEBUG("Discarding isolated MySQL query: table = ", get_table(), ", query = ", query);
+				LOG_POSEIDON_DEBUG("Discarding isolated MySQL query: table = ", get_table(), ", query = ", m_query);
 				return;
 			}
 
-			conn->execute_sql(query);
+			if(is_prepared()){
+				conn->execute_prepared(m_query, m_params);
+			} else {
+				conn->execute_sql(query);
+			}
 			if(!conn->fetch_row()){
 				DEBUG_THROW(MySql::Exception, SharedNts::view(get_table()), ER_SP_FETCH_NO_DATA, sslit("No rows returned"));
 			}
 			m_object->fetch(conn);
 		}
+
+		bool is_prepared() const OVERRIDE {
+			return m_prepared && g_use_prepared_statements;
+		}
 	};
 
 	class DeleteOperation : public OperationBase {
 	private:
 		const char *const m_table_hint;
 		const std::string m_query;
+		const MySql::StatementParams m_params;
+		const bool m_prepared;
 
 	public:
 		DeleteOperation(boost::shared_ptr<JobPromise> promise,
-			const char *table_hint, std::string query)
+			const char *table_hint, std::string query, MySql::StatementParams params, bool prepared)
 			: OperationBase(STD_MOVE(promise))
-			, m_table_hint(table_hint), m_query(STD_MOVE(query))
+			, m_table_hint(table_hint), m_query(STD_MOVE(query)), m_params(STD_MOVE_IDN(params)), m_prepared(prepared)
 		{ }
 
 	protected:
@@ -281,12 +500,27 @@ namespace {
 			return m_table_hint;
 		}
 		void generate_sql(std::string &query) const OVERRIDE {
-			query = m_query;
+			if(!m_prepared){
+				query = m_query;
+			} else {
+				query = m_params.interpolate(m_query);
+			}
 		}
 		void execute(const boost::shared_ptr<MySql::Connection> &conn, const std::string &query) const OVERRIDE {
 			PROFILE_ME;
 
-			conn->execute_sql(query);
+			if(is_prepared()){
+				conn->execute_prepared(m_query, m_params);
+			} else {
+				conn->execute_sql(query);
+			}
+		}
+
+		bool is_prepared() const OVERRIDE {
+			return m_prepared && g_use_prepared_statements;
+		}
+		bool is_write_only() const OVERRIDE {
+			return true;
 		}
 	};
 
@@ -295,12 +529,15 @@ namespace {
 		const QueryCallback m_callback;
 		const char *const m_table_hint;
 		const std::string m_query;
+		const MySql::StatementParams m_params;
+		const bool m_prepared;
 
 	public:
 		BatchLoadOperation(boost::shared_ptr<JobPromise> promise,
-			QueryCallback callback, const char *table_hint, std::string query)
+			QueryCallback callback, const char *table_hint, std::string query, MySql::StatementParams params, bool prepared)
 			: OperationBase(STD_MOVE(promise))
 			, m_callback(STD_MOVE_IDN(callback)), m_table_hint(table_hint), m_query(STD_MOVE(query))
+			, m_params(STD_MOVE_IDN(params)), m_prepared(prepared)
 		{ }
 
 	protected:
@@ -314,17 +551,25 @@ namespace {
 			return m_table_hint;
 		}
 		void generate_sql(std::string &query) const OVERRIDE {
-			query = m_query;
+			if(!m_prepared){
+				query = m_query;
+			} else {
+				query = m_params.interpolate(m_query);
+			}
 		}
 		void execute(const boost::shared_ptr<MySql::Connection> &conn, const std::string &query) const OVERRIDE {
 			PROFILE_ME;
 
 			if(is_isolated()){
-				LOG_POSEIDON_DEBUG("Discarding isolated MySQL query: table = ", get_table(), ", query = ", query);
+				LOG_POSEIDON_DEBUG("Discarding isolated MySQL query: table = ", get_table(), ", query = ", m_query);
 				return;
 			}
 
-			conn->execute_sql(query);
+			if(is_prepared()){
+				conn->execute_prepared(m_query, m_params);
+			} else {
+				conn->execute_sql(query);
+			}
 			if(m_callback){
 				while(conn->fetch_row()){
 					m_callback(conn);
@@ -333,6 +578,10 @@ namespace {
 				LOG_POSEIDON_DEBUG("Result discarded.");
 			}
 		}
+
+		bool is_prepared() const OVERRIDE {
+			return m_prepared && g_use_prepared_statements;
+		}
 	};
 
 	class LowLevelAccessOperation : public OperationBase {
@@ -419,18 +668,129 @@ namespace {
 		}
 	};
 
+	// 分片的表上不针对单个对象的操作在所有持有这个表的分片的线程之间建立屏障。
+	// 其他线程执行完之前的操作之后在这里等待，持有 0 号分片的线程等待它们全部到达之后执行这个操作，完成之后所有线程继续。
+	class ShardBarrier : NONCOPYABLE {
+	private:
+		mutable Mutex m_mutex;
+		mutable ConditionVariable m_cond;
+		std::size_t m_pending_arrivals;
+		bool m_released;
+
+	public:
+		explicit ShardBarrier(std::size_t arrivals)
+			: m_pending_arrivals(arrivals), m_released(false)
+		{ }
+
+	public:
+		void arrive_and_wait(){
+			Mutex::UniqueLock lock(m_mutex);
+			if(m_pending_arrivals != 0){
+				--m_pending_arrivals;
+			}
+			m_cond.broadcast();
+			while(!m_released){
+				m_cond.wait(lock);
+			}
+		}
+		void wait_for_arrivals(){
+			Mutex::UniqueLock lock(m_mutex);
+			while(m_pending_arrivals != 0){
+				m_cond.wait(lock);
+			}
+		}
+		void release() NOEXCEPT {
+			const Mutex::UniqueLock lock(m_mutex);
+			m_pending_arrivals = 0;
+			m_released = true;
+			m_cond.broadcast();
+		}
+	};
+
+	class BarrierOperation : public OperationBase {
+	public:
+		enum Action {
+			ACT_ARRIVE,             // 其他线程。
+			ACT_GATE,               // 0 号分片的线程，在真正的操作之前。
+			ACT_RELEASE,            // 0 号分片的线程，在真正的操作之后。
+		};
+
+	private:
+		const boost::shared_ptr<ShardBarrier> m_barrier;
+		const char *const m_table_hint;
+		const Action m_action;
+
+	public:
+		BarrierOperation(boost::shared_ptr<ShardBarrier> barrier, const char *table_hint, Action action)
+			: OperationBase(VAL_INIT)
+			, m_barrier(STD_MOVE(barrier)), m_table_hint(table_hint), m_action(action)
+		{ }
+		~BarrierOperation(){
+			// 真正的操作没有执行时也不能让其他线程一直等待。
+			if(m_action == ACT_RELEASE){
+				m_barrier->release();
+			}
+		}
+
+	protected:
+		bool should_use_slave() const {
+			return false;
+		}
+		boost::shared_ptr<const MySql::ObjectBase> get_combinable_object() const OVERRIDE {
+			return VAL_INIT; // 不能合并。
+		}
+		const char *get_table() const OVERRIDE {
+			return m_table_hint;
+		}
+		void generate_sql(std::string & /* query */) const OVERRIDE { }
+		void execute(const boost::shared_ptr<MySql::Connection> & /* conn */, const std::string & /* query */) const OVERRIDE {
+			PROFILE_ME;
+
+			switch(m_action){
+			case ACT_ARRIVE:
+				m_barrier->arrive_and_wait();
+				break;
+			case ACT_GATE:
+				m_barrier->wait_for_arrivals();
+				break;
+			case ACT_RELEASE:
+				m_barrier->release();
+				break;
+			}
+		}
+
+		bool is_prepared() const OVERRIDE {
+			return true;
+		}
+	};
+
 	class MySqlThread : NONCOPYABLE {
 	private:
 		struct OperationQueueElement {
 			boost::shared_ptr<OperationBase> operation;
 			boost::uint64_t due_time;
 			std::size_t retry_count;
+			bool done;              // 已经作为多行语句的一部分或者在异步连接上执行完毕，promise 也已经满足。
+			bool batch_failed;      // 所在的多行语句或者事务执行失败，此后单独执行。
+			bool in_flight;         // 正在异步连接上执行。
+			bool in_transaction;    // 已经在当前事务中执行，等待提交。
 
 			OperationQueueElement(boost::shared_ptr<OperationBase> operation_, boost::uint64_t due_time_)
 				: operation(STD_MOVE(operation_)), due_time(due_time_), retry_count(0)
+				, done(false), batch_failed(false), in_flight(false), in_transaction(false)
 			{ }
 		};
 
+		// 异步连接。只在这个线程中访问。
+		struct AsyncSlot {
+			boost::shared_ptr<MySql::Connection> conn;
+			int socket;                     // 注册在 epoll 中的套接字，没有时为 -1。
+			boost::uint64_t reconn_time;    // 连接失败之后，在这个时间之前不再尝试。
+			OperationQueueElement *elem;    // 正在执行的操作，空闲时为空。
+			std::string query;
+			boost::uint64_t timeout_time;   // 没有等待 WAIT_TIMEOUT 时为 -1。
+		};
+
 	private:
 		Thread m_thread;
 		volatile bool m_running;
@@ -440,103 +800,170 @@ namespace {
 		volatile bool m_urgent; // 无视延迟写入，一次性处理队列中所有操作。
 		boost::container::deque<OperationQueueElement> m_queue;
 
+		UniqueFile m_epoll;
+		std::vector<AsyncSlot> m_async_slots;
+		std::size_t m_async_in_flight;
+
+		volatile boost::uint64_t m_commits;
+		volatile boost::uint64_t m_committed_operations;
+		volatile std::size_t m_last_commit_size;
+		volatile std::size_t m_max_commit_size;
+		volatile boost::uint64_t m_rollbacks;
+
 	public:
 		MySqlThread()
 			: m_running(false)
 			, m_urgent(false)
+			, m_async_in_flight(0)
+			, m_commits(0), m_committed_operations(0), m_last_commit_size(0), m_max_commit_size(0), m_rollbacks(0)
 		{ }
 
 	private:
-		bool pump_one_operation(boost::shared_ptr<MySql::Connection> &master_conn,
-			boost::shared_ptr<MySql::Connection> &slave_conn) NOEXCEPT
+		// 把队列中紧随 elem 之后的、写入同一个表且方式相同的保存操作合并为一条多行语句执行。elem 位于队列的 index 处。
+		// 其他表的保存操作可以被越过，遇到其他任何操作则停止，以保证同一个表上的操作顺序不变。
+		// 返回 false 表示没有可以合并的操作，或者多行语句执行失败，调用者应当单独执行 elem。
+		// 如果 deferred 非空，被合并的操作追加到其中，等待事务提交之后再满足 promise。
+		bool execute_save_batch(OperationQueueElement *elem, std::size_t index, boost::uint64_t now,
+			const boost::shared_ptr<MySql::Connection> &conn, std::vector<OperationQueueElement *> *deferred)
 		{
 			PROFILE_ME;
 
-			const AUTO(now, get_fast_mono_clock());
-			OperationQueueElement *elem;
+			if((g_save_batch_max_rows <= 1) || elem->batch_failed){
+				return false;
+			}
+			const AUTO(save, dynamic_cast<const SaveOperation *>(elem->operation.get()));
+			if(!save || save->is_update()){
+				return false;
+			}
+			const char *const table = save->get_object()->get_table();
+
+			std::vector<OperationQueueElement *> candidates;
 			{
 				const Mutex::UniqueLock lock(m_mutex);
-				if(m_queue.empty()){
-					atomic_store(m_urgent, false, ATOMIC_RELAXED);
-					return false;
+				const bool urgent = atomic_load(m_urgent, ATOMIC_CONSUME);
+				// 队列只在这个线程中弹出，push_back() 不会使已有元素的指针失效。
+				for(std::size_t i = index + 1; (i < m_queue.size()) && (candidates.size() + 1 < g_save_batch_max_rows); ++i){
+					AUTO_REF(test_elem, m_queue[i]);
+					if(!urgent && (now < test_elem.due_time)){
+						break;
+					}
+					if(test_elem.done || test_elem.in_transaction){
+						continue;
+					}
+					const AUTO(test_save, dynamic_cast<const SaveOperation *>(test_elem.operation.get()));
+					if(!test_save){
+						break;
+					}
+					if(std::strcmp(test_save->get_object()->get_table(), table) != 0){
+						continue;
+					}
+					if((test_save->is_to_replace() != save->is_to_replace()) || test_elem.batch_failed){
+						break;
+					}
+					const AUTO(write_stamp, test_save->get_object()->get_combined_write_stamp());
+					if(write_stamp && (write_stamp != &test_elem)){
+						// 与更早的操作合并了。
+						continue;
+					}
+					candidates.push_back(&test_elem);
 				}
-				if(!atomic_load(m_urgent, ATOMIC_CONSUME) && (now < m_queue.front().due_time)){
-					return false;
+			}
+			// 确定写入方式时需要锁定对象，不能在锁定队列时进行。
+			// 这里不能生成快照，否则在执行之前合并进来的修改会丢失。
+			for(AUTO(it, candidates.begin()); it != candidates.end(); ++it){
+				if(static_cast<const SaveOperation &>(*((*it)->operation)).may_update()){
+					candidates.erase(it, candidates.end());
+					break;
 				}
-				elem = &m_queue.front();
 			}
-			const AUTO_REF(operation, elem->operation);
-			AUTO_REF(conn, elem->operation->should_use_slave() ? slave_conn : master_conn);
+			if(candidates.empty()){
+				return false;
+			}
 
-			std::string query;
-#ifdef POSEIDON_CXX11
-			std::exception_ptr except;
-#else
-			boost::exception_ptr except;
-#endif
-			long err_code = 0;
-			char err_msg[4096];
-#define SET_ERR_CODE_AND_MSG(c_, s_)	\
-			do {	\
-				err_code = (c_);	\
-				const std::size_t len_ = std::min<std::size_t>(std::strlen(s_), sizeof(err_msg) - 1);	\
-				std::memcpy(err_msg, (s_), len_);	\
-				err_msg[len_] = 0;	\
-			} while(false)
+			std::string query, row;
+			save->generate_batch_sql_prefix(query);
+			save->generate_batch_sql_row(row);
+			query += row;
+			std::vector<OperationQueueElement *> batch;
+			for(AUTO(it, candidates.begin()); it != candidates.end(); ++it){
+				const AUTO_REF(test_save, static_cast<const SaveOperation &>(*((*it)->operation)));
+				if(test_save.is_update()){
+					// 检查之后对象被标记为已经写入了，留给 pump_one_operation() 单独执行。
+					continue;
+				}
+				test_save.generate_batch_sql_row(row);
+				if(query.size() + 2 + row.size() > g_save_batch_max_bytes){
+					break;
+				}
+				query += ", ";
+				query += row;
+				batch.push_back(*it);
+			}
+			if(batch.empty()){
+				return false;
+			}
 
-			bool execute_it = false;
-			const AUTO(combinable_object, elem->operation->get_combinable_object());
-			if(!combinable_object){
-				execute_it = true;
-			} else {
-				const AUTO(old_write_stamp, combinable_object->get_combined_write_stamp());
-				if(!old_write_stamp){
-					execute_it = true;
-				} else if(old_write_stamp == elem){
-					combinable_object->set_combined_write_stamp(NULLPTR);
-					execute_it = true;
+			LOG_POSEIDON_DEBUG("Executing batched SQL: table = ", table, ", rows = ", batch.size() + 1, ", bytes = ", query.size());
+			try {
+				conn->execute_sql(query);
+				conn->discard_result();
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("Batched MySQL save failed, falling back to per-row execution: table = ", table,
+					", rows = ", batch.size() + 1, ", what = ", e.what());
+				conn->discard_result();
+				elem->batch_failed = true;
+				for(AUTO(it, batch.begin()); it != batch.end(); ++it){
+					(*it)->batch_failed = true;
 				}
+				return false;
 			}
-			if(execute_it){
-				try {
-					operation->generate_sql(query);
-					LOG_POSEIDON_DEBUG("Executing SQL: table = ", operation->get_table(), ", query = ", query);
-					operation->execute(conn, query);
-				} catch(MySql::Exception &e){
-					LOG_POSEIDON_WARNING("MySql::Exception thrown: code = ", e.get_code(), ", what = ", e.what());
-#ifdef POSEIDON_CXX11
-					except = std::current_exception();
-#else
-					except = boost::copy_exception(e);
-#endif
-					SET_ERR_CODE_AND_MSG(e.get_code(), e.what());
-				} catch(std::exception &e){
-					LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
+			for(AUTO(it, batch.begin()); it != batch.end(); ++it){
+				const AUTO_REF(operation, (*it)->operation);
+				const AUTO(object, static_cast<const SaveOperation &>(*operation).get_object());
+				if(object->get_combined_write_stamp() == *it){
+					object->set_combined_write_stamp(NULLPTR);
+				}
+				if(deferred){
+					(*it)->in_transaction = true;
+					deferred->push_back(*it);
+					continue;
+				}
+				(*it)->done = true;
+				if(!operation->is_satisfied()){
+					try {
+						operation->set_success();
+					} catch(std::exception &e){
+						LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+					}
+				}
+			}
+			return true;
+		}
+
+#define SET_ERR_CODE_AND_MSG(c_, s_)	\
+		do {	\
+			err_code = (c_);	\
+			const std::size_t len_ = std::min<std::size_t>(std::strlen(s_), sizeof(err_msg) - 1);	\
+			std::memcpy(err_msg, (s_), len_);	\
+			err_msg[len_] = 0;	\
+		} while(false)
+
+		// 操作执行完毕（无论成功与否）之后调用。返回 false 表示需要重试，元素留在队列中。
+		bool complete_operation(OperationQueueElement *elem, boost::uint64_t now, const std::string &query,
 #ifdef POSEIDON_CXX11
-					except = std::current_exception();
+			std::exception_ptr except,
 #else
-					except = boost::copy_exception(std::runtime_error(e.what()));
+			boost::exception_ptr except,
 #endif
-					SET_ERR_CODE_AND_MSG(ER_UNKNOWN_ERROR, e.what());
-				} catch(...){
-					LOG_POSEIDON_WARNING("Unknown exception thrown");
-#ifdef POSEIDON_CXX11
-					except = std::current_exception();
-#else
-					except = boost::copy_exception(std::bad_exception());
-#endif
-					SET_ERR_CODE_AND_MSG(ER_UNKNOWN_ERROR, "Unknown exception");
-				}
-				conn->discard_result();
-			}
+			long err_code, const char *err_msg) NOEXCEPT
+		{
 			if(except){
 				const AUTO(retry_count, ++elem->retry_count);
 				if(retry_count < g_max_retry_count){
 					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
 						"Going to retry MySQL operation: retry_count = ", retry_count);
 					elem->due_time = now + (g_retry_init_delay << retry_count);
-					conn.reset();
-					return true;
+					return false;
 				}
 				LOG_POSEIDON_ERROR("Max retry count exceeded.");
 				dump_sql_to_file(query, err_code, err_msg);
@@ -552,6 +979,594 @@ namespace {
 					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
 				}
 			}
+			elem->done = true;
+			return true;
+		}
+
+		void reset_async_slot(AsyncSlot &slot) NOEXCEPT {
+			if(slot.socket >= 0){
+				::epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, slot.socket, NULLPTR);
+				slot.socket = -1;
+			}
+			slot.conn.reset();
+		}
+		void wait_async_slot(AsyncSlot &slot, int wait_events, boost::uint64_t now){
+			::epoll_event event;
+			event.events = 0;
+			if(wait_events & MySql::Connection::WAIT_READ){
+				event.events |= EPOLLIN;
+			}
+			if(wait_events & MySql::Connection::WAIT_WRITE){
+				event.events |= EPOLLOUT;
+			}
+			if(wait_events & MySql::Connection::WAIT_EXCEPT){
+				event.events |= EPOLLPRI;
+			}
+			event.data.ptr = &slot;
+			// 客户端库可能重新连接过，所以每次都重新获取套接字。
+			const int socket = slot.conn->get_socket();
+			if(slot.socket != socket){
+				if(slot.socket >= 0){
+					::epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, slot.socket, NULLPTR);
+					slot.socket = -1;
+				}
+				if(::epoll_ctl(m_epoll.get(), EPOLL_CTL_ADD, socket, &event) != 0){
+					const int err_code = errno;
+					LOG_POSEIDON_ERROR("::epoll_ctl() failed, errno was ", err_code);
+					DEBUG_THROW(SystemException, err_code);
+				}
+				slot.socket = socket;
+			} else {
+				if(::epoll_ctl(m_epoll.get(), EPOLL_CTL_MOD, socket, &event) != 0){
+					const int err_code = errno;
+					LOG_POSEIDON_ERROR("::epoll_ctl() failed, errno was ", err_code);
+					DEBUG_THROW(SystemException, err_code);
+				}
+			}
+			if(wait_events & MySql::Connection::WAIT_TIMEOUT){
+				slot.timeout_time = now + slot.conn->get_timeout();
+			} else {
+				slot.timeout_time = (boost::uint64_t)-1;
+			}
+		}
+		// elem 为空时继续执行 slot 上的操作，否则在 slot 上开始执行 elem。
+		void step_async_slot(AsyncSlot &slot, OperationQueueElement *elem, int ready_events, boost::uint64_t now) NOEXCEPT {
+			PROFILE_ME;
+
+#ifdef POSEIDON_CXX11
+			std::exception_ptr except;
+#else
+			boost::exception_ptr except;
+#endif
+			long err_code = 0;
+			char err_msg[4096];
+
+			try {
+				int wait_events;
+				if(elem){
+					slot.elem = elem;
+					elem->in_flight = true;
+					++m_async_in_flight;
+					elem->operation->generate_sql(slot.query);
+					LOG_POSEIDON_DEBUG("Executing SQL asynchronously: table = ", elem->operation->get_table(), ", query = ", slot.query);
+					wait_events = slot.conn->begin_execute_sql(slot.query);
+				} else {
+					wait_events = slot.conn->continue_execute_sql(ready_events);
+				}
+				for(;;){
+					if(wait_events != 0){
+						wait_async_slot(slot, wait_events, now);
+						return;
+					}
+					slot.conn->end_execute_sql();
+					const bool finished = slot.elem->operation->check_async_result(slot.conn);
+					slot.conn->discard_result();
+					if(finished){
+						break;
+					}
+					slot.elem->operation->generate_sql(slot.query);
+					LOG_POSEIDON_DEBUG("Executing SQL asynchronously: table = ", slot.elem->operation->get_table(), ", query = ", slot.query);
+					wait_events = slot.conn->begin_execute_sql(slot.query);
+				}
+			} catch(MySql::Exception &e){
+				LOG_POSEIDON_WARNING("MySql::Exception thrown: code = ", e.get_code(), ", what = ", e.what());
+#ifdef POSEIDON_CXX11
+				except = std::current_exception();
+#else
+				except = boost::copy_exception(e);
+#endif
+				SET_ERR_CODE_AND_MSG(e.get_code(), e.what());
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
+#ifdef POSEIDON_CXX11
+				except = std::current_exception();
+#else
+				except = boost::copy_exception(std::runtime_error(e.what()));
+#endif
+				SET_ERR_CODE_AND_MSG(ER_UNKNOWN_ERROR, e.what());
+			} catch(...){
+				LOG_POSEIDON_WARNING("Unknown exception thrown");
+#ifdef POSEIDON_CXX11
+				except = std::current_exception();
+#else
+				except = boost::copy_exception(std::bad_exception());
+#endif
+				SET_ERR_CODE_AND_MSG(ER_UNKNOWN_ERROR, "Unknown exception");
+			}
+			if(except){
+				// 连接的状态不确定，直接丢弃。
+				reset_async_slot(slot);
+			}
+			AUTO(done_elem, slot.elem);
+			slot.elem = NULLPTR;
+			slot.timeout_time = (boost::uint64_t)-1;
+			if(!done_elem){
+				return;
+			}
+			done_elem->in_flight = false;
+			--m_async_in_flight;
+			complete_operation(done_elem, now, slot.query, except, err_code, err_msg);
+		}
+
+		// 把队列开头可以并发执行的写操作分配给空闲的异步连接。同一个对象的操作，以及同一个表上不属于任何对象的操作，
+		// 在前一个完成之前不会开始。遇到其他操作则停止，它会在前面的操作全部完成之后由 pump_one_operation() 执行。
+		bool dispatch_async_operations(boost::uint64_t now) NOEXCEPT {
+			PROFILE_ME;
+
+			bool busy = false;
+			for(;;){
+				const Mutex::UniqueLock lock(m_mutex);
+				if(m_queue.empty() || !m_queue.front().done){
+					break;
+				}
+				m_queue.pop_front();
+				busy = true;
+			}
+
+			std::vector<OperationQueueElement *> pending;
+			{
+				const Mutex::UniqueLock lock(m_mutex);
+				const bool urgent = atomic_load(m_urgent, ATOMIC_CONSUME);
+				const std::size_t max_scan = m_async_slots.size() * 4 + m_async_in_flight;
+				for(std::size_t i = 0; (i < m_queue.size()) && (i < max_scan); ++i){
+					AUTO_REF(elem, m_queue[i]);
+					if(elem.done){
+						continue;
+					}
+					if(!elem.in_flight && (!elem.operation->is_write_only() || (!urgent && (now < elem.due_time)))){
+						break;
+					}
+					// 队列只在这个线程中弹出，push_back() 不会使已有元素的指针失效。
+					pending.push_back(&elem);
+				}
+			}
+
+			std::size_t next_slot = 0;
+			for(std::size_t i = 0; i < pending.size(); ++i){
+				const AUTO(elem, pending.at(i));
+				if(elem->in_flight){
+					continue;
+				}
+				const AUTO(object, elem->operation->get_combinable_object());
+				const char *const table = elem->operation->get_table();
+				bool blocked = false;
+				for(std::size_t j = 0; j < i; ++j){
+					const AUTO(test_elem, pending.at(j));
+					if(test_elem->done){
+						continue;
+					}
+					const AUTO(test_object, test_elem->operation->get_combinable_object());
+					if(object && test_object){
+						blocked = may_refer_to_same_row(object, test_object);
+					} else {
+						blocked = (std::strcmp(table, test_elem->operation->get_table()) == 0);
+					}
+					if(blocked){
+						break;
+					}
+				}
+				if(blocked){
+					continue;
+				}
+
+				bool execute_it = false;
+				if(!object){
+					execute_it = true;
+				} else {
+					const AUTO(old_write_stamp, object->get_combined_write_stamp());
+					if(!old_write_stamp){
+						execute_it = true;
+					} else if(old_write_stamp == elem){
+						object->set_combined_write_stamp(NULLPTR);
+						execute_it = true;
+					}
+				}
+				if(execute_it && !elem->operation->prepare_execution()){
+					execute_it = false;
+				}
+				if(!execute_it){
+					complete_operation(elem, now, std::string(), VAL_INIT, 0, "");
+					busy = true;
+					continue;
+				}
+
+				AsyncSlot *slot = NULLPTR;
+				while(next_slot < m_async_slots.size()){
+					AUTO_REF(test_slot, m_async_slots.at(next_slot++));
+					if(test_slot.elem){
+						continue;
+					}
+					if(!test_slot.conn){
+						if(now < test_slot.reconn_time){
+							continue;
+						}
+						try {
+							test_slot.conn = real_create_connection(false, true);
+						} catch(std::exception &e){
+							LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+							test_slot.reconn_time = now + g_reconn_delay;
+							continue;
+						}
+					}
+					slot = &test_slot;
+					break;
+				}
+				if(!slot){
+					break;
+				}
+				step_async_slot(*slot, elem, 0, now);
+				busy = true;
+			}
+			return busy;
+		}
+		// 等待异步连接上的事件，最多等待 timeout 毫秒。
+		bool poll_async_operations(boost::uint64_t now, unsigned timeout) NOEXCEPT {
+			PROFILE_ME;
+
+			bool busy = false;
+			for(AUTO(it, m_async_slots.begin()); it != m_async_slots.end(); ++it){
+				if(!it->elem){
+					continue;
+				}
+				if(now >= it->timeout_time){
+					step_async_slot(*it, NULLPTR, MySql::Connection::WAIT_TIMEOUT, now);
+					busy = true;
+					continue;
+				}
+				if(it->timeout_time != (boost::uint64_t)-1){
+					timeout = static_cast<unsigned>(std::min<boost::uint64_t>(timeout, it->timeout_time - now));
+				}
+			}
+			if(busy){
+				timeout = 0;
+			}
+
+			::epoll_event events[64];
+			const int result = ::epoll_wait(m_epoll.get(), events, COUNT_OF(events), static_cast<int>(timeout));
+			if(result < 0){
+				const int err_code = errno;
+				if(err_code != EINTR){
+					LOG_POSEIDON_ERROR("::epoll_wait() failed! errno was ", err_code);
+				}
+				return busy;
+			}
+			for(int i = 0; i < result; ++i){
+				AUTO_REF(slot, *static_cast<AsyncSlot *>(events[i].data.ptr));
+				if(!slot.elem){
+					continue;
+				}
+				int ready_events = 0;
+				if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)){
+					ready_events |= MySql::Connection::WAIT_READ;
+				}
+				if(events[i].events & (EPOLLOUT | EPOLLERR)){
+					ready_events |= MySql::Connection::WAIT_WRITE;
+				}
+				if(events[i].events & EPOLLPRI){
+					ready_events |= MySql::Connection::WAIT_EXCEPT;
+				}
+				step_async_slot(slot, NULLPTR, ready_events, get_fast_mono_clock());
+				busy = true;
+			}
+			return busy;
+		}
+
+		// 返回 1 表示 elem 可以放在事务中，0 表示应当越过，-1 表示事务应当在此结束。
+		static int check_group_committable(const OperationQueueElement &elem, boost::uint64_t now, bool urgent){
+			if(elem.done || elem.in_transaction){
+				return 0;
+			}
+			if(!urgent && (now < elem.due_time)){
+				return -1;
+			}
+			if(elem.batch_failed || elem.in_flight){
+				return -1;
+			}
+			const AUTO_REF(operation, *(elem.operation));
+			if(!operation.is_write_only() || operation.should_use_slave()){
+				return -1;
+			}
+			return 1;
+		}
+
+		static void restore_auto_reconnect(boost::shared_ptr<MySql::Connection> &conn, bool reconnect_disabled) NOEXCEPT {
+			if(!conn || !reconnect_disabled){
+				return;
+			}
+			try {
+				conn->set_auto_reconnect(true);
+			} catch(std::exception &e){
+				LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				conn.reset();
+			}
+		}
+
+		// 把队列开头已经到期的写操作放在同一个事务中执行，提交时只刷新一次日志。
+		// 任何语句或者提交失败时回滚整个事务，其中的操作改为单独执行，由 pump_one_operation() 逐个重试。
+		// 返回 false 表示没有使用事务，调用者应当单独执行队列开头的操作。
+		bool execute_group_commit(boost::shared_ptr<MySql::Connection> &conn, boost::uint64_t now) NOEXCEPT {
+			PROFILE_ME;
+
+			if(g_group_commit_max_statements <= 1){
+				return false;
+			}
+			{
+				// 只有一个操作时不值得使用事务。
+				const Mutex::UniqueLock lock(m_mutex);
+				const bool urgent = atomic_load(m_urgent, ATOMIC_CONSUME);
+				std::size_t count = 0;
+				for(std::size_t i = 0; (i < m_queue.size()) && (count < 2); ++i){
+					const int state = check_group_committable(m_queue[i], now, urgent);
+					if(state < 0){
+						break;
+					}
+					count += static_cast<unsigned>(state);
+				}
+				if(count < 2){
+					return false;
+				}
+			}
+
+			std::vector<OperationQueueElement *> group;
+			std::size_t statements = 0;
+			bool committed = false;
+			bool reconnect_disabled = false;
+			// 断线重连之后执行的语句已经在新的连接上自动提交，group 中从这里开始的操作不能重试。
+			std::size_t autocommitted_begin = (std::size_t)-1;
+			try {
+				const AUTO(thread_id, conn->get_thread_id());
+				// 断线时让语句失败，而不是在新的连接上继续执行。
+				conn->set_auto_reconnect(false);
+				reconnect_disabled = true;
+				conn->execute_sql("BEGIN");
+				conn->discard_result();
+				for(std::size_t index = 0; statements < g_group_commit_max_statements; ++index){
+					if((statements != 0) && (get_fast_mono_clock() >= now + g_group_commit_max_time)){
+						break;
+					}
+					OperationQueueElement *elem;
+					{
+						const Mutex::UniqueLock lock(m_mutex);
+						if(index >= m_queue.size()){
+							break;
+						}
+						elem = &m_queue[index];
+						const int state = check_group_committable(*elem, now, atomic_load(m_urgent, ATOMIC_CONSUME));
+						if(state < 0){
+							break;
+						}
+						if(state == 0){
+							continue;
+						}
+					}
+					const std::size_t group_begin = group.size();
+					elem->in_transaction = true;
+					group.push_back(elem);
+
+					const AUTO_REF(operation, elem->operation);
+					const AUTO(combinable_object, operation->get_combinable_object());
+					if(combinable_object){
+						const AUTO(old_write_stamp, combinable_object->get_combined_write_stamp());
+						if(old_write_stamp == elem){
+							combinable_object->set_combined_write_stamp(NULLPTR);
+						} else if(old_write_stamp){
+							continue;
+						}
+					}
+					if(!operation->prepare_execution()){
+						continue;
+					}
+					++statements;
+					if(!execute_save_batch(elem, index, now, conn, &group)){
+						std::string query;
+						if(!operation->is_prepared()){
+							operation->generate_sql(query);
+							LOG_POSEIDON_DEBUG("Executing SQL in transaction: table = ", operation->get_table(), ", query = ", query);
+						} else {
+							LOG_POSEIDON_DEBUG("Executing prepared statement in transaction: table = ", operation->get_table());
+						}
+						operation->execute(conn, query);
+						conn->discard_result();
+					}
+					// 自动重连之后 BEGIN 之后的语句都已经丢失，不能提交。
+					if(conn->get_thread_id() != thread_id){
+						autocommitted_begin = group_begin;
+						DEBUG_THROW(Exception, sslit("MySQL connection was lost in the middle of a transaction"));
+					}
+				}
+				conn->execute_sql("COMMIT");
+				conn->discard_result();
+				committed = true;
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("MySQL group commit failed, falling back to per-statement execution: operations = ", group.size(),
+					", what = ", e.what());
+			} catch(...){
+				LOG_POSEIDON_WARNING("MySQL group commit failed, falling back to per-statement execution: operations = ", group.size(),
+					", unknown exception thrown");
+			}
+			if(!committed){
+				conn->discard_result();
+				try {
+					conn->execute_sql("ROLLBACK");
+					conn->discard_result();
+				} catch(std::exception &e){
+					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+					conn.reset();
+				}
+				for(std::size_t i = 0; i < group.size(); ++i){
+					const AUTO(elem, group.at(i));
+					elem->in_transaction = false;
+					if(i < autocommitted_begin){
+						elem->batch_failed = true;
+						continue;
+					}
+					elem->done = true;
+					if(!elem->operation->is_satisfied()){
+						try {
+							elem->operation->set_success();
+						} catch(std::exception &e){
+							LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+						}
+					}
+				}
+				restore_auto_reconnect(conn, reconnect_disabled);
+				atomic_add(m_rollbacks, 1, ATOMIC_RELAXED);
+				return true;
+			}
+			restore_auto_reconnect(conn, reconnect_disabled);
+			LOG_POSEIDON_DEBUG("Committed MySQL transaction: statements = ", statements, ", operations = ", group.size());
+			for(AUTO(it, group.begin()); it != group.end(); ++it){
+				const AUTO_REF(operation, (*it)->operation);
+				(*it)->in_transaction = false;
+				(*it)->done = true;
+				if(!operation->is_satisfied()){
+					try {
+						operation->set_success();
+					} catch(std::exception &e){
+						LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+					}
+				}
+			}
+			const std::size_t commit_size = group.size();
+			atomic_add(m_commits, 1, ATOMIC_RELAXED);
+			atomic_add(m_committed_operations, commit_size, ATOMIC_RELAXED);
+			atomic_store(m_last_commit_size, commit_size, ATOMIC_RELAXED);
+			if(atomic_load(m_max_commit_size, ATOMIC_RELAXED) < commit_size){
+				atomic_store(m_max_commit_size, commit_size, ATOMIC_RELAXED);
+			}
+			return true;
+		}
+
+		bool pump_one_operation(boost::shared_ptr<MySql::Connection> &master_conn,
+			boost::shared_ptr<MySql::Connection> &slave_conn) NOEXCEPT
+		{
+			PROFILE_ME;
+
+			const AUTO(now, get_fast_mono_clock());
+			OperationQueueElement *elem;
+			{
+				const Mutex::UniqueLock lock(m_mutex);
+				if(m_queue.empty()){
+					atomic_store(m_urgent, false, ATOMIC_RELAXED);
+					return false;
+				}
+				if(!atomic_load(m_urgent, ATOMIC_CONSUME) && (now < m_queue.front().due_time)){
+					return false;
+				}
+				elem = &m_queue.front();
+			}
+			if(elem->done){
+				const Mutex::UniqueLock lock(m_mutex);
+				m_queue.pop_front();
+				return true;
+			}
+			if(elem->in_flight || (!m_async_slots.empty() && elem->operation->is_write_only())){
+				// 由 dispatch_async_operations() 处理。
+				return false;
+			}
+			if(execute_group_commit(master_conn, now)){
+				return true;
+			}
+			const AUTO_REF(operation, elem->operation);
+			AUTO_REF(conn, elem->operation->should_use_slave() ? slave_conn : master_conn);
+
+			std::string query;
+#ifdef POSEIDON_CXX11
+			std::exception_ptr except;
+#else
+			boost::exception_ptr except;
+#endif
+			long err_code = 0;
+			char err_msg[4096];
+
+			bool execute_it = false;
+			const AUTO(combinable_object, elem->operation->get_combinable_object());
+			if(!combinable_object){
+				execute_it = true;
+			} else {
+				const AUTO(old_write_stamp, combinable_object->get_combined_write_stamp());
+				if(!old_write_stamp){
+					execute_it = true;
+				} else if(old_write_stamp == elem){
+					combinable_object->set_combined_write_stamp(NULLPTR);
+					execute_it = true;
+				}
+			}
+			if(execute_it && !operation->prepare_execution()){
+				LOG_POSEIDON_DEBUG("Nothing to write: table = ", operation->get_table());
+				execute_it = false;
+			}
+			if(execute_it && execute_save_batch(elem, 0, now, conn, NULLPTR)){
+				execute_it = false;
+			}
+			if(execute_it){
+				try {
+					if(!operation->is_prepared()){
+						operation->generate_sql(query);
+						LOG_POSEIDON_DEBUG("Executing SQL: table = ", operation->get_table(), ", query = ", query);
+					} else {
+						LOG_POSEIDON_DEBUG("Executing prepared statement: table = ", operation->get_table());
+					}
+					operation->execute(conn, query);
+				} catch(MySql::Exception &e){
+					LOG_POSEIDON_WARNING("MySql::Exception thrown: code = ", e.get_code(), ", what = ", e.what());
+#ifdef POSEIDON_CXX11
+					except = std::current_exception();
+#else
+					except = boost::copy_exception(e);
+#endif
+					SET_ERR_CODE_AND_MSG(e.get_code(), e.what());
+				} catch(std::exception &e){
+					LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
+#ifdef POSEIDON_CXX11
+					except = std::current_exception();
+#else
+					except = boost::copy_exception(std::runtime_error(e.what()));
+#endif
+					SET_ERR_CODE_AND_MSG(ER_UNKNOWN_ERROR, e.what());
+				} catch(...){
+					LOG_POSEIDON_WARNING("Unknown exception thrown");
+#ifdef POSEIDON_CXX11
+					except = std::current_exception();
+#else
+					except = boost::copy_exception(std::bad_exception());
+#endif
+					SET_ERR_CODE_AND_MSG(ER_UNKNOWN_ERROR, "Unknown exception");
+				}
+				conn->discard_result();
+			}
+			if(except && query.empty()){
+				// 预处理语句没有生成 SQL，转储时需要。
+				try {
+					operation->generate_sql(query);
+				} catch(std::exception &e){
+					LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+				}
+			}
+			if(!complete_operation(elem, now, query, except, err_code, err_msg)){
+				conn.reset();
+				return true;
+			}
 			const Mutex::UniqueLock lock(m_mutex);
 			m_queue.pop_front();
 			return true;
@@ -564,6 +1579,20 @@ namespace {
 			const MySql::ThreadContext thread_context;
 			boost::shared_ptr<MySql::Connection> master_conn, slave_conn;
 
+			if(g_async_connections_per_thread != 0){
+				if(!m_epoll.reset(::epoll_create(4096))){
+					const int err_code = errno;
+					LOG_POSEIDON_FATAL("::epoll_create() failed, errno was ", err_code);
+					std::abort();
+				}
+				AsyncSlot slot;
+				slot.socket = -1;
+				slot.reconn_time = 0;
+				slot.elem = NULLPTR;
+				slot.timeout_time = (boost::uint64_t)-1;
+				m_async_slots.resize(g_async_connections_per_thread, slot);
+			}
+
 			unsigned timeout = 0;
 			for(;;){
 				bool busy;
@@ -571,7 +1600,7 @@ namespace {
 					while(!master_conn){
 						LOG_POSEIDON_INFO("Connecting to MySQL master server...");
 						try {
-							master_conn = real_create_connection(false);
+							master_conn = real_create_connection(false, true);
 							LOG_POSEIDON_INFO("Successfully connected to MySQL master server.");
 						} catch(std::exception &e){
 							LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
@@ -588,7 +1617,7 @@ namespace {
 					while(!slave_conn){
 						LOG_POSEIDON_INFO("Connecting to MySQL slave server...");
 						try {
-							slave_conn = real_create_connection(true);
+							slave_conn = real_create_connection(true, true);
 							LOG_POSEIDON_INFO("Successfully connected to MySQL slave server.");
 						} catch(std::exception &e){
 							LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
@@ -599,9 +1628,19 @@ namespace {
 						}
 					}
 					busy = pump_one_operation(master_conn, slave_conn);
+					if(!m_async_slots.empty()){
+						const AUTO(now, get_fast_mono_clock());
+						busy = dispatch_async_operations(now) || busy;
+						busy = poll_async_operations(now, 0) || busy;
+					}
 					timeout = std::min<unsigned>(timeout * 2u + 1u, !busy * 100u);
 				} while(busy);
 
+				if(m_async_in_flight != 0){
+					// 新的操作最多等待 timeout 毫秒之后被处理。
+					poll_async_operations(get_fast_mono_clock(), timeout);
+					continue;
+				}
 				Mutex::UniqueLock lock(m_mutex);
 				if(m_queue.empty() && !atomic_load(m_running, ATOMIC_CONSUME)){
 					break;
@@ -657,6 +1696,13 @@ namespace {
 			const Mutex::UniqueLock lock(m_mutex);
 			return m_queue.size();
 		}
+		void snapshot_commits(MySqlDaemon::ThreadSnapshotElement &elem) const {
+			elem.commits = atomic_load(m_commits, ATOMIC_RELAXED);
+			elem.committed_operations = atomic_load(m_committed_operations, ATOMIC_RELAXED);
+			elem.last_commit_size = atomic_load(m_last_commit_size, ATOMIC_RELAXED);
+			elem.max_commit_size = atomic_load(m_max_commit_size, ATOMIC_RELAXED);
+			elem.rollbacks = atomic_load(m_rollbacks, ATOMIC_RELAXED);
+		}
 		void add_operation(boost::shared_ptr<OperationBase> operation, bool urgent){
 			PROFILE_ME;
 
@@ -693,62 +1739,149 @@ namespace {
 		boost::shared_ptr<const void> probe;
 		boost::shared_ptr<MySqlThread> thread;
 	};
-	boost::container::flat_map<SharedNts, Route> g_router;
-	boost::container::flat_multimap<std::size_t, std::size_t> g_routing_map;
+	// 未分片的表只有 0 号分片。
+	typedef std::pair<SharedNts, std::size_t> RouteKey;
+	boost::container::flat_map<RouteKey, Route> g_router;
+	// 键的第一个元素表示这个线程上是否已有同一个表的其他分片，这样的线程排在后面。
+	boost::container::flat_multimap<std::pair<bool, std::size_t>, std::size_t> g_routing_map;
 	std::vector<boost::shared_ptr<MySqlThread> > g_threads;
 
-	void submit_operation_by_table(const char *table, boost::shared_ptr<OperationBase> operation, bool urgent){
+	std::size_t get_shard_index(const char *table, std::size_t shard_hash){
+		if((g_shard_count <= 1) || (g_sharded_tables.find(SharedNts::view(table)) == g_sharded_tables.end())){
+			return 0;
+		}
+		// 指针和整数的散列值的低位分布很差，先打散再取模。
+		const AUTO(mixed, static_cast<boost::uint64_t>(shard_hash) * 0x9E3779B97F4A7C15ull);
+		return static_cast<std::size_t>(mixed >> 32) % g_shard_count;
+	}
+
+	// 调用者必须锁定 g_router_mutex。probe 在操作完成之前持有，此时这个分片不会被分配到其他线程上。
+	boost::shared_ptr<MySqlThread> route_shard(const char *table, std::size_t shard, boost::shared_ptr<const void> &probe){
+		AUTO(rit, g_router.find(RouteKey(SharedNts::view(table), shard)));
+		if(rit == g_router.end()){
+			rit = g_router.emplace(RouteKey(SharedNts(table), shard), Route()).first;
+		}
+		AUTO_REF(route, rit->second);
+		if(route.probe.use_count() > 1){
+			probe = route.probe;
+			return route.thread;
+		}
+		if(!route.probe){
+			route.probe = boost::make_shared<int>();
+		}
+		probe = route.probe;
+
+		g_routing_map.clear();
+		g_routing_map.reserve(g_threads.size());
+		for(std::size_t i = 0; i < g_threads.size(); ++i){
+			AUTO_REF(test_thread, g_threads.at(i));
+			if(!test_thread){
+				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+					"Creating new MySQL thread ", i, " for table ", table, ", shard ", shard);
+				test_thread = boost::make_shared<MySqlThread>();
+				test_thread->start();
+				route.thread = test_thread;
+				return route.thread;
+			}
+			bool hosts_sibling = false;
+			for(AUTO(sit, g_router.lower_bound(RouteKey(SharedNts::view(table), 0))); sit != g_router.end(); ++sit){
+				if(std::strcmp(sit->first.first.get(), table) != 0){
+					break;
+				}
+				if((sit->first.second != shard) && (sit->second.probe.use_count() > 1) && (sit->second.thread == test_thread)){
+					hosts_sibling = true;
+					break;
+				}
+			}
+			const AUTO(queue_size, test_thread->get_queue_size());
+			LOG_POSEIDON_DEBUG("> MySQL thread ", i, "'s queue size: ", queue_size, ", hosts_sibling = ", hosts_sibling);
+			g_routing_map.emplace(std::make_pair(hosts_sibling, queue_size), i);
+		}
+		if(g_routing_map.empty()){
+			LOG_POSEIDON_FATAL("No available MySQL thread?!");
+			std::abort();
+		}
+		const AUTO(index, g_routing_map.begin()->second);
+		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
+			"Picking thread ", index, " for table ", table, ", shard ", shard);
+		route.thread = g_threads.at(index);
+		return route.thread;
+	}
+
+	// 对象上的操作按照 ObjectBase::get_shard_hash() 选择分片，同一个键上的操作在同一个线程中按顺序执行。
+	void submit_operation_by_table(const char *table, std::size_t shard_hash, boost::shared_ptr<OperationBase> operation, bool urgent){
 		PROFILE_ME;
 
+		const AUTO(shard, get_shard_index(table, shard_hash));
+
 		boost::shared_ptr<const void> probe;
 		boost::shared_ptr<MySqlThread> thread;
 		{
 			const Mutex::UniqueLock lock(g_router_mutex);
-
-			AUTO_REF(route, g_router[SharedNts::view(table)]);
-			if(route.probe.use_count() > 1){
-				probe = route.probe;
-				thread = route.thread;
-				goto _use_thread;
-			}
-			if(!route.probe){
-				route.probe = boost::make_shared<int>();
-			}
-			probe = route.probe;
-
-			g_routing_map.clear();
-			g_routing_map.reserve(g_threads.size());
-			for(std::size_t i = 0; i < g_threads.size(); ++i){
-				AUTO_REF(test_thread, g_threads.at(i));
-				if(!test_thread){
-					LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-						"Creating new MySQL thread ", i, " for table ", table);
-					thread = boost::make_shared<MySqlThread>();
-					thread->start();
-					test_thread = thread;
-					route.thread = thread;
-					goto _use_thread;
-				}
-				const AUTO(queue_size, test_thread->get_queue_size());
-				LOG_POSEIDON_DEBUG("> MySQL thread ", i, "'s queue size: ", queue_size);
-				g_routing_map.emplace(queue_size, i);
-			}
-			if(g_routing_map.empty()){
-				LOG_POSEIDON_FATAL("No available MySQL thread?!");
-				std::abort();
-			}
-			const AUTO(index, g_routing_map.begin()->second);
-			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
-				"Picking thread ", index, " for table ", table);
-			thread = g_threads.at(index);
-			route.thread = thread;
-		}
-	_use_thread:
+			thread = route_shard(table, shard, probe);
+		}
 		assert(probe);
 		assert(thread);
 		operation->set_probe(STD_MOVE(probe));
 		thread->add_operation(STD_MOVE(operation), urgent);
 	}
+	// 不针对单个对象的操作（按照条件删除、批量加载、底层访问）。分片的表上在所有分片之间建立屏障，
+	// 因此与之前和之后提交的所有分片上的操作保持顺序，代价是执行期间这个表的所有线程都被占用。
+	void submit_operation_by_table_all_shards(const char *table, boost::shared_ptr<OperationBase> operation, bool urgent){
+		PROFILE_ME;
+
+		if((g_shard_count <= 1) || (g_sharded_tables.find(SharedNts::view(table)) == g_sharded_tables.end())){
+			submit_operation_by_table(table, 0, STD_MOVE(operation), urgent);
+			return;
+		}
+
+		// 屏障必须在同一次锁定中加入所有线程，否则两个屏障在不同的线程上可能顺序相反，导致死锁。
+		const Mutex::UniqueLock lock(g_router_mutex);
+
+		// 同一个线程上可能有多个分片，只等待一次。屏障持有所有分片的 probe，执行完之前它们都不会被分配到其他线程上。
+		std::vector<std::pair<boost::shared_ptr<MySqlThread>, std::vector<boost::shared_ptr<const void> > > > threads;
+		for(std::size_t shard = 0; shard < g_shard_count; ++shard){
+			boost::shared_ptr<const void> probe;
+			AUTO(thread, route_shard(table, shard, probe));
+			std::size_t i = 0;
+			while((i < threads.size()) && (threads.at(i).first != thread)){
+				++i;
+			}
+			if(i == threads.size()){
+				threads.resize(i + 1);
+				threads.at(i).first = STD_MOVE(thread);
+			}
+			threads.at(i).second.push_back(STD_MOVE(probe));
+		}
+		// 第一个元素是 0 号分片所在的线程。
+		const AUTO(barrier, boost::make_shared<ShardBarrier>(threads.size() - 1));
+		try {
+			for(std::size_t i = 0; i < threads.size(); ++i){
+				AUTO_REF(thread, threads.at(i).first);
+				const boost::shared_ptr<const void> probes = boost::make_shared<std::vector<boost::shared_ptr<const void> > >(threads.at(i).second);
+				if(i != 0){
+					AUTO(arrive, boost::make_shared<BarrierOperation>(barrier, table, BarrierOperation::ACT_ARRIVE));
+					arrive->set_probe(probes);
+					thread->add_operation(STD_MOVE_IDN(arrive), urgent);
+					continue;
+				}
+				if(threads.size() > 1){
+					AUTO(gate, boost::make_shared<BarrierOperation>(barrier, table, BarrierOperation::ACT_GATE));
+					gate->set_probe(probes);
+					thread->add_operation(STD_MOVE_IDN(gate), urgent);
+				}
+				operation->set_probe(probes);
+				thread->add_operation(STD_MOVE(operation), urgent);
+			}
+			if(threads.size() > 1){
+				AUTO(release, boost::make_shared<BarrierOperation>(barrier, table, BarrierOperation::ACT_RELEASE));
+				threads.front().first->add_operation(STD_MOVE_IDN(release), urgent);
+			}
+		} catch(...){
+			barrier->release();
+			throw;
+		}
+	}
 	void submit_operation_all(boost::shared_ptr<OperationBase> operation, bool urgent){
 		PROFILE_ME;
 
@@ -815,6 +1948,44 @@ void MySqlDaemon::start(){
 	MainConfig::get(g_max_thread_count, "mysql_max_thread_count");
 	LOG_POSEIDON_DEBUG("mysql_max_thread_count = ", g_max_thread_count);
 
+	MainConfig::get(g_save_batch_max_rows, "mysql_save_batch_max_rows");
+	LOG_POSEIDON_DEBUG("mysql_save_batch_max_rows = ", g_save_batch_max_rows);
+
+	MainConfig::get(g_save_batch_max_bytes, "mysql_save_batch_max_bytes");
+	LOG_POSEIDON_DEBUG("mysql_save_batch_max_bytes = ", g_save_batch_max_bytes);
+
+	MainConfig::get(g_use_prepared_statements, "mysql_use_prepared_statements");
+	LOG_POSEIDON_DEBUG("mysql_use_prepared_statements = ", g_use_prepared_statements);
+
+	MainConfig::get(g_max_prepared_statements, "mysql_max_prepared_statements");
+	LOG_POSEIDON_DEBUG("mysql_max_prepared_statements = ", g_max_prepared_statements);
+
+	MainConfig::get(g_async_connections_per_thread, "mysql_async_connections_per_thread");
+	LOG_POSEIDON_DEBUG("mysql_async_connections_per_thread = ", g_async_connections_per_thread);
+	if((g_async_connections_per_thread != 0) && !MySql::Connection::is_nonblocking_supported()){
+		LOG_POSEIDON_WARNING("The MySQL client library does not support non-blocking operations. ",
+			"mysql_async_connections_per_thread is ignored.");
+		g_async_connections_per_thread = 0;
+	}
+
+	MainConfig::get(g_group_commit_max_statements, "mysql_group_commit_max_statements");
+	LOG_POSEIDON_DEBUG("mysql_group_commit_max_statements = ", g_group_commit_max_statements);
+
+	MainConfig::get(g_group_commit_max_time, "mysql_group_commit_max_time");
+	LOG_POSEIDON_DEBUG("mysql_group_commit_max_time = ", g_group_commit_max_time);
+
+	MainConfig::get(g_shard_count, "mysql_shard_count");
+	LOG_POSEIDON_DEBUG("mysql_shard_count = ", g_shard_count);
+	if(g_shard_count == 0){
+		g_shard_count = 1;
+	}
+
+	const AUTO(sharded_tables, MainConfig::get_all<std::string>("mysql_sharded_table"));
+	for(AUTO(it, sharded_tables.begin()); it != sharded_tables.end(); ++it){
+		LOG_POSEIDON_DEBUG("mysql_sharded_table = ", *it);
+		g_sharded_tables.insert(SharedNts(*it));
+	}
+
 	if(!g_dump_dir.empty()){
 		const AUTO(placeholder_path, g_dump_dir + "/placeholder");
 		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
@@ -853,13 +2024,52 @@ void MySqlDaemon::stop(){
 		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Waiting for MySQL thread ", i, " to terminate...");
 		thread->safe_join();
 	}
-	g_threads.clear();
+	{
+		const Mutex::UniqueLock lock(g_router_mutex);
+		g_threads.clear();
+		g_router.clear();
+	}
+	g_sharded_tables.clear();
 
 	LOG_POSEIDON_INFO("MySQL daemon stopped.");
 }
 
 boost::shared_ptr<MySql::Connection> MySqlDaemon::create_connection(bool from_slave){
-	return real_create_connection(from_slave);
+	return real_create_connection(from_slave, false);
+}
+
+void MySqlDaemon::make_snapshot(std::vector<MySqlDaemon::SnapshotElement> &snapshot){
+	const Mutex::UniqueLock lock(g_router_mutex);
+	snapshot.reserve(snapshot.size() + g_router.size());
+	for(AUTO(it, g_router.begin()); it != g_router.end(); ++it){
+		const AUTO_REF(route, it->second);
+		if(!route.thread){
+			continue;
+		}
+		SnapshotElement elem = { };
+		elem.table = it->first.first.get();
+		elem.shard = it->first.second;
+		elem.thread_index = static_cast<std::size_t>(std::find(g_threads.begin(), g_threads.end(), route.thread) - g_threads.begin());
+		elem.pending_operations = static_cast<std::size_t>(std::max<long>(route.probe.use_count() - 1, 0));
+		elem.thread_queue_size = route.thread->get_queue_size();
+		snapshot.push_back(STD_MOVE(elem));
+	}
+}
+
+void MySqlDaemon::make_thread_snapshot(std::vector<MySqlDaemon::ThreadSnapshotElement> &snapshot){
+	const Mutex::UniqueLock lock(g_router_mutex);
+	snapshot.reserve(snapshot.size() + g_threads.size());
+	for(std::size_t i = 0; i < g_threads.size(); ++i){
+		const AUTO_REF(thread, g_threads.at(i));
+		if(!thread){
+			continue;
+		}
+		ThreadSnapshotElement elem = { };
+		elem.thread_index = i;
+		elem.queue_size = thread->get_queue_size();
+		thread->snapshot_commits(elem);
+		snapshot.push_back(elem);
+	}
 }
 
 void MySqlDaemon::wait_for_all_async_operations(){
@@ -877,8 +2087,9 @@ boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_saving(
 {
 	AUTO(promise, boost::make_shared<JobPromise>());
 	const char *const table = object->get_table();
+	const AUTO(shard_hash, object->get_shard_hash());
 	AUTO(operation, boost::make_shared<SaveOperation>(promise, STD_MOVE(object), to_replace));
-	submit_operation_by_table(table, STD_MOVE_IDN(operation), urgent);
+	submit_operation_by_table(table, shard_hash, STD_MOVE_IDN(operation), urgent);
 	return STD_MOVE_IDN(promise);
 }
 boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_loading(
@@ -888,8 +2099,27 @@ boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_loading(
 
 	AUTO(promise, boost::make_shared<JobPromise>());
 	const char *const table = object->get_table();
-	AUTO(operation, boost::make_shared<LoadOperation>(promise, STD_MOVE(object), STD_MOVE(query)));
-	submit_operation_by_table(table, STD_MOVE_IDN(operation), true);
+	const AUTO(shard_hash, object->get_shard_hash());
+	AUTO(operation, boost::make_shared<LoadOperation>(promise, STD_MOVE(object), STD_MOVE(query), MySql::StatementParams(), false));
+	submit_operation_by_table(table, shard_hash, STD_MOVE_IDN(operation), true);
+	return STD_MOVE_IDN(promise);
+}
+boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_deleting(
+	boost::shared_ptr<const MySql::ObjectBase> object)
+{
+	DEBUG_THROW_ASSERT(object->is_updatable());
+
+	// 此后的保存必须写入所有字段，不能使用 UPDATE。
+	object->set_persisted(false);
+
+	AUTO(promise, boost::make_shared<JobPromise>());
+	const char *const table = object->get_table();
+	Buffer_ostream os;
+	os <<"DELETE FROM `" <<table <<"`";
+	object->generate_sql_where(os);
+	const AUTO(shard_hash, object->get_shard_hash());
+	AUTO(operation, boost::make_shared<DeleteOperation>(promise, table, os.get_buffer().dump_string(), MySql::StatementParams(), false));
+	submit_operation_by_table(table, shard_hash, STD_MOVE_IDN(operation), true);
 	return STD_MOVE_IDN(promise);
 }
 boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_deleting(
@@ -899,8 +2129,8 @@ boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_deleting(
 
 	AUTO(promise, boost::make_shared<JobPromise>());
 	const char *const table = table_hint;
-	AUTO(operation, boost::make_shared<DeleteOperation>(promise, table_hint, STD_MOVE(query)));
-	submit_operation_by_table(table, STD_MOVE_IDN(operation), true);
+	AUTO(operation, boost::make_shared<DeleteOperation>(promise, table_hint, STD_MOVE(query), MySql::StatementParams(), false));
+	submit_operation_by_table_all_shards(table, STD_MOVE_IDN(operation), true);
 	return STD_MOVE_IDN(promise);
 }
 boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_batch_loading(
@@ -910,8 +2140,43 @@ boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_batch_loading(
 
 	AUTO(promise, boost::make_shared<JobPromise>());
 	const char *const table = table_hint;
-	AUTO(operation, boost::make_shared<BatchLoadOperation>(promise, STD_MOVE(callback), table_hint, STD_MOVE(query)));
-	submit_operation_by_table(table, STD_MOVE_IDN(operation), true);
+	AUTO(operation, boost::make_shared<BatchLoadOperation>(promise, STD_MOVE(callback), table_hint, STD_MOVE(query), MySql::StatementParams(), false));
+	submit_operation_by_table_all_shards(table, STD_MOVE_IDN(operation), true);
+	return STD_MOVE_IDN(promise);
+}
+
+boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_loading(
+	boost::shared_ptr<MySql::ObjectBase> object, std::string query, MySql::StatementParams params)
+{
+	DEBUG_THROW_ASSERT(!query.empty());
+
+	AUTO(promise, boost::make_shared<JobPromise>());
+	const char *const table = object->get_table();
+	const AUTO(shard_hash, object->get_shard_hash());
+	AUTO(operation, boost::make_shared<LoadOperation>(promise, STD_MOVE(object), STD_MOVE(query), STD_MOVE_IDN(params), true));
+	submit_operation_by_table(table, shard_hash, STD_MOVE_IDN(operation), true);
+	return STD_MOVE_IDN(promise);
+}
+boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_deleting(
+	const char *table_hint, std::string query, MySql::StatementParams params)
+{
+	DEBUG_THROW_ASSERT(!query.empty());
+
+	AUTO(promise, boost::make_shared<JobPromise>());
+	const char *const table = table_hint;
+	AUTO(operation, boost::make_shared<DeleteOperation>(promise, table_hint, STD_MOVE(query), STD_MOVE_IDN(params), true));
+	submit_operation_by_table_all_shards(table, STD_MOVE_IDN(operation), true);
+	return STD_MOVE_IDN(promise);
+}
+boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_batch_loading(
+	QueryCallback callback, const char *table_hint, std::string query, MySql::StatementParams params)
+{
+	DEBUG_THROW_ASSERT(!query.empty());
+
+	AUTO(promise, boost::make_shared<JobPromise>());
+	const char *const table = table_hint;
+	AUTO(operation, boost::make_shared<BatchLoadOperation>(promise, STD_MOVE(callback), table_hint, STD_MOVE(query), STD_MOVE_IDN(params), true));
+	submit_operation_by_table_all_shards(table, STD_MOVE_IDN(operation), true);
 	return STD_MOVE_IDN(promise);
 }
 
@@ -920,7 +2185,7 @@ void MySqlDaemon::enqueue_for_low_level_access(boost::shared_ptr<JobPromise> pro
 {
 	const char *const table = table_hint;
 	AUTO(operation, boost::make_shared<LowLevelAccessOperation>(STD_MOVE(promise), STD_MOVE(callback), table_hint, from_slave));
-	submit_operation_by_table(table, STD_MOVE_IDN(operation), true);
+	submit_operation_by_table_all_shards(table, STD_MOVE_IDN(operation), true);
 }
 
 boost::shared_ptr<const JobPromise> MySqlDaemon::enqueue_for_waiting_for_all_async_operations(){
@@ -8,12 +8,16 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <string>
+#include <vector>
+#include <cstddef>
+#include <boost/cstdint.hpp>
 
 namespace Poseidon {
 
 namespace MySql {
 	class ObjectBase;
 	class Connection;
+	class StatementParams;
 }
 
 class JobPromise;
@@ -25,9 +29,30 @@ private:
 public:
 	typedef boost::function<void (const boost::shared_ptr<MySql::Connection> &)> QueryCallback;
 
+	struct SnapshotElement {
+		std::string table;
+		std::size_t shard;                  // 未分片的表只有 0 号分片。
+		std::size_t thread_index;
+		std::size_t pending_operations;     // 这个分片中尚未完成的操作数。
+		std::size_t thread_queue_size;      // 所在线程的队列长度，包括其他表和分片的操作。
+	};
+
+	struct ThreadSnapshotElement {
+		std::size_t thread_index;
+		std::size_t queue_size;
+		boost::uint64_t commits;                // 成功提交的合并事务数。
+		boost::uint64_t committed_operations;   // 所有合并事务中的操作总数。
+		std::size_t last_commit_size;           // 最近一次提交的事务中的操作数。
+		std::size_t max_commit_size;
+		boost::uint64_t rollbacks;              // 回滚之后改为逐个执行的事务数。
+	};
+
 	static void start();
 	static void stop();
 
+	static void make_snapshot(std::vector<SnapshotElement> &snapshot);
+	static void make_thread_snapshot(std::vector<ThreadSnapshotElement> &snapshot);
+
 	// 同步接口。
 	static boost::shared_ptr<MySql::Connection> create_connection(bool from_slave = false);
 
@@ -38,14 +63,27 @@ public:
 		boost::shared_ptr<const MySql::ObjectBase> object, bool to_replace, bool urgent);
 	static boost::shared_ptr<const JobPromise> enqueue_for_loading(
 		boost::shared_ptr<MySql::ObjectBase> object, std::string query);
+	// 按照主键删除这一行，对象必须声明了 MYSQL_OBJECT_PRIMARY_KEYS。
+	static boost::shared_ptr<const JobPromise> enqueue_for_deleting(
+		boost::shared_ptr<const MySql::ObjectBase> object);
 	static boost::shared_ptr<const JobPromise> enqueue_for_deleting(
 		const char *table_hint, std::string query);
 	static boost::shared_ptr<const JobPromise> enqueue_for_batch_loading(
 		QueryCallback callback, const char *table_hint, std::string query);
 
+	// query 中的 ? 是占位符，使用预处理语句执行，参数和结果都以二进制形式传递。
+	// 语句按照 query 缓存，因此 query 中不应包含会变化的值。
+	static boost::shared_ptr<const JobPromise> enqueue_for_loading(
+		boost::shared_ptr<MySql::ObjectBase> object, std::string query, MySql::StatementParams params);
+	static boost::shared_ptr<const JobPromise> enqueue_for_deleting(
+		const char *table_hint, std::string query, MySql::StatementParams params);
+	static boost::shared_ptr<const JobPromise> enqueue_for_batch_loading(
+		QueryCallback callback, const char *table_hint, std::string query, MySql::StatementParams params);
+
 	static void enqueue_for_low_level_access(boost::shared_ptr<JobPromise> promise, QueryCallback callback,
 		const char *table_hint, bool from_slave = false);
 
+	// 在所有线程上排队，因此也会等待所有分片。
 	static boost::shared_ptr<const JobPromise> enqueue_for_waiting_for_all_async_operations();
 };
 
@@ -5,8 +5,11 @@
 #include "system_http_server.hpp"
 #include "main_config.hpp"
 #include "epoll_daemon.hpp"
+#include "job_dispatcher.hpp"
 #include "module_depository.hpp"
 #include "profile_depository.hpp"
+#include "http_client_pool.hpp"
+#include "mysql_daemon.hpp"
 #include <signal.h>
 #include "../log.hpp"
 #include "../exception.hpp"
@@ -148,6 +151,135 @@ namespace {
 					header.set(sslit("Content-Type"), "text/csv");
 					header.set(sslit("Content-Disposition"), "attachment; name=\"modules.csv\"");
 					send(Http::ST_OK, STD_MOVE(header), StreamBuffer(csv.dump()));
+				} else if(uri == "show_epoll_threads"){
+					CsvDocument csv;
+					boost::container::map<SharedNts, std::string> row;
+					std::vector<EpollDaemon::ThreadSnapshotElement> snapshot;
+					EpollDaemon::make_thread_snapshot(snapshot);
+					for(AUTO(it, snapshot.begin()); it != snapshot.end(); ++it){
+						row[sslit("thread_index")] = boost::lexical_cast<std::string>(it->thread_index);
+						row[sslit("socket_count")] = boost::lexical_cast<std::string>(it->socket_count);
+						row[sslit("iterations")] = boost::lexical_cast<std::string>(it->iterations);
+						row[sslit("sockets_pumped")] = boost::lexical_cast<std::string>(it->sockets_pumped);
+						row[sslit("last_batch_size")] = boost::lexical_cast<std::string>(it->last_batch_size);
+						row[sslit("max_batch_size")] = boost::lexical_cast<std::string>(it->max_batch_size);
+						if(csv.empty()){
+							csv.reset_header(row);
+						}
+						csv.append(row);
+					}
+
+					OptionalMap header;
+					header.set(sslit("Content-Type"), "text/csv");
+					header.set(sslit("Content-Disposition"), "attachment; name=\"epoll_threads.csv\"");
+					send(Http::ST_OK, STD_MOVE(header), StreamBuffer(csv.dump()));
+				} else if(uri == "show_fiber_stacks"){
+					CsvDocument csv;
+					boost::container::map<SharedNts, std::string> row;
+					JobDispatcher::FiberStackSnapshot snapshot;
+					JobDispatcher::make_fiber_stack_snapshot(snapshot);
+					row[sslit("stack_size")] = boost::lexical_cast<std::string>(snapshot.stack_size);
+					row[sslit("stack_count")] = boost::lexical_cast<std::string>(snapshot.stack_count);
+					row[sslit("stack_count_peak")] = boost::lexical_cast<std::string>(snapshot.stack_count_peak);
+					row[sslit("stacks_in_use")] = boost::lexical_cast<std::string>(snapshot.stacks_in_use);
+					row[sslit("stacks_in_use_peak")] = boost::lexical_cast<std::string>(snapshot.stacks_in_use_peak);
+					row[sslit("bytes_mapped")] = boost::lexical_cast<std::string>(snapshot.bytes_mapped);
+					row[sslit("bytes_resident")] = boost::lexical_cast<std::string>(snapshot.bytes_resident);
+					csv.reset_header(row);
+					csv.append(row);
+
+					OptionalMap header;
+					header.set(sslit("Content-Type"), "text/csv");
+					header.set(sslit("Content-Disposition"), "attachment; name=\"fiber_stacks.csv\"");
+					send(Http::ST_OK, STD_MOVE(header), StreamBuffer(csv.dump()));
+				} else if(uri == "show_chunk_pool"){
+					CsvDocument csv;
+					boost::container::map<SharedNts, std::string> row;
+					std::vector<StreamBuffer::ChunkPoolSnapshot> snapshot;
+					StreamBuffer::make_chunk_pool_snapshot(snapshot);
+					for(AUTO(it, snapshot.begin()); it != snapshot.end(); ++it){
+						row[sslit("chunk_capacity")] = boost::lexical_cast<std::string>(it->chunk_capacity);
+						row[sslit("chunks_created")] = boost::lexical_cast<std::string>(it->chunks_created);
+						row[sslit("chunks_destroyed")] = boost::lexical_cast<std::string>(it->chunks_destroyed);
+						row[sslit("chunks_in_global_cache")] = boost::lexical_cast<std::string>(it->chunks_in_global_cache);
+						if(csv.empty()){
+							csv.reset_header(row);
+						}
+						csv.append(row);
+					}
+
+					OptionalMap header;
+					header.set(sslit("Content-Type"), "text/csv");
+					header.set(sslit("Content-Disposition"), "attachment; name=\"chunk_pool.csv\"");
+					send(Http::ST_OK, STD_MOVE(header), StreamBuffer(csv.dump()));
+				} else if(uri == "show_http_client_pool"){
+					CsvDocument csv;
+					boost::container::map<SharedNts, std::string> row;
+					std::vector<HttpClientPool::SnapshotElement> snapshot;
+					HttpClientPool::make_snapshot(snapshot);
+					for(AUTO(it, snapshot.begin()); it != snapshot.end(); ++it){
+						row[sslit("host")] = it->host;
+						row[sslit("port")] = boost::lexical_cast<std::string>(it->port);
+						row[sslit("use_ssl")] = boost::lexical_cast<std::string>(it->use_ssl);
+						row[sslit("idle_count")] = boost::lexical_cast<std::string>(it->idle_count);
+						row[sslit("busy_count")] = boost::lexical_cast<std::string>(it->busy_count);
+						row[sslit("hits")] = boost::lexical_cast<std::string>(it->hits);
+						row[sslit("misses")] = boost::lexical_cast<std::string>(it->misses);
+						row[sslit("retries")] = boost::lexical_cast<std::string>(it->retries);
+						if(csv.empty()){
+							csv.reset_header(row);
+						}
+						csv.append(row);
+					}
+
+					OptionalMap header;
+					header.set(sslit("Content-Type"), "text/csv");
+					header.set(sslit("Content-Disposition"), "attachment; name=\"http_client_pool.csv\"");
+					send(Http::ST_OK, STD_MOVE(header), StreamBuffer(csv.dump()));
+				} else if(uri == "show_mysql_shards"){
+					CsvDocument csv;
+					boost::container::map<SharedNts, std::string> row;
+					std::vector<MySqlDaemon::SnapshotElement> snapshot;
+					MySqlDaemon::make_snapshot(snapshot);
+					for(AUTO(it, snapshot.begin()); it != snapshot.end(); ++it){
+						row[sslit("table")] = it->table;
+						row[sslit("shard")] = boost::lexical_cast<std::string>(it->shard);
+						row[sslit("thread_index")] = boost::lexical_cast<std::string>(it->thread_index);
+						row[sslit("pending_operations")] = boost::lexical_cast<std::string>(it->pending_operations);
+						row[sslit("thread_queue_size")] = boost::lexical_cast<std::string>(it->thread_queue_size);
+						if(csv.empty()){
+							csv.reset_header(row);
+						}
+						csv.append(row);
+					}
+
+					OptionalMap header;
+					header.set(sslit("Content-Type"), "text/csv");
+					header.set(sslit("Content-Disposition"), "attachment; name=\"mysql_shards.csv\"");
+					send(Http::ST_OK, STD_MOVE(header), StreamBuffer(csv.dump()));
+				} else if(uri == "show_mysql_threads"){
+					CsvDocument csv;
+					boost::container::map<SharedNts, std::string> row;
+					std::vector<MySqlDaemon::ThreadSnapshotElement> snapshot;
+					MySqlDaemon::make_thread_snapshot(snapshot);
+					for(AUTO(it, snapshot.begin()); it != snapshot.end(); ++it){
+						row[sslit("thread_index")] = boost::lexical_cast<std::string>(it->thread_index);
+						row[sslit("queue_size")] = boost::lexical_cast<std::string>(it->queue_size);
+						row[sslit("commits")] = boost::lexical_cast<std::string>(it->commits);
+						row[sslit("committed_operations")] = boost::lexical_cast<std::string>(it->committed_operations);
+						row[sslit("last_commit_size")] = boost::lexical_cast<std::string>(it->last_commit_size);
+						row[sslit("max_commit_size")] = boost::lexical_cast<std::string>(it->max_commit_size);
+						row[sslit("rollbacks")] = boost::lexical_cast<std::string>(it->rollbacks);
+						if(csv.empty()){
+							csv.reset_header(row);
+						}
+						csv.append(row);
+					}
+
+					OptionalMap header;
+					header.set(sslit("Content-Type"), "text/csv");
+					header.set(sslit("Content-Disposition"), "attachment; name=\"mysql_threads.csv\"");
+					send(Http::ST_OK, STD_MOVE(header), StreamBuffer(csv.dump()));
 				} else if(uri == "set_log_mask"){
 					const Http::UrlParam to_disable(STD_MOVE(request_header.get_params), "to_disable");
 					const Http::UrlParam to_enable(STD_MOVE(request_header.get_params), "to_enable");
@@ -171,7 +303,7 @@ namespace {
 	public:
 		SystemServer(const IpPort &bind_addr, const char *cert, const char *private_key,
 			std::vector<std::string> user_pass, std::string path)
-			: TcpServerBase(bind_addr, cert, private_key)
+			: TcpServerBase(bind_addr, cert, private_key, Http::LowLevelSession::get_alpn_protocols())
 			, m_auth_info(Http::create_auth_info(STD_MOVE(user_pass))), m_path(STD_MOVE(path))
 		{ }
 
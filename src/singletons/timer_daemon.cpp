@@ -14,24 +14,22 @@
 #include "../job_base.hpp"
 #include "../profiler.hpp"
 #include "../checked_arithmetic.hpp"
+#include "../timer_wheel.hpp"
 
 namespace Poseidon {
 
-struct TimerItem : NONCOPYABLE {
+struct TimerItem : public TimerWheel::Node {
+	boost::weak_ptr<TimerItem> weak_self;
 	boost::uint64_t period;
 	boost::shared_ptr<const TimerCallback> callback;
 	bool low_level;
-	unsigned long stamp;
 
 	TimerItem(boost::uint64_t period_, boost::shared_ptr<const TimerCallback> callback_, bool low_level_)
-		: period(period_), callback(STD_MOVE(callback_)), low_level(low_level_)
-		, stamp(0)
+		: weak_self(), period(period_), callback(STD_MOVE(callback_)), low_level(low_level_)
 	{
 		LOG_POSEIDON_DEBUG("Created timer: period = ", period, ", low_level = ", low_level);
 	}
-	~TimerItem(){
-		LOG_POSEIDON_DEBUG("Destroyed timer: period = ", period, ", low_level = ", low_level);
-	}
+	~TimerItem(); // 从时间轮中摘除。
 };
 
 namespace {
@@ -65,101 +63,99 @@ namespace {
 		}
 	};
 
-	struct TimerQueueElement {
-		boost::uint64_t next;
-		boost::weak_ptr<TimerItem> item;
-		unsigned long stamp;
-
-		TimerQueueElement(boost::uint64_t next_, const boost::shared_ptr<TimerItem> &item_)
-			: next(next_), item(item_), stamp(item_->stamp)
-		{ }
-
-		bool operator<(const TimerQueueElement &rhs) const {
-			return next > rhs.next;
-		}
-	};
-
-	inline void swap(TimerQueueElement &lhs, TimerQueueElement &rhs) NOEXCEPT {
-		using std::swap;
-		swap(lhs.next, rhs.next);
-		swap(lhs.item, rhs.item);
-		swap(lhs.stamp, rhs.stamp);
-	}
-
 	volatile bool g_running = false;
 	Thread g_thread;
 
 	Mutex g_mutex;
 	ConditionVariable g_new_timer;
-	std::vector<TimerQueueElement> g_timers;
+	TimerWheel g_wheel;
+	std::vector<TimerWheel::Node *> g_expired; // 只在计时器线程中使用，避免反复分配内存。
 
-	bool pump_one_element() NOEXCEPT {
+	bool pump_expired_timers() NOEXCEPT {
 		PROFILE_ME;
 
 		const AUTO(now, get_fast_mono_clock());
 
-		boost::shared_ptr<TimerItem> item;
-		{
+		// 计时器的最后一个 shared_ptr 可能在这里释放，而 ~TimerItem() 会锁定 g_mutex，因此这个容器必须在锁外析构。
+		std::vector<boost::shared_ptr<TimerItem> > items;
+		try {
 			const Mutex::UniqueLock lock(g_mutex);
-		_pick_next:
-			if(g_timers.empty()){
-				return false;
-			}
-			if(now < g_timers.front().next){
-				return false;
-			}
-			std::pop_heap(g_timers.begin(), g_timers.end());
-			item = g_timers.back().item.lock();
-			if(!item || (item->stamp != g_timers.back().stamp)){
-				g_timers.pop_back();
-				goto _pick_next;
-			}
-			if(item->period == 0){
-				g_timers.pop_back();
-			} else {
-				g_timers.back().next = saturated_add(g_timers.back().next, item->period);
-				std::push_heap(g_timers.begin(), g_timers.end());
+			g_wheel.advance(now, g_expired);
+			items.reserve(g_expired.size());
+			for(AUTO(it, g_expired.begin()); it != g_expired.end(); ++it){
+				const AUTO(item, static_cast<TimerItem *>(*it));
+				AUTO(ptr, item->weak_self.lock());
+				if(!ptr){
+					// 正在析构。
+					continue;
+				}
+				if(item->period != 0){
+					g_wheel.insert(item, saturated_add(item->get_expiry(), item->period));
+				}
+				items.push_back(STD_MOVE(ptr));
 			}
+			g_expired.clear();
+		} catch(std::exception &e){
+			LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
+			g_expired.clear();
 		}
-		try {
-			if(item->low_level){
-				LOG_POSEIDON_TRACE("Dispatching low level timer: item = ", item);
-				(*item->callback)(item, now, item->period);
-			} else {
-				LOG_POSEIDON_TRACE("Preparing a timer job for dispatching: item = ", item);
-				JobDispatcher::enqueue(boost::make_shared<TimerJob>(item, now), VAL_INIT);
+		for(AUTO(it, items.begin()); it != items.end(); ++it){
+			const AUTO_REF(item, *it);
+			try {
+				if(item->low_level){
+					LOG_POSEIDON_TRACE("Dispatching low level timer: item = ", item);
+					(*item->callback)(item, now, item->period);
+				} else {
+					LOG_POSEIDON_TRACE("Preparing a timer job for dispatching: item = ", item);
+					JobDispatcher::enqueue(boost::make_shared<TimerJob>(item, now), VAL_INIT);
+				}
+			} catch(std::exception &e){
+				LOG_POSEIDON_WARNING("std::exception thrown while dispatching timer job, what = ", e.what());
+			} catch(...){
+				LOG_POSEIDON_WARNING("Unknown exception thrown while dispatching timer job.");
 			}
-		} catch(std::exception &e){
-			LOG_POSEIDON_WARNING("std::exception thrown while dispatching timer job, what = ", e.what());
-		} catch(...){
-			LOG_POSEIDON_WARNING("Unknown exception thrown while dispatching timer job.");
 		}
-		return true;
+		return !items.empty();
 	}
 
 	void thread_proc(){
 		PROFILE_ME;
 		LOG_POSEIDON_INFO("Timer daemon started.");
 
-		unsigned timeout = 0;
 		for(;;){
-			bool busy;
-			do {
-				busy = pump_one_element();
-				timeout = std::min(timeout * 2u + 1u, !busy * 100u);
-			} while(busy);
+			while(pump_expired_timers()){
+				// 回调中可能注册了新的已经到期的计时器。
+			}
 
 			Mutex::UniqueLock lock(g_mutex);
 			if(!atomic_load(g_running, ATOMIC_CONSUME)){
 				break;
 			}
-			g_new_timer.timed_wait(lock, timeout);
+			const AUTO(next, g_wheel.get_next_expiry());
+			if(next == (boost::uint64_t)-1){
+				g_new_timer.wait(lock);
+				continue;
+			}
+			const AUTO(now, get_fast_mono_clock());
+			if(next <= now){
+				continue;
+			}
+			g_new_timer.timed_wait(lock, next - now);
 		}
 
 		LOG_POSEIDON_INFO("Timer daemon stopped.");
 	}
 }
 
+TimerItem::~TimerItem(){
+	LOG_POSEIDON_DEBUG("Destroyed timer: period = ", period, ", low_level = ", low_level);
+
+	const Mutex::UniqueLock lock(g_mutex);
+	if(is_linked()){
+		g_wheel.erase(this);
+	}
+}
+
 void TimerDaemon::start(){
 	if(atomic_exchange(g_running, true, ATOMIC_ACQ_REL) != false){
 		LOG_POSEIDON_FATAL("Only one daemon is allowed at the same time.");
@@ -175,10 +171,16 @@ void TimerDaemon::stop(){
 	}
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO, "Stopping timer daemon...");
 
+	{
+		const Mutex::UniqueLock lock(g_mutex);
+		g_new_timer.signal();
+	}
 	if(g_thread.joinable()){
 		g_thread.join();
 	}
-	g_timers.clear();
+
+	const Mutex::UniqueLock lock(g_mutex);
+	g_wheel.clear();
 }
 
 boost::shared_ptr<TimerItem> TimerDaemon::register_absolute_timer(
@@ -187,10 +189,10 @@ boost::shared_ptr<TimerItem> TimerDaemon::register_absolute_timer(
 	PROFILE_ME;
 
 	AUTO(item, boost::make_shared<TimerItem>(period, boost::make_shared<TimerCallback>(STD_MOVE_IDN(callback)), false));
+	item->weak_self = item;
 	{
 		const Mutex::UniqueLock lock(g_mutex);
-		g_timers.push_back(TimerQueueElement(first, item));
-		std::push_heap(g_timers.begin(), g_timers.end());
+		g_wheel.insert(item.get(), first);
 		g_new_timer.signal();
 	}
 	LOG_POSEIDON_DEBUG("Created a timer which will be triggered ", saturated_sub(first, get_fast_mono_clock()),
@@ -233,10 +235,10 @@ boost::shared_ptr<TimerItem> TimerDaemon::register_low_level_absolute_timer(
 	PROFILE_ME;
 
 	AUTO(item, boost::make_shared<TimerItem>(period, boost::make_shared<TimerCallback>(STD_MOVE_IDN(callback)), true));
+	item->weak_self = item;
 	{
 		const Mutex::UniqueLock lock(g_mutex);
-		g_timers.push_back(TimerQueueElement(first, item));
-		std::push_heap(g_timers.begin(), g_timers.end());
+		g_wheel.insert(item.get(), first);
 		g_new_timer.signal();
 	}
 	LOG_POSEIDON_DEBUG("Created a low level timer which will be triggered ", saturated_sub(first, get_fast_mono_clock()),
@@ -259,9 +261,10 @@ void TimerDaemon::set_absolute_time(const boost::shared_ptr<TimerItem> &item,
 	if(period != PERIOD_NOT_MODIFIED){
 		item->period = period;
 	}
-	g_timers.push_back(TimerQueueElement(first, item)); // may throw std::bad_alloc.
-	g_timers.back().stamp = ++(item->stamp);
-	std::push_heap(g_timers.begin(), g_timers.end());
+	if(item->is_linked()){
+		g_wheel.erase(item.get());
+	}
+	g_wheel.insert(item.get(), first);
 	g_new_timer.signal();
 }
 void TimerDaemon::set_time(const boost::shared_ptr<TimerItem> &item,
@@ -169,5 +169,9 @@ int SocketBase::poll_write(Mutex::UniqueLock &write_lock, bool writeable){
 void SocketBase::on_close(int err_code){
 	(void)err_code;
 }
+boost::uint64_t SocketBase::poll_idle(boost::uint64_t now){
+	(void)now;
+	return (boost::uint64_t)-1;
+}
 
 }
@@ -77,6 +77,8 @@ public:
 	virtual int poll_read_and_process(bool readable);
 	virtual int poll_write(Mutex::UniqueLock &write_lock, bool writeable);
 	virtual void on_close(int err_code);
+	// 返回下一次需要调用这个函数的时间，(boost::uint64_t)-1 表示不需要。
+	virtual boost::uint64_t poll_idle(boost::uint64_t now);
 };
 
 }
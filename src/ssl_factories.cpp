@@ -30,6 +30,24 @@ namespace {
 
 		std::atexit(&uninit_ssl);
 	}
+
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+	int alpn_select_callback(::SSL * /* ssl */, const unsigned char **out, unsigned char *outlen,
+		const unsigned char *in, unsigned inlen, void *arg)
+	{
+		const AUTO(protocols, static_cast<const std::string *>(arg));
+		// 按照我们的优先级选择。没有共同的协议时不回应 ALPN，由对方决定是否继续。
+		unsigned char *selected;
+		if(::SSL_select_next_proto(&selected, outlen,
+			reinterpret_cast<const unsigned char *>(protocols->data()), static_cast<unsigned>(protocols->size()),
+			in, inlen) != OPENSSL_NPN_NEGOTIATED)
+		{
+			return SSL_TLSEXT_ERR_NOACK;
+		}
+		*out = selected;
+		return SSL_TLSEXT_ERR_OK;
+	}
+#endif
 }
 
 SslFactoryBase::SslFactoryBase(){
@@ -45,7 +63,7 @@ void SslFactoryBase::create_ssl(UniqueSsl &ssl) const {
 	ssl.reset(::SSL_new(m_ctx.get()));
 }
 
-ServerSslFactory::ServerSslFactory(const char *cert, const char *private_key)
+ServerSslFactory::ServerSslFactory(const char *cert, const char *private_key, const char *alpn_protocols)
 	: SslFactoryBase()
 {
 	if(!m_ctx.reset(::SSL_CTX_new(::SSLv23_server_method()))){
@@ -76,6 +94,33 @@ ServerSslFactory::ServerSslFactory(const char *cert, const char *private_key)
 	if(::SSL_CTX_set_session_id_context(m_ctx.get(), s_session_id_context, sizeof(s_session_id_context)) != 1){
 		DEBUG_THROW(Exception, sslit("::SSL_CTX_set_session_id_context() failed"));
 	}
+
+	if(alpn_protocols && *alpn_protocols){
+		const char *begin = alpn_protocols;
+		for(;;){
+			const char *end = std::strchr(begin, ',');
+			if(!end){
+				end = begin + std::strlen(begin);
+			}
+			const AUTO(len, static_cast<std::size_t>(end - begin));
+			if((len == 0) || (len > 255)){
+				LOG_POSEIDON_ERROR("Invalid ALPN protocol list: ", alpn_protocols);
+				DEBUG_THROW(Exception, sslit("Invalid ALPN protocol list"));
+			}
+			m_alpn_protocols += static_cast<char>(len);
+			m_alpn_protocols.append(begin, end);
+			if(*end == 0){
+				break;
+			}
+			begin = end + 1;
+		}
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+		LOG_POSEIDON_INFO("Enabling ALPN: ", alpn_protocols);
+		::SSL_CTX_set_alpn_select_cb(m_ctx.get(), &alpn_select_callback, &m_alpn_protocols);
+#else
+		LOG_POSEIDON_WARNING("ALPN is not supported by this OpenSSL version: ", alpn_protocols);
+#endif
+	}
 }
 ServerSslFactory::~ServerSslFactory(){ }
 
@@ -7,6 +7,7 @@
 #include "cxx_ver.hpp"
 #include "cxx_util.hpp"
 #include "ssl_raii.hpp"
+#include <string>
 
 namespace Poseidon {
 
@@ -23,8 +24,12 @@ public:
 };
 
 class ServerSslFactory : public SslFactoryBase {
+private:
+	std::string m_alpn_protocols; // ALPN 的线路格式，每个协议名前面是一个字节的长度。
+
 public:
-	explicit ServerSslFactory(const char *cert, const char *private_key);
+	// alpn_protocols 是逗号分隔的协议名，按照优先级排列，例如 "h2,http/1.1"。为空时不使用 ALPN。
+	ServerSslFactory(const char *cert, const char *private_key, const char *alpn_protocols = "");
 	~ServerSslFactory() OVERRIDE;
 };
 
@@ -54,6 +54,8 @@ SslFilterBase::SslFilterBase(Move<UniqueSsl> ssl, int fd)
 	if(!::SSL_set_fd(m_ssl.get(), fd)){
 		DEBUG_THROW(Exception, sslit("::SSL_set_fd() failed"));
 	}
+	// 重试时数据可能位于不同的地址，但是内容相同。
+	::SSL_set_mode(m_ssl.get(), SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 }
 SslFilterBase::~SslFilterBase(){ }
 
@@ -4,6 +4,9 @@
 #include "precompiled.hpp"
 #include "stream_buffer.hpp"
 #include "checked_arithmetic.hpp"
+#include "atomic.hpp"
+#include "mutex.hpp"
+#include <pthread.h>
 #include <boost/type_traits/common_type.hpp>
 
 namespace Poseidon {
@@ -12,17 +15,202 @@ namespace {
 	// XXX: Emulate C++14 `std::exchange()`.
 	template<typename T>
 	inline T exchange(T &t, typename boost::common_type<T>::type u){
-		AUTO(v, STD_MOVE(t));
+		AUTO(v, STD_MOVE_IDN(t));
 		t = STD_MOVE(u);
 		return v;
 	}
+
+	// 块的容量分为 1KiB 到 64KiB 七个尺寸分类，更大的块直接使用全局分配器。
+	// 第 0 个分类没有数据，用于引用其他块中数据的共享块。
+	// 每个线程为每个分类缓存至多 THREAD_CACHE_BYTES 字节的空闲块，超出时将一半交给全局缓存；
+	// 线程缓存为空时从全局缓存中一次取回一批。这样在 epoll 线程中分配、在任务线程中释放的块也能被重用。
+	CONSTEXPR const unsigned SIZE_CLASS_COUNT = 8;
+	CONSTEXPR const std::size_t MIN_CLASS_CAPACITY = 1024;
+	CONSTEXPR const std::size_t THREAD_CACHE_BYTES = 1048576;
+	CONSTEXPR const std::size_t GLOBAL_CACHE_BYTES = 16777216;
+
+	// 短于这个长度的数据在复制时不共享，而是直接复制。
+	CONSTEXPR const std::size_t SHARE_THRESHOLD = 256;
+
+	std::size_t get_class_capacity(unsigned size_class) NOEXCEPT {
+		return (size_class == 0) ? 0 : (MIN_CLASS_CAPACITY << (size_class - 1));
+	}
+	std::size_t get_thread_cache_limit(unsigned size_class) NOEXCEPT {
+		return THREAD_CACHE_BYTES / std::max(get_class_capacity(size_class), MIN_CLASS_CAPACITY);
+	}
+	std::size_t get_global_cache_limit(unsigned size_class) NOEXCEPT {
+		return GLOBAL_CACHE_BYTES / std::max(get_class_capacity(size_class), MIN_CLASS_CAPACITY);
+	}
+
+	struct FreeBlock {
+		FreeBlock *next;
+	};
+
+	struct GlobalCache {
+		Mutex mutex;
+		FreeBlock *head;
+		std::size_t count;
+
+		GlobalCache()
+			: head(NULLPTR), count(0)
+		{ }
+	};
+
+	struct ThreadCache {
+		bool registered;
+		FreeBlock *heads[SIZE_CLASS_COUNT];
+		std::size_t counts[SIZE_CLASS_COUNT];
+	};
+
+	volatile bool g_pool_enabled = true;
+
+	// 下标 SIZE_CLASS_COUNT 用于不经过内存池的块。
+	volatile boost::uint64_t g_blocks_created[SIZE_CLASS_COUNT + 1];
+	volatile boost::uint64_t g_blocks_destroyed[SIZE_CLASS_COUNT + 1];
+
+	GlobalCache g_global_caches[SIZE_CLASS_COUNT];
+
+	::pthread_once_t g_cache_key_once = PTHREAD_ONCE_INIT;
+	::pthread_key_t g_cache_key;
+
+	__thread ThreadCache t_cache;
+
+	void *create_block(unsigned size_class, std::size_t size){
+		const AUTO(block, ::operator new(size));
+		atomic_add(g_blocks_created[size_class], 1, ATOMIC_RELAXED);
+		return block;
+	}
+	void destroy_block(unsigned size_class, void *block) NOEXCEPT {
+		::operator delete(block);
+		atomic_add(g_blocks_destroyed[size_class], 1, ATOMIC_RELAXED);
+	}
+
+	// 将链表中的 count 个块交给全局缓存，全局缓存满了之后剩下的块被释放。
+	void return_to_global_cache(unsigned size_class, FreeBlock *head, std::size_t count) NOEXCEPT {
+		AUTO_REF(global, g_global_caches[size_class]);
+		{
+			const Mutex::UniqueLock lock(global.mutex);
+			const std::size_t limit = get_global_cache_limit(size_class);
+			while(head && (global.count < limit)){
+				const AUTO(next, head->next);
+				head->next = global.head;
+				global.head = head;
+				global.count += 1;
+				head = next;
+				--count;
+			}
+		}
+		while(head){
+			const AUTO(next, head->next);
+			destroy_block(size_class, head);
+			head = next;
+		}
+	}
+
+	void flush_thread_cache(void *param) NOEXCEPT {
+		const AUTO(cache, static_cast<ThreadCache *>(param));
+		for(unsigned i = 0; i < SIZE_CLASS_COUNT; ++i){
+			return_to_global_cache(i, cache->heads[i], cache->counts[i]);
+			cache->heads[i] = NULLPTR;
+			cache->counts[i] = 0;
+		}
+		cache->registered = false;
+	}
+	void create_cache_key() NOEXCEPT {
+		if(::pthread_key_create(&g_cache_key, &flush_thread_cache) != 0){
+			std::abort();
+		}
+	}
+
+	// 线程退出时把缓存中的块交给全局缓存。
+	ThreadCache &get_thread_cache() NOEXCEPT {
+		AUTO_REF(cache, t_cache);
+		if(!cache.registered){
+			::pthread_once(&g_cache_key_once, &create_cache_key);
+			::pthread_setspecific(g_cache_key, &cache);
+			cache.registered = true;
+		}
+		return cache;
+	}
+
+	void *allocate_block(unsigned size_class, std::size_t size){
+		if(size_class >= SIZE_CLASS_COUNT){
+			return create_block(SIZE_CLASS_COUNT, size);
+		}
+		AUTO_REF(cache, get_thread_cache());
+		AUTO_REF(head, cache.heads[size_class]);
+		AUTO_REF(count, cache.counts[size_class]);
+		if(!head){
+			AUTO_REF(global, g_global_caches[size_class]);
+			const Mutex::UniqueLock lock(global.mutex);
+			const std::size_t batch = get_thread_cache_limit(size_class) / 2;
+			while(global.head && (count < batch)){
+				const AUTO(block, global.head);
+				global.head = block->next;
+				global.count -= 1;
+				block->next = head;
+				head = block;
+				count += 1;
+			}
+		}
+		if(!head){
+			return create_block(size_class, size);
+		}
+		const AUTO(block, head);
+		head = block->next;
+		count -= 1;
+		return block;
+	}
+	void deallocate_block(unsigned size_class, void *ptr) NOEXCEPT {
+		if(size_class >= SIZE_CLASS_COUNT){
+			destroy_block(SIZE_CLASS_COUNT, ptr);
+			return;
+		}
+		AUTO_REF(cache, get_thread_cache());
+		AUTO_REF(head, cache.heads[size_class]);
+		AUTO_REF(count, cache.counts[size_class]);
+		const AUTO(block, static_cast<FreeBlock *>(ptr));
+		block->next = head;
+		head = block;
+		count += 1;
+		const std::size_t limit = get_thread_cache_limit(size_class);
+		if(count <= limit){
+			return;
+		}
+		// 保留前一半，后一半交给全局缓存。
+		const std::size_t kept = limit / 2;
+		AUTO(last_kept, head);
+		for(std::size_t i = 1; i < kept; ++i){
+			last_kept = last_kept->next;
+		}
+		const AUTO(released, last_kept->next);
+		last_kept->next = NULLPTR;
+		const std::size_t released_count = count - kept;
+		count = kept;
+		return_to_global_cache(size_class, released, released_count);
+	}
 }
 
+// 每个块都拥有一块存储，storage 指向自身；共享块没有自己的存储，storage 指向被共享的块。
+// refs 是存储的引用计数，只在 storage 指向的块中有意义。被共享的存储是只读的，只有独占的块才能写入。
 struct StreamBuffer::ChunkHeader {
 	static ChunkHeader *create(std::size_t min_capacity, ChunkHeader *prev, ChunkHeader *next, bool backward){
-		const std::size_t capacity = min_capacity | 1024;
+		unsigned size_class = SIZE_CLASS_COUNT;
+		std::size_t capacity = min_capacity | 1024;
+		if(atomic_load(g_pool_enabled, ATOMIC_RELAXED)){
+			for(unsigned i = 1; i < SIZE_CLASS_COUNT; ++i){
+				if(min_capacity <= get_class_capacity(i)){
+					size_class = i;
+					capacity = get_class_capacity(i);
+					break;
+				}
+			}
+		}
 		const std::size_t origin = backward ? capacity : 0;
-		const AUTO(chunk, static_cast<ChunkHeader *>(::operator new(checked_add(sizeof(ChunkHeader), capacity))));
+		const AUTO(chunk, static_cast<ChunkHeader *>(allocate_block(size_class, checked_add(sizeof(ChunkHeader), capacity))));
+		chunk->size_class = size_class;
+		chunk->refs = 1;
+		chunk->storage = chunk;
 		chunk->capacity = capacity;
 		chunk->prev = prev;
 		chunk->next = next;
@@ -30,10 +218,34 @@ struct StreamBuffer::ChunkHeader {
 		chunk->end = origin;
 		return chunk;
 	}
+	static ChunkHeader *create_shared(const ChunkHeader *source, std::size_t begin, std::size_t end, ChunkHeader *prev, ChunkHeader *next){
+		const unsigned size_class = atomic_load(g_pool_enabled, ATOMIC_RELAXED) ? 0 : SIZE_CLASS_COUNT;
+		const AUTO(chunk, static_cast<ChunkHeader *>(allocate_block(size_class, sizeof(ChunkHeader))));
+		const AUTO(storage, source->storage);
+		atomic_add(storage->refs, 1, ATOMIC_RELAXED);
+		chunk->size_class = size_class;
+		chunk->refs = 0;
+		chunk->storage = storage;
+		chunk->capacity = storage->capacity;
+		chunk->prev = prev;
+		chunk->next = next;
+		chunk->begin = begin;
+		chunk->end = end;
+		return chunk;
+	}
 	static void destroy(ChunkHeader *chunk) NOEXCEPT {
-		::operator delete(chunk);
+		const AUTO(storage, chunk->storage);
+		if(storage != chunk){
+			deallocate_block(chunk->size_class, chunk);
+		}
+		if(atomic_sub(storage->refs, 1, ATOMIC_ACQ_REL) == 0){
+			deallocate_block(storage->size_class, storage);
+		}
 	}
 
+	unsigned size_class;
+	volatile std::size_t refs;
+	ChunkHeader *storage;
 	std::size_t capacity;
 	ChunkHeader *prev;
 	ChunkHeader *next;
@@ -41,8 +253,35 @@ struct StreamBuffer::ChunkHeader {
 	std::size_t begin;
 	std::size_t end;
 	__extension__ unsigned char data[];
+
+	unsigned char *get_data() const NOEXCEPT {
+		return storage->data;
+	}
+	bool is_exclusive() const NOEXCEPT {
+		return (storage == this) && (atomic_load(refs, ATOMIC_ACQUIRE) == 1);
+	}
 };
 
+void StreamBuffer::make_chunk_pool_snapshot(std::vector<StreamBuffer::ChunkPoolSnapshot> &snapshot){
+	snapshot.reserve(snapshot.size() + SIZE_CLASS_COUNT + 1);
+	for(unsigned i = 0; i <= SIZE_CLASS_COUNT; ++i){
+		ChunkPoolSnapshot elem = { };
+		elem.chunk_capacity = (std::size_t)-1;
+		if(i < SIZE_CLASS_COUNT){
+			elem.chunk_capacity = get_class_capacity(i);
+			AUTO_REF(global, g_global_caches[i]);
+			const Mutex::UniqueLock lock(global.mutex);
+			elem.chunks_in_global_cache = global.count;
+		}
+		elem.chunks_created = atomic_load(g_blocks_created[i], ATOMIC_RELAXED);
+		elem.chunks_destroyed = atomic_load(g_blocks_destroyed[i], ATOMIC_RELAXED);
+		snapshot.push_back(elem);
+	}
+}
+void StreamBuffer::set_chunk_pool_enabled(bool enabled) NOEXCEPT {
+	atomic_store(g_pool_enabled, enabled, ATOMIC_RELAXED);
+}
+
 StreamBuffer::StreamBuffer(const void *data, std::size_t count)
 	: m_first(NULLPTR), m_last(NULLPTR), m_size(0)
 {
@@ -66,20 +305,18 @@ StreamBuffer::StreamBuffer(const std::basic_string<unsigned char> &str)
 StreamBuffer::StreamBuffer(const StreamBuffer &rhs)
 	: m_first(NULLPTR), m_last(NULLPTR), m_size(0)
 {
+	StreamBuffer temp;
 	AUTO(chunk, rhs.m_first);
-	if(!chunk){
-		return;
-	}
-	const AUTO(integral, ChunkHeader::create(rhs.m_size, NULLPTR, NULLPTR, false));
 	while(chunk){
 		const std::size_t avail = chunk->end - chunk->begin;
-		std::memcpy(integral->data + integral->end, chunk->data + chunk->begin, avail);
-		integral->end += avail;
+		if(avail >= SHARE_THRESHOLD){
+			temp.append_shared(chunk, chunk->begin, chunk->end);
+		} else if(avail != 0){
+			temp.put(chunk->get_data() + chunk->begin, avail);
+		}
 		chunk = chunk->next;
 	}
-	m_first = integral;
-	m_last = integral;
-	m_size = rhs.m_size;
+	swap(temp);
 }
 StreamBuffer::~StreamBuffer(){
 	AUTO(chunk, m_first);
@@ -110,7 +347,7 @@ int StreamBuffer::front() const NOEXCEPT {
 	AUTO(chunk, m_first);
 	while(chunk){
 		if(chunk->end != chunk->begin){
-			read = chunk->data[chunk->begin];
+			read = chunk->get_data()[chunk->begin];
 			break;
 		}
 		const AUTO(next, chunk->next);
@@ -123,7 +360,7 @@ int StreamBuffer::get() NOEXCEPT {
 	AUTO(chunk, m_first);
 	while(chunk){
 		if(chunk->end != chunk->begin){
-			read = chunk->data[chunk->begin];
+			read = chunk->get_data()[chunk->begin];
 			chunk->begin += 1;
 			m_size -= 1;
 			break;
@@ -157,10 +394,13 @@ bool StreamBuffer::discard() NOEXCEPT {
 void StreamBuffer::put(unsigned char data){
 	AUTO(chunk, m_last);
 	AUTO(prev, chunk);
+	if(chunk && !chunk->is_exclusive()){
+		chunk = NULLPTR;
+	}
 	if(chunk && (chunk->capacity == chunk->end)){
 		const std::size_t avail = chunk->end - chunk->begin;
 		if(chunk->capacity > avail){
-			std::memmove(chunk->data, chunk->data + chunk->begin, avail);
+			std::memmove(chunk->get_data(), chunk->get_data() + chunk->begin, avail);
 			chunk->begin = 0;
 			chunk->end = avail;
 		} else {
@@ -173,7 +413,7 @@ void StreamBuffer::put(unsigned char data){
 		m_last = next;
 		chunk = next;
 	}
-	chunk->data[chunk->end] = data;
+	chunk->get_data()[chunk->end] = data;
 	chunk->end += 1;
 	m_size += 1;
 }
@@ -182,7 +422,7 @@ int StreamBuffer::back() const NOEXCEPT {
 	AUTO(chunk, m_last);
 	while(chunk){
 		if(chunk->end != chunk->begin){
-			read = chunk->data[chunk->end - 1];
+			read = chunk->get_data()[chunk->end - 1];
 			break;
 		}
 		const AUTO(prev, chunk->prev);
@@ -195,7 +435,7 @@ int StreamBuffer::unput() NOEXCEPT {
 	AUTO(chunk, m_last);
 	while(chunk){
 		if(chunk->end != chunk->begin){
-			read = chunk->data[chunk->end - 1];
+			read = chunk->get_data()[chunk->end - 1];
 			chunk->end -= 1;
 			m_size -= 1;
 			break;
@@ -211,10 +451,13 @@ int StreamBuffer::unput() NOEXCEPT {
 void StreamBuffer::unget(unsigned char data){
 	AUTO(chunk, m_first);
 	AUTO(next, chunk);
+	if(chunk && !chunk->is_exclusive()){
+		chunk = NULLPTR;
+	}
 	if(chunk && (chunk->begin == 0)){
 		const std::size_t avail = chunk->end - chunk->begin;
 		if(chunk->capacity > avail){
-			std::memmove(chunk->data + chunk->begin + (chunk->capacity - chunk->end), chunk->data + chunk->begin, avail);
+			std::memmove(chunk->get_data() + chunk->begin + (chunk->capacity - chunk->end), chunk->get_data() + chunk->begin, avail);
 			chunk->begin = chunk->capacity - avail;
 			chunk->end = chunk->capacity;
 		} else {
@@ -227,7 +470,7 @@ void StreamBuffer::unget(unsigned char data){
 		m_first = prev;
 		chunk = prev;
 	}
-	chunk->data[chunk->begin - 1] = data;
+	chunk->get_data()[chunk->begin - 1] = data;
 	chunk->begin -= 1;
 	m_size += 1;
 }
@@ -242,11 +485,11 @@ std::size_t StreamBuffer::peek(void *data, std::size_t count) const NOEXCEPT {
 		}
 		const std::size_t avail = chunk->end - chunk->begin;
 		if(avail >= remaining){
-			std::memcpy(static_cast<unsigned char *>(data) + total, chunk->data + chunk->begin, remaining);
+			std::memcpy(static_cast<unsigned char *>(data) + total, chunk->get_data() + chunk->begin, remaining);
 			total += remaining;
 			break;
 		}
-		std::memcpy(static_cast<unsigned char *>(data) + total, chunk->data + chunk->begin, avail);
+		std::memcpy(static_cast<unsigned char *>(data) + total, chunk->get_data() + chunk->begin, avail);
 		total += avail;
 		const AUTO(next, chunk->next);
 		chunk = next;
@@ -263,13 +506,13 @@ std::size_t StreamBuffer::get(void *data, std::size_t count) NOEXCEPT {
 		}
 		const std::size_t avail = chunk->end - chunk->begin;
 		if(avail >= remaining){
-			std::memcpy(static_cast<unsigned char *>(data) + total, chunk->data + chunk->begin, remaining);
+			std::memcpy(static_cast<unsigned char *>(data) + total, chunk->get_data() + chunk->begin, remaining);
 			chunk->begin += remaining;
 			m_size -= remaining;
 			total += remaining;
 			break;
 		}
-		std::memcpy(static_cast<unsigned char *>(data) + total, chunk->data + chunk->begin, avail);
+		std::memcpy(static_cast<unsigned char *>(data) + total, chunk->get_data() + chunk->begin, avail);
 		chunk->begin += avail;
 		m_size -= avail;
 		total += avail;
@@ -310,10 +553,13 @@ std::size_t StreamBuffer::discard(std::size_t count) NOEXCEPT {
 void StreamBuffer::put(unsigned char data, std::size_t count){
 	AUTO(chunk, m_last);
 	AUTO(prev, chunk);
+	if(chunk && !chunk->is_exclusive()){
+		chunk = NULLPTR;
+	}
 	if(chunk && (chunk->capacity - chunk->end < count)){
 		const std::size_t avail = chunk->end - chunk->begin;
 		if(chunk->capacity - avail >= count){
-			std::memmove(chunk->data, chunk->data + chunk->begin, avail);
+			std::memmove(chunk->get_data(), chunk->get_data() + chunk->begin, avail);
 			chunk->begin = 0;
 			chunk->end = avail;
 		} else {
@@ -326,17 +572,20 @@ void StreamBuffer::put(unsigned char data, std::size_t count){
 		chunk = next;
 		m_last = next;
 	}
-	std::memset(chunk->data + chunk->end, data, count);
+	std::memset(chunk->get_data() + chunk->end, data, count);
 	chunk->end += count;
 	m_size += count;
 }
 void StreamBuffer::put(const void *data, std::size_t count){
 	AUTO(chunk, m_last);
 	AUTO(prev, chunk);
+	if(chunk && !chunk->is_exclusive()){
+		chunk = NULLPTR;
+	}
 	if(chunk && (chunk->capacity - chunk->end < count)){
 		const std::size_t avail = chunk->end - chunk->begin;
 		if(chunk->capacity - avail >= count){
-			std::memmove(chunk->data, chunk->data + chunk->begin, avail);
+			std::memmove(chunk->get_data(), chunk->get_data() + chunk->begin, avail);
 			chunk->begin = 0;
 			chunk->end = avail;
 		} else {
@@ -349,7 +598,44 @@ void StreamBuffer::put(const void *data, std::size_t count){
 		chunk = next;
 		m_last = next;
 	}
-	std::memcpy(chunk->data + chunk->end, data, count);
+	std::memcpy(chunk->get_data() + chunk->end, data, count);
+	chunk->end += count;
+	m_size += count;
+}
+void *StreamBuffer::reserve(std::size_t *count, std::size_t min_count){
+	AUTO(chunk, m_last);
+	AUTO(prev, chunk);
+	if(chunk && !chunk->is_exclusive()){
+		chunk = NULLPTR;
+	}
+	if(chunk && (chunk->capacity - chunk->end < min_count)){
+		const std::size_t avail = chunk->end - chunk->begin;
+		if(chunk->capacity - avail >= min_count){
+			std::memmove(chunk->get_data(), chunk->get_data() + chunk->begin, avail);
+			chunk->begin = 0;
+			chunk->end = avail;
+		} else {
+			chunk = NULLPTR;
+		}
+	}
+	if(!chunk){
+		const AUTO(next, ChunkHeader::create(min_count, prev, NULLPTR, false));
+		(prev ? prev->next : m_first) = next;
+		chunk = next;
+		m_last = next;
+	}
+	if(count){
+		*count = chunk->capacity - chunk->end;
+	}
+	return chunk->get_data() + chunk->end;
+}
+void StreamBuffer::commit(std::size_t count) NOEXCEPT {
+	const AUTO(chunk, m_last);
+	if(!chunk){
+		assert(count == 0);
+		return;
+	}
+	assert(chunk->capacity - chunk->end >= count);
 	chunk->end += count;
 	m_size += count;
 }
@@ -359,11 +645,21 @@ void *StreamBuffer::squash(){
 	if(!chunk){
 		return NULLPTR;
 	}
-	if(chunk != m_last){
-		StreamBuffer(*this).swap(*this);
-		chunk = m_first;
+	if((chunk != m_last) || !chunk->is_exclusive()){
+		const AUTO(integral, ChunkHeader::create(m_size, NULLPTR, NULLPTR, false));
+		while(chunk){
+			const std::size_t avail = chunk->end - chunk->begin;
+			std::memcpy(integral->get_data() + integral->end, chunk->get_data() + chunk->begin, avail);
+			integral->end += avail;
+			const AUTO(next, chunk->next);
+			ChunkHeader::destroy(chunk);
+			chunk = next;
+		}
+		m_first = integral;
+		m_last = integral;
+		chunk = integral;
 	}
-	return chunk->data + chunk->begin;
+	return chunk->get_data() + chunk->begin;
 }
 
 StreamBuffer StreamBuffer::cut_off(std::size_t count){
@@ -379,9 +675,13 @@ StreamBuffer StreamBuffer::cut_off(std::size_t count){
 			if(avail > remaining){
 				const AUTO(prev, chunk->prev);
 				const AUTO(next, chunk);
-				chunk = ChunkHeader::create(remaining, prev, next, false);
-				std::memcpy(chunk->data, next->data + next->begin, remaining);
-				chunk->end = remaining;
+				if(remaining >= SHARE_THRESHOLD){
+					chunk = ChunkHeader::create_shared(next, next->begin, next->begin + remaining, prev, next);
+				} else {
+					chunk = ChunkHeader::create(remaining, prev, next, false);
+					std::memcpy(chunk->get_data(), next->get_data() + next->begin, remaining);
+					chunk->end = remaining;
+				}
 				next->begin += remaining;
 				(prev ? prev->next : m_first) = chunk;
 				next->prev = chunk;
@@ -406,6 +706,13 @@ StreamBuffer StreamBuffer::cut_off(std::size_t count){
 	}
 	return head;
 }
+void StreamBuffer::append_shared(const ChunkHeader *source, std::size_t begin, std::size_t end){
+	const AUTO(prev, m_last);
+	const AUTO(chunk, ChunkHeader::create_shared(source, begin, end, prev, NULLPTR));
+	(prev ? prev->next : m_first) = chunk;
+	m_last = chunk;
+	m_size += end - begin;
+}
 void StreamBuffer::splice(StreamBuffer &rhs) NOEXCEPT {
 	assert(&rhs != this);
 
@@ -426,21 +733,32 @@ bool StreamBuffer::enumerate_chunk(const void **data, std::size_t *count, Stream
 		return false;
 	}
 	if(data){
-		*data = chunk->data + chunk->begin;
+		*data = chunk->get_data() + chunk->begin;
 	}
 	if(count){
 		*count = chunk->end - chunk->begin;
 	}
 	return true;
 }
-bool StreamBuffer::enumerate_chunk(void **data, std::size_t *count, StreamBuffer::EnumerationCookie &cookie) NOEXCEPT {
-	const AUTO(chunk, cookie.prev ? cookie.prev->next : m_first);
+bool StreamBuffer::enumerate_chunk(void **data, std::size_t *count, StreamBuffer::EnumerationCookie &cookie){
+	AUTO(chunk, cookie.prev ? cookie.prev->next : m_first);
+	if(chunk && !chunk->is_exclusive()){
+		// 调用者可能写入数据，因此共享的块需要先复制一份。
+		const std::size_t avail = chunk->end - chunk->begin;
+		const AUTO(copy, ChunkHeader::create(avail, chunk->prev, chunk->next, false));
+		std::memcpy(copy->get_data(), chunk->get_data() + chunk->begin, avail);
+		copy->end = avail;
+		(chunk->prev ? chunk->prev->next : m_first) = copy;
+		(chunk->next ? chunk->next->prev : m_last) = copy;
+		ChunkHeader::destroy(chunk);
+		chunk = copy;
+	}
 	cookie.prev = chunk;
 	if(!chunk){
 		return false;
 	}
 	if(data){
-		*data = chunk->data + chunk->begin;
+		*data = chunk->get_data() + chunk->begin;
 	}
 	if(count){
 		*count = chunk->end - chunk->begin;
@@ -454,7 +772,7 @@ std::string StreamBuffer::dump_string() const {
 	AUTO(chunk, m_first);
 	while(chunk){
 		const std::size_t avail = chunk->end - chunk->begin;
-		str.append(reinterpret_cast<const char *>(chunk->data + chunk->begin), avail);
+		str.append(reinterpret_cast<const char *>(chunk->get_data() + chunk->begin), avail);
 		chunk = chunk->next;
 	}
 	return str;
@@ -465,7 +783,7 @@ std::basic_string<unsigned char> StreamBuffer::dump_byte_string() const {
 	AUTO(chunk, m_first);
 	while(chunk){
 		const std::size_t avail = chunk->end - chunk->begin;
-		str.append(chunk->data + chunk->begin, avail);
+		str.append(chunk->get_data() + chunk->begin, avail);
 		chunk = chunk->next;
 	}
 	return str;
@@ -474,7 +792,7 @@ void StreamBuffer::dump(std::ostream &os) const {
 	AUTO(chunk, m_first);
 	while(chunk){
 		const std::size_t avail = chunk->end - chunk->begin;
-		os.write(reinterpret_cast<const char *>(chunk->data + chunk->begin), static_cast<std::streamsize>(avail));
+		os.write(reinterpret_cast<const char *>(chunk->get_data() + chunk->begin), static_cast<std::streamsize>(avail));
 		chunk = chunk->next;
 	}
 }
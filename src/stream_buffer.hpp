@@ -11,6 +11,8 @@
 #include <iosfwd>
 #include <cstring>
 #include <cstddef>
+#include <vector>
+#include <boost/cstdint.hpp>
 
 namespace Poseidon {
 
@@ -36,11 +38,25 @@ public:
 	class ReadIterator;
 	class WriteIterator;
 
+	struct ChunkPoolSnapshot {
+		std::size_t chunk_capacity;         // 0 表示共享块，(std::size_t)-1 表示不经过内存池的块。
+		boost::uint64_t chunks_created;     // 从全局分配器分配的块数。
+		boost::uint64_t chunks_destroyed;   // 释放给全局分配器的块数。
+		std::size_t chunks_in_global_cache; // 不含各个线程缓存中的块。
+	};
+
+	static void make_chunk_pool_snapshot(std::vector<ChunkPoolSnapshot> &snapshot);
+	// 关闭之后新的块直接从全局分配器分配。用于性能比较。
+	static void set_chunk_pool_enabled(bool enabled) NOEXCEPT;
+
 private:
 	ChunkHeader *m_first;
 	ChunkHeader *m_last;
 	std::size_t m_size;
 
+private:
+	void append_shared(const ChunkHeader *source, std::size_t begin, std::size_t end);
+
 public:
 	CONSTEXPR StreamBuffer() NOEXCEPT
 		: m_first(NULLPTR), m_last(NULLPTR), m_size(0)
@@ -49,6 +65,7 @@ public:
 	explicit StreamBuffer(const char *str);
 	explicit StreamBuffer(const std::string &str);
 	explicit StreamBuffer(const std::basic_string<unsigned char> &str);
+	// 复制和 cut_off() 共享不短于 256 字节的块而不复制数据。共享的块是只读的，向其追加数据时会分配新的块。
 	StreamBuffer(const StreamBuffer &rhs);
 	StreamBuffer &operator=(const StreamBuffer &rhs){
 		StreamBuffer(rhs).swap(*this);
@@ -102,6 +119,11 @@ public:
 		put(str.data(), str.size());
 	}
 
+	// 返回末尾一段不少于 min_count 字节的连续可写空间，实际长度写入 *count。
+	// 写入之后调用 commit() 将其中的前若干字节加入缓冲区。在此之间不得以其他方式修改缓冲区。
+	void *reserve(std::size_t *count, std::size_t min_count);
+	void commit(std::size_t count) NOEXCEPT;
+
 	void *squash();
 
 	StreamBuffer cut_off(std::size_t count);
@@ -113,7 +135,8 @@ public:
 #endif
 
 	bool enumerate_chunk(const void **data, std::size_t *count, EnumerationCookie &cookie) const NOEXCEPT;
-	bool enumerate_chunk(void **data, std::size_t *count, EnumerationCookie &cookie) NOEXCEPT;
+	// 共享的块会被复制，因此可能抛出异常。
+	bool enumerate_chunk(void **data, std::size_t *count, EnumerationCookie &cookie);
 
 	void swap(StreamBuffer &rhs) NOEXCEPT {
 		using std::swap;
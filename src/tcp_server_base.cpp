@@ -12,7 +12,6 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <openssl/ssl.h>
-#include "singletons/main_config.hpp"
 #include "singletons/epoll_daemon.hpp"
 #include "log.hpp"
 #include "system_exception.hpp"
@@ -59,11 +58,11 @@ namespace {
 	}
 }
 
-TcpServerBase::TcpServerBase(const SockAddr &addr, const char *cert, const char *private_key)
+TcpServerBase::TcpServerBase(const SockAddr &addr, const char *cert, const char *private_key, const char *alpn_protocols)
 	: SocketBase(create_tcp_socket(addr))
 {
 	if(cert && *cert){
-		m_ssl_factory.reset(new ServerSslFactory(cert, private_key));
+		m_ssl_factory.reset(new ServerSslFactory(cert, private_key, alpn_protocols));
 	}
 
 	LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_INFO,
@@ -106,8 +105,7 @@ int TcpServerBase::poll_read_and_process(bool readable){
 				filter.reset(new SslFilter(STD_MOVE(ssl), session->get_fd()));
 				session->init_ssl(STD_MOVE(filter));
 			}
-			const AUTO(tcp_request_timeout, MainConfig::get<boost::uint64_t>("tcp_request_timeout", 5000));
-			session->set_timeout(tcp_request_timeout);
+			session->set_timeout(EpollDaemon::get_tcp_request_timeout());
 			EpollDaemon::add_socket(session, true);
 			LOG_POSEIDON_INFO("Accepted TCP connection from ", session->get_remote_info());
 		} catch(std::exception &e){
@@ -21,7 +21,8 @@ private:
 	boost::scoped_ptr<ServerSslFactory> m_ssl_factory;
 
 public:
-	explicit TcpServerBase(const SockAddr &addr, const char *cert = "", const char *private_key = "");
+	// alpn_protocols 只在使用 SSL 时有效，参见 ServerSslFactory。
+	explicit TcpServerBase(const SockAddr &addr, const char *cert = "", const char *private_key = "", const char *alpn_protocols = "");
 	~TcpServerBase();
 
 protected:
@@ -8,31 +8,58 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/uio.h>
 #include "singletons/epoll_daemon.hpp"
-#include "singletons/main_config.hpp"
 #include "log.hpp"
 #include "system_exception.hpp"
 #include "profiler.hpp"
 #include "atomic.hpp"
 #include "checked_arithmetic.hpp"
-#include "singletons/timer_daemon.hpp"
 #include "time.hpp"
 
 namespace Poseidon {
 
-void TcpSessionBase::shutdown_timer_proc(const boost::weak_ptr<TcpSessionBase> &weak, boost::uint64_t now){
-	PROFILE_ME;
-
-	const AUTO(session, weak.lock());
-	if(!session){
-		return;
-	}
-
-	try {
-		session->on_shutdown_timer(now);
-	} catch(std::exception &e){
-		LOG_POSEIDON_WARNING("std::exception thrown: what = ", e.what());
-		session->force_shutdown();
+namespace {
+	// SSL_write() 不支持 iovec。小块合并成完整的 TLS 记录，足够大的块直接发送。
+	::ssize_t ssl_send_vector(SslFilterBase &ssl_filter, const ::iovec *vec, std::size_t count){
+		unsigned char record[16384];
+		std::size_t total = 0;
+		std::size_t index = 0;
+		std::size_t offset = 0;
+		while(index < count){
+			const unsigned char *data = static_cast<const unsigned char *>(vec[index].iov_base) + offset;
+			std::size_t size = vec[index].iov_len - offset;
+			if(size >= sizeof(record)){
+				++index;
+				offset = 0;
+			} else {
+				std::size_t filled = 0;
+				while((index < count) && (filled < sizeof(record))){
+					const std::size_t avail = std::min(vec[index].iov_len - offset, sizeof(record) - filled);
+					std::memcpy(record + filled, static_cast<const unsigned char *>(vec[index].iov_base) + offset, avail);
+					filled += avail;
+					offset += avail;
+					if(offset == vec[index].iov_len){
+						++index;
+						offset = 0;
+					}
+				}
+				data = record;
+				size = filled;
+			}
+			const long result = ssl_filter.send(data, size);
+			if(result < 0){
+				if(total != 0){
+					break;
+				}
+				return -1;
+			}
+			total += static_cast<std::size_t>(result);
+			if(static_cast<std::size_t>(result) < size){
+				break;
+			}
+		}
+		return static_cast< ::ssize_t>(total);
 	}
 }
 
@@ -46,15 +73,11 @@ TcpSessionBase::~TcpSessionBase(){ }
 void TcpSessionBase::init_ssl(Move<boost::scoped_ptr<SslFilterBase> > ssl_filter){
 	swap(m_ssl_filter, ssl_filter);
 }
-void TcpSessionBase::create_shutdown_timer(){
-	PROFILE_ME;
-
-	const Mutex::UniqueLock lock(m_shutdown_mutex);
-	if(m_shutdown_timer){
-		return;
+void TcpSessionBase::touch(boost::uint64_t now){
+	if(atomic_exchange(m_last_use_time, now, ATOMIC_ACQ_REL) == (boost::uint64_t)-1){
+		// 第一次读写之前没有响应超时，需要通知 epoll 开始检查。
+		EpollDaemon::schedule_idle_check(this, saturated_add(saturated_add(now, EpollDaemon::get_tcp_response_timeout()), (boost::uint64_t)1));
 	}
-	m_shutdown_timer = TimerDaemon::register_low_level_timer(1000, 5000,
-		boost::bind(&shutdown_timer_proc, virtual_weak_from_this<TcpSessionBase>(), _2));
 }
 
 int TcpSessionBase::poll_read_and_process(bool readable){
@@ -62,39 +85,53 @@ int TcpSessionBase::poll_read_and_process(bool readable){
 
 	(void)readable;
 
-	std::vector<unsigned char> temp;
-
+	// 直接读入 StreamBuffer 的块中，直到 EAGAIN 或者读满预算为止。
 	StreamBuffer data;
+	int err_code = 0;
+	bool hung_up = false;
 	try {
-		temp.resize(4096);
-		::ssize_t result;
-		if(m_ssl_filter){
-			result = m_ssl_filter->recv(temp.data(), temp.size());
-		} else {
-			result = ::recv(get_fd(), temp.data(), temp.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
-		}
-		if(result < 0){
-			return errno;
+		const std::size_t budget = EpollDaemon::get_read_budget();
+		do {
+			std::size_t avail;
+			const AUTO(ptr, data.reserve(&avail, std::min<std::size_t>(budget - data.size(), 16384)));
+			avail = std::min(avail, budget - data.size());
+			::ssize_t result;
+			if(m_ssl_filter){
+				result = m_ssl_filter->recv(ptr, avail);
+			} else {
+				result = ::recv(get_fd(), ptr, avail, MSG_NOSIGNAL | MSG_DONTWAIT);
+			}
+			if(result < 0){
+				err_code = errno;
+				break;
+			}
+			if(result == 0){
+				hung_up = true;
+				break;
+			}
+			data.commit(static_cast<std::size_t>(result));
+			LOG_POSEIDON_TRACE("Read ", result, " byte(s) from ", get_remote_info());
+		} while(data.size() < budget);
+		if(data.empty() && !hung_up){
+			return err_code;
 		}
-		temp.resize(static_cast<std::size_t>(result));
-		data.put(temp.data(), temp.size());
-		LOG_POSEIDON_TRACE("Read ", result, " byte(s) from ", get_remote_info());
 
 		const AUTO(now, get_fast_mono_clock());
-		atomic_store(m_last_use_time, now, ATOMIC_RELEASE);
-		create_shutdown_timer();
+		touch(now);
 
-		if(data.empty() && !m_read_hup_notified){
+		if(!data.empty()){
+			on_receive(STD_MOVE(data));
+		}
+		if(hung_up && !m_read_hup_notified){
 			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
 				"TCP connection read hung up: local = ", get_local_info(), ", remote = ", get_remote_info());
 			shutdown_read();
 			on_read_hup();
 			m_read_hup_notified = true;
 		}
-		if(data.empty()){
+		if(hung_up){
 			return EWOULDBLOCK;
 		}
-		on_receive(STD_MOVE(data));
 	} catch(std::exception &e){
 		LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
 		force_shutdown();
@@ -104,16 +141,14 @@ int TcpSessionBase::poll_read_and_process(bool readable){
 		force_shutdown();
 		return EPIPE;
 	}
-	return 0;
+	// 没有读到 EAGAIN 说明预算用完了，下一轮循环继续读。
+	return err_code;
 }
 int TcpSessionBase::poll_write(Mutex::UniqueLock &write_lock, bool writeable){
 	PROFILE_ME;
 
 	assert(!write_lock);
 
-	std::vector<unsigned char> temp;
-
-	StreamBuffer data;
 	try {
 		if(writeable && !m_connected_notified){
 			LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
@@ -122,43 +157,69 @@ int TcpSessionBase::poll_write(Mutex::UniqueLock &write_lock, bool writeable){
 			m_connected_notified = true;
 		}
 
-		temp.resize(4096);
+		// 只有这个函数会从 m_send_buffer 中移除数据，其他线程只会通过 splice() 在末尾追加新的块，
+		// 因此解锁之后 iovec 指向的块仍然有效。
+		const std::size_t budget = EpollDaemon::get_write_budget();
+		std::size_t total = 0;
 		Mutex::UniqueLock lock(m_send_mutex);
-		const std::size_t avail = m_send_buffer.peek(temp.data(), temp.size());
-		if(avail == 0){
-_check_shutdown:
-			if(should_really_shutdown_write()){
-				if(m_ssl_filter){
-					m_ssl_filter->send_fin();
-				} else {
-					::shutdown(get_fd(), SHUT_WR);
+		for(;;){
+			if(m_send_buffer.empty()){
+				if(should_really_shutdown_write()){
+					if(m_ssl_filter){
+						m_ssl_filter->send_fin();
+					} else {
+						::shutdown(get_fd(), SHUT_WR);
+					}
 				}
+				swap(write_lock, lock);
+				return EWOULDBLOCK;
+			}
+			if(total >= budget){
+				swap(write_lock, lock);
+				return 0;
 			}
-			return EWOULDBLOCK;
-		}
-		lock.unlock();
-		temp.resize(avail);
-
-		::ssize_t result;
-		if(m_ssl_filter){
-			result = m_ssl_filter->send(temp.data(), temp.size());
-		} else {
-			result = ::send(get_fd(), temp.data(), temp.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
-		}
-		if(result < 0){
-			return errno;
-		}
-		LOG_POSEIDON_TRACE("Wrote ", result, " byte(s) to ", get_remote_info());
 
-		const AUTO(now, get_fast_mono_clock());
-		atomic_store(m_last_use_time, now, ATOMIC_RELEASE);
-		create_shutdown_timer();
-
-		lock.lock();
-		m_send_buffer.discard(static_cast<std::size_t>(result));
-		swap(write_lock, lock);
-		if(m_send_buffer.empty()){
-			goto _check_shutdown;
+			::iovec vec[64];
+			std::size_t count = 0;
+			std::size_t bytes = 0;
+			StreamBuffer::EnumerationCookie cookie;
+			const void *data;
+			std::size_t size;
+			while((count < COUNT_OF(vec)) && (bytes < budget - total) && m_send_buffer.enumerate_chunk(&data, &size, cookie)){
+				if(size == 0){
+					continue;
+				}
+				vec[count].iov_base = const_cast<void *>(data);
+				vec[count].iov_len = std::min(size, budget - total - bytes);
+				bytes += vec[count].iov_len;
+				++count;
+			}
+			lock.unlock();
+
+			::ssize_t result;
+			if(m_ssl_filter){
+				result = ssl_send_vector(*m_ssl_filter, vec, count);
+			} else {
+				::msghdr msg = { };
+				msg.msg_iov = vec;
+				msg.msg_iovlen = count;
+				result = ::sendmsg(get_fd(), &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+			}
+			if(result < 0){
+				return errno;
+			}
+			LOG_POSEIDON_TRACE("Wrote ", result, " byte(s) to ", get_remote_info());
+
+			const AUTO(now, get_fast_mono_clock());
+			touch(now);
+
+			lock.lock();
+			m_send_buffer.discard(static_cast<std::size_t>(result));
+			total += static_cast<std::size_t>(result);
+			if(result == 0){
+				swap(write_lock, lock);
+				return 0;
+			}
 		}
 	} catch(std::exception &e){
 		LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
@@ -169,7 +230,21 @@ _check_shutdown:
 		force_shutdown();
 		return EPIPE;
 	}
-	return 0;
+}
+
+boost::uint64_t TcpSessionBase::poll_idle(boost::uint64_t now){
+	PROFILE_ME;
+
+	// 最后一次读写只会推迟到期时间，因此不必在每次读写时更新 epoll 中的检查时间，在这里重新计算即可。
+	const AUTO(shutdown_time, atomic_load(m_shutdown_time, ATOMIC_CONSUME));
+	const AUTO(last_use_time, atomic_load(m_last_use_time, ATOMIC_CONSUME));
+	const AUTO(deadline, std::min(shutdown_time, saturated_add(last_use_time, EpollDaemon::get_tcp_response_timeout())));
+	if(now <= deadline){
+		return saturated_add(deadline, (boost::uint64_t)1);
+	}
+	on_shutdown_timer(now);
+	// 发送缓冲区中仍有数据，稍后再检查。
+	return saturated_add(now, (boost::uint64_t)1000);
 }
 
 void TcpSessionBase::on_shutdown_timer(boost::uint64_t now){
@@ -194,8 +269,7 @@ void TcpSessionBase::on_shutdown_timer(boost::uint64_t now){
 	}
 
 	const AUTO(last_use_time, atomic_load(m_last_use_time, ATOMIC_CONSUME));
-	const AUTO(tcp_response_timeout, MainConfig::get<boost::uint64_t>("tcp_response_timeout", 30000));
-	if(saturated_add(last_use_time, tcp_response_timeout) < now){
+	if(saturated_add(last_use_time, EpollDaemon::get_tcp_response_timeout()) < now){
 		LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG,
 			"The connection seems dead: remote = ", get_remote_info());
 		force_shutdown();
@@ -244,8 +318,9 @@ void TcpSessionBase::set_timeout(boost::uint64_t timeout){
 	PROFILE_ME;
 
 	const AUTO(now, get_fast_mono_clock());
-	atomic_store(m_shutdown_time, saturated_add(now, timeout), ATOMIC_RELEASE);
-	create_shutdown_timer();
+	const AUTO(shutdown_time, saturated_add(now, timeout));
+	atomic_store(m_shutdown_time, shutdown_time, ATOMIC_RELEASE);
+	EpollDaemon::schedule_idle_check(this, saturated_add(shutdown_time, (boost::uint64_t)1));
 }
 
 bool TcpSessionBase::send(StreamBuffer buffer){
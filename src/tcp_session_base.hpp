@@ -14,14 +14,10 @@ namespace Poseidon {
 
 class TcpServerBase;
 class SslFilterBase;
-class TimerItem;
 
 class TcpSessionBase : public SocketBase, public SessionBase {
 	friend TcpServerBase;
 
-private:
-	static void shutdown_timer_proc(const boost::weak_ptr<TcpSessionBase> &weak, boost::uint64_t now);
-
 private:
 	boost::scoped_ptr<SslFilterBase> m_ssl_filter;
 
@@ -33,27 +29,29 @@ private:
 
 	volatile boost::uint64_t m_shutdown_time;
 	volatile boost::uint64_t m_last_use_time;
-	mutable Mutex m_shutdown_mutex;
-	boost::shared_ptr<TimerItem> m_shutdown_timer;
 
 public:
 	explicit TcpSessionBase(Move<UniqueFile> socket);
 	~TcpSessionBase();
 
+private:
+	void touch(boost::uint64_t now);
+
 protected:
 	void init_ssl(Move<boost::scoped_ptr<SslFilterBase> > ssl_filter);
-	void create_shutdown_timer();
 
 	// 注意，只能在 epoll 线程中调用这些函数。
 	int poll_read_and_process(bool readable) OVERRIDE;
 	int poll_write(Mutex::UniqueLock &write_lock, bool writeable) OVERRIDE;
+	boost::uint64_t poll_idle(boost::uint64_t now) OVERRIDE;
 
 	void on_connect() OVERRIDE = 0;
 	void on_read_hup() OVERRIDE = 0;
 	void on_close(int err_code) OVERRIDE = 0; // 参数就是 errno。
 	void on_receive(StreamBuffer data) OVERRIDE = 0;
 
-	// 注意，只能在 timer 线程中调用这些函数。
+	// 注意，只能在 epoll 线程中调用这些函数。
+	// 只在关闭时间或者响应超时时间已经过去时被调用。
 	virtual void on_shutdown_timer(boost::uint64_t now);
 
 public:
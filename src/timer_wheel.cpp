@@ -0,0 +1,168 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#include "precompiled.hpp"
+#include "timer_wheel.hpp"
+
+namespace Poseidon {
+
+TimerWheel::Node::~Node(){
+	assert(!is_linked());
+}
+
+TimerWheel::TimerWheel(boost::uint64_t now) NOEXCEPT
+	: m_now(now), m_size(0)
+{
+	for(unsigned level = 0; level < LEVEL_COUNT; ++level){
+		m_level_sizes[level] = 0;
+	}
+	for(std::size_t i = 0; i < COUNT_OF(m_slots); ++i){
+		m_slots[i].m_prev = m_slots + i;
+		m_slots[i].m_next = m_slots + i;
+	}
+}
+TimerWheel::~TimerWheel(){
+	clear();
+
+	for(std::size_t i = 0; i < COUNT_OF(m_slots); ++i){
+		m_slots[i].m_prev = NULLPTR;
+		m_slots[i].m_next = NULLPTR;
+	}
+}
+
+void TimerWheel::link(Node *node) NOEXCEPT {
+	assert(!node->is_linked());
+
+	boost::uint64_t expiry = std::max(node->m_expiry, m_now);
+	unsigned level = 0;
+	if(expiry - m_now >= (static_cast<boost::uint64_t>(1) << TOTAL_BITS)){
+		// 太远了，先放到最高层，以后再重新分配。
+		expiry = m_now + (static_cast<boost::uint64_t>(1) << TOTAL_BITS) - 1;
+		level = LEVEL_COUNT - 1;
+	} else {
+		while(expiry - m_now >= (static_cast<boost::uint64_t>(get_slot_count(level)) << get_shift(level))){
+			++level;
+		}
+	}
+	const AUTO(index, static_cast<unsigned>(expiry >> get_shift(level)) & (get_slot_count(level) - 1));
+	const AUTO(head, get_slot(level, index));
+	node->m_prev = head->m_prev;
+	node->m_next = head;
+	head->m_prev->m_next = node;
+	head->m_prev = node;
+	node->m_level = level;
+	++m_level_sizes[level];
+	++m_size;
+}
+void TimerWheel::cascade(unsigned level) NOEXCEPT {
+	const AUTO(index, static_cast<unsigned>(m_now >> get_shift(level)) & (get_slot_count(level) - 1));
+	if((index == 0) && (level + 1 < LEVEL_COUNT)){
+		cascade(level + 1);
+	}
+	const AUTO(head, get_slot(level, index));
+	if(head->m_next == head){
+		return;
+	}
+	// 先把整个链表摘下来，因为重新分配的节点可能回到同一个槽。
+	Node *node = head->m_next;
+	head->m_prev->m_next = NULLPTR;
+	head->m_prev = head;
+	head->m_next = head;
+	while(node){
+		const AUTO(next, node->m_next);
+		node->m_prev = NULLPTR;
+		node->m_next = NULLPTR;
+		--m_level_sizes[level];
+		--m_size;
+		link(node);
+		node = next;
+	}
+}
+
+void TimerWheel::insert(Node *node, boost::uint64_t expiry) NOEXCEPT {
+	node->m_expiry = expiry;
+	link(node);
+}
+void TimerWheel::erase(Node *node) NOEXCEPT {
+	assert(node->is_linked());
+
+	node->m_prev->m_next = node->m_next;
+	node->m_next->m_prev = node->m_prev;
+	node->m_prev = NULLPTR;
+	node->m_next = NULLPTR;
+	--m_level_sizes[node->m_level];
+	--m_size;
+}
+void TimerWheel::clear() NOEXCEPT {
+	for(std::size_t i = 0; i < COUNT_OF(m_slots); ++i){
+		const AUTO(head, m_slots + i);
+		Node *node = head->m_next;
+		while(node != head){
+			const AUTO(next, node->m_next);
+			node->m_prev = NULLPTR;
+			node->m_next = NULLPTR;
+			node = next;
+		}
+		head->m_prev = head;
+		head->m_next = head;
+	}
+	for(unsigned level = 0; level < LEVEL_COUNT; ++level){
+		m_level_sizes[level] = 0;
+	}
+	m_size = 0;
+}
+
+void TimerWheel::advance(boost::uint64_t now, std::vector<Node *> &expired){
+	while(m_now <= now){
+		if(m_size == 0){
+			m_now = now + 1;
+			break;
+		}
+		if((m_now & (LEVEL_ZERO_SLOTS - 1)) == 0){
+			cascade(1);
+		}
+		if(m_level_sizes[0] == 0){
+			// 第 0 层是空的，直接跳到下一次可能有节点落入第 0 层的时刻。
+			unsigned level = 1;
+			while(m_level_sizes[level] == 0){
+				++level;
+			}
+			const AUTO(mask, (static_cast<boost::uint64_t>(1) << get_shift(level)) - 1);
+			m_now = std::min((m_now | mask) + 1, now + 1);
+			continue;
+		}
+		const AUTO(head, get_slot(0, static_cast<unsigned>(m_now) & (LEVEL_ZERO_SLOTS - 1)));
+		while(head->m_next != head){
+			const AUTO(node, head->m_next);
+			expired.push_back(node); // may throw std::bad_alloc.
+			erase(node);
+		}
+		++m_now;
+	}
+}
+boost::uint64_t TimerWheel::get_next_expiry() const NOEXCEPT {
+	boost::uint64_t next = (boost::uint64_t)-1;
+	if(m_size != m_level_sizes[0]){
+		// 较高层的节点要等到下一次重新分配时才会落入第 0 层。
+		unsigned level = 1;
+		while(m_level_sizes[level] == 0){
+			++level;
+		}
+		const AUTO(mask, (static_cast<boost::uint64_t>(1) << get_shift(level)) - 1);
+		if((m_now & mask) == 0){
+			return m_now;
+		}
+		next = (m_now | mask) + 1;
+	}
+	if(m_level_sizes[0] != 0){
+		for(unsigned i = 0; (i < LEVEL_ZERO_SLOTS) && (m_now + i < next); ++i){
+			const AUTO(head, get_slot(0, static_cast<unsigned>(m_now + i) & (LEVEL_ZERO_SLOTS - 1)));
+			if(head->m_next != head){
+				return m_now + i;
+			}
+		}
+	}
+	return next;
+}
+
+}
@@ -0,0 +1,108 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_TIMER_WHEEL_HPP_
+#define POSEIDON_TIMER_WHEEL_HPP_
+
+#include "cxx_ver.hpp"
+#include "cxx_util.hpp"
+#include <vector>
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace Poseidon {
+
+// 分层时间轮，时间单位是毫秒。
+// 第 0 层有 256 个槽，每个槽 1 毫秒；第 1 到 4 层各有 64 个槽，每层的槽宽是下一层的总跨度。
+// 插入和删除都是 O(1) 的；更远的节点在时间推进到所在槽时被重新分配到较低的层。
+// 这个类不是线程安全的。
+class TimerWheel : NONCOPYABLE {
+public:
+	class Node : NONCOPYABLE {
+		friend class TimerWheel;
+
+	private:
+		Node *m_prev;
+		Node *m_next;
+		boost::uint64_t m_expiry;
+		unsigned m_level;
+
+	public:
+		Node() NOEXCEPT
+			: m_prev(NULLPTR), m_next(NULLPTR), m_expiry(0), m_level(0)
+		{ }
+		~Node(); // assert(!is_linked());
+
+	public:
+		bool is_linked() const NOEXCEPT {
+			return m_next;
+		}
+		boost::uint64_t get_expiry() const NOEXCEPT {
+			return m_expiry;
+		}
+	};
+
+private:
+	enum {
+		LEVEL_COUNT         = 5,
+		LEVEL_ZERO_BITS     = 8,
+		LEVEL_BITS          = 6,
+		LEVEL_ZERO_SLOTS    = 1u << LEVEL_ZERO_BITS,
+		LEVEL_SLOTS         = 1u << LEVEL_BITS,
+		TOTAL_BITS          = LEVEL_ZERO_BITS + LEVEL_BITS * (LEVEL_COUNT - 1),
+	};
+
+	static unsigned get_shift(unsigned level) NOEXCEPT {
+		return (level == 0) ? 0 : (LEVEL_ZERO_BITS + LEVEL_BITS * (level - 1));
+	}
+	static unsigned get_slot_count(unsigned level) NOEXCEPT {
+		return (level == 0) ? LEVEL_ZERO_SLOTS : LEVEL_SLOTS;
+	}
+	static unsigned get_slot_offset(unsigned level) NOEXCEPT {
+		return (level == 0) ? 0 : (LEVEL_ZERO_SLOTS + LEVEL_SLOTS * (level - 1));
+	}
+
+private:
+	// 所有到期时间小于 m_now 的节点都已经被取出。
+	boost::uint64_t m_now;
+	std::size_t m_size;
+	std::size_t m_level_sizes[LEVEL_COUNT];
+	// 每个槽是一个以哨兵节点为头的双向循环链表。
+	Node m_slots[LEVEL_ZERO_SLOTS + LEVEL_SLOTS * (LEVEL_COUNT - 1)];
+
+public:
+	explicit TimerWheel(boost::uint64_t now = 0) NOEXCEPT;
+	~TimerWheel();
+
+private:
+	Node *get_slot(unsigned level, unsigned index) NOEXCEPT {
+		return m_slots + get_slot_offset(level) + index;
+	}
+	const Node *get_slot(unsigned level, unsigned index) const NOEXCEPT {
+		return m_slots + get_slot_offset(level) + index;
+	}
+	void link(Node *node) NOEXCEPT;
+	void cascade(unsigned level) NOEXCEPT;
+
+public:
+	bool empty() const NOEXCEPT {
+		return m_size == 0;
+	}
+	std::size_t size() const NOEXCEPT {
+		return m_size;
+	}
+
+	// 早于当前时间的节点将在下一次 advance() 时被取出。
+	void insert(Node *node, boost::uint64_t expiry) NOEXCEPT;
+	void erase(Node *node) NOEXCEPT;
+	void clear() NOEXCEPT;
+
+	// 取出所有到期时间不晚于 now 的节点，逐毫秒追加到 expired 中。
+	void advance(boost::uint64_t now, std::vector<Node *> &expired);
+	// 返回下一个节点到期时间的下界。没有节点时返回 (boost::uint64_t)-1。
+	boost::uint64_t get_next_expiry() const NOEXCEPT;
+};
+
+}
+
+#endif
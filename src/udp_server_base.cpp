@@ -57,22 +57,35 @@ int UdpServerBase::poll_read_and_process(bool readable){
 
 	(void)readable;
 
-	std::vector<unsigned char> temp;
+	// 数据报直接读入 spare 的块中。大的数据报连同整个块交给 on_receive()，
+	// 小的数据报复制出来，以免每个数据报都占用一个 64KiB 的块，块留给下一个数据报使用。
+	StreamBuffer spare;
+	const std::size_t budget = EpollDaemon::get_read_budget();
+	std::size_t total = 0;
 	for(unsigned i = 0; i < 256; ++i){
+		if(total >= budget){
+			break;
+		}
 		SockAddr sock_addr;
 		StreamBuffer data;
 		try {
 			::sockaddr_storage sa;
 			::socklen_t sa_len = sizeof(sa);
-			temp.resize(65536);
-			::ssize_t result = ::recvfrom(get_fd(), temp.data(), temp.size(), MSG_NOSIGNAL | MSG_DONTWAIT,
+			spare.clear();
+			const AUTO(ptr, spare.reserve(NULLPTR, 65536));
+			::ssize_t result = ::recvfrom(get_fd(), ptr, 65536, MSG_NOSIGNAL | MSG_DONTWAIT,
 				static_cast< ::sockaddr *>(static_cast<void *>(&sa)), &sa_len);
 			if(result < 0){
 				return errno;
 			}
-			temp.resize(static_cast<std::size_t>(result));
 			sock_addr = SockAddr(&sa, sa_len);
-			data.put(temp.data(), temp.size());
+			if(result <= 4096){
+				data.put(ptr, static_cast<std::size_t>(result));
+			} else {
+				spare.commit(static_cast<std::size_t>(result));
+				data.swap(spare);
+			}
+			total += static_cast<std::size_t>(result);
 			LOG_POSEIDON_TRACE("Read ", result, " byte(s) from ", IpPort(sock_addr));
 		} catch(std::exception &e){
 			LOG_POSEIDON_ERROR("std::exception thrown: what = ", e.what());
@@ -8,11 +8,99 @@
 #include "../random.hpp"
 #include "../profiler.hpp"
 #include "../base64.hpp"
+#include "../string.hpp"
+#include "../buffer_streams.hpp"
+#include "../http/header_option.hpp"
+#include "../singletons/main_config.hpp"
 
 namespace Poseidon {
 
 namespace WebSocket {
-	Http::ResponseHeaders make_handshake_response(const Http::RequestHeaders &request){
+	namespace {
+		void get_extensions(std::vector<Http::HeaderOption> &extensions, const OptionalMap &headers){
+			const AUTO(range, headers.range("Sec-WebSocket-Extensions"));
+			for(AUTO(it, range.first); it != range.second; ++it){
+				const AUTO(parts, explode<std::string>(',', it->second));
+				for(AUTO(part_it, parts.begin()); part_it != parts.end(); ++part_it){
+					AUTO(str, trim(*part_it));
+					if(str.empty()){
+						continue;
+					}
+					StreamBuffer buffer(str);
+					Buffer_istream is(STD_MOVE(buffer));
+					extensions.push_back(VAL_INIT);
+					extensions.back().parse(is);
+				}
+			}
+		}
+
+		bool parse_window_bits(unsigned &bits, const std::string &str){
+			char *endptr;
+			const AUTO(value, std::strtoul(str.c_str(), &endptr, 10));
+			if(str.empty() || *endptr || (value < 8) || (value > 15)){
+				return false;
+			}
+			bits = static_cast<unsigned>(value);
+			return true;
+		}
+
+		// 返回 false 表示参数无效。没有值的 client_max_window_bits 保留默认值 15。
+		bool parse_permessage_deflate(PermessageDeflateParams &params, const Http::HeaderOption &extension){
+			params.enabled = true;
+			params.server_no_context_takeover = false;
+			params.client_no_context_takeover = false;
+			params.server_max_window_bits = 15;
+			params.client_max_window_bits = 15;
+
+			bool seen[4] = { };
+			const AUTO_REF(options, extension.get_options());
+			for(AUTO(it, options.begin()); it != options.end(); ++it){
+				const char *const key = it->first.get();
+				const AUTO_REF(value, it->second);
+				unsigned index;
+				if(::strcasecmp(key, "server_no_context_takeover") == 0){
+					index = 0;
+					params.server_no_context_takeover = true;
+				} else if(::strcasecmp(key, "client_no_context_takeover") == 0){
+					index = 1;
+					params.client_no_context_takeover = true;
+				} else if(::strcasecmp(key, "server_max_window_bits") == 0){
+					index = 2;
+					if(!parse_window_bits(params.server_max_window_bits, value)){
+						return false;
+					}
+				} else if(::strcasecmp(key, "client_max_window_bits") == 0){
+					index = 3;
+					if(!value.empty() && !parse_window_bits(params.client_max_window_bits, value)){
+						return false;
+					}
+				} else {
+					LOG_POSEIDON_DEBUG("Unknown permessage-deflate parameter: ", key);
+					return false;
+				}
+				if(seen[index]){
+					LOG_POSEIDON_DEBUG("Duplicate permessage-deflate parameter: ", key);
+					return false;
+				}
+				if((index < 2) && !value.empty()){
+					LOG_POSEIDON_DEBUG("Unexpected value for permessage-deflate parameter: ", key, " = ", value);
+					return false;
+				}
+				seen[index] = true;
+			}
+			return true;
+		}
+
+		bool is_deflate_enabled(){
+			return MainConfig::get<bool>("websocket_deflate_enabled", false);
+		}
+		unsigned get_local_max_window_bits(){
+			// zlib 不支持 8 位的窗口。
+			return std::min(std::max(MainConfig::get<unsigned>("websocket_deflate_max_window_bits", 15), 9u), 15u);
+		}
+	}
+
+	Http::ResponseHeaders make_handshake_response(const Http::RequestHeaders &request, PermessageDeflateParams *deflate_params){
 		PROFILE_ME;
 
 		Http::ResponseHeaders response = { };
@@ -56,6 +144,49 @@ namespace WebSocket {
 			response.headers.set(sslit("Upgrade"), "websocket");
 			response.headers.set(sslit("Connection"), "Upgrade");
 			response.headers.set(sslit("Sec-WebSocket-Accept"), STD_MOVE(sec_websocket_accept));
+			if(deflate_params){
+				deflate_params->enabled = false;
+			}
+			if(deflate_params && is_deflate_enabled()){
+				std::vector<Http::HeaderOption> extensions;
+				get_extensions(extensions, request.headers);
+				for(AUTO(it, extensions.begin()); it != extensions.end(); ++it){
+					if(::strcasecmp(it->get_base().c_str(), "permessage-deflate") != 0){
+						continue;
+					}
+					PermessageDeflateParams params;
+					if(!parse_permessage_deflate(params, *it)){
+						continue;
+					}
+					const bool has_server_max_window_bits = it->get_options().find("server_max_window_bits") != it->get_options().end();
+					if(params.server_max_window_bits < 9){
+						LOG_POSEIDON_DEBUG("Declining permessage-deflate offer with server_max_window_bits = 8");
+						continue;
+					}
+					params.server_max_window_bits = std::min(params.server_max_window_bits, get_local_max_window_bits());
+					if(MainConfig::get<bool>("websocket_deflate_no_context_takeover", false)){
+						params.server_no_context_takeover = true;
+					}
+					// 我们总是使用 15 位的窗口解压，因此不需要限制对方的窗口。
+					params.client_max_window_bits = 15;
+
+					std::string str("permessage-deflate");
+					if(params.server_no_context_takeover){
+						str += "; server_no_context_takeover";
+					}
+					if(params.client_no_context_takeover){
+						str += "; client_no_context_takeover";
+					}
+					if(has_server_max_window_bits){
+						char temp[64];
+						std::sprintf(temp, "; server_max_window_bits=%u", params.server_max_window_bits);
+						str += temp;
+					}
+					response.headers.set(sslit("Sec-WebSocket-Extensions"), STD_MOVE(str));
+					*deflate_params = params;
+					break;
+				}
+			}
 			response.status_code = Http::ST_SWITCHING_PROTOCOLS;
 		}
 	_done:
@@ -63,7 +194,9 @@ namespace WebSocket {
 		return response;
 	}
 
-	std::pair<Http::RequestHeaders, std::string> make_handshake_request(std::string uri, OptionalMap get_params, std::string host){
+	std::pair<Http::RequestHeaders, std::string> make_handshake_request(std::string uri, OptionalMap get_params, std::string host,
+		bool offer_deflate)
+	{
 		PROFILE_ME;
 
 		Http::RequestHeaders request = { };
@@ -83,9 +216,14 @@ namespace WebSocket {
 		enc.put(key, sizeof(key));
 		AUTO(sec_websocket_key, enc.finalize().dump_string());
 		request.headers.set(sslit("Sec-WebSocket-Key"), sec_websocket_key);
+		if(offer_deflate && is_deflate_enabled()){
+			request.headers.set(sslit("Sec-WebSocket-Extensions"), "permessage-deflate; client_max_window_bits");
+		}
 		return std::make_pair(STD_MOVE_IDN(request), STD_MOVE_IDN(sec_websocket_key));
 	}
-	bool check_handshake_response(const Http::ResponseHeaders &response, const std::string &sec_websocket_key){
+	bool check_handshake_response(const Http::ResponseHeaders &response, const std::string &sec_websocket_key,
+		PermessageDeflateParams *deflate_params)
+	{
 		PROFILE_ME;
 
 		if(response.version < 10001){
@@ -122,6 +260,31 @@ namespace WebSocket {
 				"Bad Sec-WebSocket-Accept: got ", sec_websocket_accept, ", expecting ", sec_websocket_accept_expecting);
 			return false;
 		}
+		if(deflate_params){
+			deflate_params->enabled = false;
+		}
+		std::vector<Http::HeaderOption> extensions;
+		get_extensions(extensions, response.headers);
+		if(!extensions.empty()){
+			if(!deflate_params || (extensions.size() != 1) || (::strcasecmp(extensions.front().get_base().c_str(), "permessage-deflate") != 0)){
+				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG, "Unexpected Sec-WebSocket-Extensions: ", response.headers.get("Sec-WebSocket-Extensions"));
+				return false;
+			}
+			PermessageDeflateParams params;
+			if(!parse_permessage_deflate(params, extensions.front())){
+				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG, "Invalid permessage-deflate response: ", response.headers.get("Sec-WebSocket-Extensions"));
+				return false;
+			}
+			if(params.client_max_window_bits < 9){
+				LOG_POSEIDON(Logger::SP_MAJOR | Logger::LV_DEBUG, "Unsupported permessage-deflate client_max_window_bits: ", params.client_max_window_bits);
+				return false;
+			}
+			params.client_max_window_bits = std::min(params.client_max_window_bits, get_local_max_window_bits());
+			if(MainConfig::get<bool>("websocket_deflate_no_context_takeover", false)){
+				params.client_no_context_takeover = true;
+			}
+			*deflate_params = params;
+		}
 		return true;
 	}
 }
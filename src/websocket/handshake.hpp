@@ -6,14 +6,22 @@
 
 #include "../http/request_headers.hpp"
 #include "../http/response_headers.hpp"
+#include "permessage_deflate.hpp"
 
 namespace Poseidon {
 
 namespace WebSocket {
-	extern Http::ResponseHeaders make_handshake_response(const Http::RequestHeaders &request);
+	// 如果 websocket_deflate_enabled 打开并且 deflate_params 非空，则协商 permessage-deflate，
+	// 协商结果写入 *deflate_params，之后应当在会话上调用 enable_permessage_deflate()。
+	extern Http::ResponseHeaders make_handshake_response(const Http::RequestHeaders &request,
+		PermessageDeflateParams *deflate_params = NULLPTR);
 
-	extern std::pair<Http::RequestHeaders, std::string> make_handshake_request(std::string uri, OptionalMap get_params, std::string host);
-	extern bool check_handshake_response(const Http::ResponseHeaders &response, const std::string &sec_websocket_key);
+	// 如果 offer_deflate 为 true 并且 websocket_deflate_enabled 打开，则在请求中提议 permessage-deflate。
+	// 此时调用 check_handshake_response() 时 deflate_params 必须非空。
+	extern std::pair<Http::RequestHeaders, std::string> make_handshake_request(std::string uri, OptionalMap get_params, std::string host,
+		bool offer_deflate = false);
+	extern bool check_handshake_response(const Http::ResponseHeaders &response, const std::string &sec_websocket_key,
+		PermessageDeflateParams *deflate_params = NULLPTR);
 }
 
 }
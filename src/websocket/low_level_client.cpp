@@ -113,6 +113,22 @@ namespace WebSocket {
 		return UpgradedSessionBase::send(STD_MOVE(encoded));
 	}
 
+	void LowLevelClient::enable_permessage_deflate(const PermessageDeflateParams &params){
+		PROFILE_ME;
+
+		if(!params.enabled){
+			return;
+		}
+		Writer::enable_deflation(params.client_max_window_bits, params.client_no_context_takeover);
+		Reader::enable_inflation(params.server_no_context_takeover);
+	}
+	PermessageDeflateStatistics LowLevelClient::get_permessage_deflate_statistics() const {
+		PermessageDeflateStatistics stats = { };
+		Writer::get_deflation_statistics(stats);
+		Reader::get_inflation_statistics(stats);
+		return stats;
+	}
+
 	bool LowLevelClient::send(OpCode opcode, StreamBuffer payload, bool masked){
 		PROFILE_ME;
 
@@ -10,6 +10,7 @@
 #include "status_codes.hpp"
 #include "reader.hpp"
 #include "writer.hpp"
+#include "permessage_deflate.hpp"
 
 namespace Poseidon {
 
@@ -64,6 +65,10 @@ namespace WebSocket {
 			return shutdown(ST_NORMAL_CLOSURE);
 		}
 
+		// 根据握手时协商的参数启用 permessage-deflate。必须在收发任何数据之前调用。
+		void enable_permessage_deflate(const PermessageDeflateParams &params);
+		PermessageDeflateStatistics get_permessage_deflate_statistics() const;
+
 		bool send(OpCode opcode, StreamBuffer payload, bool masked = true);
 		bool shutdown(StatusCode status_code, const char *reason = "") NOEXCEPT;
 	};
@@ -65,6 +65,22 @@ namespace WebSocket {
 		return UpgradedSessionBase::send(STD_MOVE(encoded));
 	}
 
+	void LowLevelSession::enable_permessage_deflate(const PermessageDeflateParams &params){
+		PROFILE_ME;
+
+		if(!params.enabled){
+			return;
+		}
+		Writer::enable_deflation(params.server_max_window_bits, params.server_no_context_takeover);
+		Reader::enable_inflation(params.client_no_context_takeover);
+	}
+	PermessageDeflateStatistics LowLevelSession::get_permessage_deflate_statistics() const {
+		PermessageDeflateStatistics stats = { };
+		Writer::get_deflation_statistics(stats);
+		Reader::get_inflation_statistics(stats);
+		return stats;
+	}
+
 	bool LowLevelSession::send(OpCode opcode, StreamBuffer payload, bool masked){
 		PROFILE_ME;
 
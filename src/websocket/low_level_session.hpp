@@ -9,6 +9,7 @@
 #include "status_codes.hpp"
 #include "reader.hpp"
 #include "writer.hpp"
+#include "permessage_deflate.hpp"
 
 namespace Poseidon {
 
@@ -43,6 +44,10 @@ namespace WebSocket {
 		virtual bool on_low_level_control_message(OpCode opcode, StreamBuffer payload) = 0;
 
 	public:
+		// 根据握手时协商的参数启用 permessage-deflate。必须在收发任何数据之前调用。
+		void enable_permessage_deflate(const PermessageDeflateParams &params);
+		PermessageDeflateStatistics get_permessage_deflate_statistics() const;
+
 		bool send(OpCode opcode, StreamBuffer payload, bool masked = false);
 		bool shutdown(StatusCode status_code, const char *reason = "") NOEXCEPT;
 	};
@@ -0,0 +1,135 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "masking.hpp"
+#include "../endian.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#endif
+
+namespace Poseidon {
+
+namespace WebSocket {
+	namespace {
+		// key 按内存顺序存放四个字节，data 的第一个字节与 key[0] 进行运算。
+		typedef void (*MaskProc)(unsigned char *data, std::size_t size, const unsigned char (&key)[4]);
+
+		void mask_generic(unsigned char *data, std::size_t size, const unsigned char (&key)[4]){
+			unsigned char key_bytes[8];
+			for(unsigned i = 0; i < 8; ++i){
+				key_bytes[i] = key[i % 4];
+			}
+			boost::uint64_t word_key;
+			std::memcpy(&word_key, key_bytes, 8);
+
+			std::size_t offset = 0;
+			for(; offset + 8 <= size; offset += 8){
+				boost::uint64_t word;
+				std::memcpy(&word, data + offset, 8);
+				word ^= word_key;
+				std::memcpy(data + offset, &word, 8);
+			}
+			for(; offset < size; ++offset){
+				data[offset] ^= key[offset % 4];
+			}
+		}
+
+#if defined(__x86_64__) || defined(__i386__)
+		__attribute__((__target__("sse2")))
+		void mask_sse2(unsigned char *data, std::size_t size, const unsigned char (&key)[4]){
+			boost::uint32_t word_key;
+			std::memcpy(&word_key, key, 4);
+			const __m128i vec_key = _mm_set1_epi32(static_cast<int>(word_key));
+
+			std::size_t offset = 0;
+			for(; offset + 16 <= size; offset += 16){
+				__m128i *const ptr = reinterpret_cast<__m128i *>(data + offset);
+				_mm_storeu_si128(ptr, _mm_xor_si128(_mm_loadu_si128(ptr), vec_key));
+			}
+			// offset 是 4 的倍数，剩余部分仍然从 key[0] 开始。
+			mask_generic(data + offset, size - offset, key);
+		}
+
+		__attribute__((__target__("avx2")))
+		void mask_avx2(unsigned char *data, std::size_t size, const unsigned char (&key)[4]){
+			boost::uint32_t word_key;
+			std::memcpy(&word_key, key, 4);
+			const __m256i vec_key = _mm256_set1_epi32(static_cast<int>(word_key));
+
+			std::size_t offset = 0;
+			for(; offset + 64 <= size; offset += 64){
+				__m256i *const ptr = reinterpret_cast<__m256i *>(data + offset);
+				_mm256_storeu_si256(ptr, _mm256_xor_si256(_mm256_loadu_si256(ptr), vec_key));
+				_mm256_storeu_si256(ptr + 1, _mm256_xor_si256(_mm256_loadu_si256(ptr + 1), vec_key));
+			}
+			for(; offset + 32 <= size; offset += 32){
+				__m256i *const ptr = reinterpret_cast<__m256i *>(data + offset);
+				_mm256_storeu_si256(ptr, _mm256_xor_si256(_mm256_loadu_si256(ptr), vec_key));
+			}
+			mask_generic(data + offset, size - offset, key);
+		}
+#endif
+
+		struct MaskImplementation {
+			const char *name;
+			MaskProc proc;
+		};
+
+		MaskImplementation select_implementation(){
+			MaskImplementation impl = { "generic", &mask_generic };
+#if defined(__x86_64__) || defined(__i386__)
+			// 静态初始化时可能还没有初始化 CPU 特性信息。
+			__builtin_cpu_init();
+			if(__builtin_cpu_supports("avx2")){
+				impl.name = "avx2";
+				impl.proc = &mask_avx2;
+			} else if(__builtin_cpu_supports("sse2")){
+				impl.name = "sse2";
+				impl.proc = &mask_sse2;
+			}
+#endif
+			return impl;
+		}
+
+		const MaskImplementation g_implementation = select_implementation();
+
+		inline boost::uint32_t rotate_mask(boost::uint32_t mask, std::size_t size){
+			const unsigned shift = static_cast<unsigned>(size % 4) * 8;
+			if(shift == 0){
+				return mask;
+			}
+			return (mask >> shift) | (mask << (32 - shift));
+		}
+	}
+
+	boost::uint32_t apply_mask(void *data, std::size_t size, boost::uint32_t mask) NOEXCEPT {
+		if((mask == 0) || (size == 0)){
+			return mask;
+		}
+		boost::uint32_t temp32;
+		store_le(temp32, mask);
+		unsigned char key[4];
+		std::memcpy(key, &temp32, 4);
+		(*g_implementation.proc)(static_cast<unsigned char *>(data), size, key);
+		return rotate_mask(mask, size);
+	}
+	boost::uint32_t apply_mask(StreamBuffer &buffer, boost::uint32_t mask){
+		if(mask == 0){
+			return mask;
+		}
+		void *data;
+		std::size_t count;
+		StreamBuffer::EnumerationCookie cookie;
+		while(buffer.enumerate_chunk(&data, &count, cookie)){
+			mask = apply_mask(data, count, mask);
+		}
+		return mask;
+	}
+
+	const char *get_mask_implementation_name() NOEXCEPT {
+		return g_implementation.name;
+	}
+}
+
+}
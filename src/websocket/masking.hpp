@@ -0,0 +1,27 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_WEBSOCKET_MASKING_HPP_
+#define POSEIDON_WEBSOCKET_MASKING_HPP_
+
+#include "../cxx_ver.hpp"
+#include <cstddef>
+#include <boost/cstdint.hpp>
+#include "../stream_buffer.hpp"
+
+namespace Poseidon {
+
+namespace WebSocket {
+	// mask 的最低字节作用于第一个字节，此后每处理一个字节循环右移 8 位（即 load_le() 读出的掩码）。
+	// 返回值是处理完所有数据之后的 mask，可用于处理同一帧的后续数据。
+	extern boost::uint32_t apply_mask(void *data, std::size_t size, boost::uint32_t mask) NOEXCEPT;
+	// 直接在缓冲区的块上进行运算。共享的块会被复制，因此可能抛出异常。
+	extern boost::uint32_t apply_mask(StreamBuffer &buffer, boost::uint32_t mask);
+
+	// 运行时选定的实现，例如 "avx2"、"sse2" 或 "generic"。
+	extern const char *get_mask_implementation_name() NOEXCEPT;
+}
+
+}
+
+#endif
@@ -0,0 +1,158 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#include "../precompiled.hpp"
+#include "permessage_deflate.hpp"
+#include "exception.hpp"
+#include "../singletons/main_config.hpp"
+#include "../log.hpp"
+#include "../profiler.hpp"
+#include "../atomic.hpp"
+#include <time.h>
+
+namespace Poseidon {
+
+namespace WebSocket {
+	namespace {
+		boost::uint64_t get_thread_cpu_time() NOEXCEPT {
+			::timespec ts;
+			if(::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0){
+				return 0;
+			}
+			return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000u + static_cast<boost::uint64_t>(ts.tv_nsec);
+		}
+
+		int get_raw_window_bits(unsigned max_window_bits){
+			// zlib 不支持 8 位的窗口，协商时已经拒绝了这种情况。
+			return -static_cast<int>(std::min(std::max(max_window_bits, 9u), 15u));
+		}
+
+		const unsigned char g_flush_trailer[4] = { 0x00, 0x00, 0xFF, 0xFF };
+
+		// deflate 的压缩比最高约为 1032:1，每一步的输出因此不超过 1 MiB 左右。
+		const std::size_t INFLATION_STEP_SIZE = 1024;
+	}
+
+	MessageDeflator::MessageDeflator(unsigned max_window_bits, bool no_context_takeover)
+		: m_deflator(false, MainConfig::get<int>("websocket_deflate_level", 6), get_raw_window_bits(max_window_bits))
+		, m_no_context_takeover(no_context_takeover)
+		, m_min_message_size(MainConfig::get<std::size_t>("websocket_deflate_min_message_size", 256))
+		, m_messages_deflated(0), m_messages_not_deflated(0), m_bytes_before(0), m_bytes_after(0), m_cpu_time(0)
+	{ }
+	MessageDeflator::~MessageDeflator(){ }
+
+	bool MessageDeflator::deflate(StreamBuffer &payload){
+		PROFILE_ME;
+
+		const std::size_t size_before = payload.size();
+		if(size_before < m_min_message_size){
+			atomic_add(m_messages_not_deflated, 1, ATOMIC_RELAXED);
+			return false;
+		}
+
+		const AUTO(cpu_time_begin, get_thread_cpu_time());
+		m_deflator.put(payload);
+		m_deflator.flush();
+		StreamBuffer deflated;
+		deflated.swap(m_deflator.get_buffer());
+		// Z_SYNC_FLUSH 输出的数据以 00 00 FF FF 结尾，按照 RFC 7692 需要去掉。
+		DEBUG_THROW_ASSERT(deflated.size() >= sizeof(g_flush_trailer));
+		StreamBuffer body = deflated.cut_off(deflated.size() - sizeof(g_flush_trailer));
+		if(m_no_context_takeover){
+			m_deflator.clear();
+		}
+		const AUTO(cpu_time_end, get_thread_cpu_time());
+
+		atomic_add(m_messages_deflated, 1, ATOMIC_RELAXED);
+		atomic_add(m_bytes_before, size_before, ATOMIC_RELAXED);
+		atomic_add(m_bytes_after, body.size(), ATOMIC_RELAXED);
+		atomic_add(m_cpu_time, cpu_time_end - cpu_time_begin, ATOMIC_RELAXED);
+		payload.swap(body);
+		return true;
+	}
+
+	void MessageDeflator::get_statistics(PermessageDeflateStatistics &stats) const NOEXCEPT {
+		stats.messages_deflated      = atomic_load(m_messages_deflated, ATOMIC_RELAXED);
+		stats.messages_not_deflated  = atomic_load(m_messages_not_deflated, ATOMIC_RELAXED);
+		stats.bytes_before_deflation = atomic_load(m_bytes_before, ATOMIC_RELAXED);
+		stats.bytes_after_deflation  = atomic_load(m_bytes_after, ATOMIC_RELAXED);
+		stats.deflation_cpu_time     = atomic_load(m_cpu_time, ATOMIC_RELAXED);
+	}
+
+	MessageInflator::MessageInflator(bool no_context_takeover)
+		// 对方的窗口不会超过 15 位，使用最大的窗口解压总是安全的。
+		: m_inflator(false, -15)
+		, m_no_context_takeover(no_context_takeover)
+		, m_messages_inflated(0), m_bytes_before(0), m_bytes_after(0), m_cpu_time(0)
+	{ }
+	MessageInflator::~MessageInflator(){ }
+
+	void MessageInflator::inflate(StreamBuffer &payload, boost::uint64_t max_size){
+		PROFILE_ME;
+
+		const std::size_t size_before = payload.size();
+		const AUTO(cpu_time_begin, get_thread_cpu_time());
+		// 每次只喂给解压器一小段数据，一旦输出超过上限立即终止，防止压缩炸弹撑爆内存。
+		const void *data;
+		std::size_t size;
+		StreamBuffer::EnumerationCookie cookie;
+		while(payload.enumerate_chunk(&data, &size, cookie)){
+			for(std::size_t offset = 0; offset < size; offset += INFLATION_STEP_SIZE){
+				try {
+					m_inflator.put(static_cast<const char *>(data) + offset, std::min(size - offset, INFLATION_STEP_SIZE));
+				} catch(ProtocolException &e){
+					LOG_POSEIDON_WARNING("Failed to inflate WebSocket message: what = ", e.what());
+					DEBUG_THROW(Exception, ST_PROTOCOL_ERROR, sslit("Failed to inflate message"));
+				}
+				if(m_inflator.get_buffer().size() > max_size){
+					LOG_POSEIDON_WARNING("Inflated WebSocket message too large: max_size = ", max_size);
+					DEBUG_THROW(Exception, ST_MESSAGE_TOO_LARGE, sslit("Message too large"));
+				}
+			}
+		}
+		StreamBuffer inflated;
+		inflated.swap(m_inflator.get_buffer());
+		const AUTO(cpu_time_end, get_thread_cpu_time());
+
+		atomic_add(m_bytes_before, size_before, ATOMIC_RELAXED);
+		atomic_add(m_bytes_after, inflated.size(), ATOMIC_RELAXED);
+		atomic_add(m_cpu_time, cpu_time_end - cpu_time_begin, ATOMIC_RELAXED);
+		payload.swap(inflated);
+	}
+	StreamBuffer MessageInflator::finish(boost::uint64_t max_size){
+		PROFILE_ME;
+
+		const AUTO(cpu_time_begin, get_thread_cpu_time());
+		try {
+			m_inflator.put(g_flush_trailer, sizeof(g_flush_trailer));
+			m_inflator.flush();
+		} catch(ProtocolException &e){
+			LOG_POSEIDON_WARNING("Failed to inflate WebSocket message: what = ", e.what());
+			DEBUG_THROW(Exception, ST_PROTOCOL_ERROR, sslit("Failed to inflate message"));
+		}
+		if(m_inflator.get_buffer().size() > max_size){
+			LOG_POSEIDON_WARNING("Inflated WebSocket message too large: max_size = ", max_size);
+			DEBUG_THROW(Exception, ST_MESSAGE_TOO_LARGE, sslit("Message too large"));
+		}
+		StreamBuffer inflated;
+		inflated.swap(m_inflator.get_buffer());
+		if(m_no_context_takeover){
+			m_inflator.clear();
+		}
+		const AUTO(cpu_time_end, get_thread_cpu_time());
+
+		atomic_add(m_messages_inflated, 1, ATOMIC_RELAXED);
+		atomic_add(m_bytes_after, inflated.size(), ATOMIC_RELAXED);
+		atomic_add(m_cpu_time, cpu_time_end - cpu_time_begin, ATOMIC_RELAXED);
+		return inflated;
+	}
+
+	void MessageInflator::get_statistics(PermessageDeflateStatistics &stats) const NOEXCEPT {
+		stats.messages_inflated      = atomic_load(m_messages_inflated, ATOMIC_RELAXED);
+		stats.bytes_before_inflation = atomic_load(m_bytes_before, ATOMIC_RELAXED);
+		stats.bytes_after_inflation  = atomic_load(m_bytes_after, ATOMIC_RELAXED);
+		stats.inflation_cpu_time     = atomic_load(m_cpu_time, ATOMIC_RELAXED);
+	}
+}
+
+}
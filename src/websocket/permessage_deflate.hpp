@@ -0,0 +1,90 @@
+// 这个文件是 Poseidon 服务器应用程序框架的一部分。
+// Copyleft 2014 - 2017, LH_Mouse. All wrongs reserved.
+
+#ifndef POSEIDON_WEBSOCKET_PERMESSAGE_DEFLATE_HPP_
+#define POSEIDON_WEBSOCKET_PERMESSAGE_DEFLATE_HPP_
+
+#include "../cxx_ver.hpp"
+#include "../cxx_util.hpp"
+#include "../stream_buffer.hpp"
+#include "../zlib.hpp"
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace Poseidon {
+
+namespace WebSocket {
+	// RFC 7692 中协商的参数，名称与 Sec-WebSocket-Extensions 中的参数相同。
+	struct PermessageDeflateParams {
+		bool enabled;
+		bool server_no_context_takeover;
+		bool client_no_context_takeover;
+		unsigned server_max_window_bits;
+		unsigned client_max_window_bits;
+	};
+
+	struct PermessageDeflateStatistics {
+		boost::uint64_t messages_deflated;
+		boost::uint64_t messages_not_deflated;  // 小于 websocket_deflate_min_message_size 的消息。
+		boost::uint64_t bytes_before_deflation;
+		boost::uint64_t bytes_after_deflation;
+		boost::uint64_t deflation_cpu_time;     // 纳秒。
+		boost::uint64_t messages_inflated;
+		boost::uint64_t bytes_before_inflation;
+		boost::uint64_t bytes_after_inflation;
+		boost::uint64_t inflation_cpu_time;     // 纳秒。
+	};
+
+	// 发送方向。调用者负责同步。
+	class MessageDeflator : NONCOPYABLE {
+	private:
+		Deflator m_deflator;
+		const bool m_no_context_takeover;
+		const std::size_t m_min_message_size;
+
+		volatile boost::uint64_t m_messages_deflated;
+		volatile boost::uint64_t m_messages_not_deflated;
+		volatile boost::uint64_t m_bytes_before;
+		volatile boost::uint64_t m_bytes_after;
+		volatile boost::uint64_t m_cpu_time;
+
+	public:
+		MessageDeflator(unsigned max_window_bits, bool no_context_takeover);
+		~MessageDeflator();
+
+	public:
+		// 返回 false 表示消息太小，payload 保持不变，不应设置 RSV1。
+		bool deflate(StreamBuffer &payload);
+
+		void get_statistics(PermessageDeflateStatistics &stats) const NOEXCEPT;
+	};
+
+	// 接收方向。调用者负责同步。
+	class MessageInflator : NONCOPYABLE {
+	private:
+		Inflator m_inflator;
+		const bool m_no_context_takeover;
+
+		volatile boost::uint64_t m_messages_inflated;
+		volatile boost::uint64_t m_bytes_before;
+		volatile boost::uint64_t m_bytes_after;
+		volatile boost::uint64_t m_cpu_time;
+
+	public:
+		explicit MessageInflator(bool no_context_takeover);
+		~MessageInflator();
+
+	public:
+		// 用解压后的数据替换 payload。数据可能滞留在解压器中，直到调用 finish()。
+		// 解压后的数据超过 max_size 字节时抛出 ST_MESSAGE_TOO_LARGE。
+		void inflate(StreamBuffer &payload, boost::uint64_t max_size);
+		// 消息结束时调用，返回剩余的数据。
+		StreamBuffer finish(boost::uint64_t max_size);
+
+		void get_statistics(PermessageDeflateStatistics &stats) const NOEXCEPT;
+	};
+}
+
+}
+
+#endif
@@ -4,6 +4,8 @@
 #include "../precompiled.hpp"
 #include "reader.hpp"
 #include "exception.hpp"
+#include "masking.hpp"
+#include "permessage_deflate.hpp"
 #include "../log.hpp"
 #include "../random.hpp"
 #include "../endian.hpp"
@@ -16,6 +18,7 @@ namespace WebSocket {
 		: m_force_masked_frames(force_masked_frames)
 		, m_size_expecting(1), m_state(S_OPCODE)
 		, m_whole_offset(0), m_prev_fin(true)
+		, m_inflator(), m_compressed(false)
 	{ }
 	Reader::~Reader(){
 		if(m_state != S_OPCODE){
@@ -23,6 +26,30 @@ namespace WebSocket {
 		}
 	}
 
+	void Reader::enable_inflation(bool no_context_takeover){
+		PROFILE_ME;
+
+		m_inflator.reset(new MessageInflator(no_context_takeover));
+	}
+	void Reader::get_inflation_statistics(PermessageDeflateStatistics &stats) const NOEXCEPT {
+		if(!m_inflator){
+			return;
+		}
+		m_inflator->get_statistics(stats);
+	}
+
+	boost::uint64_t Reader::get_inflation_budget() const {
+		const AUTO(max_length, get_max_inflated_message_length());
+		if(m_whole_offset >= max_length){
+			return 0;
+		}
+		return max_length - m_whole_offset;
+	}
+
+	boost::uint64_t Reader::get_max_inflated_message_length() const {
+		return (boost::uint64_t)-1;
+	}
+
 	bool Reader::put_encoded_data(StreamBuffer encoded){
 		PROFILE_ME;
 
@@ -49,11 +76,21 @@ namespace WebSocket {
 				m_frame_offset = 0;
 
 				ch = m_queue.get();
-				if(ch & (OP_FL_RSV1 | OP_FL_RSV2 | OP_FL_RSV3)){
+				if(ch & (OP_FL_RSV2 | OP_FL_RSV3)){
 					LOG_POSEIDON_WARNING("Aborting because some reserved bits are set, opcode = ", ch);
 					DEBUG_THROW(Exception, ST_PROTOCOL_ERROR, sslit("Reserved bits set"));
 				}
 				m_opcode = static_cast<OpCode>(ch & OP_FL_OPCODE);
+				// permessage-deflate 只允许在数据消息的第一帧设置 RSV1。
+				if(ch & OP_FL_RSV1){
+					if(!m_inflator || (m_opcode & OP_FL_CONTROL) || (m_opcode == OP_CONTINUATION)){
+						LOG_POSEIDON_WARNING("Aborting because RSV1 is set unexpectedly, opcode = ", ch);
+						DEBUG_THROW(Exception, ST_PROTOCOL_ERROR, sslit("Reserved bits set"));
+					}
+				}
+				if(((m_opcode & OP_FL_CONTROL) == 0) && (m_opcode != OP_CONTINUATION)){
+					m_compressed = ch & OP_FL_RSV1;
+				}
 				m_fin = ch & OP_FL_FIN;
 				if((m_opcode & OP_FL_CONTROL) && !m_fin){
 					DEBUG_THROW(Exception, ST_PROTOCOL_ERROR, sslit("Control frame fragemented"));
@@ -146,21 +183,30 @@ namespace WebSocket {
 			case S_DATA_FRAME:
 				temp64 = std::min<boost::uint64_t>(m_queue.size(), m_frame_size - m_frame_offset);
 				{
-					StreamBuffer payload;
-					for(std::size_t i = 0; i < temp64; ++i){
-						payload.put(static_cast<unsigned char>(m_queue.get()) ^ m_mask);
-						m_mask = (m_mask << 24) | (m_mask >> 8);
+					StreamBuffer payload = m_queue.cut_off(static_cast<std::size_t>(temp64));
+					m_mask = apply_mask(payload, m_mask);
+					if(m_compressed){
+						m_inflator->inflate(payload, get_inflation_budget());
 					}
+					const std::size_t payload_size = payload.size();
 					on_data_message_payload(m_whole_offset, STD_MOVE(payload));
+					m_whole_offset += payload_size;
 				}
 				m_frame_offset += temp64;
-				m_whole_offset += temp64;
 
 				if(m_frame_offset < m_frame_size){
 					m_size_expecting = std::min<boost::uint64_t>(m_frame_size - m_frame_offset, 4096);
 					// m_state = S_DATA_FRAME;
 				} else {
 					if(m_fin){
+						if(m_compressed){
+							StreamBuffer payload = m_inflator->finish(get_inflation_budget());
+							if(!payload.empty()){
+								const std::size_t payload_size = payload.size();
+								on_data_message_payload(m_whole_offset, STD_MOVE(payload));
+								m_whole_offset += payload_size;
+							}
+						}
 						has_next_request = on_data_message_end(m_whole_offset);
 						m_whole_offset = 0;
 						m_prev_fin = true;
@@ -175,11 +221,8 @@ namespace WebSocket {
 
 			case S_CONTROL_FRAME:
 				{
-					StreamBuffer payload;
-					for(std::size_t i = 0; i < m_frame_size; ++i){
-						payload.put(static_cast<unsigned char>(m_queue.get()) ^ m_mask);
-						m_mask = (m_mask << 24) | (m_mask >> 8);
-					}
+					StreamBuffer payload = m_queue.cut_off(static_cast<std::size_t>(m_frame_size));
+					m_mask = apply_mask(payload, m_mask);
 					has_next_request = on_control_message(m_opcode, STD_MOVE(payload));
 				}
 				m_frame_offset = m_frame_size;
@@ -6,12 +6,16 @@
 
 #include <string>
 #include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
 #include "../stream_buffer.hpp"
 #include "opcodes.hpp"
 
 namespace Poseidon {
 
 namespace WebSocket {
+	class MessageInflator;
+	struct PermessageDeflateStatistics;
+
 	class Reader {
 	private:
 		enum State {
@@ -37,6 +41,9 @@ namespace WebSocket {
 		boost::uint64_t m_whole_offset;
 		bool m_prev_fin;
 
+		boost::scoped_ptr<MessageInflator> m_inflator;
+		bool m_compressed;
+
 		bool m_fin;
 		bool m_masked;
 		OpCode m_opcode;
@@ -44,11 +51,17 @@ namespace WebSocket {
 		boost::uint32_t m_mask;
 		boost::uint64_t m_frame_offset;
 
+	private:
+		boost::uint64_t get_inflation_budget() const;
+
 	public:
 		explicit Reader(bool force_masked_frames);
 		virtual ~Reader();
 
 	protected:
+		// 解压之后一条消息的最大长度。默认不限制。
+		virtual boost::uint64_t get_max_inflated_message_length() const;
+
 		virtual void on_data_message_header(OpCode opcode) = 0;
 		virtual void on_data_message_payload(boost::uint64_t whole_offset, StreamBuffer payload) = 0;
 		// 以下两个回调返回 false 导致于当前消息终止后退出循环。
@@ -64,6 +77,11 @@ namespace WebSocket {
 			return m_queue;
 		}
 
+		// 启用 permessage-deflate 之后，设置了 RSV1 的消息会被解压。必须在收到任何数据之前调用。
+		void enable_inflation(bool no_context_takeover);
+		// 只填写 PermessageDeflateStatistics 中解压的部分。
+		void get_inflation_statistics(PermessageDeflateStatistics &stats) const NOEXCEPT;
+
 		bool put_encoded_data(StreamBuffer encoded);
 	};
 }
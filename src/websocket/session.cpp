@@ -136,6 +136,10 @@ namespace WebSocket {
 		LowLevelSession::on_read_hup();
 	}
 
+	boost::uint64_t Session::get_max_inflated_message_length() const {
+		return get_max_request_length();
+	}
+
 	void Session::on_low_level_message_header(OpCode opcode){
 		PROFILE_ME;
 
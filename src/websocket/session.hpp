@@ -40,6 +40,9 @@ namespace WebSocket {
 		// UpgradedSessionBase
 		void on_read_hup() OVERRIDE;
 
+		// Reader
+		boost::uint64_t get_max_inflated_message_length() const OVERRIDE;
+
 		// LowLevelSession
 		void on_low_level_message_header(OpCode opcode) OVERRIDE;
 		void on_low_level_message_payload(boost::uint64_t whole_offset, StreamBuffer payload) OVERRIDE;
@@ -4,6 +4,8 @@
 #include "../precompiled.hpp"
 #include "writer.hpp"
 #include "opcodes.hpp"
+#include "masking.hpp"
+#include "permessage_deflate.hpp"
 #include "../log.hpp"
 #include "../profiler.hpp"
 #include "../endian.hpp"
@@ -12,14 +14,38 @@
 namespace Poseidon {
 
 namespace WebSocket {
-	Writer::Writer(){ }
+	Writer::Writer()
+		: m_deflator()
+	{ }
 	Writer::~Writer(){ }
 
+	void Writer::enable_deflation(unsigned max_window_bits, bool no_context_takeover){
+		PROFILE_ME;
+
+		m_deflator.reset(new MessageDeflator(max_window_bits, no_context_takeover));
+	}
+	void Writer::get_deflation_statistics(PermessageDeflateStatistics &stats) const NOEXCEPT {
+		if(!m_deflator){
+			return;
+		}
+		m_deflator->get_statistics(stats);
+	}
+
 	long Writer::put_message(int opcode, bool masked, StreamBuffer payload){
 		PROFILE_ME;
 
+		Mutex::UniqueLock lock(m_deflator_mutex, false);
+		bool compressed = false;
+		if(m_deflator && ((opcode & OP_FL_CONTROL) == 0)){
+			lock.lock();
+			compressed = m_deflator->deflate(payload);
+		}
+
 		StreamBuffer frame;
 		unsigned char ch = opcode | OP_FL_FIN;
+		if(compressed){
+			ch |= OP_FL_RSV1;
+		}
 		frame.put(ch);
 		const std::size_t size = payload.size();
 		ch = masked ? 0x80 : 0;
@@ -40,22 +66,13 @@ namespace WebSocket {
 			frame.put(&temp64, 8);
 		}
 		if(masked){
-			boost::uint32_t mask;
-			store_le(mask, random_uint32() | 0x80808080u);
-			frame.put(&mask, 4);
-			int mb;
-			for(;;){
-				mb = payload.get();
-				if(mb == -1){
-					break;
-				}
-				mb ^= static_cast<unsigned char>(mask);
-				frame.put(mb);
-				mask = (mask << 24) | (mask >> 8);
-			}
-		} else {
-			frame.splice(payload);
+			const boost::uint32_t mask = random_uint32() | 0x80808080u;
+			boost::uint32_t temp32;
+			store_le(temp32, mask);
+			frame.put(&temp32, 4);
+			apply_mask(payload, mask);
 		}
+		frame.splice(payload);
 		return on_encoded_data_avail(STD_MOVE(frame));
 	}
 	long Writer::put_close_message(StatusCode status_code, bool masked, StreamBuffer additional){
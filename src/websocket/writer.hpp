@@ -6,13 +6,23 @@
 
 #include <string>
 #include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
 #include "status_codes.hpp"
 #include "../stream_buffer.hpp"
+#include "../mutex.hpp"
 
 namespace Poseidon {
 
 namespace WebSocket {
+	class MessageDeflator;
+	struct PermessageDeflateStatistics;
+
 	class Writer {
+	private:
+		boost::scoped_ptr<MessageDeflator> m_deflator;
+		// 压缩上下文在消息之间共享，压缩和写出的顺序必须一致。
+		Mutex m_deflator_mutex;
+
 	public:
 		Writer();
 		virtual ~Writer();
@@ -21,6 +31,11 @@ namespace WebSocket {
 		virtual long on_encoded_data_avail(StreamBuffer encoded) = 0;
 
 	public:
+		// 启用 permessage-deflate 之后，不小于阈值的数据消息会被压缩并设置 RSV1。必须在发送任何数据之前调用。
+		void enable_deflation(unsigned max_window_bits, bool no_context_takeover);
+		// 只填写 PermessageDeflateStatistics 中压缩的部分。
+		void get_deflation_statistics(PermessageDeflateStatistics &stats) const NOEXCEPT;
+
 		long put_message(int opcode, bool masked, StreamBuffer payload);
 		long put_close_message(StatusCode status_code, bool masked, StreamBuffer additional);
 	};
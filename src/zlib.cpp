@@ -14,13 +14,13 @@ struct Deflator::Context : NONCOPYABLE {
 	::z_stream stream;
 	::Bytef temp[4096];
 
-	explicit Context(bool gzip, int level){
+	Context(bool gzip, int level, int window_bits){
 		stream.zalloc = NULLPTR;
 		stream.zfree = NULLPTR;
 		stream.opaque = NULLPTR;
 		stream.next_in = NULLPTR;
 		stream.avail_in = 0;
-		const int err_code = ::deflateInit2(&stream, level, Z_DEFLATED, 15 + gzip * 16, 9, Z_DEFAULT_STRATEGY);
+		const int err_code = ::deflateInit2(&stream, level, Z_DEFLATED, window_bits + gzip * 16, 9, Z_DEFAULT_STRATEGY);
 		if(err_code < 0){
 			LOG_POSEIDON_ERROR("::deflateInit2() error: err_code = ", err_code);
 			DEBUG_THROW(ProtocolException, sslit("::deflateInit2()"), err_code);
@@ -28,14 +28,15 @@ struct Deflator::Context : NONCOPYABLE {
 	}
 	~Context(){
 		const int err_code = ::deflateEnd(&stream);
-		if(err_code < 0){
+		// 没有调用 finalize() 时 deflateEnd() 返回 Z_DATA_ERROR，这不是错误。
+		if((err_code < 0) && (err_code != Z_DATA_ERROR)){
 			LOG_POSEIDON_WARNING("::deflateEnd() error: err_code = ", err_code);
 		}
 	}
 };
 
-Deflator::Deflator(bool gzip, int level)
-	: m_ctx(new Context(gzip, level)), m_buffer()
+Deflator::Deflator(bool gzip, int level, int window_bits)
+	: m_ctx(new Context(gzip, level, window_bits)), m_buffer()
 { }
 Deflator::~Deflator(){ }
 
@@ -139,13 +140,13 @@ struct Inflator::Context : NONCOPYABLE {
 	::z_stream stream;
 	::Bytef temp[4096];
 
-	explicit Context(bool gzip){
+	Context(bool gzip, int window_bits){
 		stream.zalloc = NULLPTR;
 		stream.zfree = NULLPTR;
 		stream.opaque = NULLPTR;
 		stream.next_in = NULLPTR;
 		stream.avail_in = 0;
-		const int err_code = ::inflateInit2(&stream, 15 + gzip * 16);
+		const int err_code = ::inflateInit2(&stream, window_bits + gzip * 16);
 		if(err_code < 0){
 			LOG_POSEIDON_ERROR("::inflateInit2() error: err_code = ", err_code);
 			DEBUG_THROW(ProtocolException, sslit("::deflateInit2()"), err_code);
@@ -159,8 +160,8 @@ struct Inflator::Context : NONCOPYABLE {
 	}
 };
 
-Inflator::Inflator(bool gzip)
-	: m_ctx(new Context(gzip)), m_buffer()
+Inflator::Inflator(bool gzip, int window_bits)
+	: m_ctx(new Context(gzip, window_bits)), m_buffer()
 { }
 Inflator::~Inflator(){ }
 
@@ -234,6 +235,9 @@ void Inflator::flush(){
 			DEBUG_THROW(ProtocolException, sslit("::inflate()"), err_code);
 		}
 		m_buffer.put(m_ctx->temp, static_cast<unsigned>(m_ctx->stream.next_out - m_ctx->temp));
+		if(err_code == Z_STREAM_END){
+			break;
+		}
 		DEBUG_THROW_ASSERT(err_code == 0);
 	}
 }
@@ -20,7 +20,8 @@ private:
 	StreamBuffer m_buffer;
 
 public:
-	explicit Deflator(bool gzip = false, int level = 8);
+	// window_bits 为负数时输出不带头部和校验和的原始 deflate 数据，参考 zlib 的 deflateInit2()。
+	explicit Deflator(bool gzip = false, int level = 8, int window_bits = 15);
 	~Deflator();
 
 public:
@@ -54,7 +55,7 @@ private:
 	StreamBuffer m_buffer;
 
 public:
-	explicit Inflator(bool gzip = false);
+	explicit Inflator(bool gzip = false, int window_bits = 15);
 	~Inflator();
 
 public: